@@ -0,0 +1,330 @@
+// ===========================================================================
+//	RegexBench.cpp
+// ===========================================================================
+//
+//	Benchmark of the regex extraction against the bare atlrx engine.
+//
+//	Each case runs one pattern over one corpus, finding every match as the
+//	plugin does when asked for the last occurrence. It is run twice: through
+//	CAtlRegExp alone, with a new match context for each response (as the
+//	plugin matched before the context pool), and through RegexPattern, which
+//	adds the prefix scan, the DFA, the fixed matchers and the pool. For each
+//	run the report gives
+//
+//		ms/search	time to find every match in the corpus
+//		MB/s		bytes of response searched per second
+//		matches/s	matches found per second
+//		allocs		heap allocations per match (per search if nothing matches)
+//
+//	Allocations are counted with the debug CRT's allocation hook, so the
+//	column is only filled in by the Debug build; time the Release build.
+//
+//	The corpora are generated, so runs are comparable between machines and
+//	checkouts. Captured responses can be used instead by passing a
+//	directory holding any of json.txt, html.txt and csv.txt:
+//
+//		regex_bench [corpus directory]
+
+#include "RegexExtract.h"
+
+#include <windows.h>
+#include <crtdbg.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+// the least time each run is repeated for
+static const double	kMinSeconds = 0.5;
+
+// ---------------------------------------------------------------------------------
+//		Allocation count
+// ---------------------------------------------------------------------------------
+
+static volatile LONG	sAllocations = 0;
+
+#ifdef _DEBUG
+static int __cdecl
+CountAllocation(int inType, void*, size_t, int, long, const unsigned char*, int)
+{
+	if (inType == _HOOK_ALLOC || inType == _HOOK_REALLOC)
+		InterlockedIncrement(&sAllocations);
+	return TRUE;
+}
+#endif
+
+// ---------------------------------------------------------------------------------
+//		Corpora
+// ---------------------------------------------------------------------------------
+
+// a small deterministic generator, so every run searches the same text
+static unsigned long	sSeed = 12345;
+
+static int
+Random(int inRange)
+{
+	sSeed = sSeed * 1103515245 + 12345;
+	return (int) ((sSeed >> 16) % inRange);
+}
+
+static void
+AppendFormat(std::string& ioText, const char* inFormat, ...)
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, inFormat);
+	int length = _vsnprintf(buffer, sizeof(buffer), inFormat, args);
+	va_end(args);
+	if (length > 0)
+		ioText.append(buffer, length < (int) sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+// an earthquake feed in the shape of the USGS GeoJSON summaries
+static std::string
+MakeJsonCorpus()
+{
+	std::string text = "{\"type\":\"FeatureCollection\",\"metadata\":{\"generated\":1700000000000,\"title\":\"USGS All Earthquakes, Past Week\"},\"features\":[";
+	for (int i = 0; i < 4000; i++) {
+		if (i > 0)
+			text += ',';
+		AppendFormat(text, "{\"type\":\"Feature\",\"properties\":{\"mag\":%d.%d,\"place\":\"%d km NNW of Ca\xC3\xB1\x61\x64\x61 %d\",\"time\":%d%06d,\"updated\":%d%06d,\"tz\":null,",
+			Random(7), Random(10), Random(200), i, 1700000, Random(1000000), 1700001, Random(1000000));
+		AppendFormat(text, "\"url\":\"https://earthquake.usgs.gov/earthquakes/eventpage/us%07d\",\"felt\":%d,\"status\":\"reviewed\",\"tsunami\":0,\"sig\":%d,\"net\":\"us\",",
+			i, Random(50), Random(900));
+		AppendFormat(text, "\"type\":\"earthquake\",\"title\":\"M %d.%d - Somewhere\"},\"geometry\":{\"type\":\"Point\",\"coordinates\":[%d.%04d,%d.%04d,%d.%02d]},\"id\":\"us%07d\"}",
+			Random(7), Random(10), Random(360) - 180, Random(10000), Random(180) - 90, Random(10000), Random(600), Random(100), i);
+	}
+	text += "]}";
+	return text;
+}
+
+// pages as a crawler would fetch them, one after the other
+static std::string
+MakeHtmlCorpus()
+{
+	static const char* const	kWords[] = { "stage", "light", "cue", "sc\xC3\xA8ne", "video", "actor", "patch", "\xE9\x9F\xB3\xE6\xA5\xBD", "scene", "timeline" };
+	std::string text;
+	for (int page = 0; page < 200; page++) {
+		AppendFormat(text, "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"utf-8\">\n<title>Page %d \xE2\x80\x93 Performance archive</title>\n", page);
+		AppendFormat(text, "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n<meta name=\"description\" content=\"Notes on show %d, its %s and %s\">\n", page, kWords[Random(10)], kWords[Random(10)]);
+		text += "<link rel=\"stylesheet\" href=\"/style.css\">\n</head>\n<body>\n<div class=\"content\">\n";
+		for (int para = 0; para < 20; para++) {
+			text += "<p>";
+			for (int word = 0; word < 40; word++) {
+				text += kWords[Random(10)];
+				text += word % 9 == 8 ? ", " : " ";
+			}
+			AppendFormat(text, "<a href=\"/show/%d/%d\">more</a></p>\n", page, para);
+		}
+		text += "</div>\n</body>\n</html>\n";
+	}
+	return text;
+}
+
+// a sensor export: id, name, latitude, longitude, reading
+static std::string
+MakeCsvCorpus()
+{
+	std::string text = "id,name,lat,lon,value\n";
+	for (int i = 0; i < 20000; i++)
+		AppendFormat(text, "%d,sensor-%d,%d.%05d,%d.%05d,%d.%02d\n",
+			i, Random(500), Random(180) - 90, Random(100000), Random(360) - 180, Random(100000), Random(1000), Random(100));
+	return text;
+}
+
+static bool
+ReadCorpus(const std::string& inDirectory, const char* inName, std::string& outText)
+{
+	std::string path = inDirectory + "\\" + inName;
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+
+	outText.clear();
+	char buffer[65536];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		outText.append(buffer, count);
+	fclose(file);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		Runs
+// ---------------------------------------------------------------------------------
+
+struct BenchCase
+{
+	const char*		mName;
+	const char*		mPattern;
+	std::string*	mCorpus;
+};
+
+struct BenchResult
+{
+	double	mSeconds;		// for one search of the corpus
+	long	mMatches;
+	long	mAllocations;	// for one search, -1 if not counted
+};
+
+static double
+Now()
+{
+	static LARGE_INTEGER	sFrequency = { 0 };
+	if (sFrequency.QuadPart == 0)
+		QueryPerformanceFrequency(&sFrequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (double) counter.QuadPart / (double) sFrequency.QuadPart;
+}
+
+// all matches of inRegExp in inText, through atlrx alone
+static long
+SearchAtlrx(CAtlRegExp<CAtlRECharTraitsUTF8>& inRegExp, const char* inText)
+{
+	CAtlREMatchContext<CAtlRECharTraitsUTF8> context;
+
+	long matches = 0;
+	const char* from = inText;
+	while (*from != '\0' && inRegExp.Match(from, &context)) {
+		matches++;
+		from = context.m_Match.szEnd;
+		if (from == context.m_Match.szStart && *from != '\0')
+			from = CAtlRECharTraitsUTF8::Next(from);
+	}
+	return matches;
+}
+
+// all inMatches matches of inPattern in inText, through the plugin's path;
+// with no matches it makes one failing search
+static long
+SearchPattern(RegexPattern* inPattern, const char* inText, long inMatches)
+{
+	std::string groups[kRegexMaxGroups];
+	int groupCount = 0;
+	std::string error;
+	return inPattern->Match(inText, inMatches > 0 ? inMatches : 1, RegexLimits(), groups, groupCount, error) ? inMatches : 0;
+}
+
+template <class tSearch>
+static BenchResult
+Time(tSearch inSearch)
+{
+	BenchResult result;
+
+	// once to warm up caches and the context pool, once counting allocations
+	result.mMatches = inSearch();
+	result.mAllocations = -1;
+#ifdef _DEBUG
+	sAllocations = 0;
+	_CRT_ALLOC_HOOK previous = _CrtSetAllocHook(CountAllocation);
+	inSearch();
+	_CrtSetAllocHook(previous);
+	result.mAllocations = sAllocations;
+#endif
+
+	long runs = 0;
+	double start = Now();
+	double elapsed;
+	do {
+		inSearch();
+		runs++;
+		elapsed = Now() - start;
+	} while (elapsed < kMinSeconds);
+
+	result.mSeconds = elapsed / runs;
+	return result;
+}
+
+static void
+Report(const char* inCase, const char* inEngine, size_t inBytes, const BenchResult& inResult)
+{
+	printf("%-18s %-13s %12.4f %10.1f %14.0f ", inCase, inEngine, inResult.mSeconds * 1000.0,
+		inBytes / inResult.mSeconds / (1024.0 * 1024.0), inResult.mMatches / inResult.mSeconds);
+	if (inResult.mAllocations < 0)
+		printf("%10s\n", "-");
+	else
+		printf("%10.2f\n", (double) inResult.mAllocations / (inResult.mMatches > 0 ? inResult.mMatches : 1));
+}
+
+// ---------------------------------------------------------------------------------
+//		main
+// ---------------------------------------------------------------------------------
+
+int
+main(int argc, char* argv[])
+{
+	std::string json = MakeJsonCorpus();
+	std::string html = MakeHtmlCorpus();
+	std::string csv = MakeCsvCorpus();
+
+	if (argc > 1) {
+		std::string directory = argv[1];
+		if (ReadCorpus(directory, "json.txt", json))
+			printf("json corpus from %s\n", directory.c_str());
+		if (ReadCorpus(directory, "html.txt", html))
+			printf("html corpus from %s\n", directory.c_str());
+		if (ReadCorpus(directory, "csv.txt", csv))
+			printf("csv corpus from %s\n", directory.c_str());
+	}
+
+	// strings of a's and of separators, on which nested repeats backtrack
+	// exponentially in atlrx; kept short enough for it to finish
+	std::string runOfA(20, 'a');
+	std::string fields;
+	for (int i = 0; i < 16; i++)
+		fields += "x,";
+
+	BenchCase cases[] =
+	{
+		{ "json key",			"\"mag\":{[0-9.\\-]+}",										&json },
+		{ "json id",			"\"id\":\"{[^\"]*}\"",										&json },
+		{ "html title",			"<title>{[^<]*}</title>",									&html },
+		{ "html meta",			"<meta name=\"description\" content=\"{[^\"]*}\"",			&html },
+		{ "html link",			"href=\"{[^\"]*}\">more",									&html },
+		{ "csv field",			"\n{\\d+},{[^,\n]*},[^,\n]*,[^,\n]*,{[0-9.]+}",				&csv },
+		{ "csv any column",		"{[^,\n]*}\n",												&csv },
+		{ "nested plus",		"(a+)+b",													&runOfA },
+		{ "alternation",		"(a|aa)*c",													&runOfA },
+		{ "greedy fields",		"^(.*,)*;",													&fields },
+	};
+
+	printf("%-18s %-13s %12s %10s %14s %10s\n", "case", "engine", "ms/search", "MB/s", "matches/s", "allocs");
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const BenchCase& bench = cases[i];
+		const char* text = bench.mCorpus->c_str();
+
+		CAtlRegExp<CAtlRECharTraitsUTF8> regExp;
+		if (regExp.Parse(bench.mPattern) != REPARSE_ERROR_OK) {
+			printf("%-18s bad pattern %s\n", bench.mName, bench.mPattern);
+			continue;
+		}
+
+		std::string error;
+		RegexPattern* pattern = new RegexPattern;
+		if (!pattern->Parse(bench.mPattern, error)) {
+			printf("%-18s %s\n", bench.mName, error.c_str());
+			pattern->Release();
+			continue;
+		}
+
+		BenchResult atlrx = Time([&]() { return SearchAtlrx(regExp, text); });
+		Report(bench.mName, "atlrx", bench.mCorpus->size(), atlrx);
+
+		long matches = atlrx.mMatches;
+		BenchResult extract = Time([&]() { return SearchPattern(pattern, text, matches); });
+		Report(bench.mName, "RegexPattern", bench.mCorpus->size(), extract);
+
+		if (extract.mMatches != atlrx.mMatches)
+			printf("%-18s MISMATCH: atlrx found %ld matches, RegexPattern %ld\n", bench.mName, atlrx.mMatches, extract.mMatches);
+
+		pattern->Release();
+	}
+
+	return 0;
+}
@@ -0,0 +1,472 @@
+// ===========================================================================
+//	CsvStream.cpp
+// ===========================================================================
+
+#include "CsvStream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define CSV_USE_SSE2	1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// ---------------------------------------------------------------------------------
+//		ParseCsvColumnList
+// ---------------------------------------------------------------------------------
+
+void
+ParseCsvColumnList(const char* inText, std::string outColumns[kCsvMaxColumns])
+{
+	for (int i = 0; i < kCsvMaxColumns; i++) {
+		outColumns[i].clear();
+	}
+
+	const char* p = inText;
+	for (int i = 0; i < kCsvMaxColumns && *p != '\0'; i++) {
+
+		while (*p == ' ' || *p == '\t')
+			p++;
+		const char* start = p;
+		while (*p != '\0' && *p != ',')
+			p++;
+		const char* end = p;
+		while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+			end--;
+
+		outColumns[i].assign(start, end);
+		if (*p == ',')
+			p++;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		CsvTable
+// ---------------------------------------------------------------------------------
+
+void
+CsvTable::Clear()
+{
+	mRowCount = 0;
+	for (int c = 0; c < kCsvMaxColumns; c++) {
+		mText[c].clear();
+		mEnd[c].clear();
+		mNumber[c].clear();
+	}
+}
+
+void
+CsvTable::Swap(CsvTable& ioOther)
+{
+	std::swap(mRowCount, ioOther.mRowCount);
+	for (int c = 0; c < kCsvMaxColumns; c++) {
+		mText[c].swap(ioOther.mText[c]);
+		mEnd[c].swap(ioOther.mEnd[c]);
+		mNumber[c].swap(ioOther.mNumber[c]);
+	}
+}
+
+void
+CsvTable::Append(const CsvTable& inOther)
+{
+	for (int c = 0; c < kCsvMaxColumns; c++) {
+		size_t base = mText[c].size();
+		mText[c].insert(mText[c].end(), inOther.mText[c].begin(), inOther.mText[c].end());
+		for (size_t i = 0; i < inOther.mEnd[c].size(); i++) {
+			mEnd[c].push_back(base + inOther.mEnd[c][i]);
+		}
+		mNumber[c].insert(mNumber[c].end(), inOther.mNumber[c].begin(), inOther.mNumber[c].end());
+	}
+	mRowCount += inOther.mRowCount;
+}
+
+void
+CsvTable::AddRow(const std::string inValues[kCsvMaxColumns])
+{
+	for (int c = 0; c < kCsvMaxColumns; c++) {
+		const std::string& value = inValues[c];
+		mText[c].insert(mText[c].end(), value.begin(), value.end());
+		mEnd[c].push_back(mText[c].size());
+
+		const char* start = value.c_str();
+		char* end;
+		double number = strtod(start, &end);
+		mNumber[c].push_back(end != start ? (float) number : 0);
+	}
+	mRowCount++;
+}
+
+void
+CsvTable::GetText(size_t inRow, int inColumn, std::string& outText) const
+{
+	size_t start = inRow > 0 ? mEnd[inColumn][inRow - 1] : 0;
+	size_t end = mEnd[inColumn][inRow];
+	if (end > start)
+		outText.assign(&mText[inColumn][start], end - start);
+	else
+		outText.clear();
+}
+
+// ---------------------------------------------------------------------------------
+//		Scanning
+// ---------------------------------------------------------------------------------
+
+#if CSV_USE_SSE2
+static inline int
+LowestBit(unsigned int inMask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, inMask);
+	return (int) index;
+#else
+	return __builtin_ctz(inMask);
+#endif
+}
+#endif
+
+// returns the first separator or line end at or after p, or end
+static const char*
+FieldEnd(const char* p, const char* end, char inSeparator)
+{
+#if CSV_USE_SSE2
+	const __m128i separator = _mm_set1_epi8(inSeparator);
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		unsigned int hits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, separator),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf))));
+		if (hits != 0)
+			return p + LowestBit(hits);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != inSeparator && *p != '\r' && *p != '\n')
+		p++;
+	return p;
+}
+
+static bool
+EqualNoCase(const std::string& inA, const std::string& inB)
+{
+	if (inA.length() != inB.length())
+		return false;
+	for (size_t i = 0; i < inA.length(); i++) {
+		char a = inA[i];
+		char b = inB[i];
+		if (a >= 'A' && a <= 'Z')
+			a += 'a' - 'A';
+		if (b >= 'A' && b <= 'Z')
+			b += 'a' - 'A';
+		if (a != b)
+			return false;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		CsvParser
+// ---------------------------------------------------------------------------------
+
+CsvParser::CsvParser(const std::string inColumns[kCsvMaxColumns])
+	: mSeparator(0)
+	, mHeaderDone(false)
+	, mFailed(false)
+	, mColumn(0)
+	, mKeep(true)
+	, mFieldStart(true)
+	, mQuoted(false)
+	, mQuoteEnd(false)
+	, mSkipLF(false)
+	, mRowEmpty(true)
+{
+	for (int i = 0; i < kCsvMaxColumns; i++) {
+		mSelectors[i] = inColumns[i];
+		mSourceColumn[i] = -1;
+	}
+}
+
+bool
+CsvParser::Feed(const char* inData, size_t inLength, CsvRowSink& ioRows, std::string& outError)
+{
+	if (mFailed) {
+		outError = mError;
+		return false;
+	}
+
+	if (mSeparator != 0) {
+		Parse(inData, inLength, ioRows);
+	}
+	else {
+		// the start of the file is held until the header row is complete
+		mHeaderText.append(inData, inLength);
+
+		bool quoted = false;
+		size_t lineEnd = 0;
+		while (lineEnd < mHeaderText.length()) {
+			char c = mHeaderText[lineEnd];
+			if (c == '"')
+				quoted = !quoted;
+			else if (!quoted && (c == '\r' || c == '\n'))
+				break;
+			lineEnd++;
+		}
+
+		if (lineEnd == mHeaderText.length()) {
+			if (mHeaderText.length() > kCsvMaxHeaderLength) {
+				mFailed = true;
+				mError = "ERROR: the CSV header row is too long";
+				outError = mError;
+				return false;
+			}
+			return true;
+		}
+
+		ChooseSeparator(lineEnd);
+		std::string text;
+		text.swap(mHeaderText);
+		Parse(text.data(), text.length(), ioRows);
+	}
+
+	if (mFailed) {
+		outError = mError;
+		return false;
+	}
+	return true;
+}
+
+bool
+CsvParser::Finish(CsvRowSink& ioRows, std::string& outError)
+{
+	if (mFailed) {
+		outError = mError;
+		return false;
+	}
+
+	// a file that is a single line without a line break
+	if (mSeparator == 0 && !mHeaderText.empty()) {
+		ChooseSeparator(mHeaderText.length());
+		std::string text;
+		text.swap(mHeaderText);
+		Parse(text.data(), text.length(), ioRows);
+	}
+
+	if (!mFailed && !mRowEmpty)
+		EndRow(ioRows);
+
+	if (mFailed) {
+		outError = mError;
+		return false;
+	}
+	return true;
+}
+
+// picks the separator that occurs most often outside quotes in the header row
+void
+CsvParser::ChooseSeparator(size_t inLineEnd)
+{
+	// a UTF-8 byte order mark is not part of the first column's name
+	if (mHeaderText.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+		mHeaderText.erase(0, 3);
+		inLineEnd = inLineEnd >= 3 ? inLineEnd - 3 : 0;
+	}
+
+	size_t commas = 0;
+	size_t tabs = 0;
+	size_t semicolons = 0;
+	bool quoted = false;
+	for (size_t i = 0; i < inLineEnd; i++) {
+		switch (mHeaderText[i]) {
+		case '"':	quoted = !quoted;				break;
+		case ',':	if (!quoted) commas++;			break;
+		case '\t':	if (!quoted) tabs++;			break;
+		case ';':	if (!quoted) semicolons++;		break;
+		}
+	}
+
+	mSeparator = ',';
+	if (tabs > commas && tabs >= semicolons)
+		mSeparator = '\t';
+	else if (semicolons > commas && semicolons > tabs)
+		mSeparator = ';';
+}
+
+void
+CsvParser::Parse(const char* inData, size_t inLength, CsvRowSink& ioRows)
+{
+	const char* p = inData;
+	const char* end = inData + inLength;
+
+	while (p < end && !mFailed) {
+
+		// the LF of a CRLF has already ended its row
+		if (mSkipLF) {
+			mSkipLF = false;
+			if (*p == '\n') {
+				p++;
+				continue;
+			}
+		}
+
+		if (mQuoted) {
+			const char* quote = static_cast<const char*>(memchr(p, '"', end - p));
+			if (quote == NULL) {
+				AppendToField(p, end - p);
+				break;
+			}
+			AppendToField(p, quote - p);
+			p = quote + 1;
+			mQuoted = false;
+			mQuoteEnd = true;
+			continue;
+		}
+
+		if (mQuoteEnd) {
+			// "" inside quotes is a quote; anything else closes the quotes
+			mQuoteEnd = false;
+			if (*p == '"') {
+				AppendToField(p, 1);
+				mQuoted = true;
+				p++;
+				continue;
+			}
+		}
+		else if (mFieldStart && *p == '"') {
+			mQuoted = true;
+			mFieldStart = false;
+			mRowEmpty = false;
+			p++;
+			continue;
+		}
+
+		const char* stop = FieldEnd(p, end, mSeparator);
+		AppendToField(p, stop - p);
+		if (stop == end)
+			break;
+
+		p = stop + 1;
+		if (*stop == mSeparator) {
+			mRowEmpty = false;
+			EndField();
+		}
+		else {
+			EndRow(ioRows);
+			mSkipLF = *stop == '\r';
+		}
+	}
+}
+
+void
+CsvParser::AppendToField(const char* inData, size_t inLength)
+{
+	if (inLength == 0)
+		return;
+
+	mFieldStart = false;
+	mRowEmpty = false;
+	if (mKeep && mField.length() < kCsvMaxFieldLength) {
+		size_t room = kCsvMaxFieldLength - mField.length();
+		mField.append(inData, inLength < room ? inLength : room);
+	}
+}
+
+// readies the next field, which is kept if it is in the header or selected
+void
+CsvParser::StartField()
+{
+	mField.clear();
+	mFieldStart = true;
+	mQuoted = false;
+	mQuoteEnd = false;
+
+	mKeep = !mHeaderDone;
+	for (int i = 0; i < kCsvMaxColumns && !mKeep; i++) {
+		if (mSourceColumn[i] == mColumn)
+			mKeep = true;
+	}
+}
+
+void
+CsvParser::EndField()
+{
+	if (!mHeaderDone) {
+		// names are compared without surrounding white space
+		size_t start = mField.find_first_not_of(" \t");
+		size_t end = mField.find_last_not_of(" \t");
+		mHeader.push_back(start != std::string::npos ? mField.substr(start, end - start + 1) : std::string());
+	}
+	else if (mKeep) {
+		for (int i = 0; i < kCsvMaxColumns; i++) {
+			if (mSourceColumn[i] == mColumn)
+				mValues[i] = mField;
+		}
+	}
+
+	mColumn++;
+	StartField();
+}
+
+void
+CsvParser::EndRow(CsvRowSink& ioRows)
+{
+	if (mRowEmpty) {
+		StartField();
+		return;
+	}
+
+	EndField();
+
+	if (!mHeaderDone) {
+		ReadHeader();
+	}
+	else {
+		ioRows.OnRow(mValues);
+		for (int i = 0; i < kCsvMaxColumns; i++) {
+			mValues[i].clear();
+		}
+	}
+
+	mColumn = 0;
+	mRowEmpty = true;
+	StartField();
+}
+
+// finds the column of each selector in the header row just read
+void
+CsvParser::ReadHeader()
+{
+	mHeaderDone = true;
+
+	for (int i = 0; i < kCsvMaxColumns; i++) {
+		const std::string& selector = mSelectors[i];
+		mSourceColumn[i] = -1;
+		if (selector.empty())
+			continue;
+
+		if (selector.find_first_not_of("0123456789") == std::string::npos) {
+			long number = atol(selector.c_str());
+			if (number >= 1)
+				mSourceColumn[i] = (int) number - 1;
+			continue;
+		}
+
+		for (size_t c = 0; c < mHeader.size(); c++) {
+			if (EqualNoCase(mHeader[c], selector)) {
+				mSourceColumn[i] = (int) c;
+				break;
+			}
+		}
+		if (mSourceColumn[i] < 0) {
+			mFailed = true;
+			mError = "ERROR: no CSV column named " + selector;
+		}
+	}
+
+	std::vector<std::string>().swap(mHeader);
+}
@@ -0,0 +1,167 @@
+// ===========================================================================
+//	CsvStream.h
+// ===========================================================================
+//
+//	Streaming extraction of columns from CSV and TSV responses, such as
+//	timetable exports or weather station logs.
+//
+//	The parser is fed the body in the chunks it arrives in and never holds
+//	more of it than the row it is in. Only the selected columns are copied
+//	out; the bytes of every other field are stepped over sixteen at a time
+//	with SSE2, looking only for the separator, quotes and line ends. What is
+//	copied out is kept by the actor, so in rows mode only a window of
+//	kCsvWindowRows rows, placed around row_index when the trigger fires, is
+//	passed on: a 100 MB export is read to the end and its rows counted, in
+//	the same memory as a small one. Column arrays hold every row by nature;
+//	they stop at kCsvMaxKeptBytes, and the status output reports an error.
+//
+//	Quoting follows RFC 4180: a field that starts with a double quote runs to
+//	the matching quote, may contain separators and line breaks, and writes a
+//	quote as "". CRLF, LF and lone CR all end a row, and blank lines are
+//	skipped. The separator is taken from the header row: whichever of comma,
+//	tab and semicolon occurs most often outside quotes.
+//
+//	The first row is always the header. Columns are selected by header name
+//	or by one-based number, e.g. "stop_name, departure, 5".
+
+#ifndef CSVSTREAM_H
+#define CSVSTREAM_H
+
+#include <string>
+#include <vector>
+
+// number of columns the actor can select
+static const int	kCsvMaxColumns = 4;
+
+// rows gathered before they are handed on as one chunk
+static const size_t	kCsvChunkRows = 4096;
+
+// longest value kept for a selected field, and longest header row; the rest
+// of a longer field is dropped, so an unbalanced quote cannot fill memory
+static const size_t	kCsvMaxFieldLength = 64 * 1024;
+static const size_t	kCsvMaxHeaderLength = 64 * 1024;
+
+// rows of one response kept in kCsvRows mode, from the first row asked for
+static const size_t	kCsvWindowRows = 4096;
+
+// most text kept of one response, in the window or the JSON arrays; a
+// response that needs more is cut short there and reported as an error
+static const size_t	kCsvMaxKeptBytes = 16 * 1024 * 1024;
+
+// the values of the actor's csv input
+enum CsvMode
+{
+	kCsvOff = 0,
+	kCsvRows,			// a CsvTable of a window of rows, read one at a time through row_index
+	kCsvArrays			// each selected column as one JSON array
+};
+
+// ---------------------------------------------------------------------------------
+//	ParseCsvColumnList
+// ---------------------------------------------------------------------------------
+//	Splits the comma separated list of the csv_columns input into at most
+//	kCsvMaxColumns selectors. Unused entries are left empty.
+
+void	ParseCsvColumnList(const char* inText, std::string outColumns[kCsvMaxColumns]);
+
+// ---------------------------------------------------------------------------------
+//	CsvTable
+// ---------------------------------------------------------------------------------
+//	The selected columns of a run of rows. Each column keeps its values back to
+//	back in one buffer with the end of each row's value, plus the number each
+//	value starts with, so rows are stored without an allocation per field.
+
+struct CsvTable
+{
+	CsvTable() : mRowCount(0) {}
+
+	size_t	Count() const		{ return mRowCount; }
+	void	Clear();
+	void	Swap(CsvTable& ioOther);
+
+	// adds the rows of inOther after these
+	void	Append(const CsvTable& inOther);
+
+	// adds one row; inValues has a value for each of the kCsvMaxColumns columns
+	void	AddRow(const std::string inValues[kCsvMaxColumns]);
+
+	// the text of column inColumn (zero-based) of row inRow
+	void	GetText(size_t inRow, int inColumn, std::string& outText) const;
+	float	GetNumber(size_t inRow, int inColumn) const	{ return mNumber[inColumn][inRow]; }
+
+	size_t				mRowCount;
+	std::vector<char>	mText[kCsvMaxColumns];
+	std::vector<size_t>	mEnd[kCsvMaxColumns];		// end of each row's value in mText
+	std::vector<float>	mNumber[kCsvMaxColumns];	// 0 where a value does not start with a number
+};
+
+// ---------------------------------------------------------------------------------
+//	CsvRowSink
+// ---------------------------------------------------------------------------------
+//	Receives the selected values of each data row as the parser completes it.
+
+class CsvRowSink
+{
+public:
+	virtual ~CsvRowSink() {}
+
+	// inValues[i] is the value of selector i, empty if the row is too short
+	virtual void	OnRow(const std::string inValues[kCsvMaxColumns]) = 0;
+};
+
+// ---------------------------------------------------------------------------------
+//	CsvParser
+// ---------------------------------------------------------------------------------
+
+class CsvParser
+{
+public:
+	// inColumns are the selectors from ParseCsvColumnList
+	explicit CsvParser(const std::string inColumns[kCsvMaxColumns]);
+
+	// parses the next inLength bytes of the file, passing each completed row
+	// to ioRows. Returns false with a description in outError if the header
+	// lacks a selected column or is too long; nothing more is parsed then.
+	bool	Feed(const char* inData, size_t inLength, CsvRowSink& ioRows, std::string& outError);
+
+	// completes the last row when the file does not end with a line break
+	bool	Finish(CsvRowSink& ioRows, std::string& outError);
+
+	// the separator found in the header, 0 until it has been read
+	char	GetSeparator() const		{ return mSeparator; }
+
+private:
+	CsvParser(const CsvParser&);
+	CsvParser& operator=(const CsvParser&);
+
+	void	Parse(const char* inData, size_t inLength, CsvRowSink& ioRows);
+	void	AppendToField(const char* inData, size_t inLength);
+	void	EndField();
+	void	EndRow(CsvRowSink& ioRows);
+	void	ReadHeader();
+	void	StartField();
+	void	ChooseSeparator(size_t inLineEnd);
+
+	std::string		mSelectors[kCsvMaxColumns];
+	std::string		mHeaderText;				// the start of the file while the separator is not known
+	char			mSeparator;
+	bool			mHeaderDone;				// the header row has been parsed
+	bool			mFailed;
+	std::string		mError;
+
+	std::vector<std::string>	mHeader;		// names of the columns while the header row is parsed
+	int				mSourceColumn[kCsvMaxColumns];	// zero-based column of each selector, -1 if none
+
+	// the state of the row being parsed
+	int				mColumn;					// zero-based column of the current field
+	bool			mKeep;						// the current field is copied out
+	bool			mFieldStart;				// nothing of the current field has been read
+	bool			mQuoted;					// inside a quoted field
+	bool			mQuoteEnd;					// just after a quote inside a quoted field
+	bool			mSkipLF;					// the last row ended in a CR
+	bool			mRowEmpty;					// the row so far is a blank line
+	std::string		mField;						// text of the current field, if it is kept
+	std::string		mValues[kCsvMaxColumns];
+};
+
+#endif
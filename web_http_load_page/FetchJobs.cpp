@@ -0,0 +1,1618 @@
+// ===========================================================================
+//	FetchJobs.cpp
+// ===========================================================================
+//
+//	Everything in here runs on a FetchScheduler worker thread, except for
+//	ParseURLList and the FetchBatch calls made from the actor's frame tick.
+
+#include "FetchJobs.h"
+#include "JsonCursor.h"
+#include "RegexExtract.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		AppendJSONString
+// ---------------------------------------------------------------------------------
+//	Appends inText to ioOut as a quoted JSON string.
+
+static void
+AppendJSONString(std::string& ioOut, const std::string& inText)
+{
+	static const char* kHex = "0123456789abcdef";
+
+	ioOut += '"';
+	for (size_t i = 0; i < inText.length(); i++) {
+		unsigned char c = static_cast<unsigned char>(inText[i]);
+		switch (c) {
+		case '"':	ioOut += "\\\"";	break;
+		case '\\':	ioOut += "\\\\";	break;
+		case '\n':	ioOut += "\\n";		break;
+		case '\r':	ioOut += "\\r";		break;
+		case '\t':	ioOut += "\\t";		break;
+		default:
+			if (c < 0x20) {
+				ioOut += "\\u00";
+				ioOut += kHex[c >> 4];
+				ioOut += kHex[c & 0xF];
+			}
+			else {
+				ioOut += static_cast<char>(c);
+			}
+			break;
+		}
+	}
+	ioOut += '"';
+}
+
+// the number a matched group starts with, or 0
+static double
+LeadingNumber(const std::string& inText)
+{
+	const char* start = inText.c_str();
+	char* end;
+	double number = strtod(start, &end);
+	return end != start ? number : 0;
+}
+
+// whether inText is a number by the JSON grammar, so it can be written unquoted
+static bool
+IsJSONNumber(const std::string& inText)
+{
+	const char* p = inText.c_str();
+	if (*p == '-')
+		p++;
+	if (*p == '0')
+		p++;
+	else if (*p >= '1' && *p <= '9')
+		while (*p >= '0' && *p <= '9') p++;
+	else
+		return false;
+	if (*p == '.') {
+		p++;
+		if (!(*p >= '0' && *p <= '9'))
+			return false;
+		while (*p >= '0' && *p <= '9') p++;
+	}
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		if (*p == '+' || *p == '-')
+			p++;
+		if (!(*p >= '0' && *p <= '9'))
+			return false;
+		while (*p >= '0' && *p <= '9') p++;
+	}
+	return p == inText.c_str() + inText.length();
+}
+
+// ---------------------------------------------------------------------------------
+//		FetchRequestText
+// ---------------------------------------------------------------------------------
+
+std::string
+FetchRequestText(const HttpRequest& inRequest)
+{
+	HttpResponse response;
+	if (!HttpSend(inRequest, response))
+		return response.mError;
+	return HttpResponseText(response);
+}
+
+// ---------------------------------------------------------------------------------
+//		ResponseJob
+// ---------------------------------------------------------------------------------
+
+ResponseJob::ResponseJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority)
+	: FetchJob(inInbox, inPriority)
+{
+}
+
+void
+ResponseJob::SendAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan)
+{
+	ResponseMode mode = inPlan != NULL ? inPlan->GetMode() : kResponseText;
+
+	switch (mode) {
+	case kResponseImage:
+		SendImageAndPost(inRequest, inPlan);
+		return;
+	case kResponseCsv:
+		SendCsvAndPost(inRequest, inPlan);
+		return;
+	case kResponseXml:
+		SendXmlAndPost(inRequest, inPlan);
+		return;
+	case kResponseText: {
+		FetchResult* result = new FetchResult;
+		result->mText = FetchRequestText(inRequest);
+		Post(result);
+		return;
+	}
+	default:
+		break;
+	}
+
+	FetchResult* status = new FetchResult;
+
+	HttpResponse response;
+	if (!HttpSend(inRequest, response)) {
+		status->mText = response.mError;
+		Post(status);
+		return;
+	}
+
+	std::string text = HttpResponseText(response);
+	std::string matchError;
+
+	if (mode == kResponseGeoJson) {
+		GeoJsonResult* points = new GeoJsonResult;
+		if (!ExtractGeoJsonPoints(text.data(), text.length(), inPlan->GetGeoProperties(), points->mPoints, status->mText)) {
+			delete points;
+			Post(status);
+			return;
+		}
+		Post(points);
+	}
+	else if (mode == kResponseRegex) {
+		const RegexPatternSet* patterns = inPlan->GetPatterns();
+		RegexLimits limits;
+		limits.mMaxSteps = inPlan->GetMatchSteps();
+		limits.mMaxStackBytes = inPlan->GetMatchStackKB() * 1024;
+
+		std::string groups[kRegexMaxPatterns][kRegexMaxGroups];
+		int counts[kRegexMaxPatterns];
+		if (patterns->Match(text.c_str(), inPlan->GetMatchIndex(), limits, groups, counts, matchError) == 0) {
+			status->mText = matchError.empty() ? "NO MATCH" : matchError;
+			Post(status);
+			return;
+		}
+
+		// a lone pattern spreads its groups over the fields; several patterns
+		// each send their first group to the field of the same number, empty
+		// if that pattern did not match
+		if (patterns->IsSingle()) {
+			for (int i = 0; i < counts[0]; i++) {
+				PostField(i + 1, LeadingNumber(groups[0][i]), groups[0][i]);
+			}
+		}
+		else {
+			for (int i = 0; i < kRegexMaxPatterns; i++) {
+				if (!patterns->HasPattern(i))
+					continue;
+				if (counts[i] == 0)
+					groups[i][0].clear();
+				PostField(i + 1, LeadingNumber(groups[i][0]), groups[i][0]);
+			}
+		}
+	}
+	else {
+		JsonValue values[kJsonMaxPointers];
+		if (!inPlan->GetPointers().Extract(text.data(), text.length(), values, status->mText)) {
+			Post(status);
+			return;
+		}
+
+		for (int i = 0; i < kJsonMaxPointers; i++) {
+			if (inPlan->HasPointer(i))
+				PostField(i + 1, values[i].mNumber, values[i].mText);
+		}
+
+		// an error body is not a state of the document, so it is not diffed
+		if (inPlan->IsDiff() && response.mStatus >= 200 && response.mStatus < 300) {
+			if (!PostChanges(inPlan, text, status->mText)) {
+				Post(status);
+				return;
+			}
+		}
+	}
+
+	// the fields are still extracted from an error response, since APIs
+	// usually describe the problem in the body, but the status says what happened
+	if (!matchError.empty()) {
+		status->mText = matchError;
+	}
+	else if (response.mStatus >= 200 && response.mStatus < 300) {
+		status->mText = "OK";
+	}
+	else {
+		char buf[64];
+		_snprintf(buf, sizeof(buf), "ERROR: HTTP %lu", (unsigned long) response.mStatus);
+		buf[sizeof(buf) - 1] = '\0';
+		status->mText = buf;
+	}
+	Post(status);
+}
+
+// diffs the document in ioText, taking the text, against the last one and
+// posts the changes as a kFetchResultChanges, if there are any
+bool
+ResponseJob::PostChanges(const ResponsePlan* inPlan, std::string& ioText, std::string& outError)
+{
+	JsonSnapshot snapshot;
+	if (!snapshot.Read(ioText, outError))
+		return false;
+
+	JsonDiffState* state = inPlan->GetDiffState();
+	FetchResult* changes = new FetchResult;
+	changes->mKind = kFetchResultChanges;
+
+	// held until the changes are posted, so they arrive in the order computed
+	state->Lock();
+	size_t count = state->Update(snapshot, (JsonDiffFormat) inPlan->GetDiffFormat(), changes->mText);
+	changes->mNumber = (double) count;
+	if (count > 0)
+		Post(changes);
+	else
+		delete changes;
+	state->Unlock();
+	return true;
+}
+
+void
+ResponseJob::PostField(int inIndex, double inNumber, std::string& ioText)
+{
+	FetchResult* field = new FetchResult;
+	field->mKind = kFetchResultField;
+	field->mIndex = inIndex;
+	field->mNumber = inNumber;
+	field->mText.swap(ioText);
+	Post(field);
+}
+
+// the status line of a streamed response; an error page is rarely in the
+// format asked for, so its HTTP status comes before the parser's error
+static void
+StreamStatus(DWORD inStatus, const std::string& inError, std::string& outStatus)
+{
+	if (inStatus != 0 && (inStatus < 200 || inStatus >= 300)) {
+		char buf[64];
+		_snprintf(buf, sizeof(buf), "ERROR: HTTP %lu", (unsigned long) inStatus);
+		buf[sizeof(buf) - 1] = '\0';
+		outStatus = buf;
+	}
+	else if (!inError.empty()) {
+		outStatus = inError;
+	}
+	else {
+		outStatus = "OK";
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		CsvResponseSink
+// ---------------------------------------------------------------------------------
+//	Feeds the body to a CsvParser as WinHTTP hands it over and passes the rows
+//	on in the plan's CsvMode. Only the current row and the rows or arrays not
+//	yet posted are held, never the body. In kCsvRows mode only the window
+//	from the plan's first row is passed on, and the rest counted.
+
+class CsvResponseSink : public HttpResponseSink, public CsvRowSink
+{
+public:
+	CsvResponseSink(ResponseJob* inJob, const ResponsePlan* inPlan);
+	virtual ~CsvResponseSink();
+
+	virtual bool	OnHeaders(DWORD inStatus, const std::string& inHeaders);
+	virtual bool	OnData(const char* inData, size_t inLength);
+	virtual void	OnRow(const std::string inValues[kCsvMaxColumns]);
+
+	// completes the last row, posts what has not been posted yet and returns
+	// the status line
+	void	Finish(std::string& outStatus);
+
+private:
+	void	PostRows();
+
+	ResponseJob*		mJob;
+	int					mMode;
+	const std::string*	mColumns;
+	CsvParser			mParser;
+	DWORD				mStatus;
+	std::string			mError;
+	size_t				mRowCount;
+	size_t				mKeptRows;
+	size_t				mKeptBytes;					// text passed on so far, in either mode
+	size_t				mDropped;					// rows that did not fit in kCsvMaxKeptBytes
+	size_t				mFirstRow;					// one-based first row of the window in kCsvRows mode
+	CsvRowsResult*		mRows;						// the chunk being filled in kCsvRows mode
+	bool				mPosted;					// a chunk has gone to the actor
+	std::string			mArrays[kCsvMaxColumns];	// the JSON arrays in kCsvArrays mode
+};
+
+CsvResponseSink::CsvResponseSink(ResponseJob* inJob, const ResponsePlan* inPlan)
+	: mJob(inJob)
+	, mMode(inPlan->GetCsvMode())
+	, mColumns(inPlan->GetCsvColumns())
+	, mParser(inPlan->GetCsvColumns())
+	, mStatus(0)
+	, mRowCount(0)
+	, mKeptRows(0)
+	, mKeptBytes(0)
+	, mDropped(0)
+	, mFirstRow(inPlan->GetCsvFirstRow())
+	, mRows(NULL)
+	, mPosted(false)
+{
+	if (mMode == kCsvRows) {
+		mRows = new CsvRowsResult;
+	}
+	else {
+		for (int i = 0; i < kCsvMaxColumns; i++) {
+			mArrays[i] = "[";
+		}
+	}
+}
+
+CsvResponseSink::~CsvResponseSink()
+{
+	delete mRows;
+}
+
+bool
+CsvResponseSink::OnHeaders(DWORD inStatus, const std::string& /* inHeaders */)
+{
+	mStatus = inStatus;
+	return true;
+}
+
+bool
+CsvResponseSink::OnData(const char* inData, size_t inLength)
+{
+	return mParser.Feed(inData, inLength, *this, mError);
+}
+
+void
+CsvResponseSink::OnRow(const std::string inValues[kCsvMaxColumns])
+{
+	mRowCount++;
+
+	if (mMode == kCsvRows) {
+		// rows outside the window are only counted, and the count still goes
+		// to the actor every kCsvChunkRows rows
+		bool inWindow = mRowCount >= mFirstRow && mRowCount - mFirstRow < kCsvWindowRows;
+		if (inWindow && mKeptBytes >= kCsvMaxKeptBytes) {
+			mDropped++;
+		}
+		else if (inWindow) {
+			for (int i = 0; i < kCsvMaxColumns; i++) {
+				mKeptBytes += inValues[i].length() + sizeof(size_t) + sizeof(float);
+			}
+			if (mRows->mRows.Count() == 0)
+				mRows->mIndex = (long) mRowCount;
+			mRows->mRows.AddRow(inValues);
+			mKeptRows++;
+		}
+		if (mRowCount % kCsvChunkRows == 0)
+			PostRows();
+		return;
+	}
+
+	// the arrays hold every row, so once the budget is spent the rest of the
+	// file is only counted
+	if (mKeptBytes >= kCsvMaxKeptBytes) {
+		mDropped++;
+		return;
+	}
+	mKeptRows++;
+
+	for (int i = 0; i < kCsvMaxColumns; i++) {
+		if (mColumns[i].empty())
+			continue;
+		std::string& array = mArrays[i];
+		size_t before = array.length();
+		if (mKeptRows > 1)
+			array += ',';
+		if (IsJSONNumber(inValues[i]))
+			array += inValues[i];
+		else
+			AppendJSONString(array, inValues[i]);
+		mKeptBytes += array.length() - before;
+	}
+}
+
+// hands the rows gathered since the last chunk, if any, and the count so far
+// to the actor, and starts the next chunk
+void
+CsvResponseSink::PostRows()
+{
+	if (mRows->mRows.Count() == 0)
+		mRows->mIndex = (long) mRowCount + 1;
+	mRows->mNumber = (double) mRowCount;
+	mRows->mStart = !mPosted;
+	mPosted = true;
+	mJob->Post(mRows);
+	mRows = new CsvRowsResult;
+}
+
+void
+CsvResponseSink::Finish(std::string& outStatus)
+{
+	if (mError.empty())
+		mParser.Finish(*this, mError);
+
+	if (mMode == kCsvRows) {
+		// the last rows and the final count; an empty file still clears the
+		// actor's table
+		PostRows();
+	}
+	else {
+		for (int i = 0; i < kCsvMaxColumns; i++) {
+			if (mColumns[i].empty())
+				continue;
+			mArrays[i] += ']';
+			mJob->PostField(i + 1, (double) mKeptRows, mArrays[i]);
+		}
+	}
+
+	StreamStatus(mStatus, mError, outStatus);
+	if (mDropped > 0 && outStatus == "OK") {
+		char buf[96];
+		_snprintf(buf, sizeof(buf), "ERROR: %lu rows did not fit in the %lu MB kept of a response",
+			(unsigned long) mDropped, (unsigned long) (kCsvMaxKeptBytes / (1024 * 1024)));
+		buf[sizeof(buf) - 1] = '\0';
+		outStatus = buf;
+	}
+}
+
+// streams the response through a CsvResponseSink
+void
+ResponseJob::SendCsvAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan)
+{
+	FetchResult* status = new FetchResult;
+
+	CsvResponseSink sink(this, inPlan);
+	if (!HttpSend(inRequest, sink, status->mText)) {
+		Post(status);
+		return;
+	}
+
+	sink.Finish(status->mText);
+	Post(status);
+}
+
+// ---------------------------------------------------------------------------------
+//		XmlResponseSink
+// ---------------------------------------------------------------------------------
+//	Feeds the body to an XmlParser as WinHTTP hands it over, and stops the
+//	download once the parser has every match it was asked for.
+
+class XmlResponseSink : public HttpResponseSink
+{
+public:
+	XmlResponseSink(const ResponsePlan* inPlan)
+		: mParser(inPlan->GetXmlPaths(), inPlan->GetXmlItems()), mStatus(0) {}
+
+	virtual bool	OnHeaders(DWORD inStatus, const std::string& /* inHeaders */)
+	{
+		mStatus = inStatus;
+		return true;
+	}
+
+	virtual bool	OnData(const char* inData, size_t inLength)
+	{
+		return mParser.Feed(inData, inLength, mError);
+	}
+
+	XmlParser		mParser;
+	DWORD			mStatus;
+	std::string		mError;
+};
+
+// streams the response through an XmlResponseSink and posts the matches
+void
+ResponseJob::SendXmlAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan)
+{
+	FetchResult* status = new FetchResult;
+
+	XmlResponseSink sink(inPlan);
+	if (!HttpSend(inRequest, sink, status->mText)) {
+		Post(status);
+		return;
+	}
+
+	const std::string* paths = inPlan->GetXmlPaths();
+	size_t items = (size_t) inPlan->GetXmlItems();
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		if (paths[i].empty())
+			continue;
+
+		const std::vector<std::string>& matches = sink.mParser.GetMatches(i);
+		std::string text;
+		if (inPlan->GetXmlMode() == kXmlArrays) {
+			text = "[";
+			for (size_t k = 0; k < matches.size(); k++) {
+				if (k > 0)
+					text += ',';
+				AppendJSONString(text, matches[k]);
+			}
+			text += ']';
+			PostField(i + 1, (double) matches.size(), text);
+		}
+		else {
+			if (matches.size() >= items)
+				text = matches[items - 1];
+			PostField(i + 1, LeadingNumber(text), text);
+		}
+	}
+
+	StreamStatus(sink.mStatus, sink.mError, status->mText);
+	Post(status);
+}
+
+// ---------------------------------------------------------------------------------
+//		ResponseJob::SendImageAndPost
+// ---------------------------------------------------------------------------------
+//	Decodes the response into a pooled frame. An error page is reported by its
+//	HTTP status and never decoded, so the last good frame stays on the output.
+
+void
+ResponseJob::SendImageAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan)
+{
+	FetchResult* status = new FetchResult;
+
+	HttpResponse response;
+	if (!HttpSend(inRequest, response)) {
+		status->mText = response.mError;
+		Post(status);
+		return;
+	}
+
+	std::string decodeError;
+	if (response.mStatus >= 200 && response.mStatus < 300) {
+		ImageResult* image = new ImageResult(inPlan->GetFramePool());
+		if (DecodeImage(response.mBody.data(), response.mBody.length(), *image->mFrame, decodeError))
+			Post(image);
+		else
+			delete image;
+	}
+
+	StreamStatus(response.mStatus, decodeError, status->mText);
+	Post(status);
+}
+
+// ---------------------------------------------------------------------------------
+//		PageFetchJob
+// ---------------------------------------------------------------------------------
+
+PageFetchJob::PageFetchJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority,
+	const HttpRequest&	inRequest,
+	ResponsePlan*		inPlan)
+	: ResponseJob(inInbox, inPriority)
+	, mRequest(inRequest)
+	, mPlan(inPlan)
+{
+	if (mPlan != NULL)
+		mPlan->AddRef();
+}
+
+PageFetchJob::~PageFetchJob()
+{
+	if (mPlan != NULL)
+		mPlan->Release();
+}
+
+void
+PageFetchJob::Run()
+{
+	SendAndPost(mRequest, mPlan);
+}
+
+// ---------------------------------------------------------------------------------
+//		TailSink
+// ---------------------------------------------------------------------------------
+//	Splits the part of the body after the offset into records. mPosition is
+//	the file offset of the next byte, which for a 206 response is where its
+//	Content-Range starts and for a 200 response is 0.
+
+// reads "bytes 100-199/5000" or "bytes */5000"; outTotal is 0 when unknown
+static void
+ParseContentRange(const std::string& inRange, ULONGLONG& outStart, ULONGLONG& outTotal)
+{
+	outStart = 0;
+	outTotal = 0;
+
+	const char* p = inRange.c_str();
+	if (_strnicmp(p, "bytes", 5) == 0)
+		p += 5;
+	while (*p == ' ')
+		p++;
+	if (*p != '*')
+		outStart = strtoull(p, NULL, 10);
+
+	const char* slash = strchr(p, '/');
+	if (slash != NULL && slash[1] != '*')
+		outTotal = strtoull(slash + 1, NULL, 10);
+}
+
+class TailSink : public HttpResponseSink
+{
+public:
+	TailSink(ULONGLONG inOffset, bool inFindEnd, std::vector<TailRecord>& ioRecords)
+		: mStatus(0), mEnd(inOffset), mOffset(inOffset), mFindEnd(inFindEnd), mPosition(0), mRecords(ioRecords) {}
+
+	virtual bool	OnHeaders(DWORD inStatus, const std::string& inHeaders);
+	virtual bool	OnData(const char* inData, size_t inLength);
+
+	// the offset after the last complete line, 0 if the file is now shorter
+	// than the offset
+	ULONGLONG		GetEnd() const;
+
+	DWORD			mStatus;
+
+private:
+	TailSink& operator=(const TailSink&);
+
+	ULONGLONG		mEnd;
+	ULONGLONG		mOffset;
+	bool			mFindEnd;
+	ULONGLONG		mPosition;
+	std::string		mLine;
+	std::vector<TailRecord>&	mRecords;
+};
+
+bool
+TailSink::OnHeaders(DWORD inStatus, const std::string& inHeaders)
+{
+	mStatus = inStatus;
+
+	ULONGLONG start;
+	ULONGLONG total;
+	if (inStatus == 206) {
+		ParseContentRange(HttpHeaderValue(inHeaders, "Content-Range"), start, total);
+		mPosition = start;
+
+		// the end is just after the last line break in the bytes that follow;
+		// without one the last line started before them, and the best guess
+		// left is the end of the file
+		if (mFindEnd)
+			mEnd = start > 0 ? total : 0;
+		return true;
+	}
+
+	// 416 means there is nothing after the offset, or that the file has been
+	// truncated to less than it
+	if (inStatus == 416) {
+		ParseContentRange(HttpHeaderValue(inHeaders, "Content-Range"), start, total);
+		if (total < mOffset)
+			mEnd = 0;
+		return false;
+	}
+
+	// an error page is not part of the file
+	return inStatus >= 200 && inStatus < 300;
+}
+
+bool
+TailSink::OnData(const char* inData, size_t inLength)
+{
+	const char* p = inData;
+	const char* end = inData + inLength;
+
+	// a server that ignored the Range header sends what earlier polls read
+	if (mPosition < mOffset) {
+		ULONGLONG skip = mOffset - mPosition;
+		if (skip >= inLength) {
+			mPosition += inLength;
+			return true;
+		}
+		p += (size_t) skip;
+		mPosition = mOffset;
+	}
+
+	while (p < end) {
+		const char* lf = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* stop = lf != NULL ? lf : end;
+		if (!mFindEnd && mLine.length() < kTailMaxLineLength) {
+			size_t room = kTailMaxLineLength - mLine.length();
+			size_t length = stop - p;
+			mLine.append(p, length < room ? length : room);
+		}
+		mPosition += stop - p;
+		if (lf == NULL)
+			break;
+
+		p = lf + 1;
+		mPosition++;
+		mEnd = mPosition;
+		if (mFindEnd)
+			continue;
+
+		if (!mLine.empty() && mLine[mLine.length() - 1] == '\r')
+			mLine.erase(mLine.length() - 1);
+		if (!mLine.empty()) {
+			mRecords.push_back(TailRecord());
+			mRecords.back().mText.swap(mLine);
+			if (mRecords.size() >= kTailMaxRecords)
+				return false;
+		}
+		mLine.clear();
+	}
+	return true;
+}
+
+ULONGLONG
+TailSink::GetEnd() const
+{
+	// a whole file shorter than the offset has been truncated or replaced
+	if (mStatus >= 200 && mStatus < 300 && mStatus != 206 && mPosition < mOffset)
+		return 0;
+	return mEnd;
+}
+
+// ---------------------------------------------------------------------------------
+//		TailFetchJob
+// ---------------------------------------------------------------------------------
+
+TailFetchJob::TailFetchJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority,
+	const HttpRequest&	inRequest,
+	ResponsePlan*		inPlan,
+	ULONGLONG		inOffset,
+	bool			inFindEnd)
+	: FetchJob(inInbox, inPriority)
+	, mRequest(inRequest)
+	, mPlan(inPlan)
+	, mOffset(inOffset)
+	, mFindEnd(inFindEnd)
+{
+	if (mPlan != NULL)
+		mPlan->AddRef();
+}
+
+TailFetchJob::~TailFetchJob()
+{
+	if (mPlan != NULL)
+		mPlan->Release();
+}
+
+void
+TailFetchJob::Run()
+{
+	// finding the end asks for the last bytes of the file, and starts after
+	// the last line break in them, so the first record is a whole line
+	char range[64];
+	if (mFindEnd)
+		_snprintf(range, sizeof(range), "Range: bytes=-%lu\r\n", (unsigned long) kTailFindEndBytes);
+	else
+		_snprintf(range, sizeof(range), "Range: bytes=%llu-\r\n", mOffset);
+	range[sizeof(range) - 1] = '\0';
+
+	HttpRequest request = mRequest;
+	request.mHeaders += range;
+
+	FetchResult* status = new FetchResult;
+	TailResult* tail = new TailResult;
+	tail->mURL = mRequest.mURL;
+	tail->mStart = mOffset;
+
+	TailSink sink(mOffset, mFindEnd, tail->mRecords);
+	if (!HttpSend(request, sink, status->mText)) {
+		delete tail;
+		Post(status);
+		return;
+	}
+
+	if (sink.mStatus == 416 || (sink.mStatus >= 200 && sink.mStatus < 300)) {
+		tail->mEnd = sink.GetEnd();
+
+		// NDJSON records each get the plan's JSON pointers read from them
+		if (mPlan != NULL && mPlan->GetMode() == kResponseJson) {
+			std::string error;
+			for (size_t i = 0; i < tail->mRecords.size(); i++) {
+				TailRecord& record = tail->mRecords[i];
+				record.mHasValues = mPlan->GetPointers().Extract(record.mText.data(), record.mText.length(), record.mValues, error);
+			}
+		}
+
+		Post(tail);
+		status->mText = "OK";
+	}
+	else {
+		delete tail;
+		StreamStatus(sink.mStatus, std::string(), status->mText);
+	}
+	Post(status);
+}
+
+// ---------------------------------------------------------------------------------
+//		MjpegSink
+// ---------------------------------------------------------------------------------
+//	Splits the stream into parts as WinHTTP hands it over and offers each one to
+//	the MjpegStream. Stops the download once the stream is stopped or the actor
+//	is gone.
+
+class MjpegSink : public HttpResponseSink, public MultipartPartSink
+{
+public:
+	MjpegSink(MjpegStreamJob* inJob) : mStatus(0), mJob(inJob), mParser(NULL) {}
+	virtual ~MjpegSink()			{ delete mParser; }
+
+	virtual bool	OnHeaders(DWORD inStatus, const std::string& inHeaders);
+	virtual bool	OnData(const char* inData, size_t inLength);
+	virtual void	OnPart(const char* inData, size_t inLength);
+
+	DWORD			mStatus;
+	std::string		mError;
+
+private:
+	MjpegSink(const MjpegSink&);
+	MjpegSink& operator=(const MjpegSink&);
+
+	MjpegStreamJob*		mJob;
+	MultipartParser*	mParser;
+};
+
+bool
+MjpegSink::OnHeaders(DWORD inStatus, const std::string& inHeaders)
+{
+	mStatus = inStatus;
+	if (inStatus < 200 || inStatus >= 300)
+		return false;
+
+	std::string boundary;
+	if (!ParseMultipartBoundary(inHeaders, boundary)) {
+		mError = "ERROR: the response is not a multipart stream";
+		return false;
+	}
+	mParser = new MultipartParser(boundary);
+
+	FetchResult* status = new FetchResult;
+	status->mText = "OK";
+	mJob->Post(status);
+	return true;
+}
+
+bool
+MjpegSink::OnData(const char* inData, size_t inLength)
+{
+	if (mJob->mStream->IsStopped() || mJob->GetInbox()->IsClosed())
+		return false;
+	return mParser->Feed(inData, inLength, *this, mError);
+}
+
+void
+MjpegSink::OnPart(const char* inData, size_t inLength)
+{
+	if (mJob->mStream->OfferPart(inData, inLength))
+		SubmitFetchJob(new MjpegDecodeJob(mJob->GetInbox(), mJob->GetPriority(), mJob->mStream));
+}
+
+// ---------------------------------------------------------------------------------
+//		MjpegStreamJob
+// ---------------------------------------------------------------------------------
+
+MjpegStreamJob::MjpegStreamJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority,
+	const HttpRequest&	inRequest,
+	MjpegStream*	inStream)
+	: FetchJob(inInbox, inPriority)
+	, mRequest(inRequest)
+	, mStream(inStream)
+{
+	mRequest.mReceiveTimeoutMs = kHttpStreamReceiveTimeoutMs;
+	mStream->AddRef();
+}
+
+MjpegStreamJob::~MjpegStreamJob()
+{
+	mStream->Release();
+}
+
+void
+MjpegStreamJob::Run()
+{
+	FetchResult* status = new FetchResult;
+
+	MjpegSink sink(this);
+	bool sent = HttpSend(mRequest, sink, status->mText, &mStream->GetCancel());
+
+	// a stream the actor closed needs no word about it
+	if (mStream->IsStopped()) {
+		delete status;
+		return;
+	}
+
+	if (sent)
+		StreamStatus(sink.mStatus, sink.mError.empty() ? std::string("ERROR: the stream ended") : sink.mError, status->mText);
+	Post(status);
+}
+
+// ---------------------------------------------------------------------------------
+//		SseSink
+// ---------------------------------------------------------------------------------
+//	Feeds the stream to an SseParser as WinHTTP hands it over and pushes the
+//	events it completes onto the subscription.
+
+class SseSink : public HttpResponseSink
+{
+public:
+	SseSink(SseStreamJob* inJob, bool inPointers, const std::string& inLastId, DWORD inRetryMs)
+		: mStatus(0), mOpen(false), mParser(inLastId, inRetryMs), mJob(inJob), mPointers(inPointers) {}
+
+	virtual bool	OnHeaders(DWORD inStatus, const std::string& inHeaders);
+	virtual bool	OnData(const char* inData, size_t inLength);
+
+	DWORD			mStatus;
+	bool			mOpen;				// the response is an event stream
+	SseParser		mParser;
+
+private:
+	SseSink(const SseSink&);
+	SseSink& operator=(const SseSink&);
+
+	SseStreamJob*			mJob;
+	bool					mPointers;
+	std::vector<SseEvent>	mEvents;
+};
+
+bool
+SseSink::OnHeaders(DWORD inStatus, const std::string& inHeaders)
+{
+	mStatus = inStatus;
+	if (inStatus < 200 || inStatus >= 300)
+		return false;
+	if (_strnicmp(HttpHeaderValue(inHeaders, "Content-Type").c_str(), "text/event-stream", 17) != 0)
+		return false;
+	mOpen = true;
+
+	FetchResult* status = new FetchResult;
+	status->mText = "OK";
+	mJob->Post(status);
+	return true;
+}
+
+bool
+SseSink::OnData(const char* inData, size_t inLength)
+{
+	if (mJob->mSubscription->IsStopped() || mJob->GetInbox()->IsClosed())
+		return false;
+
+	mParser.Feed(inData, inLength, mEvents);
+	if (mEvents.empty())
+		return true;
+
+	if (mPointers) {
+		std::string error;
+		for (size_t i = 0; i < mEvents.size(); i++) {
+			SseEvent& event = mEvents[i];
+			event.mHasValues = mJob->mPlan->GetPointers().Extract(event.mData.data(), event.mData.length(), event.mValues, error);
+		}
+	}
+	mJob->mSubscription->Push(mEvents);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		SseStreamJob
+// ---------------------------------------------------------------------------------
+
+SseStreamJob::SseStreamJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority,
+	const HttpRequest&	inRequest,
+	ResponsePlan*		inPlan,
+	SseSubscription*	inSubscription)
+	: FetchJob(inInbox, inPriority)
+	, mRequest(inRequest)
+	, mPlan(inPlan)
+	, mSubscription(inSubscription)
+{
+	// servers go quiet between events for longer than the session's timeout
+	mRequest.mReceiveTimeoutMs = kHttpStreamReceiveTimeoutMs;
+	if (mPlan != NULL)
+		mPlan->AddRef();
+	mSubscription->AddRef();
+}
+
+SseStreamJob::~SseStreamJob()
+{
+	if (mPlan != NULL)
+		mPlan->Release();
+	mSubscription->Release();
+}
+
+void
+SseStreamJob::Run()
+{
+	bool pointers = mPlan != NULL && mPlan->GetMode() == kResponseJson;
+
+	std::string lastId;
+	DWORD retryMs = kSseDefaultRetryMs;
+
+	for (;;) {
+		HttpRequest request = mRequest;
+		request.mHeaders += "Accept: text/event-stream\r\nCache-Control: no-cache\r\n";
+		if (!lastId.empty())
+			request.mHeaders += "Last-Event-ID: " + lastId + "\r\n";
+
+		FetchResult* status = new FetchResult;
+		SseSink sink(this, pointers, lastId, retryMs);
+		bool sent = HttpSend(request, sink, status->mText, &mSubscription->GetCancel());
+
+		if (mSubscription->IsStopped() || GetInbox()->IsClosed()) {
+			delete status;
+			return;
+		}
+
+		lastId = sink.mParser.GetLastId();
+		retryMs = sink.mParser.GetRetryMs();
+
+		// a server that answers but not with a stream will not change its mind
+		bool retry = !sent || sink.mOpen || sink.mStatus >= 500;
+		if (sent) {
+			if (sink.mOpen)
+				status->mText = "ERROR: the stream ended";
+			else if (sink.mStatus == 204)
+				status->mText = "ERROR: the server closed the subscription";
+			else if (sink.mStatus >= 200 && sink.mStatus < 300)
+				status->mText = "ERROR: the response is not an event stream";
+			else
+				StreamStatus(sink.mStatus, std::string(), status->mText);
+		}
+		if (retry)
+			status->mText += ", reconnecting";
+		Post(status);
+
+		if (!retry || !mSubscription->Wait(retryMs))
+			return;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		MjpegDecodeJob
+// ---------------------------------------------------------------------------------
+
+MjpegDecodeJob::MjpegDecodeJob(FetchInbox* inInbox, FetchPriority inPriority, MjpegStream* inStream)
+	: FetchJob(inInbox, inPriority)
+	, mStream(inStream)
+{
+	mStream->AddRef();
+}
+
+MjpegDecodeJob::~MjpegDecodeJob()
+{
+	mStream->Release();
+}
+
+void
+MjpegDecodeJob::Run()
+{
+	std::string error;
+	while (mStream->DecodeNext(error)) {
+		if (!error.empty()) {
+			FetchResult* status = new FetchResult;
+			status->mText = error;
+			Post(status);
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		WebSocketJob
+// ---------------------------------------------------------------------------------
+
+WebSocketJob::WebSocketJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority,
+	const HttpRequest&	inRequest,
+	ResponsePlan*		inPlan,
+	WebSocketSession*	inSession)
+	: FetchJob(inInbox, inPriority)
+	, mRequest(inRequest)
+	, mPlan(inPlan)
+	, mSession(inSession)
+{
+	if (mPlan != NULL)
+		mPlan->AddRef();
+	mSession->AddRef();
+}
+
+WebSocketJob::~WebSocketJob()
+{
+	if (mPlan != NULL)
+		mPlan->Release();
+	mSession->Release();
+}
+
+void
+WebSocketJob::Run()
+{
+	bool pointers = mPlan != NULL && mPlan->GetMode() == kResponseJson;
+
+	HttpWebSocket& socket = mSession->GetSocket();
+
+	FetchResult* status = new FetchResult;
+	bool open = socket.Open(mRequest, status->mText);
+
+	// a session stopped while the socket was opening is closed here
+	if (mSession->IsStopped()) {
+		socket.Abort();
+		delete status;
+		return;
+	}
+	if (!open) {
+		Post(status);
+		return;
+	}
+
+	status->mText = "OK";
+	Post(status);
+
+	if (mSession->SetOpen())
+		SubmitFetchJob(new WebSocketSendJob(GetInbox(), GetPriority(), mSession));
+
+	// the message is swapped into its slot, so the two trade buffers rather than copy
+	WebSocketQueue& inbound = mSession->GetInbound();
+	std::string message;
+	std::string error;
+	std::string extractError;
+	bool binary;
+	while (socket.Receive(message, binary, kWebSocketMaxMessage, error)) {
+		if (GetInbox()->IsClosed())
+			return;
+
+		WebSocketMessage* slot = inbound.BeginPush();
+		if (slot == NULL) {
+			mSession->AddDropped(1);
+			continue;
+		}
+		slot->mText.swap(message);
+		slot->mBinary = binary;
+		slot->mHasValues = pointers && !binary
+			&& mPlan->GetPointers().Extract(slot->mText.data(), slot->mText.length(), slot->mValues, extractError);
+		inbound.EndPush();
+	}
+
+	// a session the actor closed needs no word about it
+	if (mSession->IsStopped() || GetInbox()->IsClosed())
+		return;
+
+	status = new FetchResult;
+	status->mText = error.empty() ? std::string("ERROR: the connection closed") : error;
+	Post(status);
+}
+
+// ---------------------------------------------------------------------------------
+//		WebSocketSendJob
+// ---------------------------------------------------------------------------------
+
+WebSocketSendJob::WebSocketSendJob(FetchInbox* inInbox, FetchPriority inPriority, WebSocketSession* inSession)
+	: FetchJob(inInbox, inPriority)
+	, mSession(inSession)
+{
+	mSession->AddRef();
+}
+
+WebSocketSendJob::~WebSocketSendJob()
+{
+	mSession->Release();
+}
+
+void
+WebSocketSendJob::Run()
+{
+	std::string text;
+	std::string error;
+	bool reported = false;
+
+	// the rest of the queue is still tried after a failure, but only the
+	// first is reported
+	while (mSession->TakeOutgoing(text)) {
+		if (mSession->GetSocket().Send(text.data(), text.length(), false, error) || reported)
+			continue;
+		if (mSession->IsStopped())
+			continue;
+
+		FetchResult* status = new FetchResult;
+		status->mText = error;
+		Post(status);
+		reported = true;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		FetchBatch
+// ---------------------------------------------------------------------------------
+
+FetchBatch::FetchBatch(
+	FetchInbox*		inInbox,
+	size_t			inCount,
+	DWORD			inDeadlineMs)
+	: mRefCount(1)
+	, mInbox(inInbox)
+	, mTexts(inCount)
+	, mDone(inCount, false)
+	, mRemaining(inCount)
+	, mFinished(false)
+	, mStartTick(GetTickCount())
+	, mDeadlineMs(inDeadlineMs)
+{
+	InitializeCriticalSection(&mLock);
+	mInbox->AddRef();
+}
+
+FetchBatch::~FetchBatch()
+{
+	mInbox->Release();
+	DeleteCriticalSection(&mLock);
+}
+
+void
+FetchBatch::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+FetchBatch::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+bool
+FetchBatch::IsFinished()
+{
+	EnterCriticalSection(&mLock);
+	bool finished = mFinished;
+	LeaveCriticalSection(&mLock);
+	return finished;
+}
+
+void
+FetchBatch::Complete(size_t inIndex, const std::string& inText, std::vector<FetchResult*>& ioResults)
+{
+	EnterCriticalSection(&mLock);
+
+	if (!mFinished && inIndex < mTexts.size() && !mDone[inIndex]) {
+
+		mTexts[inIndex] = inText;
+		mDone[inIndex] = true;
+
+		// posted under the lock so another item's values cannot come between
+		for (size_t i = 0; i < ioResults.size(); i++) {
+			mInbox->Post(ioResults[i]);
+		}
+		ioResults.clear();
+
+		FetchResult* item = new FetchResult;
+		item->mKind = kFetchResultBatchItem;
+		item->mIndex = static_cast<long>(inIndex) + 1;
+		item->mText = inText;
+		mInbox->Post(item);
+
+		if (--mRemaining == 0) {
+			PostCombined();
+		}
+	}
+
+	LeaveCriticalSection(&mLock);
+
+	// a response that came too late
+	for (size_t i = 0; i < ioResults.size(); i++) {
+		delete ioResults[i];
+	}
+	ioResults.clear();
+}
+
+void
+FetchBatch::CheckDeadline(DWORD inNow)
+{
+	EnterCriticalSection(&mLock);
+	if (!mFinished && mDeadlineMs != 0 && inNow - mStartTick >= mDeadlineMs) {
+		PostCombined();
+	}
+	LeaveCriticalSection(&mLock);
+}
+
+void
+FetchBatch::Abandon()
+{
+	EnterCriticalSection(&mLock);
+	mFinished = true;
+	LeaveCriticalSection(&mLock);
+}
+
+void
+FetchBatch::PostCombined()
+{
+	mFinished = true;
+
+	size_t reserve = 2;
+	for (size_t i = 0; i < mTexts.size(); i++) {
+		reserve += mTexts[i].length() + 8;
+	}
+
+	FetchResult* combined = new FetchResult;
+	combined->mKind = kFetchResultBatch;
+	combined->mIndex = static_cast<long>(mTexts.size() - mRemaining);
+	combined->mText.reserve(reserve);
+	combined->mText += '[';
+	for (size_t i = 0; i < mTexts.size(); i++) {
+		if (i > 0)
+			combined->mText += ',';
+		if (mDone[i])
+			AppendJSONString(combined->mText, mTexts[i]);
+		else
+			combined->mText += "null";
+	}
+	combined->mText += ']';
+	mInbox->Post(combined);
+
+	// the responses now live in the combined result
+	std::vector<std::string>().swap(mTexts);
+}
+
+// ---------------------------------------------------------------------------------
+//		BatchItemJob
+// ---------------------------------------------------------------------------------
+
+BatchItemJob::BatchItemJob(
+	FetchBatch*		inBatch,
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority,
+	size_t			inIndex,
+	const HttpRequest&	inRequest,
+	ResponsePlan*		inPlan)
+	: ResponseJob(inInbox, inPriority)
+	, mBatch(inBatch)
+	, mIndex(inIndex)
+	, mRequest(inRequest)
+	, mPlan(inPlan)
+{
+	mBatch->AddRef();
+	if (mPlan != NULL)
+		mPlan->AddRef();
+}
+
+BatchItemJob::~BatchItemJob()
+{
+	for (size_t i = 0; i < mResults.size(); i++) {
+		delete mResults[i];
+	}
+	if (mPlan != NULL)
+		mPlan->Release();
+	mBatch->Release();
+}
+
+void
+BatchItemJob::Run()
+{
+	// no point in loading a page for a batch that has already been reported
+	if (mBatch->IsFinished())
+		return;
+
+	SendAndPost(mRequest, mPlan);
+	mBatch->Complete(mIndex, mStatus, mResults);
+}
+
+// every response ends with a status, the whole text in kResponseText mode
+void
+BatchItemJob::Post(FetchResult* inResult)
+{
+	if (inResult->mKind == kFetchResultStatus) {
+		mStatus.swap(inResult->mText);
+		delete inResult;
+	}
+	else {
+		mResults.push_back(inResult);
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpChannel
+// ---------------------------------------------------------------------------------
+
+HttpChannel::HttpChannel(FetchInbox* inInbox)
+	: mRefCount(1)
+	, mInbox(inInbox)
+	, mRunning(false)
+	, mPlan(NULL)
+{
+	InitializeCriticalSection(&mLock);
+	mInbox->AddRef();
+}
+
+HttpChannel::~HttpChannel()
+{
+	if (mPlan != NULL)
+		mPlan->Release();
+	mInbox->Release();
+	DeleteCriticalSection(&mLock);
+}
+
+void
+HttpChannel::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+HttpChannel::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+void
+HttpChannel::Send(const HttpRequest& inRequest, FetchPriority inPriority)
+{
+	EnterCriticalSection(&mLock);
+
+	if (mPending.size() >= kHttpChannelMaxPending) {
+		mPending.pop_front();
+	}
+	mPending.push_back(inRequest);
+
+	bool start = !mRunning;
+	mRunning = true;
+
+	LeaveCriticalSection(&mLock);
+
+	if (start) {
+		SubmitFetchJob(new ChannelJob(this, inPriority));
+	}
+}
+
+void
+HttpChannel::SetResponsePlan(ResponsePlan* inPlan)
+{
+	if (inPlan != NULL)
+		inPlan->AddRef();
+
+	EnterCriticalSection(&mLock);
+	ResponsePlan* old = mPlan;
+	mPlan = inPlan;
+	LeaveCriticalSection(&mLock);
+
+	if (old != NULL)
+		old->Release();
+}
+
+bool
+HttpChannel::TakeNext(HttpRequest& outRequest, ResponsePlan*& outPlan)
+{
+	EnterCriticalSection(&mLock);
+
+	bool any = !mPending.empty();
+	if (any) {
+		outRequest = mPending.front();
+		mPending.pop_front();
+		outPlan = mPlan;
+		if (outPlan != NULL)
+			outPlan->AddRef();
+	}
+	else {
+		mRunning = false;
+	}
+
+	LeaveCriticalSection(&mLock);
+	return any;
+}
+
+// ---------------------------------------------------------------------------------
+//		ChannelJob
+// ---------------------------------------------------------------------------------
+
+ChannelJob::ChannelJob(HttpChannel* inChannel, FetchPriority inPriority)
+	: ResponseJob(inChannel->GetInbox(), inPriority)
+	, mChannel(inChannel)
+{
+	mChannel->AddRef();
+}
+
+ChannelJob::~ChannelJob()
+{
+	mChannel->Release();
+}
+
+void
+ChannelJob::Run()
+{
+	HttpRequest request;
+	ResponsePlan* plan;
+	while (!GetInbox()->IsClosed() && mChannel->TakeNext(request, plan)) {
+		SendAndPost(request, plan);
+		if (plan != NULL)
+			plan->Release();
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		ParseURLList
+// ---------------------------------------------------------------------------------
+
+static void
+PushTrimmed(const char* inStart, const char* inEnd, std::vector<std::string>& outURLs)
+{
+	while (inStart < inEnd && isspace((unsigned char) *inStart))
+		inStart++;
+	while (inEnd > inStart && isspace((unsigned char) inEnd[-1]))
+		inEnd--;
+	if (inStart < inEnd)
+		outURLs.push_back(std::string(inStart, inEnd));
+}
+
+size_t
+ParseURLList(const char* inText, std::vector<std::string>& outURLs)
+{
+	outURLs.clear();
+
+	const char* p = inText;
+	while (isspace((unsigned char) *p))
+		p++;
+
+	if (*p != '[') {
+		// one URL per line
+		const char* line = p;
+		for (;; p++) {
+			if (*p == '\n' || *p == '\r' || *p == '\0') {
+				PushTrimmed(line, p, outURLs);
+				if (*p == '\0')
+					break;
+				line = p + 1;
+			}
+		}
+		return outURLs.size();
+	}
+
+	// JSON array of strings; anything that is not a string is skipped
+	for (p++; *p != '\0' && *p != ']'; ) {
+
+		if (*p != '"') {
+			p++;
+			continue;
+		}
+
+		std::string url;
+		for (p++; *p != '\0' && *p != '"'; p++) {
+			if (*p != '\\') {
+				url += *p;
+				continue;
+			}
+			p++;
+			switch (*p) {
+			case 'n':	url += '\n';	break;
+			case 'r':	url += '\r';	break;
+			case 't':	url += '\t';	break;
+			case 'b':	url += '\b';	break;
+			case 'f':	url += '\f';	break;
+			case 'u':
+				{
+					unsigned long cp = 0;
+					int digits = 0;
+					for (; digits < 4 && isxdigit((unsigned char) p[1]); digits++, p++) {
+						char h = p[1];
+						cp = (cp << 4) | (unsigned long) (h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+					}
+					if (digits == 4)
+						AppendUTF8(url, cp);
+				}
+				break;
+			case '\0':
+				p--;
+				break;
+			default:
+				url += *p;
+				break;
+			}
+		}
+		if (*p == '"')
+			p++;
+
+		PushTrimmed(url.c_str(), url.c_str() + url.length(), outURLs);
+	}
+
+	return outURLs.size();
+}
@@ -0,0 +1,550 @@
+// ===========================================================================
+//	FetchJobs.h
+// ===========================================================================
+//
+//	The concrete jobs the actor submits to the FetchScheduler.
+
+#ifndef FETCHJOBS_H
+#define FETCHJOBS_H
+
+#include "FetchScheduler.h"
+#include "HttpTransport.h"
+#include "MjpegStream.h"
+#include "ResponsePlan.h"
+#include "SseStream.h"
+#include "WebSocketSession.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------
+//	FetchRequestText
+// ---------------------------------------------------------------------------------
+//	Sends inRequest and returns the response text as UTF-8, or an "ERROR: ..."
+//	line if the request failed. Blocks, so only call it from a worker thread.
+
+std::string		FetchRequestText(const HttpRequest& inRequest);
+
+// ---------------------------------------------------------------------------------
+//	GeoJsonResult
+// ---------------------------------------------------------------------------------
+//	The kFetchResultPoints result. The actor swaps the columns into its own
+//	GeoJsonPoints, so they are never copied.
+
+struct GeoJsonResult : public FetchResult
+{
+	GeoJsonResult()		{ mKind = kFetchResultPoints; }
+
+	GeoJsonPoints	mPoints;
+};
+
+// ---------------------------------------------------------------------------------
+//	CsvRowsResult
+// ---------------------------------------------------------------------------------
+//	The kFetchResultRows result: the next run of rows of the window of a CSV
+//	response, posted while the rest is still downloading. mIndex is the
+//	one-based number of the first row and mNumber the rows read so far.
+//	Rows past the window are only counted, in results without rows. The first
+//	result of a response has mStart set and replaces the actor's table; later
+//	ones are appended to it.
+
+struct CsvRowsResult : public FetchResult
+{
+	CsvRowsResult() : mStart(false)		{ mKind = kFetchResultRows; }
+
+	bool		mStart;
+	CsvTable	mRows;
+};
+
+// ---------------------------------------------------------------------------------
+//	ImageResult
+// ---------------------------------------------------------------------------------
+//	The kFetchResultImage result: a frame decoded from an image response. The
+//	actor copies mFrame to its video output, and deleting the result recycles
+//	the frame into mPool.
+
+struct ImageResult : public FetchResult
+{
+	ImageResult(FramePool* inPool)
+		: mFrame(inPool->Acquire()), mPool(inPool)
+	{
+		mKind = kFetchResultImage;
+		mPool->AddRef();
+	}
+
+	~ImageResult()
+	{
+		mPool->Recycle(mFrame);
+		mPool->Release();
+	}
+
+	VideoFrame*		mFrame;
+	FramePool*		mPool;
+
+private:
+	ImageResult(const ImageResult&);
+	ImageResult& operator=(const ImageResult&);
+};
+
+// ---------------------------------------------------------------------------------
+//	ResponseJob
+// ---------------------------------------------------------------------------------
+//	Base for the jobs whose responses go to the actor's status output.
+//
+//	Without a ResponsePlan, or in kResponseText mode, the response text is
+//	posted as a kFetchResultStatus result. Otherwise the response is parsed on the
+//	worker and only what was extracted is posted, one kFetchResultField per
+//	pointer or regular expression group, or a single GeoJsonResult in GeoJSON
+//	mode, followed by a short status line instead of the whole text. In CSV
+//	mode the response is never collected: it is parsed as it streams in and
+//	its window posted as CsvRowsResult chunks, or as one JSON array per column. XML mode
+//	streams too, and stops the download once every path has its matches.
+//	With diffing on, a JSON response is also compared with the one before and
+//	the changes posted as one kFetchResultChanges. In image mode the response
+//	is decoded into a frame from the plan's FramePool and posted as an
+//	ImageResult, followed by the status line.
+
+class ResponseJob : public FetchJob
+{
+protected:
+	ResponseJob(FetchInbox* inInbox, FetchPriority inPriority);
+
+	// inPlan may be NULL
+	void	SendAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan);
+
+	// posts a kFetchResultField for the one-based field inIndex, taking ioText
+	void	PostField(int inIndex, double inNumber, std::string& ioText);
+
+private:
+	friend class CsvResponseSink;
+
+	bool	PostChanges(const ResponsePlan* inPlan, std::string& ioText, std::string& outError);
+
+	void	SendCsvAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan);
+	void	SendXmlAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan);
+	void	SendImageAndPost(const HttpRequest& inRequest, const ResponsePlan* inPlan);
+};
+
+// ---------------------------------------------------------------------------------
+//	PageFetchJob
+// ---------------------------------------------------------------------------------
+//	Sends one request and posts its response. Used for GET requests, which may
+//	run in parallel and complete in any order.
+
+class PageFetchJob : public ResponseJob
+{
+public:
+	// inPlan may be NULL; the job holds a reference while it runs
+	PageFetchJob(
+		FetchInbox*		inInbox,
+		FetchPriority	inPriority,
+		const HttpRequest&	inRequest,
+		ResponsePlan*		inPlan);
+
+	virtual ~PageFetchJob();
+
+	virtual void	Run();
+
+private:
+	HttpRequest			mRequest;
+	ResponsePlan*		mPlan;
+};
+
+// ---------------------------------------------------------------------------------
+//	Tail mode
+// ---------------------------------------------------------------------------------
+//	For append-only logs and NDJSON feeds. Each poll asks only for the bytes
+//	after the last complete line already read, with an HTTP Range request, and
+//	posts the new lines as records. A server that ignores Range sends the whole
+//	file, which is then streamed past up to the same offset, so the records
+//	are the same either way and only the download is longer.
+
+// the values of the actor's tail input
+enum TailMode
+{
+	kTailOff = 0,
+	kTailAll,			// the first poll reads the file from the start
+	kTailNew			// the first poll only finds the end, so only lines added later are read
+};
+
+// bytes at the end of the file the first kTailNew poll reads, looking for the
+// last line break; only lines after it are read later
+static const size_t	kTailFindEndBytes = 64 * 1024;
+
+// most records one poll reads; the rest is left for the next poll
+static const size_t	kTailMaxRecords = 10000;
+
+// most records the actor holds waiting for the record output
+static const size_t	kTailMaxWaiting = 100000;
+
+// longest line kept as a record; the rest of a longer line is dropped
+static const size_t	kTailMaxLineLength = 1024 * 1024;
+
+// one line of the file, without its line break, and the values of the plan's
+// JSON pointers in it when there are any
+struct TailRecord
+{
+	TailRecord() : mHasValues(false) {}
+
+	std::string		mText;
+	bool			mHasValues;
+	JsonValue		mValues[kJsonMaxPointers];
+};
+
+// ---------------------------------------------------------------------------------
+//	TailResult
+// ---------------------------------------------------------------------------------
+//	The kFetchResultTail result. The actor only takes it if mStart is still its
+//	offset for mURL, so a poll that overlapped another adds nothing twice.
+
+struct TailResult : public FetchResult
+{
+	TailResult() : mStart(0), mEnd(0)		{ mKind = kFetchResultTail; }
+
+	std::string					mURL;
+	ULONGLONG					mStart;			// offset the poll asked from
+	ULONGLONG					mEnd;			// offset after the last record; 0 when the file was truncated
+	std::vector<TailRecord>		mRecords;
+};
+
+// ---------------------------------------------------------------------------------
+//	TailFetchJob
+// ---------------------------------------------------------------------------------
+//	Polls inRequest from byte inOffset and posts a TailResult, then a status
+//	line. With inFindEnd set the poll only finds where the last line of the
+//	file starts.
+
+class TailFetchJob : public FetchJob
+{
+public:
+	// inPlan may be NULL; its JSON pointers are read from every record
+	TailFetchJob(
+		FetchInbox*		inInbox,
+		FetchPriority	inPriority,
+		const HttpRequest&	inRequest,
+		ResponsePlan*		inPlan,
+		ULONGLONG		inOffset,
+		bool			inFindEnd);
+
+	virtual ~TailFetchJob();
+
+	virtual void	Run();
+
+private:
+	HttpRequest			mRequest;
+	ResponsePlan*		mPlan;
+	ULONGLONG			mOffset;
+	bool				mFindEnd;
+};
+
+// ---------------------------------------------------------------------------------
+//	MjpegStreamJob
+// ---------------------------------------------------------------------------------
+//	Reads the MJPEG stream at inRequest into inStream, submitting an
+//	MjpegDecodeJob whenever a part arrives with no decoder running. Runs on a
+//	stream thread (see SubmitStreamJob) until the stream is stopped, which
+//	cancels the request, or the response ends. Posts OK once the stream is
+//	open, and a status line if it ends without being stopped.
+
+class MjpegStreamJob : public FetchJob
+{
+public:
+	MjpegStreamJob(
+		FetchInbox*		inInbox,
+		FetchPriority	inPriority,
+		const HttpRequest&	inRequest,
+		MjpegStream*	inStream);
+
+	virtual ~MjpegStreamJob();
+
+	virtual void	Run();
+
+private:
+	friend class MjpegSink;
+
+	HttpRequest		mRequest;
+	MjpegStream*	mStream;
+};
+
+// ---------------------------------------------------------------------------------
+//	SseStreamJob
+// ---------------------------------------------------------------------------------
+//	Reads the event stream at inRequest into inSubscription, on a stream
+//	thread, until the subscription is stopped, which cancels the request. A
+//	dropped connection, or a 5xx response, is retried after the server's retry
+//	time with Last-Event-ID set; any other response that is not an event
+//	stream ends the subscription. Posts OK on each connect and a status line
+//	on each disconnect.
+
+class SseStreamJob : public FetchJob
+{
+public:
+	// inPlan may be NULL; its JSON pointers are read from every event's data
+	SseStreamJob(
+		FetchInbox*		inInbox,
+		FetchPriority	inPriority,
+		const HttpRequest&	inRequest,
+		ResponsePlan*		inPlan,
+		SseSubscription*	inSubscription);
+
+	virtual ~SseStreamJob();
+
+	virtual void	Run();
+
+private:
+	friend class SseSink;
+
+	HttpRequest			mRequest;
+	ResponsePlan*		mPlan;
+	SseSubscription*	mSubscription;
+};
+
+// ---------------------------------------------------------------------------------
+//	WebSocketJob
+// ---------------------------------------------------------------------------------
+//	Opens the WebSocket at inRequest and reads it into inSession's ring, on a
+//	stream thread, until the session is stopped, which aborts the socket, or
+//	the socket closes. Submits a WebSocketSendJob if messages were queued
+//	before the socket opened. Posts OK once the socket is open, and a status
+//	line if it closes without being stopped.
+
+class WebSocketJob : public FetchJob
+{
+public:
+	// inPlan may be NULL; its JSON pointers are read from every text message
+	WebSocketJob(
+		FetchInbox*		inInbox,
+		FetchPriority	inPriority,
+		const HttpRequest&	inRequest,
+		ResponsePlan*		inPlan,
+		WebSocketSession*	inSession);
+
+	virtual ~WebSocketJob();
+
+	virtual void	Run();
+
+private:
+	HttpRequest			mRequest;
+	ResponsePlan*		mPlan;
+	WebSocketSession*	mSession;
+};
+
+// ---------------------------------------------------------------------------------
+//	WebSocketSendJob
+// ---------------------------------------------------------------------------------
+//	Sends the messages queued on inSession, oldest first, until none is
+//	waiting, and posts a status line if one cannot be sent.
+
+class WebSocketSendJob : public FetchJob
+{
+public:
+	WebSocketSendJob(FetchInbox* inInbox, FetchPriority inPriority, WebSocketSession* inSession);
+
+	virtual ~WebSocketSendJob();
+
+	virtual void	Run();
+
+private:
+	WebSocketSession*	mSession;
+};
+
+// ---------------------------------------------------------------------------------
+//	MjpegDecodeJob
+// ---------------------------------------------------------------------------------
+//	Decodes the newest part of inStream into its frames until no part is
+//	waiting, and posts a status line when parts stop decoding.
+
+class MjpegDecodeJob : public FetchJob
+{
+public:
+	MjpegDecodeJob(FetchInbox* inInbox, FetchPriority inPriority, MjpegStream* inStream);
+
+	virtual ~MjpegDecodeJob();
+
+	virtual void	Run();
+
+private:
+	MjpegStream*	mStream;
+};
+
+// ---------------------------------------------------------------------------------
+//	FetchBatch
+// ---------------------------------------------------------------------------------
+//	Shared state for one trigger of a URL list. Every URL is a separate
+//	BatchItemJob so the list is spread across the whole pool, and the batch
+//	collects their responses.
+//
+//	Each response is posted as a kFetchResultBatchItem as soon as it arrives.
+//	When the last one is in, or when the deadline passes first, a single
+//	kFetchResultBatch holding a JSON array of all responses is posted; entries
+//	that missed the deadline are null. After that the batch is finished and any
+//	late responses are dropped.
+//
+//	Each response is read with the actor's ResponsePlan like a single one. In
+//	a mode that extracts values, the results extracted from a response are
+//	posted together, just before its item, and the item and the array hold
+//	its status line instead of the text.
+//
+//	Only requests that may run in parallel and in any order are batched; the
+//	actor sends a list of POSTs etc. through its HttpChannel instead.
+
+class FetchBatch
+{
+public:
+	// inDeadlineMs of 0 waits for every response
+	FetchBatch(
+		FetchInbox*		inInbox,
+		size_t			inCount,
+		DWORD			inDeadlineMs);
+
+	void	AddRef();
+	void	Release();
+
+	bool	IsFinished();
+
+	// records the response for the zero-based inIndex, and posts ioResults,
+	// the values extracted from it, just before its item. Takes ownership of
+	// the results and empties ioResults. Called from the workers.
+	void	Complete(size_t inIndex, const std::string& inText, std::vector<FetchResult*>& ioResults);
+
+	// ends the batch if its deadline has passed. Called on each frame tick.
+	void	CheckDeadline(DWORD inNow);
+
+	// ends the batch without posting anything, e.g. when it is replaced by a new trigger
+	void	Abandon();
+
+private:
+	~FetchBatch();
+
+	FetchBatch(const FetchBatch&);
+	FetchBatch& operator=(const FetchBatch&);
+
+	// posts the combined array; must be called with mLock held
+	void	PostCombined();
+
+	volatile LONG				mRefCount;
+	CRITICAL_SECTION			mLock;
+	FetchInbox*					mInbox;
+	std::vector<std::string>	mTexts;
+	std::vector<bool>			mDone;
+	size_t						mRemaining;
+	bool						mFinished;
+	DWORD						mStartTick;
+	DWORD						mDeadlineMs;
+};
+
+// ---------------------------------------------------------------------------------
+//	BatchItemJob
+// ---------------------------------------------------------------------------------
+//	Sends the request for one URL of a FetchBatch and reads the response with
+//	the plan, gathering what it posts until the batch takes it.
+
+class BatchItemJob : public ResponseJob
+{
+public:
+	// inPlan may be NULL; the job holds a reference while it runs
+	BatchItemJob(
+		FetchBatch*		inBatch,
+		FetchInbox*		inInbox,
+		FetchPriority	inPriority,
+		size_t			inIndex,
+		const HttpRequest&	inRequest,
+		ResponsePlan*		inPlan);
+
+	virtual ~BatchItemJob();
+
+	virtual void	Run();
+
+protected:
+	virtual void	Post(FetchResult* inResult);
+
+private:
+	FetchBatch*		mBatch;
+	size_t			mIndex;
+	HttpRequest		mRequest;
+	ResponsePlan*	mPlan;
+	std::string		mStatus;		// the last status posted, the item's text
+	std::vector<FetchResult*>	mResults;	// everything else posted
+};
+
+// ---------------------------------------------------------------------------------
+//	HttpChannel
+// ---------------------------------------------------------------------------------
+//	An ordered queue of requests for one actor, used for methods that change
+//	state on the server (POST, PUT, ...). Those must arrive in the order they
+//	were triggered, so rather than one job per request the channel runs a
+//	single ChannelJob at a time, which sends everything queued back to back
+//	over the session's kept-alive connection until the queue is empty.
+//
+//	(WinHTTP does not offer HTTP/1.1 pipelining, so this is the closest thing:
+//	no reconnects and no gaps between requests, while still getting a response
+//	for each one.)
+//
+//	The queue holds at most kHttpChannelMaxPending requests. When a slow server
+//	lets it fill up, the oldest queued request is dropped to make room.
+
+static const size_t	kHttpChannelMaxPending = 64;
+
+class HttpChannel
+{
+public:
+	HttpChannel(FetchInbox* inInbox);
+
+	void	AddRef();
+	void	Release();
+
+	// queues inRequest and, if no ChannelJob is running, submits one
+	void	Send(const HttpRequest& inRequest, FetchPriority inPriority);
+
+	// the plan applied to responses from now on; may be NULL
+	void	SetResponsePlan(ResponsePlan* inPlan);
+
+	// called by the running ChannelJob; returns false, and marks the channel
+	// idle, once the queue is empty. outPlan receives a reference to the
+	// current plan, or NULL, which the caller releases.
+	bool	TakeNext(HttpRequest& outRequest, ResponsePlan*& outPlan);
+
+	FetchInbox*	GetInbox() const	{ return mInbox; }
+
+private:
+	~HttpChannel();
+
+	HttpChannel(const HttpChannel&);
+	HttpChannel& operator=(const HttpChannel&);
+
+	volatile LONG				mRefCount;
+	CRITICAL_SECTION			mLock;
+	FetchInbox*					mInbox;
+	std::deque<HttpRequest>		mPending;
+	bool						mRunning;
+	ResponsePlan*				mPlan;
+};
+
+// ---------------------------------------------------------------------------------
+//	ChannelJob
+// ---------------------------------------------------------------------------------
+//	Drains an HttpChannel, posting the response to each request in turn.
+
+class ChannelJob : public ResponseJob
+{
+public:
+	ChannelJob(HttpChannel* inChannel, FetchPriority inPriority);
+	virtual ~ChannelJob();
+
+	virtual void	Run();
+
+private:
+	HttpChannel*	mChannel;
+};
+
+// ---------------------------------------------------------------------------------
+//	ParseURLList
+// ---------------------------------------------------------------------------------
+//	Splits the text of the url_list input into URLs. Accepts either a JSON array
+//	of strings or one URL per line; blank lines and surrounding white space are
+//	ignored. Returns the number of URLs found.
+
+size_t			ParseURLList(const char* inText, std::vector<std::string>& outURLs);
+
+#endif
@@ -0,0 +1,396 @@
+// ===========================================================================
+//	FetchScheduler.cpp
+// ===========================================================================
+//
+//	See FetchScheduler.h for an overview.
+//
+//	This file is compiled as native code (CompileAsManaged is off for it in the
+//	project) so the worker threads never enter the CLR.
+
+#include "FetchScheduler.h"
+
+#include <process.h>
+#include <deque>
+
+// ---------------------------------------------------------------------------------
+// GLOBAL VARIABLES
+// ---------------------------------------------------------------------------------
+// One pool for all instantiations of the plugin. Everything below is guarded by
+// sQueueLock, except sStartCount and sQueueLockReady which are only touched from
+// Isadora's thread. The lock is created by the first Start and never deleted,
+// since a worker that outlived the last Stop still takes it on its way out.
+// Each Start begins a new generation, and a worker leaves once the pool it was
+// started for is gone.
+
+static int						sStartCount = 0;
+static bool						sQueueLockReady = false;
+static LONG						sGeneration = 0;
+static bool						sStopping = false;
+static CRITICAL_SECTION			sQueueLock;
+static CONDITION_VARIABLE		sQueueWake;
+static std::deque<FetchJob*>	sLanes[kFetchPriorityCount];
+static HANDLE					sWorkers[kFetchPoolSize];
+static std::vector<HANDLE>		sStreams;		// threads of the stream jobs, closed once they have ended
+
+// ---------------------------------------------------------------------------------
+//		FetchInbox
+// ---------------------------------------------------------------------------------
+
+FetchInbox::FetchInbox()
+	: mRefCount(1)
+	, mClosed(0)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+FetchInbox::~FetchInbox()
+{
+	for (size_t i = 0; i < mResults.size(); i++) {
+		delete mResults[i];
+	}
+	DeleteCriticalSection(&mLock);
+}
+
+void
+FetchInbox::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+FetchInbox::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+void
+FetchInbox::Close()
+{
+	InterlockedExchange(&mClosed, 1);
+}
+
+bool
+FetchInbox::IsClosed() const
+{
+	return mClosed != 0;
+}
+
+void
+FetchInbox::Post(FetchResult* inResult)
+{
+	if (IsClosed()) {
+		delete inResult;
+		return;
+	}
+
+	EnterCriticalSection(&mLock);
+	if (mResults.size() >= kFetchInboxMaxResults)
+		Compact();
+	mResults.push_back(inResult);
+	LeaveCriticalSection(&mLock);
+}
+
+// keeps the newest result of each kind and index, at most half the limit of
+// them, in their original order. Must be called with mLock held.
+void
+FetchInbox::Compact()
+{
+	std::vector<FetchResult*> kept;
+	for (size_t i = mResults.size(); i-- > 0; ) {
+		FetchResult* result = mResults[i];
+
+		bool superseded = false;
+		for (size_t k = 0; k < kept.size() && !superseded; k++) {
+			superseded = kept[k]->mKind == result->mKind && kept[k]->mIndex == result->mIndex;
+		}
+
+		if (superseded || kept.size() >= kFetchInboxMaxResults / 2)
+			delete result;
+		else
+			kept.push_back(result);
+	}
+	mResults.assign(kept.rbegin(), kept.rend());
+}
+
+bool
+FetchInbox::Drain(std::vector<FetchResult*>& outResults)
+{
+	EnterCriticalSection(&mLock);
+	bool any = !mResults.empty();
+	if (any) {
+		outResults.insert(outResults.end(), mResults.begin(), mResults.end());
+		mResults.clear();
+	}
+	LeaveCriticalSection(&mLock);
+	return any;
+}
+
+// ---------------------------------------------------------------------------------
+//		FetchJob
+// ---------------------------------------------------------------------------------
+
+FetchJob::FetchJob(
+	FetchInbox*		inInbox,
+	FetchPriority	inPriority)
+	: mInbox(inInbox)
+	, mPriority(inPriority)
+	, mQueuedTick(0)
+{
+	mInbox->AddRef();
+}
+
+FetchJob::~FetchJob()
+{
+	mInbox->Release();
+}
+
+void
+FetchJob::Post(FetchResult* inResult)
+{
+	mInbox->Post(inResult);
+}
+
+// ---------------------------------------------------------------------------------
+//		FetchPriorityFromInt
+// ---------------------------------------------------------------------------------
+
+FetchPriority
+FetchPriorityFromInt(long inValue)
+{
+	if (inValue <= kFetchPriorityBackground)
+		return kFetchPriorityBackground;
+	if (inValue >= kFetchPriorityCue)
+		return kFetchPriorityCue;
+	return static_cast<FetchPriority>(inValue);
+}
+
+// ---------------------------------------------------------------------------------
+//		TakeNextJob
+// ---------------------------------------------------------------------------------
+//	Picks the job to run next. Must be called with sQueueLock held.
+//
+//	Each lane is FIFO, so its head is also its oldest job. The head of every lane
+//	is scored as its lane number plus one for each kFetchAgingStepMs it has been
+//	waiting, and the best score wins. On a tie the higher lane wins, which is why
+//	the lanes are walked from the top down with a strict comparison.
+
+static FetchJob*
+TakeNextJob()
+{
+	DWORD	now = GetTickCount();
+	int		bestLane = -1;
+	DWORD	bestScore = 0;
+
+	for (int lane = kFetchPriorityCount - 1; lane >= 0; lane--) {
+
+		if (sLanes[lane].empty())
+			continue;
+
+		DWORD waited = now - sLanes[lane].front()->GetQueuedTick();
+		DWORD score = static_cast<DWORD>(lane) + waited / kFetchAgingStepMs;
+
+		if (bestLane < 0 || score > bestScore) {
+			bestLane = lane;
+			bestScore = score;
+		}
+	}
+
+	if (bestLane < 0)
+		return NULL;
+
+	FetchJob* job = sLanes[bestLane].front();
+	sLanes[bestLane].pop_front();
+	return job;
+}
+
+// ---------------------------------------------------------------------------------
+//		FetchWorkerMain
+// ---------------------------------------------------------------------------------
+
+static unsigned __stdcall
+FetchWorkerMain(void* inParam)
+{
+	LONG generation = (LONG) (LONG_PTR) inParam;
+
+	for (;;) {
+
+		FetchJob* job = NULL;
+
+		EnterCriticalSection(&sQueueLock);
+		while (generation == sGeneration && !sStopping && (job = TakeNextJob()) == NULL) {
+			SleepConditionVariableCS(&sQueueWake, &sQueueLock, INFINITE);
+		}
+		LeaveCriticalSection(&sQueueLock);
+
+		if (job == NULL)
+			break;
+
+		// the actor may have been disposed while the job was queued
+		if (!job->GetInbox()->IsClosed()) {
+			job->Run();
+		}
+
+		delete job;
+	}
+
+	return 0;
+}
+
+// ---------------------------------------------------------------------------------
+//		FetchStreamMain
+// ---------------------------------------------------------------------------------
+
+static unsigned __stdcall
+FetchStreamMain(void* inParam)
+{
+	FetchJob* job = static_cast<FetchJob*>(inParam);
+
+	if (!job->GetInbox()->IsClosed()) {
+		job->Run();
+	}
+
+	delete job;
+	return 0;
+}
+
+// ---------------------------------------------------------------------------------
+//		WaitForThreads
+// ---------------------------------------------------------------------------------
+//	Waits until inDeadline for every thread in inThreads to end, in groups of
+//	the most WaitForMultipleObjects takes, and closes the handles. Returns false
+//	if one was still running.
+
+static bool
+WaitForThreads(std::vector<HANDLE>& inThreads, DWORD inDeadline)
+{
+	bool ended = true;
+	for (size_t i = 0; i < inThreads.size(); i += MAXIMUM_WAIT_OBJECTS) {
+		size_t count = inThreads.size() - i;
+		if (count > MAXIMUM_WAIT_OBJECTS)
+			count = MAXIMUM_WAIT_OBJECTS;
+
+		LONG left = (LONG) (inDeadline - GetTickCount());
+		if (WaitForMultipleObjects((DWORD) count, &inThreads[i], TRUE, left > 0 ? (DWORD) left : 0) == WAIT_TIMEOUT)
+			ended = false;
+	}
+
+	for (size_t i = 0; i < inThreads.size(); i++) {
+		CloseHandle(inThreads[i]);
+	}
+	inThreads.clear();
+	return ended;
+}
+
+// ---------------------------------------------------------------------------------
+//		StartFetchScheduler
+// ---------------------------------------------------------------------------------
+
+void
+StartFetchScheduler()
+{
+	if (sStartCount++ > 0)
+		return;
+
+	if (!sQueueLockReady) {
+		InitializeCriticalSection(&sQueueLock);
+		InitializeConditionVariable(&sQueueWake);
+		sQueueLockReady = true;
+	}
+
+	EnterCriticalSection(&sQueueLock);
+	sGeneration++;
+	sStopping = false;
+	LeaveCriticalSection(&sQueueLock);
+
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		sWorkers[i] = (HANDLE) _beginthreadex(NULL, 0, FetchWorkerMain, (void*) (LONG_PTR) sGeneration, 0, NULL);
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		StopFetchScheduler
+// ---------------------------------------------------------------------------------
+
+bool
+StopFetchScheduler()
+{
+	if (sStartCount == 0 || --sStartCount > 0)
+		return true;
+
+	// anything still queued belongs to actors that have already been disposed
+	EnterCriticalSection(&sQueueLock);
+	sStopping = true;
+	for (int lane = 0; lane < kFetchPriorityCount; lane++) {
+		while (!sLanes[lane].empty()) {
+			delete sLanes[lane].front();
+			sLanes[lane].pop_front();
+		}
+	}
+	std::vector<HANDLE> threads;
+	threads.swap(sStreams);
+	LeaveCriticalSection(&sQueueLock);
+	WakeAllConditionVariable(&sQueueWake);
+
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		if (sWorkers[i] != NULL)
+			threads.push_back(sWorkers[i]);
+		sWorkers[i] = NULL;
+	}
+
+	return WaitForThreads(threads, GetTickCount() + kFetchStopWaitMs);
+}
+
+// ---------------------------------------------------------------------------------
+//		SubmitFetchJob
+// ---------------------------------------------------------------------------------
+
+void
+SubmitFetchJob(FetchJob* inJob)
+{
+	if (sStartCount == 0) {
+		delete inJob;
+		return;
+	}
+
+	inJob->mQueuedTick = GetTickCount();
+
+	EnterCriticalSection(&sQueueLock);
+	sLanes[inJob->GetPriority()].push_back(inJob);
+	LeaveCriticalSection(&sQueueLock);
+
+	WakeConditionVariable(&sQueueWake);
+}
+
+// ---------------------------------------------------------------------------------
+//		SubmitStreamJob
+// ---------------------------------------------------------------------------------
+
+void
+SubmitStreamJob(FetchJob* inJob)
+{
+	if (sStartCount == 0) {
+		delete inJob;
+		return;
+	}
+
+	inJob->mQueuedTick = GetTickCount();
+
+	HANDLE thread = (HANDLE) _beginthreadex(NULL, 0, FetchStreamMain, inJob, 0, NULL);
+	if (thread == NULL) {
+		delete inJob;
+		return;
+	}
+
+	// the threads of streams that have ended are closed as new ones start
+	EnterCriticalSection(&sQueueLock);
+	for (size_t i = sStreams.size(); i-- > 0; ) {
+		if (WaitForSingleObject(sStreams[i], 0) == WAIT_OBJECT_0) {
+			CloseHandle(sStreams[i]);
+			sStreams.erase(sStreams.begin() + i);
+		}
+	}
+	sStreams.push_back(thread);
+	LeaveCriticalSection(&sQueueLock);
+}
@@ -0,0 +1,204 @@
+// ===========================================================================
+//	FetchScheduler.h
+// ===========================================================================
+//
+//	A small pool of worker threads shared by every instance of the actor.
+//
+//	Actors never talk to the network on Isadora's thread. Instead they wrap the
+//	work in a FetchJob and hand it to SubmitFetchJob. The job waits in one of the
+//	priority lanes until a worker is free, runs on that worker, and posts its
+//	FetchResult into the FetchInbox of the actor that submitted it. The actor
+//	drains its inbox from ReceiveMessage on the next video frame tick.
+//
+//	The number of workers is also the number of requests that can be on the
+//	wire at once, so when the pool is saturated the order in which queued jobs
+//	leave the lanes decides what the audience sees first.
+//
+//	Streams that stay open for as long as the actor wants them, such as MJPEG,
+//	SSE and WebSocket connections, would each hold a worker for good and
+//	starve the lanes. They go to SubmitStreamJob instead, which runs every job
+//	on a thread of its own, outside the pool.
+
+#ifndef FETCHSCHEDULER_H
+#define FETCHSCHEDULER_H
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------
+//	Constants
+// ---------------------------------------------------------------------------------
+
+// number of worker threads, i.e. the number of requests that may run concurrently
+static const int	kFetchPoolSize = 8;
+
+// a queued job is treated as one lane higher for every kFetchAgingStepMs it has
+// waited, so a steady stream of cue fetches can never starve background polling
+static const DWORD	kFetchAgingStepMs = 250;
+
+// longest the last StopFetchScheduler waits, on Isadora's thread, for the
+// workers to finish their current jobs
+static const DWORD	kFetchStopWaitMs = 3000;
+
+// results an inbox holds before it starts dropping older ones, see FetchInbox
+static const size_t	kFetchInboxMaxResults = 256;
+
+// ---------------------------------------------------------------------------------
+//	FetchPriority
+// ---------------------------------------------------------------------------------
+//	The scheduler lanes. Values match the actor's "priority" input.
+
+enum FetchPriority
+{
+	kFetchPriorityBackground = 0,		// polling refreshes, nobody is waiting on them
+	kFetchPriorityNormal,				// the default
+	kFetchPriorityCue,					// cue-triggered fetches that drive visible media
+
+	kFetchPriorityCount
+};
+
+// ---------------------------------------------------------------------------------
+//	FetchResult
+// ---------------------------------------------------------------------------------
+//	The outcome of one job, handed back to the actor that submitted it.
+
+enum FetchResultKind
+{
+	kFetchResultStatus = 0,				// mText goes to the status output
+	kFetchResultBatchItem,				// one response of a batch, mIndex is its one-based position
+	kFetchResultBatch,					// mText is the combined JSON array of a whole batch
+	kFetchResultField,					// a value extracted from a JSON response, mIndex is its one-based field
+	kFetchResultPoints,					// a GeoJsonResult holding the points of a GeoJSON response
+	kFetchResultRows,					// a CsvRowsResult holding rows of a CSV response
+	kFetchResultTail,					// a TailResult holding the lines added to a file
+	kFetchResultChanges,				// mText is the changes since the last JSON response, mNumber their count
+	kFetchResultImage					// an ImageResult holding a decoded frame for the video output
+};
+
+struct FetchResult
+{
+	FetchResult() : mKind(kFetchResultStatus), mIndex(0), mNumber(0) {}
+	virtual ~FetchResult() {}
+
+	FetchResultKind	mKind;
+	long			mIndex;
+	std::string		mText;
+	double			mNumber;			// numeric value of a kFetchResultField
+};
+
+// ---------------------------------------------------------------------------------
+//	FetchInbox
+// ---------------------------------------------------------------------------------
+//	Each actor owns one inbox. Workers post finished results into it, and the
+//	actor drains it on the video frame tick so that output properties are only
+//	ever set from Isadora's own thread.
+//
+//	The inbox is reference counted. Every queued or running job holds a
+//	reference, which lets an actor be disposed while its requests are in flight.
+//
+//	Nothing drains the inbox while the actor's scene is inactive, yet streams
+//	and batches keep posting. Once kFetchInboxMaxResults are waiting, only the
+//	newest result of each kind and index is kept, which is all the outputs
+//	would have shown; if that is still too many, the oldest go.
+
+class FetchInbox
+{
+public:
+	FetchInbox();
+
+	void	AddRef();
+	void	Release();
+
+	// called when the owning actor is disposed; queued jobs are then dropped
+	// without running, and results from running jobs are discarded
+	void	Close();
+	bool	IsClosed() const;
+
+	// takes ownership of inResult
+	void	Post(FetchResult* inResult);
+
+	// moves every waiting result into outResults, oldest first. The caller takes
+	// ownership of the results. Returns false if nothing was waiting.
+	bool	Drain(std::vector<FetchResult*>& outResults);
+
+private:
+	~FetchInbox();
+
+	FetchInbox(const FetchInbox&);
+	FetchInbox& operator=(const FetchInbox&);
+
+	void	Compact();
+
+	volatile LONG				mRefCount;
+	volatile LONG				mClosed;
+	CRITICAL_SECTION			mLock;
+	std::vector<FetchResult*>	mResults;
+};
+
+// ---------------------------------------------------------------------------------
+//	FetchJob
+// ---------------------------------------------------------------------------------
+//	Base class for a unit of work run on the pool. Subclasses implement Run,
+//	which is called on a worker thread and must not call back into Isadora.
+
+class FetchJob
+{
+public:
+	FetchJob(FetchInbox* inInbox, FetchPriority inPriority);
+	virtual ~FetchJob();
+
+	virtual void	Run() = 0;
+
+	FetchInbox*		GetInbox() const		{ return mInbox; }
+	FetchPriority	GetPriority() const		{ return mPriority; }
+	DWORD			GetQueuedTick() const	{ return mQueuedTick; }
+
+protected:
+	// takes ownership of inResult. Jobs whose results belong to something
+	// larger, such as one URL of a batch, gather them here instead.
+	virtual void	Post(FetchResult* inResult);
+
+private:
+	friend void		SubmitFetchJob(FetchJob* inJob);
+	friend void		SubmitStreamJob(FetchJob* inJob);
+
+	FetchJob(const FetchJob&);
+	FetchJob& operator=(const FetchJob&);
+
+	FetchInbox*		mInbox;
+	FetchPriority	mPriority;
+	DWORD			mQueuedTick;
+};
+
+// ---------------------------------------------------------------------------------
+//	Scheduler
+// ---------------------------------------------------------------------------------
+//	StartFetchScheduler and StopFetchScheduler are reference counted: each actor
+//	calls Start from CreateActor and Stop from DisposeActor. The pool is created
+//	by the first Start and torn down by the last Stop, which waits up to
+//	kFetchStopWaitMs for the workers to finish their current job and for the
+//	stream threads to end. Stop the transport first, so no thread is left
+//	waiting on the network. A thread still busy after the wait is left to
+//	finish on its own and then exits. All four functions must be called from
+//	Isadora's thread.
+
+void	StartFetchScheduler();
+
+// returns false if a worker was still busy when the wait ran out
+bool	StopFetchScheduler();
+
+// queues inJob in the lane given by its priority. The scheduler takes ownership.
+void	SubmitFetchJob(FetchJob* inJob);
+
+// runs inJob on a new thread of its own, for a job that lasts until its actor
+// stops it. The job must end soon after its stream is stopped or the transport
+// is. The scheduler takes ownership.
+void	SubmitStreamJob(FetchJob* inJob);
+
+// clamps an arbitrary integer, e.g. the value of the actor's priority input,
+// into a valid lane
+FetchPriority	FetchPriorityFromInt(long inValue);
+
+#endif
@@ -0,0 +1,396 @@
+// ===========================================================================
+//	GeoJson.cpp
+// ===========================================================================
+
+#include "GeoJson.h"
+#include "JsonCursor.h"
+
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		GeoJsonPoints
+// ---------------------------------------------------------------------------------
+
+void
+GeoJsonPoints::Clear()
+{
+	mLongitude.clear();
+	mLatitude.clear();
+	mElevation.clear();
+	mFeature.clear();
+	for (int i = 0; i < kGeoJsonMaxProperties; i++) {
+		mProperty[i].clear();
+	}
+}
+
+void
+GeoJsonPoints::Swap(GeoJsonPoints& ioOther)
+{
+	mLongitude.swap(ioOther.mLongitude);
+	mLatitude.swap(ioOther.mLatitude);
+	mElevation.swap(ioOther.mElevation);
+	mFeature.swap(ioOther.mFeature);
+	for (int i = 0; i < kGeoJsonMaxProperties; i++) {
+		mProperty[i].swap(ioOther.mProperty[i]);
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		ParseGeoJsonPropertyList
+// ---------------------------------------------------------------------------------
+
+void
+ParseGeoJsonPropertyList(const char* inText, std::string outNames[kGeoJsonMaxProperties])
+{
+	for (int i = 0; i < kGeoJsonMaxProperties; i++) {
+		outNames[i].clear();
+	}
+
+	const char* p = inText;
+	for (int i = 0; i < kGeoJsonMaxProperties && *p != '\0'; i++) {
+
+		while (*p == ' ' || *p == '\t')
+			p++;
+		const char* start = p;
+		while (*p != '\0' && *p != ',')
+			p++;
+		const char* end = p;
+		while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+			end--;
+
+		outNames[i].assign(start, end);
+		if (*p == ',')
+			p++;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		GeoJsonScanner
+// ---------------------------------------------------------------------------------
+//	Reads only "features", "geometry", "coordinates", "geometries" and the
+//	requested members of "properties"; every other member is skipped. The
+//	positions of a feature are gathered first and written out together with its
+//	property values once the feature closes, since GeoJSON does not fix the
+//	order of "geometry" and "properties".
+
+class GeoJsonScanner : public JsonCursor
+{
+public:
+	GeoJsonScanner(
+		const char*			inText,
+		size_t				inLength,
+		const std::string*	inProperties,
+		GeoJsonPoints&		outPoints);
+
+	bool	Run(std::string& outError);
+
+private:
+	bool	ParseFeature(bool inRoot);
+	bool	ParseFeatures();
+	bool	ParseGeometry(int inDepth);
+	bool	ParseGeometries(int inDepth);
+	bool	ParseCoordinates(int inDepth);
+	bool	ParseProperties();
+	void	AddFeaturePoints();
+
+	const std::string*	mPropertyNames;
+	GeoJsonPoints&		mPoints;
+	long				mFeature;
+	std::vector<float>	mPositions;							// x, y, z of each position of the current feature
+	float				mValues[kGeoJsonMaxProperties];		// property values of the current feature
+};
+
+GeoJsonScanner::GeoJsonScanner(
+	const char*			inText,
+	size_t				inLength,
+	const std::string*	inProperties,
+	GeoJsonPoints&		outPoints)
+	: JsonCursor(inText, inLength)
+	, mPropertyNames(inProperties)
+	, mPoints(outPoints)
+	, mFeature(0)
+{
+}
+
+bool
+GeoJsonScanner::Run(std::string& outError)
+{
+	mPoints.Clear();
+
+	bool ok = SkipSpace();
+	if (ok) {
+		ok = Peek() == '{' ? ParseFeature(true) : Fail("expected a GeoJSON object");
+	}
+	if (ok && SkipSpace())
+		ok = Fail("unexpected text after the value");
+
+	if (!ok) {
+		FormatError(outError);
+		mPoints.Clear();
+	}
+	return ok;
+}
+
+// a Feature, or at the root also a FeatureCollection
+bool
+GeoJsonScanner::ParseFeature(bool inRoot)
+{
+	if (!SkipSpace())
+		return false;
+	if (Peek() != '{')
+		return SkipValue();
+
+	mPositions.clear();
+	for (int i = 0; i < kGeoJsonMaxProperties; i++) {
+		mValues[i] = 0;
+	}
+
+	bool more;
+	if (!EnterObject(more))
+		return false;
+
+	while (more) {
+
+		const char* key;
+		size_t keyLength;
+		if (!ReadMemberName(key, keyLength))
+			return false;
+
+		bool ok;
+		if (JsonKeyIs(key, keyLength, "geometry"))
+			ok = ParseGeometry(0);
+		else if (JsonKeyIs(key, keyLength, "properties"))
+			ok = ParseProperties();
+		else if (inRoot && JsonKeyIs(key, keyLength, "features"))
+			ok = ParseFeatures();
+		else
+			ok = SkipValue();
+
+		if (!ok || !NextMember(more))
+			return false;
+	}
+
+	if (!inRoot || !mPositions.empty()) {
+		AddFeaturePoints();
+		mFeature++;
+	}
+	return true;
+}
+
+bool
+GeoJsonScanner::ParseFeatures()
+{
+	if (!SkipSpace())
+		return false;
+	if (Peek() != '[')
+		return SkipValue();
+
+	bool more;
+	if (!EnterArray(more))
+		return false;
+
+	while (more) {
+		if (!ParseFeature(false) || !NextElement(more))
+			return false;
+	}
+	return true;
+}
+
+bool
+GeoJsonScanner::ParseGeometry(int inDepth)
+{
+	if (inDepth > kJsonMaxDepth)
+		return Fail("nested too deeply");
+	if (!SkipSpace())
+		return false;
+	if (Peek() != '{')
+		return SkipValue();
+
+	bool more;
+	if (!EnterObject(more))
+		return false;
+
+	while (more) {
+
+		const char* key;
+		size_t keyLength;
+		if (!ReadMemberName(key, keyLength))
+			return false;
+
+		bool ok;
+		if (JsonKeyIs(key, keyLength, "coordinates")) {
+			ok = ParseCoordinates(inDepth);
+		}
+		else if (JsonKeyIs(key, keyLength, "geometries")) {
+			ok = ParseGeometries(inDepth);
+		}
+		else {
+			ok = SkipValue();
+		}
+
+		if (!ok || !NextMember(more))
+			return false;
+	}
+	return true;
+}
+
+// the members of a GeometryCollection each add their positions
+bool
+GeoJsonScanner::ParseGeometries(int inDepth)
+{
+	if (!SkipSpace())
+		return false;
+	if (Peek() != '[')
+		return SkipValue();
+
+	bool more;
+	if (!EnterArray(more))
+		return false;
+
+	while (more) {
+		if (!ParseGeometry(inDepth + 1) || !NextElement(more))
+			return false;
+	}
+	return true;
+}
+
+// a position is an array of numbers; anything else nests positions
+bool
+GeoJsonScanner::ParseCoordinates(int inDepth)
+{
+	if (inDepth > kJsonMaxDepth)
+		return Fail("nested too deeply");
+	if (!SkipSpace())
+		return false;
+	if (Peek() != '[')
+		return SkipValue();
+
+	bool more;
+	if (!EnterArray(more))
+		return false;
+	if (!more)
+		return true;
+
+	if (!SkipSpace())
+		return false;
+
+	if (Peek() == '[') {
+		while (more) {
+			if (!ParseCoordinates(inDepth + 1) || !NextElement(more))
+				return false;
+		}
+		return true;
+	}
+
+	double position[3] = { 0, 0, 0 };
+	int count = 0;
+	while (more) {
+
+		if (!SkipSpace())
+			return false;
+
+		bool ok;
+		if (Peek() == '-' || (Peek() >= '0' && Peek() <= '9')) {
+			double value;
+			ok = ReadNumber(value);
+			if (count < 3)
+				position[count] = value;
+			count++;
+		}
+		else {
+			ok = SkipValue();
+		}
+
+		if (!ok || !NextElement(more))
+			return false;
+	}
+
+	if (count >= 2) {
+		mPositions.push_back(static_cast<float>(position[0]));
+		mPositions.push_back(static_cast<float>(position[1]));
+		mPositions.push_back(static_cast<float>(position[2]));
+	}
+	return true;
+}
+
+bool
+GeoJsonScanner::ParseProperties()
+{
+	if (!SkipSpace())
+		return false;
+	if (Peek() != '{')
+		return SkipValue();
+
+	bool more;
+	if (!EnterObject(more))
+		return false;
+
+	while (more) {
+
+		const char* key;
+		size_t keyLength;
+		if (!ReadMemberName(key, keyLength))
+			return false;
+
+		int column = -1;
+		for (int i = 0; i < kGeoJsonMaxProperties; i++) {
+			const std::string& name = mPropertyNames[i];
+			if (!name.empty() && name.length() == keyLength && memcmp(name.data(), key, keyLength) == 0) {
+				column = i;
+				break;
+			}
+		}
+
+		bool ok = SkipSpace();
+		if (ok) {
+			char c = Peek();
+			if (column >= 0 && (c == '-' || (c >= '0' && c <= '9'))) {
+				double value;
+				ok = ReadNumber(value);
+				mValues[column] = static_cast<float>(value);
+			}
+			else if (column >= 0 && c == 't') {
+				ok = ParseLiteral("true", 4);
+				mValues[column] = 1;
+			}
+			else {
+				ok = SkipValue();
+			}
+		}
+
+		if (!ok || !NextMember(more))
+			return false;
+	}
+	return true;
+}
+
+void
+GeoJsonScanner::AddFeaturePoints()
+{
+	for (size_t i = 0; i + 2 < mPositions.size(); i += 3) {
+		mPoints.mLongitude.push_back(mPositions[i]);
+		mPoints.mLatitude.push_back(mPositions[i + 1]);
+		mPoints.mElevation.push_back(mPositions[i + 2]);
+		mPoints.mFeature.push_back(mFeature);
+		for (int k = 0; k < kGeoJsonMaxProperties; k++) {
+			mPoints.mProperty[k].push_back(mValues[k]);
+		}
+	}
+	mPositions.clear();
+}
+
+// ---------------------------------------------------------------------------------
+//		ExtractGeoJsonPoints
+// ---------------------------------------------------------------------------------
+
+bool
+ExtractGeoJsonPoints(
+	const char*			inText,
+	size_t				inLength,
+	const std::string	inProperties[kGeoJsonMaxProperties],
+	GeoJsonPoints&		outPoints,
+	std::string&		outError)
+{
+	GeoJsonScanner scanner(inText, inLength, inProperties, outPoints);
+	return scanner.Run(outError);
+}
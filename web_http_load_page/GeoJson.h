@@ -0,0 +1,66 @@
+// ===========================================================================
+//	GeoJson.h
+// ===========================================================================
+//
+//	Bulk extraction of points from a GeoJSON FeatureCollection, such as the
+//	USGS earthquake feeds.
+//
+//	Every position of every feature's geometry becomes one point. A Point
+//	feature gives one point; LineStrings, Polygons and the Multi- types give
+//	one point per position. The points are stored as structure-of-arrays:
+//	one packed float column each for longitude, latitude and elevation, plus
+//	one column for each requested numeric property of the feature a point
+//	belongs to. The worker fills the columns in a single pass over the text,
+//	stepping over everything else, and the actor then reads any point by index
+//	in constant time on every frame without touching the text again.
+
+#ifndef GEOJSON_H
+#define GEOJSON_H
+
+#include <string>
+#include <vector>
+
+// number of property columns the actor can request
+static const int	kGeoJsonMaxProperties = 4;
+
+// ---------------------------------------------------------------------------------
+//	GeoJsonPoints
+// ---------------------------------------------------------------------------------
+
+struct GeoJsonPoints
+{
+	size_t	Count() const		{ return mLongitude.size(); }
+	void	Clear();
+	void	Swap(GeoJsonPoints& ioOther);
+
+	std::vector<float>	mLongitude;
+	std::vector<float>	mLatitude;
+	std::vector<float>	mElevation;						// 0 where a position has no third value
+	std::vector<long>	mFeature;						// zero-based index of each point's feature
+	std::vector<float>	mProperty[kGeoJsonMaxProperties];	// 0 where a property is missing or not a number
+};
+
+// ---------------------------------------------------------------------------------
+//	ParseGeoJsonPropertyList
+// ---------------------------------------------------------------------------------
+//	Splits a comma separated list of property names, e.g. "mag, depth", into
+//	at most kGeoJsonMaxProperties names. Unused entries are left empty.
+
+void	ParseGeoJsonPropertyList(const char* inText, std::string outNames[kGeoJsonMaxProperties]);
+
+// ---------------------------------------------------------------------------------
+//	ExtractGeoJsonPoints
+// ---------------------------------------------------------------------------------
+//	Fills outPoints from inText, which may be a FeatureCollection or a single
+//	Feature. inProperties names the property for each column; an empty name
+//	leaves that column at 0. Returns false with a description in outError if
+//	the text is not valid JSON.
+
+bool	ExtractGeoJsonPoints(
+			const char*			inText,
+			size_t				inLength,
+			const std::string	inProperties[kGeoJsonMaxProperties],
+			GeoJsonPoints&		outPoints,
+			std::string&		outError);
+
+#endif
@@ -0,0 +1,1131 @@
+// ===========================================================================
+//	HttpTransport.cpp
+// ===========================================================================
+//
+//	See HttpTransport.h for an overview. WinHTTP is used in synchronous mode;
+//	every call here blocks and is made from a FetchScheduler worker.
+
+#include "HttpTransport.h"
+
+#include <winhttp.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#pragma comment(lib, "winhttp.lib")
+
+// ---------------------------------------------------------------------------------
+// GLOBAL VARIABLES
+// ---------------------------------------------------------------------------------
+
+// sSession and sInFlight are guarded by sTransportLock, which is created by the
+// first Start and never deleted, since a worker may still be finishing a
+// request after the last Stop.
+
+static int						sTransportStartCount = 0;
+static bool						sTransportLockReady = false;
+static CRITICAL_SECTION			sTransportLock;
+static HINTERNET				sSession = NULL;
+static std::vector<HttpCancel*>	sInFlight;		// the requests being sent
+
+// ---------------------------------------------------------------------------------
+//		String helpers
+// ---------------------------------------------------------------------------------
+
+static std::wstring
+UTF8ToWide(const std::string& inText)
+{
+	if (inText.empty())
+		return std::wstring();
+
+	int len = MultiByteToWideChar(CP_UTF8, 0, inText.c_str(), (int) inText.length(), NULL, 0);
+	std::wstring out(len, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, inText.c_str(), (int) inText.length(), &out[0], len);
+	return out;
+}
+
+static std::string
+WideToUTF8(const wchar_t* inText, size_t inLength)
+{
+	if (inLength == 0)
+		return std::string();
+
+	int len = WideCharToMultiByte(CP_UTF8, 0, inText, (int) inLength, NULL, 0, NULL, NULL);
+	std::string out(len, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, inText, (int) inLength, &out[0], len, NULL, NULL);
+	return out;
+}
+
+static std::string
+ErrorText(const char* inWhere, DWORD inError)
+{
+	char buf[96];
+	_snprintf(buf, sizeof(buf), "ERROR: %s failed (%lu)", inWhere, (unsigned long) inError);
+	buf[sizeof(buf) - 1] = '\0';
+	return buf;
+}
+
+static std::string
+ErrorText(const char* inWhere)
+{
+	return ErrorText(inWhere, GetLastError());
+}
+
+// splits inURL into what WinHttpConnect and WinHttpOpenRequest take
+static bool
+CrackURL(const std::string& inURL, std::wstring& outHost, INTERNET_PORT& outPort, std::wstring& outPath, bool& outSecure)
+{
+	std::wstring url = UTF8ToWide(inURL);
+
+	URL_COMPONENTS parts;
+	memset(&parts, 0, sizeof(parts));
+	parts.dwStructSize = sizeof(parts);
+	parts.dwSchemeLength = (DWORD) -1;
+	parts.dwHostNameLength = (DWORD) -1;
+	parts.dwUrlPathLength = (DWORD) -1;
+	parts.dwExtraInfoLength = (DWORD) -1;
+
+	if (url.empty() || !WinHttpCrackUrl(url.c_str(), (DWORD) url.length(), 0, &parts))
+		return false;
+
+	outHost.assign(parts.lpszHostName, parts.dwHostNameLength);
+	outPath.assign(parts.lpszUrlPath, parts.dwUrlPathLength);
+	outPath.append(parts.lpszExtraInfo, parts.dwExtraInfoLength);
+	if (outPath.empty())
+		outPath = L"/";
+	outPort = parts.nPort;
+	outSecure = parts.nScheme == INTERNET_SCHEME_HTTPS;
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpBody
+// ---------------------------------------------------------------------------------
+
+HttpBody::HttpBody()
+	: mRefCount(1)
+	, mLength(0)
+	, mFile(INVALID_HANDLE_VALUE)
+	, mMapping(NULL)
+	, mView(NULL)
+	, mViewLength(0)
+{
+}
+
+HttpBody::~HttpBody()
+{
+	Unmap();
+}
+
+void
+HttpBody::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+HttpBody::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+void
+HttpBody::Assign(const char* inData, size_t inLength)
+{
+	Unmap();
+
+	// only ever grows, so a steady stream of similar sized bodies settles on
+	// one allocation
+	if (mBuffer.size() < inLength) {
+		mBuffer.resize(inLength);
+	}
+	if (inLength > 0) {
+		memcpy(&mBuffer[0], inData, inLength);
+	}
+	mLength = inLength;
+}
+
+void
+HttpBody::Append(const char* inData, size_t inLength)
+{
+	size_t needed = mLength + inLength;
+	if (mBuffer.size() < needed) {
+		size_t grown = mBuffer.size() * 2;
+		mBuffer.resize(grown > needed ? grown : needed);
+	}
+	if (inLength > 0) {
+		memcpy(&mBuffer[mLength], inData, inLength);
+	}
+	mLength = needed;
+}
+
+bool
+HttpBody::MapFile(const char* inPath)
+{
+	Clear();
+
+	mFile = CreateFileA(inPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart > (LONGLONG) kHttpMaxMappedBody) {
+		Unmap();
+		return false;
+	}
+
+	// an empty file cannot be mapped, but it is a perfectly good empty body
+	if (size.QuadPart == 0)
+		return true;
+
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping != NULL) {
+		mView = (const char*) MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (mView == NULL) {
+		Unmap();
+		return false;
+	}
+
+	mViewLength = (size_t) size.QuadPart;
+	return true;
+}
+
+void
+HttpBody::Clear()
+{
+	Unmap();
+	mLength = 0;
+}
+
+void
+HttpBody::Unmap()
+{
+	if (mView != NULL) {
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+	if (mMapping != NULL) {
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+	if (mFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+	mViewLength = 0;
+}
+
+const char*
+HttpBody::Data() const
+{
+	if (mView != NULL)
+		return mView;
+	return mLength > 0 ? &mBuffer[0] : NULL;
+}
+
+size_t
+HttpBody::Length() const
+{
+	return mView != NULL ? mViewLength : mLength;
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpRequest
+// ---------------------------------------------------------------------------------
+
+HttpRequest::HttpRequest()
+	: mBody(NULL)
+	, mReceiveTimeoutMs(0)
+{
+}
+
+HttpRequest::HttpRequest(const HttpRequest& inOther)
+	: mURL(inOther.mURL)
+	, mMethod(inOther.mMethod)
+	, mContentType(inOther.mContentType)
+	, mHeaders(inOther.mHeaders)
+	, mBody(NULL)
+	, mReceiveTimeoutMs(inOther.mReceiveTimeoutMs)
+{
+	SetBody(inOther.mBody);
+}
+
+HttpRequest&
+HttpRequest::operator=(const HttpRequest& inOther)
+{
+	if (this != &inOther) {
+		mURL = inOther.mURL;
+		mMethod = inOther.mMethod;
+		mContentType = inOther.mContentType;
+		mHeaders = inOther.mHeaders;
+		SetBody(inOther.mBody);
+		mReceiveTimeoutMs = inOther.mReceiveTimeoutMs;
+	}
+	return *this;
+}
+
+HttpRequest::~HttpRequest()
+{
+	SetBody(NULL);
+}
+
+void
+HttpRequest::SetBody(HttpBody* inBody)
+{
+	if (inBody != NULL)
+		inBody->AddRef();
+	if (mBody != NULL)
+		mBody->Release();
+	mBody = inBody;
+}
+
+bool
+HttpRequest::IsIdempotentRead() const
+{
+	return mMethod.empty()
+		|| _stricmp(mMethod.c_str(), "GET") == 0
+		|| _stricmp(mMethod.c_str(), "HEAD") == 0;
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpCancel
+// ---------------------------------------------------------------------------------
+
+HttpCancel::HttpCancel()
+	: mRequest(NULL)
+	, mCalls(0)
+	, mCancelled(0)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+HttpCancel::~HttpCancel()
+{
+	DeleteCriticalSection(&mLock);
+}
+
+void
+HttpCancel::Cancel()
+{
+	EnterCriticalSection(&mLock);
+	InterlockedExchange(&mCancelled, 1);
+	if (mRequest != NULL && mCalls > 0) {
+		WinHttpCloseHandle(mRequest);
+		mRequest = NULL;
+	}
+	LeaveCriticalSection(&mLock);
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpCall
+// ---------------------------------------------------------------------------------
+//	Ties the request handle HttpSend is using to an HttpCancel, and lists it in
+//	sInFlight so the last StopHttpTransport can cancel it. Every WinHTTP call on
+//	the handle goes between Begin and End.
+
+class HttpCall
+{
+public:
+	explicit HttpCall(HttpCancel& ioCancel) : mCancel(ioCancel), mAttached(false) {}
+	~HttpCall()								{ Close(); }
+
+	// takes ownership of inRequest. Called with sTransportLock held.
+	void		Attach(HINTERNET inRequest);
+
+	// returns the handle to make one call with, or NULL if the request was
+	// cancelled and the call must not be made
+	HINTERNET	Begin();
+	void		End();
+
+	// closes the request, unless Cancel did, and takes it off sInFlight
+	void		Close();
+
+private:
+	HttpCall(const HttpCall&);
+	HttpCall& operator=(const HttpCall&);
+
+	HttpCancel&	mCancel;
+	bool		mAttached;
+};
+
+void
+HttpCall::Close()
+{
+	if (!mAttached)
+		return;
+	mAttached = false;
+
+	// the handle is gone already if Cancel closed it
+	EnterCriticalSection(&mCancel.mLock);
+	HINTERNET request = mCancel.mRequest;
+	mCancel.mRequest = NULL;
+	LeaveCriticalSection(&mCancel.mLock);
+
+	if (request != NULL)
+		WinHttpCloseHandle(request);
+
+	EnterCriticalSection(&sTransportLock);
+	for (size_t i = 0; i < sInFlight.size(); i++) {
+		if (sInFlight[i] == &mCancel) {
+			sInFlight.erase(sInFlight.begin() + i);
+			break;
+		}
+	}
+	LeaveCriticalSection(&sTransportLock);
+}
+
+void
+HttpCall::Attach(HINTERNET inRequest)
+{
+	sInFlight.push_back(&mCancel);
+
+	EnterCriticalSection(&mCancel.mLock);
+	mCancel.mRequest = inRequest;
+	mCancel.mCalls = 0;
+	LeaveCriticalSection(&mCancel.mLock);
+
+	mAttached = true;
+}
+
+HINTERNET
+HttpCall::Begin()
+{
+	EnterCriticalSection(&mCancel.mLock);
+	HINTERNET request = mCancel.IsCancelled() ? NULL : mCancel.mRequest;
+	if (request != NULL)
+		mCancel.mCalls++;
+	LeaveCriticalSection(&mCancel.mLock);
+
+	return request;
+}
+
+void
+HttpCall::End()
+{
+	EnterCriticalSection(&mCancel.mLock);
+	mCancel.mCalls--;
+	LeaveCriticalSection(&mCancel.mLock);
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpResponseSink
+// ---------------------------------------------------------------------------------
+
+bool
+HttpResponseSink::OnHeaders(DWORD /* inStatus */, const std::string& /* inHeaders */)
+{
+	return true;
+}
+
+// collects the body into an HttpResponse
+class HttpBufferSink : public HttpResponseSink
+{
+public:
+	HttpBufferSink(HttpResponse& ioResponse) : mResponse(ioResponse) {}
+
+	virtual bool OnHeaders(DWORD inStatus, const std::string& inHeaders)
+	{
+		mResponse.mStatus = inStatus;
+		mResponse.mHeaders = inHeaders;
+
+		// size the body once when the server tells us how big it is
+		std::string length = HttpHeaderValue(inHeaders, "Content-Length");
+		if (!length.empty()) {
+			unsigned long n = strtoul(length.c_str(), NULL, 10);
+			if (n > 0 && n < kHttpMaxMappedBody)
+				mResponse.mBody.reserve(n);
+		}
+		return true;
+	}
+
+	virtual bool OnData(const char* inData, size_t inLength)
+	{
+		mResponse.mBody.append(inData, inLength);
+		return true;
+	}
+
+private:
+	HttpBufferSink& operator=(const HttpBufferSink&);
+
+	HttpResponse&	mResponse;
+};
+
+// ---------------------------------------------------------------------------------
+//		StartHttpTransport / StopHttpTransport
+// ---------------------------------------------------------------------------------
+
+void
+StartHttpTransport()
+{
+	if (sTransportStartCount++ > 0)
+		return;
+
+	if (!sTransportLockReady) {
+		InitializeCriticalSection(&sTransportLock);
+		sTransportLockReady = true;
+	}
+
+	HINTERNET session = WinHttpOpen(
+		L"web_http_load_page/1.0",
+		WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+		WINHTTP_NO_PROXY_NAME,
+		WINHTTP_NO_PROXY_BYPASS,
+		0);
+	if (session != NULL)
+		WinHttpSetTimeouts(session, kHttpResolveTimeoutMs, kHttpConnectTimeoutMs, kHttpSendTimeoutMs, kHttpReceiveTimeoutMs);
+
+	EnterCriticalSection(&sTransportLock);
+	sSession = session;
+	LeaveCriticalSection(&sTransportLock);
+}
+
+void
+StopHttpTransport()
+{
+	if (sTransportStartCount == 0 || --sTransportStartCount > 0)
+		return;
+
+	// requests still in flight return at once, and new ones find no session
+	EnterCriticalSection(&sTransportLock);
+	for (size_t i = 0; i < sInFlight.size(); i++) {
+		sInFlight[i]->Cancel();
+	}
+	if (sSession != NULL) {
+		WinHttpCloseHandle(sSession);
+		sSession = NULL;
+	}
+	LeaveCriticalSection(&sTransportLock);
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpSend
+// ---------------------------------------------------------------------------------
+
+bool
+HttpSend(const HttpRequest& inRequest, HttpResponse& outResponse)
+{
+	HttpBufferSink sink(outResponse);
+	return HttpSend(inRequest, sink, outResponse.mError);
+}
+
+bool
+HttpSend(const HttpRequest& inRequest, HttpResponseSink& ioSink, std::string& outError)
+{
+	return HttpSend(inRequest, ioSink, outError, NULL);
+}
+
+bool
+HttpSend(const HttpRequest& inRequest, HttpResponseSink& ioSink, std::string& outError, HttpCancel* ioCancel)
+{
+	static const char* kCancelled = "ERROR: the request was cancelled";
+
+	HttpCancel ownCancel;
+	HttpCancel& cancel = ioCancel != NULL ? *ioCancel : ownCancel;
+	if (cancel.IsCancelled()) {
+		outError = kCancelled;
+		return false;
+	}
+
+	std::wstring host;
+	std::wstring path;
+	INTERNET_PORT port;
+	bool secure;
+	if (!CrackURL(inRequest.mURL, host, port, path, secure)) {
+		outError = "ERROR: invalid URL";
+		return false;
+	}
+
+	std::wstring method = inRequest.mMethod.empty() ? std::wstring(L"GET") : UTF8ToWide(inRequest.mMethod);
+
+	const char*	body = inRequest.mBody != NULL ? inRequest.mBody->Data() : NULL;
+	DWORD		bodyLength = inRequest.mBody != NULL ? (DWORD) inRequest.mBody->Length() : 0;
+
+	std::string headers = inRequest.mHeaders;
+	if (bodyLength > 0 && !inRequest.mContentType.empty()) {
+		headers += "Content-Type: ";
+		headers += inRequest.mContentType;
+		headers += "\r\n";
+	}
+	std::wstring wheaders = UTF8ToWide(headers);
+
+	// the handles are made under the lock, so StopHttpTransport either finds the
+	// request in sInFlight or this finds no session. Neither call goes to the
+	// network, and the session pools the underlying sockets, so they are cheap.
+	HttpCall call(cancel);
+	HINTERNET connect = NULL;
+	HINTERNET request = NULL;
+
+	EnterCriticalSection(&sTransportLock);
+	if (sSession == NULL) {
+		outError = "ERROR: no HTTP session";
+	}
+	else if ((connect = WinHttpConnect(sSession, host.c_str(), port, 0)) == NULL) {
+		outError = ErrorText("WinHttpConnect");
+	}
+	else if ((request = WinHttpOpenRequest(
+		connect,
+		method.c_str(),
+		path.c_str(),
+		NULL,
+		WINHTTP_NO_REFERER,
+		WINHTTP_DEFAULT_ACCEPT_TYPES,
+		secure ? WINHTTP_FLAG_SECURE : 0)) == NULL) {
+		outError = ErrorText("WinHttpOpenRequest");
+	}
+	else {
+		call.Attach(request);
+	}
+	LeaveCriticalSection(&sTransportLock);
+
+	if (request == NULL) {
+		if (connect != NULL)
+			WinHttpCloseHandle(connect);
+		return false;
+	}
+
+	// from here on the request handle is only used between Begin and End
+	bool ok = false;
+	HINTERNET h;
+	BOOL done;
+
+	if (inRequest.mReceiveTimeoutMs != 0 && (h = call.Begin()) != NULL) {
+		DWORD timeout = inRequest.mReceiveTimeoutMs;
+		WinHttpSetOption(h, WINHTTP_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
+		call.End();
+	}
+
+	if ((h = call.Begin()) == NULL) {
+		outError = kCancelled;
+	}
+	else {
+		done = WinHttpSendRequest(
+			h,
+			wheaders.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : wheaders.c_str(),
+			wheaders.empty() ? 0 : (DWORD) -1,
+			WINHTTP_NO_REQUEST_DATA,
+			0,
+			bodyLength,
+			0);
+		if (!done)
+			outError = cancel.IsCancelled() ? std::string(kCancelled) : ErrorText("WinHttpSendRequest");
+		call.End();
+		ok = done != FALSE;
+	}
+
+	// stream the body from wherever it lives
+	for (DWORD offset = 0; ok && offset < bodyLength; ) {
+		DWORD chunk = bodyLength - offset < kHttpChunkSize ? bodyLength - offset : kHttpChunkSize;
+		DWORD written = 0;
+		if ((h = call.Begin()) == NULL) {
+			outError = kCancelled;
+			ok = false;
+			break;
+		}
+		done = WinHttpWriteData(h, body + offset, chunk, &written);
+		if (!done || written == 0) {
+			outError = cancel.IsCancelled() ? std::string(kCancelled) : ErrorText("WinHttpWriteData");
+			ok = false;
+		}
+		call.End();
+		offset += written;
+	}
+
+	if (ok) {
+		if ((h = call.Begin()) == NULL) {
+			outError = kCancelled;
+			ok = false;
+		}
+		else {
+			if (!WinHttpReceiveResponse(h, NULL)) {
+				outError = cancel.IsCancelled() ? std::string(kCancelled) : ErrorText("WinHttpReceiveResponse");
+				ok = false;
+			}
+			call.End();
+		}
+	}
+
+	DWORD status = 0;
+	std::string rawHeaders;
+	if (ok) {
+		if ((h = call.Begin()) == NULL) {
+			outError = kCancelled;
+			ok = false;
+		}
+		else {
+			DWORD size = sizeof(status);
+			WinHttpQueryHeaders(h, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+				WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX);
+
+			size = 0;
+			WinHttpQueryHeaders(h, WINHTTP_QUERY_RAW_HEADERS_CRLF,
+				WINHTTP_HEADER_NAME_BY_INDEX, WINHTTP_NO_OUTPUT_BUFFER, &size, WINHTTP_NO_HEADER_INDEX);
+			if (GetLastError() == ERROR_INSUFFICIENT_BUFFER && size > 0) {
+				std::vector<wchar_t> buf(size / sizeof(wchar_t) + 1);
+				if (WinHttpQueryHeaders(h, WINHTTP_QUERY_RAW_HEADERS_CRLF,
+					WINHTTP_HEADER_NAME_BY_INDEX, &buf[0], &size, WINHTTP_NO_HEADER_INDEX)) {
+					rawHeaders = WideToUTF8(&buf[0], size / sizeof(wchar_t));
+				}
+			}
+			call.End();
+		}
+	}
+
+	if (ok && ioSink.OnHeaders(status, rawHeaders)) {
+		std::vector<char> chunk(kHttpChunkSize);
+		for (;;) {
+			DWORD read = 0;
+			if ((h = call.Begin()) == NULL) {
+				outError = kCancelled;
+				ok = false;
+				break;
+			}
+			done = WinHttpReadData(h, &chunk[0], kHttpChunkSize, &read);
+			if (!done)
+				outError = cancel.IsCancelled() ? std::string(kCancelled) : ErrorText("WinHttpReadData");
+			call.End();
+
+			if (!done) {
+				ok = false;
+				break;
+			}
+			if (read == 0 || !ioSink.OnData(&chunk[0], read))
+				break;
+		}
+	}
+
+	// the request closes before its connection
+	call.Close();
+	WinHttpCloseHandle(connect);
+
+	return ok;
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpHeaderValue
+// ---------------------------------------------------------------------------------
+
+std::string
+HttpHeaderValue(const std::string& inHeaders, const char* inName)
+{
+	size_t nameLength = strlen(inName);
+	size_t line = 0;
+
+	while (line < inHeaders.length()) {
+
+		size_t end = inHeaders.find("\r\n", line);
+		if (end == std::string::npos)
+			end = inHeaders.length();
+
+		if (end - line > nameLength
+			&& inHeaders[line + nameLength] == ':'
+			&& _strnicmp(inHeaders.c_str() + line, inName, nameLength) == 0) {
+
+			size_t value = line + nameLength + 1;
+			while (value < end && (inHeaders[value] == ' ' || inHeaders[value] == '\t'))
+				value++;
+			return inHeaders.substr(value, end - value);
+		}
+
+		line = end + 2;
+	}
+
+	return std::string();
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpResponseText
+// ---------------------------------------------------------------------------------
+
+static UINT
+CodePageForCharset(const std::string& inContentType)
+{
+	static const struct { const char* mName; UINT mCodePage; } kCharsets[] = {
+		{ "iso-8859-1",		28591 },
+		{ "latin1",			28591 },
+		{ "iso-8859-15",	28605 },
+		{ "windows-1252",	1252 },
+		{ "windows-1251",	1251 },
+		{ "shift_jis",		932 },
+		{ "gb2312",			936 },
+		{ "big5",			950 },
+		{ "euc-kr",			949 },
+	};
+
+	std::string type(inContentType);
+	for (size_t i = 0; i < type.length(); i++)
+		type[i] = (char) tolower((unsigned char) type[i]);
+
+	size_t at = type.find("charset=");
+	if (at == std::string::npos)
+		return CP_UTF8;
+
+	std::string charset = type.substr(at + 8);
+	size_t end = charset.find_first_of("; \"");
+	if (end == 0 && charset[0] == '"') {
+		charset = charset.substr(1);
+		end = charset.find('"');
+	}
+	if (end != std::string::npos)
+		charset.resize(end);
+
+	for (size_t i = 0; i < sizeof(kCharsets) / sizeof(kCharsets[0]); i++) {
+		if (_stricmp(charset.c_str(), kCharsets[i].mName) == 0)
+			return kCharsets[i].mCodePage;
+	}
+	return CP_UTF8;
+}
+
+std::string
+HttpResponseText(const HttpResponse& inResponse)
+{
+	UINT codePage = CodePageForCharset(HttpHeaderValue(inResponse.mHeaders, "Content-Type"));
+	if (codePage == CP_UTF8 || inResponse.mBody.empty())
+		return inResponse.mBody;
+
+	const std::string& body = inResponse.mBody;
+	int len = MultiByteToWideChar(codePage, 0, body.c_str(), (int) body.length(), NULL, 0);
+	if (len <= 0)
+		return body;
+
+	std::vector<wchar_t> wide(len);
+	MultiByteToWideChar(codePage, 0, body.c_str(), (int) body.length(), &wide[0], len);
+	return WideToUTF8(&wide[0], len);
+}
+
+// ---------------------------------------------------------------------------------
+//		WebSocket calls
+// ---------------------------------------------------------------------------------
+//	The WinHttpWebSocket calls are only in the winhttp.dll of Windows 8 and
+//	later, so they are looked up rather than linked, and the plugin still loads
+//	on Windows 7. The values are those of winhttp.h in the Windows 8 SDK, so
+//	an older SDK builds this too.
+
+static const DWORD	kWebSocketUpgradeOption = 114;		// WINHTTP_OPTION_UPGRADE_TO_WEB_SOCKET
+static const USHORT	kWebSocketCloseStatus = 1000;		// WINHTTP_WEB_SOCKET_SUCCESS_CLOSE_STATUS
+
+// WINHTTP_WEB_SOCKET_BUFFER_TYPE
+enum WebSocketBufferType
+{
+	kWebSocketBinaryMessage = 0,
+	kWebSocketBinaryFragment,
+	kWebSocketUTF8Message,
+	kWebSocketUTF8Fragment,
+	kWebSocketClose
+};
+
+typedef HINTERNET	(WINAPI *WebSocketCompleteUpgradeProc)(HINTERNET, DWORD_PTR);
+typedef DWORD		(WINAPI *WebSocketSendProc)(HINTERNET, WebSocketBufferType, PVOID, DWORD);
+typedef DWORD		(WINAPI *WebSocketReceiveProc)(HINTERNET, PVOID, DWORD, DWORD*, WebSocketBufferType*);
+typedef DWORD		(WINAPI *WebSocketCloseProc)(HINTERNET, USHORT, PVOID, DWORD);
+
+// looked up once, under sTransportLock, by the first Open
+static bool							sWebSocketLookedUp = false;
+static WebSocketCompleteUpgradeProc	sWebSocketCompleteUpgrade = NULL;
+static WebSocketSendProc			sWebSocketSend = NULL;
+static WebSocketReceiveProc			sWebSocketReceive = NULL;
+static WebSocketCloseProc			sWebSocketClose = NULL;
+static WebSocketCloseProc			sWebSocketShutdown = NULL;
+
+// returns false if this Windows has no WebSocket calls. Called with
+// sTransportLock held.
+static bool
+LookUpWebSocketCalls()
+{
+	if (!sWebSocketLookedUp) {
+		sWebSocketLookedUp = true;
+
+		HMODULE winhttp = GetModuleHandleA("winhttp.dll");
+		if (winhttp != NULL) {
+			sWebSocketCompleteUpgrade = (WebSocketCompleteUpgradeProc) GetProcAddress(winhttp, "WinHttpWebSocketCompleteUpgrade");
+			sWebSocketSend = (WebSocketSendProc) GetProcAddress(winhttp, "WinHttpWebSocketSend");
+			sWebSocketReceive = (WebSocketReceiveProc) GetProcAddress(winhttp, "WinHttpWebSocketReceive");
+			sWebSocketClose = (WebSocketCloseProc) GetProcAddress(winhttp, "WinHttpWebSocketClose");
+			sWebSocketShutdown = (WebSocketCloseProc) GetProcAddress(winhttp, "WinHttpWebSocketShutdown");
+		}
+	}
+
+	return sWebSocketCompleteUpgrade != NULL && sWebSocketSend != NULL && sWebSocketReceive != NULL
+		&& sWebSocketClose != NULL && sWebSocketShutdown != NULL;
+}
+
+// ---------------------------------------------------------------------------------
+//		HttpWebSocket
+// ---------------------------------------------------------------------------------
+
+HttpWebSocket::HttpWebSocket()
+	: mConnect(NULL)
+	, mSocket(NULL)
+	, mCalls(0)
+	, mClosing(false)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+HttpWebSocket::~HttpWebSocket()
+{
+	Abort();
+	if (mConnect != NULL)
+		WinHttpCloseHandle(mConnect);
+	DeleteCriticalSection(&mLock);
+}
+
+bool
+HttpWebSocket::Open(const HttpRequest& inRequest, std::string& outError)
+{
+	// WinHTTP only knows the http schemes; the upgrade is the same over either
+	std::string url = inRequest.mURL;
+	if (_strnicmp(url.c_str(), "ws://", 5) == 0)
+		url.replace(0, 2, "http");
+	else if (_strnicmp(url.c_str(), "wss://", 6) == 0)
+		url.replace(0, 3, "https");
+
+	std::wstring host;
+	std::wstring path;
+	INTERNET_PORT port;
+	bool secure;
+	if (!CrackURL(url, host, port, path, secure)) {
+		outError = "ERROR: invalid URL";
+		return false;
+	}
+
+	std::wstring wheaders = UTF8ToWide(inRequest.mHeaders);
+
+	// the upgrade request is made and used as in HttpSend, so Abort and
+	// StopHttpTransport can cancel it
+	HttpCall call(mOpening);
+	HINTERNET request = NULL;
+
+	EnterCriticalSection(&sTransportLock);
+	if (!LookUpWebSocketCalls()) {
+		outError = "ERROR: WebSocket needs Windows 8";
+	}
+	else if (sSession == NULL) {
+		outError = "ERROR: no HTTP session";
+	}
+	else if ((mConnect = WinHttpConnect(sSession, host.c_str(), port, 0)) == NULL) {
+		outError = ErrorText("WinHttpConnect");
+	}
+	else if ((request = WinHttpOpenRequest(
+		mConnect,
+		L"GET",
+		path.c_str(),
+		NULL,
+		WINHTTP_NO_REFERER,
+		WINHTTP_DEFAULT_ACCEPT_TYPES,
+		secure ? WINHTTP_FLAG_SECURE : 0)) == NULL) {
+		outError = ErrorText("WinHttpOpenRequest");
+	}
+	else {
+		call.Attach(request);
+	}
+	LeaveCriticalSection(&sTransportLock);
+
+	if (request == NULL)
+		return false;
+
+	// from here on the request handle is only used between Begin and End; a
+	// NULL from Begin means the upgrade was cancelled
+	bool ok = false;
+	HINTERNET h;
+
+	if ((h = call.Begin()) != NULL) {
+		ok = WinHttpSetOption(h, kWebSocketUpgradeOption, NULL, 0) != FALSE;
+		if (!ok)
+			outError = ErrorText("WinHttpSetOption");
+		call.End();
+	}
+
+	if (ok && (h = call.Begin()) == NULL) {
+		ok = false;
+	}
+	else if (ok) {
+		ok = WinHttpSendRequest(
+			h,
+			wheaders.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : wheaders.c_str(),
+			wheaders.empty() ? 0 : (DWORD) -1,
+			WINHTTP_NO_REQUEST_DATA,
+			0,
+			0,
+			0) != FALSE;
+		if (!ok)
+			outError = ErrorText("WinHttpSendRequest");
+		call.End();
+	}
+
+	if (ok && (h = call.Begin()) == NULL) {
+		ok = false;
+	}
+	else if (ok) {
+		ok = WinHttpReceiveResponse(h, NULL) != FALSE;
+		if (!ok)
+			outError = ErrorText("WinHttpReceiveResponse");
+		call.End();
+	}
+
+	HINTERNET socket = NULL;
+	if (ok && (h = call.Begin()) == NULL) {
+		ok = false;
+	}
+	else if (ok) {
+		DWORD status = 0;
+		DWORD size = sizeof(status);
+		WinHttpQueryHeaders(h, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+			WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX);
+
+		if (status != 101) {
+			char buf[64];
+			_snprintf(buf, sizeof(buf), "ERROR: HTTP %lu", (unsigned long) status);
+			buf[sizeof(buf) - 1] = '\0';
+			outError = buf;
+			ok = false;
+		}
+		else {
+			socket = sWebSocketCompleteUpgrade(h, 0);
+			if (socket == NULL) {
+				outError = ErrorText("WinHttpWebSocketCompleteUpgrade");
+				ok = false;
+			}
+		}
+		call.End();
+	}
+
+	// the socket lives on without the request
+	call.Close();
+
+	// an Abort that came during the upgrade leaves the socket to be closed here
+	if (socket != NULL) {
+		EnterCriticalSection(&mLock);
+		bool closing = mClosing;
+		if (!closing)
+			mSocket = socket;
+		LeaveCriticalSection(&mLock);
+
+		if (closing) {
+			WinHttpCloseHandle(socket);
+			ok = false;
+		}
+	}
+
+	if (!ok && mOpening.IsCancelled())
+		outError = "ERROR: the WebSocket was closed while opening";
+	return ok;
+}
+
+void*
+HttpWebSocket::BeginCall()
+{
+	EnterCriticalSection(&mLock);
+	HINTERNET socket = mClosing ? NULL : mSocket;
+	if (socket != NULL)
+		mCalls++;
+	LeaveCriticalSection(&mLock);
+
+	return socket;
+}
+
+bool
+HttpWebSocket::EndCall()
+{
+	EnterCriticalSection(&mLock);
+	bool closing = mClosing;
+	HINTERNET socket = NULL;
+	if (--mCalls == 0 && closing) {
+		socket = mSocket;
+		mSocket = NULL;
+	}
+	LeaveCriticalSection(&mLock);
+
+	if (socket != NULL)
+		WinHttpCloseHandle(socket);
+	return !closing;
+}
+
+bool
+HttpWebSocket::Send(const char* inData, size_t inLength, bool inBinary, std::string& outError)
+{
+	HINTERNET socket = BeginCall();
+	if (socket == NULL) {
+		outError = "ERROR: the WebSocket is closed";
+		return false;
+	}
+
+	DWORD error = sWebSocketSend(
+		socket,
+		inBinary ? kWebSocketBinaryMessage : kWebSocketUTF8Message,
+		(PVOID) inData,
+		(DWORD) inLength);
+	bool open = EndCall();
+	if (error != NO_ERROR) {
+		outError = open ? ErrorText("WinHttpWebSocketSend", error) : std::string("ERROR: the WebSocket is closed");
+		return false;
+	}
+	return true;
+}
+
+bool
+HttpWebSocket::Receive(std::string& outMessage, bool& outBinary, size_t inMaxLength, std::string& outError)
+{
+	outMessage.clear();
+	outBinary = false;
+
+	char chunk[16 * 1024];
+	for (;;) {
+		HINTERNET socket = BeginCall();
+		if (socket == NULL)
+			return false;
+
+		DWORD read = 0;
+		WebSocketBufferType type = kWebSocketClose;
+		DWORD error = sWebSocketReceive(socket, chunk, sizeof(chunk), &read, &type);
+
+		// answer the server's close frame to finish the handshake; after an
+		// Abort it is the answer to ours
+		if (error == NO_ERROR && type == kWebSocketClose)
+			sWebSocketClose(socket, kWebSocketCloseStatus, NULL, 0);
+
+		bool open = EndCall();
+		if (error != NO_ERROR) {
+			if (open)
+				outError = ErrorText("WinHttpWebSocketReceive", error);
+			return false;
+		}
+		if (type == kWebSocketClose)
+			return false;
+
+		if (outMessage.length() < inMaxLength)
+			outMessage.append(chunk, read < inMaxLength - outMessage.length() ? read : inMaxLength - outMessage.length());
+
+		outBinary = type == kWebSocketBinaryMessage || type == kWebSocketBinaryFragment;
+		if (type == kWebSocketBinaryMessage || type == kWebSocketUTF8Message)
+			return true;
+	}
+}
+
+void
+HttpWebSocket::Abort()
+{
+	mOpening.Cancel();
+
+	// with a call in progress the socket is shut down under it, Abort holding
+	// a call of its own meanwhile, and the last call to end closes it
+	EnterCriticalSection(&mLock);
+	mClosing = true;
+	HINTERNET socket = mSocket;
+	bool busy = socket != NULL && mCalls > 0;
+	if (busy)
+		mCalls++;
+	else
+		mSocket = NULL;
+	LeaveCriticalSection(&mLock);
+
+	if (busy) {
+		sWebSocketShutdown(socket, kWebSocketCloseStatus, NULL, 0);
+		EndCall();
+	}
+	else if (socket != NULL) {
+		WinHttpCloseHandle(socket);
+	}
+}
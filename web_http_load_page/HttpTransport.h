@@ -0,0 +1,278 @@
+// ===========================================================================
+//	HttpTransport.h
+// ===========================================================================
+//
+//	A thin layer over WinHTTP used by every job that talks to the network.
+//
+//	All requests go through one WinHTTP session shared by every instance of the
+//	actor, so WinHTTP keeps connections to a host alive between requests and
+//	reuses them instead of reconnecting (and, for https, renegotiating TLS) on
+//	every trigger.
+//
+//	Request bodies are never copied: an HttpBody is either a reusable heap
+//	buffer or a read-only mapping of a file, and it is written to the socket in
+//	chunks straight from that memory.
+//
+//	Responses can be collected into an HttpResponse, or streamed to an
+//	HttpResponseSink as they arrive for modes that want to look at the data
+//	before the whole body is in.
+
+#ifndef HTTPTRANSPORT_H
+#define HTTPTRANSPORT_H
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------
+//	Constants
+// ---------------------------------------------------------------------------------
+
+// size of each WinHttpWriteData / WinHttpReadData call
+static const DWORD	kHttpChunkSize = 64 * 1024;
+
+// largest file accepted for body_file. The whole file is mapped at once, which
+// is bounded by the 32-bit address space of the plugin.
+static const size_t	kHttpMaxMappedBody = 512 * 1024 * 1024;
+
+// timeouts of the shared session. WinHTTP's own default never gives up on name
+// resolution.
+static const int	kHttpResolveTimeoutMs = 10000;
+static const int	kHttpConnectTimeoutMs = 10000;
+static const int	kHttpSendTimeoutMs = 30000;
+static const int	kHttpReceiveTimeoutMs = 30000;
+
+// receive timeout for a response kept open as a stream, which may go quiet for
+// a long time. Streams are stopped with an HttpCancel rather than by timing out;
+// this only notices a connection that died without closing.
+static const DWORD	kHttpStreamReceiveTimeoutMs = 10 * 60 * 1000;
+
+// ---------------------------------------------------------------------------------
+//	HttpBody
+// ---------------------------------------------------------------------------------
+//	A reference counted request body. Jobs keep a reference while their request
+//	is in flight, which is what lets the actor reuse the buffer: when nothing
+//	else holds the body (IsShared returns false) Assign overwrites it in place
+//	without reallocating; otherwise the actor starts a new one.
+
+class HttpBody
+{
+public:
+	HttpBody();
+
+	void		AddRef();
+	void		Release();
+
+	// true if a job still holds a reference. Only meaningful on Isadora's
+	// thread, which is the only one that adds references.
+	bool		IsShared() const		{ return mRefCount > 1; }
+
+	// copies inLength bytes into the buffer, reusing its capacity
+	void		Assign(const char* inData, size_t inLength);
+
+	// adds inLength bytes after the current contents. Only for buffer bodies.
+	void		Append(const char* inData, size_t inLength);
+
+	// maps inPath read-only and uses the file's contents as the body. Returns
+	// false, leaving the body empty, if the file cannot be mapped.
+	bool		MapFile(const char* inPath);
+
+	// drops the buffer contents or the mapping
+	void		Clear();
+
+	const char*	Data() const;
+	size_t		Length() const;
+
+private:
+	~HttpBody();
+
+	HttpBody(const HttpBody&);
+	HttpBody& operator=(const HttpBody&);
+
+	void		Unmap();
+
+	volatile LONG		mRefCount;
+	std::vector<char>	mBuffer;
+	size_t				mLength;
+	HANDLE				mFile;
+	HANDLE				mMapping;
+	const char*			mView;
+	size_t				mViewLength;
+};
+
+// ---------------------------------------------------------------------------------
+//	HttpRequest
+// ---------------------------------------------------------------------------------
+//	Everything needed to send one request. Copies share the body.
+
+struct HttpRequest
+{
+	HttpRequest();
+	HttpRequest(const HttpRequest& inOther);
+	HttpRequest& operator=(const HttpRequest& inOther);
+	~HttpRequest();
+
+	// takes a reference to inBody, which may be NULL
+	void			SetBody(HttpBody* inBody);
+
+	// true for methods that are safe to send in parallel and in any order
+	bool			IsIdempotentRead() const;
+
+	std::string		mURL;
+	std::string		mMethod;			// "GET" when empty
+	std::string		mContentType;		// sent only when there is a body
+	std::string		mHeaders;			// extra header lines, each ending in "\r\n"
+	HttpBody*		mBody;				// may be NULL
+	DWORD			mReceiveTimeoutMs;	// 0 for the session's
+};
+
+// ---------------------------------------------------------------------------------
+//	HttpCancel
+// ---------------------------------------------------------------------------------
+//	Lets another thread stop a request that is blocked in WinHTTP, e.g. a stream
+//	the actor closes. Cancel closes the request handle if a WinHTTP call on it
+//	is in flight, which makes that call fail at once; otherwise the sending
+//	thread sees the flag before its next call and closes the handle itself, so
+//	the handle is never used after it is closed. Once cancelled, an HttpSend
+//	given the same HttpCancel fails at once.
+
+class HttpCancel
+{
+public:
+	HttpCancel();
+	~HttpCancel();
+
+	// may be called from any thread, and more than once
+	void	Cancel();
+	bool	IsCancelled() const				{ return mCancelled != 0; }
+
+private:
+	friend class HttpCall;
+
+	HttpCancel(const HttpCancel&);
+	HttpCancel& operator=(const HttpCancel&);
+
+	CRITICAL_SECTION	mLock;
+	void*				mRequest;			// the request being sent, NULL once Cancel closed it
+	int					mCalls;				// WinHTTP calls on mRequest in flight
+	volatile LONG		mCancelled;
+};
+
+// ---------------------------------------------------------------------------------
+//	HttpResponseSink
+// ---------------------------------------------------------------------------------
+//	Receives a response as it streams in. Returning false from either call
+//	stops reading and closes the request.
+
+class HttpResponseSink
+{
+public:
+	virtual ~HttpResponseSink() {}
+
+	virtual bool	OnHeaders(DWORD inStatus, const std::string& inHeaders);
+	virtual bool	OnData(const char* inData, size_t inLength) = 0;
+};
+
+// ---------------------------------------------------------------------------------
+//	HttpResponse
+// ---------------------------------------------------------------------------------
+
+struct HttpResponse
+{
+	HttpResponse() : mStatus(0) {}
+
+	DWORD			mStatus;			// HTTP status code, 0 if no response arrived
+	std::string		mHeaders;			// raw header block, CRLF separated
+	std::string		mBody;				// raw body bytes
+	std::string		mError;				// set when the request failed
+};
+
+// ---------------------------------------------------------------------------------
+//	Transport
+// ---------------------------------------------------------------------------------
+//	StartHttpTransport and StopHttpTransport are reference counted like the
+//	FetchScheduler; the shared session lives from the first Start to the last
+//	Stop. The last Stop cancels every request still in flight, so workers blocked
+//	in WinHTTP return promptly, and later requests fail with an error.
+
+void	StartHttpTransport();
+void	StopHttpTransport();
+
+// sends inRequest and collects the whole response. Returns false on failure,
+// with the reason in outResponse.mError.
+bool	HttpSend(const HttpRequest& inRequest, HttpResponse& outResponse);
+
+// sends inRequest and streams the response to ioSink. Returns false on a
+// transport failure, with the reason in outError; a sink that stops early is
+// not a failure.
+bool	HttpSend(const HttpRequest& inRequest, HttpResponseSink& ioSink, std::string& outError);
+
+// the same, stopping when ioCancel is cancelled. A cancelled request returns
+// false with outError set.
+bool	HttpSend(const HttpRequest& inRequest, HttpResponseSink& ioSink, std::string& outError, HttpCancel* ioCancel);
+
+// returns the body of inResponse as UTF-8, converting from the charset named
+// in its Content-Type header when that is something else
+std::string	HttpResponseText(const HttpResponse& inResponse);
+
+// returns the value of header inName (case-insensitive) from a raw header
+// block, or an empty string
+std::string	HttpHeaderValue(const std::string& inHeaders, const char* inName);
+
+// ---------------------------------------------------------------------------------
+//	HttpWebSocket
+// ---------------------------------------------------------------------------------
+//	A WebSocket opened by upgrading a GET on the shared session, so it uses the
+//	same proxy settings and TLS as every other request. WinHTTP answers the
+//	server's pings and completes the closing handshake; Receive joins the
+//	fragments of a message. The WebSocket calls of WinHTTP are looked up when
+//	the first socket opens; before Windows 8 there are none, and Open fails.
+//
+//	One thread may Receive while another Sends. Abort may be called from any
+//	thread. It counts as a call itself, so the socket handle is only closed
+//	once no call is using it.
+
+class HttpWebSocket
+{
+public:
+	HttpWebSocket();
+	~HttpWebSocket();
+
+	// connects to inRequest.mURL, a ws, wss, http or https URL, sending
+	// inRequest.mHeaders, and upgrades the connection. Returns false with a
+	// description in outError.
+	bool	Open(const HttpRequest& inRequest, std::string& outError);
+
+	// sends one whole message. Returns false with a description in outError.
+	bool	Send(const char* inData, size_t inLength, bool inBinary, std::string& outError);
+
+	// waits for the next whole message. A message longer than inMaxLength is
+	// cut off there. Returns false once the socket is closed, with a
+	// description in outError unless it was closed normally or aborted.
+	bool	Receive(std::string& outMessage, bool& outBinary, size_t inMaxLength, std::string& outError);
+
+	// closes the socket without waiting for the server. An Open in progress is
+	// cancelled. A Send or Receive in progress gets a close frame sent under it,
+	// which makes a waiting Receive return, and the last of them closes the socket.
+	void	Abort();
+
+private:
+	HttpWebSocket(const HttpWebSocket&);
+	HttpWebSocket& operator=(const HttpWebSocket&);
+
+	// the socket for one call, or NULL once Abort was called. A socket that is
+	// returned must be given back with EndCall, which returns false if Abort
+	// was called meanwhile.
+	void*	BeginCall();
+	bool	EndCall();
+
+	HttpCancel			mOpening;			// the upgrade request while Open runs
+	CRITICAL_SECTION	mLock;
+	void*				mConnect;
+	void*				mSocket;			// NULL until open and once closed
+	int					mCalls;				// calls using mSocket
+	bool				mClosing;			// Abort was called; the last call closes mSocket
+};
+
+#endif
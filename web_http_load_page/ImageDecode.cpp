@@ -0,0 +1,207 @@
+// ===========================================================================
+//	ImageDecode.cpp
+// ===========================================================================
+
+#include "ImageDecode.h"
+
+#include <objidl.h>
+#include <gdiplus.h>
+
+#include <string.h>
+
+static int			sDecodeStartCount = 0;
+static ULONG_PTR	sGdiplusToken = 0;
+
+// ---------------------------------------------------------------------------------
+//		VideoFrame
+// ---------------------------------------------------------------------------------
+
+void
+VideoFrame::Resize(long inWidth, long inHeight)
+{
+	mWidth = inWidth;
+	mHeight = inHeight;
+	mRowBytes = inWidth * 4;
+
+	// resize never gives back capacity, so a recycled frame keeps its buffer
+	mPixels.resize((size_t)mRowBytes * (size_t)inHeight);
+}
+
+// ---------------------------------------------------------------------------------
+//		FramePool
+// ---------------------------------------------------------------------------------
+
+FramePool::FramePool()
+	: mRefCount(1)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+FramePool::~FramePool()
+{
+	for (size_t i = 0; i < mFree.size(); i++) {
+		delete mFree[i];
+	}
+	DeleteCriticalSection(&mLock);
+}
+
+void
+FramePool::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+FramePool::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+VideoFrame*
+FramePool::Acquire()
+{
+	VideoFrame* frame = NULL;
+
+	EnterCriticalSection(&mLock);
+	if (!mFree.empty()) {
+		frame = mFree.back();
+		mFree.pop_back();
+	}
+	LeaveCriticalSection(&mLock);
+
+	if (frame == NULL)
+		frame = new VideoFrame;
+	return frame;
+}
+
+void
+FramePool::Recycle(VideoFrame* inFrame)
+{
+	if (inFrame == NULL)
+		return;
+
+	EnterCriticalSection(&mLock);
+	if (mFree.size() < kFramePoolSize) {
+		mFree.push_back(inFrame);
+		inFrame = NULL;
+	}
+	LeaveCriticalSection(&mLock);
+
+	delete inFrame;
+}
+
+// ---------------------------------------------------------------------------------
+//		StartImageDecoding / StopImageDecoding
+// ---------------------------------------------------------------------------------
+
+void
+StartImageDecoding()
+{
+	if (sDecodeStartCount++ > 0)
+		return;
+
+	Gdiplus::GdiplusStartupInput input;
+	if (Gdiplus::GdiplusStartup(&sGdiplusToken, &input, NULL) != Gdiplus::Ok)
+		sGdiplusToken = 0;
+}
+
+void
+StopImageDecoding()
+{
+	if (sDecodeStartCount == 0 || --sDecodeStartCount > 0)
+		return;
+
+	if (sGdiplusToken != 0) {
+		Gdiplus::GdiplusShutdown(sGdiplusToken);
+		sGdiplusToken = 0;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		DecodeImage
+// ---------------------------------------------------------------------------------
+
+bool
+DecodeImage(const char* inData, size_t inLength, VideoFrame& ioFrame, std::string& outError)
+{
+	if (sGdiplusToken == 0) {
+		outError = "ERROR: image decoding is not available";
+		return false;
+	}
+
+	if (inLength == 0 || inLength > 0x7FFFFFFF) {
+		outError = "ERROR: the response is not an image";
+		return false;
+	}
+
+	// GDI+ reads from an IStream; the stream owns this copy and frees it on release
+	HGLOBAL memory = GlobalAlloc(GMEM_MOVEABLE, inLength);
+	if (memory == NULL) {
+		outError = "ERROR: out of memory for the image";
+		return false;
+	}
+	void* bytes = GlobalLock(memory);
+	memcpy(bytes, inData, inLength);
+	GlobalUnlock(memory);
+
+	IStream* stream = NULL;
+	if (FAILED(CreateStreamOnHGlobal(memory, TRUE, &stream))) {
+		GlobalFree(memory);
+		outError = "ERROR: out of memory for the image";
+		return false;
+	}
+
+	bool ok = false;
+	Gdiplus::Bitmap* bitmap = Gdiplus::Bitmap::FromStream(stream);
+
+	if (bitmap == NULL || bitmap->GetLastStatus() != Gdiplus::Ok) {
+		outError = "ERROR: the response is not a PNG, JPEG, GIF or BMP image";
+	}
+	else {
+		UINT width = bitmap->GetWidth();
+		UINT height = bitmap->GetHeight();
+
+		if (width == 0 || height == 0) {
+			outError = "ERROR: the image has no pixels";
+		}
+		else if ((size_t)width * height > kImageMaxPixels) {
+			char msg[128];
+			_snprintf(msg, sizeof(msg), "ERROR: image is %ux%u, larger than the %u pixels allowed",
+				width, height, (unsigned int)kImageMaxPixels);
+			msg[sizeof(msg) - 1] = 0;
+			outError = msg;
+		}
+		else {
+			ioFrame.Resize((long)width, (long)height);
+
+			// with ImageLockModeUserInputBuf, GDI+ converts the pixels
+			// straight into the frame's buffer instead of one of its own
+			Gdiplus::BitmapData data;
+			data.Width = width;
+			data.Height = height;
+			data.Stride = ioFrame.mRowBytes;
+			data.PixelFormat = PixelFormat32bppARGB;
+			data.Scan0 = &ioFrame.mPixels[0];
+			data.Reserved = 0;
+
+			Gdiplus::Rect rect(0, 0, (INT)width, (INT)height);
+			Gdiplus::Status status = bitmap->LockBits(&rect,
+				Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+				PixelFormat32bppARGB, &data);
+
+			if (status == Gdiplus::Ok) {
+				bitmap->UnlockBits(&data);
+				ok = true;
+			}
+			else {
+				outError = "ERROR: cannot decode the image";
+			}
+		}
+	}
+
+	delete bitmap;
+	stream->Release();
+	return ok;
+}
@@ -0,0 +1,93 @@
+// ===========================================================================
+//	ImageDecode.h
+// ===========================================================================
+//
+//	Decoding of PNG and JPEG responses into frames for the video output.
+//
+//	Images are decoded on the worker that fetched them, with GDI+, straight
+//	into a VideoFrame taken from a FramePool: GDI+ writes the converted pixels
+//	into the frame's own buffer, so there is no copy between the decoder and
+//	the frame. Frames go back to the pool once the actor has shown the next
+//	one, and a pooled frame keeps its buffer, so a camera snapshot polled at
+//	a steady size allocates nothing after the first few frames.
+//
+//	Pixels are 32-bit BGRA, top row first, with the alpha of the image or 255.
+
+#ifndef IMAGEDECODE_H
+#define IMAGEDECODE_H
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+// largest image accepted, in pixels
+static const size_t	kImageMaxPixels = 4096 * 4096;
+
+// frames kept in a pool for reuse; more than this are freed when recycled
+static const size_t	kFramePoolSize = 4;
+
+// ---------------------------------------------------------------------------------
+//	VideoFrame
+// ---------------------------------------------------------------------------------
+
+struct VideoFrame
+{
+	VideoFrame() : mWidth(0), mHeight(0), mRowBytes(0) {}
+
+	// sizes the frame, reusing the buffer when it is already large enough
+	void	Resize(long inWidth, long inHeight);
+
+	long						mWidth;
+	long						mHeight;
+	long						mRowBytes;
+	std::vector<unsigned char>	mPixels;
+};
+
+// ---------------------------------------------------------------------------------
+//	FramePool
+// ---------------------------------------------------------------------------------
+//	Recycled frames, shared by the workers that decode into them and the actor
+//	that shows them.
+
+class FramePool
+{
+public:
+	FramePool();
+
+	void	AddRef();
+	void	Release();
+
+	// a frame from the pool, or a new one when the pool is empty
+	VideoFrame*	Acquire();
+
+	// takes back a frame from Acquire
+	void		Recycle(VideoFrame* inFrame);
+
+private:
+	~FramePool();
+
+	FramePool(const FramePool&);
+	FramePool& operator=(const FramePool&);
+
+	volatile LONG				mRefCount;
+	CRITICAL_SECTION			mLock;
+	std::vector<VideoFrame*>	mFree;
+};
+
+// ---------------------------------------------------------------------------------
+//	Decoding
+// ---------------------------------------------------------------------------------
+//	StartImageDecoding and StopImageDecoding are reference counted like the
+//	HttpTransport, and start GDI+ for the decoders. Call them from Isadora's
+//	thread, never from DllMain.
+
+void	StartImageDecoding();
+void	StopImageDecoding();
+
+// decodes the PNG, JPEG, GIF or BMP image in inData into ioFrame. Returns
+// false with a description in outError if it cannot be decoded or is larger
+// than kImageMaxPixels.
+bool	DecodeImage(const char* inData, size_t inLength, VideoFrame& ioFrame, std::string& outError);
+
+#endif
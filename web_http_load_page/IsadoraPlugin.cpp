@@ -57,7 +57,7 @@
 #include <string>
 #include <string.h>
 #include <stdio.h>
-// #include <vector>
+#include <vector>
 #include <fstream>
 
 #include <locale>
@@ -78,11 +78,14 @@
 // ---------------------------------------------------------------------------------
 #if TARGET_OS_WIN32
 
-// #include "threadedWinHttpClient.hpp"
+// worker pool shared by all instances of the actor, see FetchScheduler.h
+#include "FetchScheduler.h"
+#include "FetchJobs.h"
+#include "UrlTemplate.h"
 
-// library source: https ://www.codeproject.com/Articles/66625/A-Fully-Featured-Windows-HTTP-Wrapper-in-C
-// files not included in git repro according to license.
-#include "WinHttpClient.h"
+// requests go straight to WinHTTP, see HttpTransport.h
+#include "HttpTransport.h"
+#include "TelemetrySink.h"
 
 #include <psapi.h> // For access to GetModuleFileNameEx, Important: Must include psapi.lib in additional dependencies section
 
@@ -177,6 +180,54 @@ typedef struct {
 
 	char					mURL[512];		// URL of page to load
 
+	FetchPriority			mPriority;		// scheduler lane used when the trigger fires
+	FetchInbox*				mInbox;			// completed fetches waiting for the next frame tick
+
+	std::vector<std::string>*	mURLList;	// URLs parsed from the url_list input, fetched together on trigger
+	DWORD					mDeadlineMs;	// how long a batch may take before it is reported, 0 = wait for all
+	FetchBatch*				mBatch;			// the batch currently in flight, if any
+
+	UrlTemplate*			mURLTemplate;	// compiled url_template input with the current param values
+
+	HttpRequest*			mRequest;		// method and content type; URL and body are filled in on trigger
+	HttpBody*				mBodyText;		// the body input, reused in place when no request still holds it
+	HttpBody*				mBodyFile;		// the file named by body_file, mapped read-only
+	Boolean					mUseBodyFile;	// true while body_file names a file
+	HttpChannel*			mChannel;		// keeps POST, PUT etc. in trigger order
+
+	TelemetrySink*			mTelemetry;		// buffers triggers in telemetry mode
+	long					mReportedBacklog;	// last values sent to the backlog and dropped outputs
+	long					mReportedDropped;
+
+	ResponsePlan*			mResponsePlan;	// how responses are read, replaced rather than changed while jobs use it
+	GeoJsonPoints*			mPoints;		// points of the last GeoJSON response
+	long					mPointIndex;	// one-based point sent to the point outputs
+	CsvTable*				mRows;			// selected columns of the rows kept of the last CSV response, filled as it streams in
+	long					mRowsFirst;		// one-based row number of the first row in mRows
+	long					mRowCount;		// rows read so far of the last CSV response, kept or not
+	long					mRowIndex;		// one-based row sent to the value and number outputs
+
+	long					mTail;			// TailMode of the tail input
+	std::string*			mTailURL;		// the URL mTailOffset belongs to
+	ULONGLONG				mTailOffset;	// where the next poll starts, after the last complete line read
+	Boolean					mTailStarted;	// a poll of mTailURL has been taken
+	std::deque<TailRecord>*	mTailRecords;	// records waiting to go to the record output
+	long					mRecordsPerFrame;
+	long					mReportedWaiting;	// last value sent to the records_waiting output
+
+	VideoFrame*				mOutputPixels;	// the pixels behind the map's output buffer, copied from each new frame
+	Boolean					mMjpeg;			// the trigger opens an MJPEG stream
+	MjpegStream*			mStream;		// the open MJPEG stream, if any
+	Boolean					mSse;			// the trigger opens an SSE subscription
+	SseSubscription*		mSubscription;	// the open SSE subscription, if any
+	std::deque<SseEvent>*	mEvents;		// events drained from mSubscription, sent on the same tick
+	Boolean					mWebSocket;		// the trigger opens a WebSocket
+	Boolean					mCoalesce;		// only the newest WebSocket message of a tick is sent
+	WebSocketSession*		mSocket;		// the open WebSocket session, if any
+	std::string*			mWsPending;		// the last ws_send text entered while there was no session
+	Boolean					mWsHasPending;	// mWsPending is queued on the next session
+	long					mReportedMessagesDropped;	// last value sent to the messages_dropped output
+
 	// char					mPIDfilePath[512];		// path to file for launch
 
 	Boolean					mBypass;
@@ -193,6 +244,9 @@ typedef struct {
 #define	GetPluginInfo_(actorDataPtr)		(PluginInfo*)((actorDataPtr)->mActorDataPtr);
 #endif
 
+// used by DisposeActor and ActivateActor, defined with the other video helpers
+void DetachOutputBuffer(PluginInfo* info);
+
 // ---------------------------------------------------------------------------------
 //	Constants
 // ---------------------------------------------------------------------------------
@@ -237,11 +291,86 @@ static const char* sPropertyDefinitionString =
 //	TYPE 	PROPERTY	NAME ID		DATATYPE	DISPLAY	FMT		MIN		MAX		INIT VALUE
 "INPROP		URL			fpat		string		text			*		*		none\r"
 "INPROP		trigger		clse		bool		trig			0		1		0\r"
+"INPROP		priority	prio		int			number			0		2		1\r"
+"INPROP		url_list	ulst		string		text			*		*		none\r"
+"INPROP		deadline	dlms		int			number			0		*		0\r"
+"INPROP		url_template	utpl		string		text			*		*		none\r"
+"INPROP		param_1		prm1		string		text			*		*		none\r"
+"INPROP		param_2		prm2		string		text			*		*		none\r"
+"INPROP		param_3		prm3		string		text			*		*		none\r"
+"INPROP		param_4		prm4		string		text			*		*		none\r"
+"INPROP		method		meth		string		text			*		*		GET\r"
+"INPROP		body		body		string		text			*		*		none\r"
+"INPROP		content_type	ctyp		string		text			*		*		application/json\r"
+"INPROP		body_file	bfil		string		text			*		*		none\r"
+"INPROP		telemetry	tlmy		int			number			0		2		0\r"
+"INPROP		flush_bytes	flby		int			number			256		4194304	65536\r"
+"INPROP		flush_ms	flms		int			number			0		*		250\r"
+"INPROP		field_1		fld1		string		text			*		*		none\r"
+"INPROP		field_2		fld2		string		text			*		*		none\r"
+"INPROP		field_3		fld3		string		text			*		*		none\r"
+"INPROP		field_4		fld4		string		text			*		*		none\r"
+"INPROP		geojson		geoj		bool		onoff			0		1		0\r"
+"INPROP		geo_properties	gprp		string		text			*		*		mag\r"
+"INPROP		point_index	pidx		int			number			1		*		1\r"
+"INPROP		pattern		ptrn		string		text			*		*		none\r"
+"INPROP		match_index	mtix		int			number			1		*		1\r"
+"INPROP		pattern_2	ptn2		string		text			*		*		none\r"
+"INPROP		pattern_3	ptn3		string		text			*		*		none\r"
+"INPROP		pattern_4	ptn4		string		text			*		*		none\r"
+"INPROP		match_steps	mstp		int			number			0		*		50000000\r"
+"INPROP		match_stack_kb	mstk		int			number			0		*		16384\r"
+"INPROP		csv			csvm		int			number			0		2		0\r"
+"INPROP		csv_columns	ccol		string		text			*		*		1\r"
+"INPROP		row_index	ridx		int			number			1		*		1\r"
+"INPROP		xml			xmlm		int			number			0		2		0\r"
+"INPROP		xml_paths	xpth		string		text			*		*		channel/item/title\r"
+"INPROP		xml_items	xitm		int			number			1		*		1\r"
+"INPROP		tail		tail		int			number			0		2		0\r"
+"INPROP		records_per_frame	rpfr	int			number			0		*		1\r"
+"INPROP		diff		diff		int			number			0		2		0\r"
+"INPROP		image		imag		bool		onoff			0		1		0\r"
+"INPROP		mjpeg		mjpg		bool		onoff			0		1		0\r"
+"INPROP		sse			ssem		bool		onoff			0		1		0\r"
+"INPROP		websocket	wsck		bool		onoff			0		1		0\r"
+"INPROP		ws_send		wsnd		string		text			*		*		none\r"
+"INPROP		coalesce	wcol		bool		onoff			0		1		0\r"
 
 // OUTPUT PROPERTY DEFINITIONS
 //	TYPE	PROPERTY NAME	ID		DATATYPE	DISPLAY FMT			MIN		MAX		INIT VALUE
-"OUTPROP	status			stat	string		text				*		*		none\r";
-//"OUTPROP	video_out		vout	data		video				*		*		0\r"
+"OUTPROP	status			stat	string		text				*		*		none\r"
+"OUTPROP	item_index		iidx	int			number				0		*		0\r"
+"OUTPROP	item			item	string		text				*		*		none\r"
+"OUTPROP	batch			btch	string		text				*		*		none\r"
+"OUTPROP	backlog			blog	int			number				0		*		0\r"
+"OUTPROP	dropped			drop	int			number				0		*		0\r"
+"OUTPROP	value_1			val1	string		text				*		*		none\r"
+"OUTPROP	value_2			val2	string		text				*		*		none\r"
+"OUTPROP	value_3			val3	string		text				*		*		none\r"
+"OUTPROP	value_4			val4	string		text				*		*		none\r"
+"OUTPROP	number_1		num1	float		number				*		*		0\r"
+"OUTPROP	number_2		num2	float		number				*		*		0\r"
+"OUTPROP	number_3		num3	float		number				*		*		0\r"
+"OUTPROP	number_4		num4	float		number				*		*		0\r"
+"OUTPROP	point_count		pcnt	int			number				0		*		0\r"
+"OUTPROP	longitude		long	float		number				*		*		0\r"
+"OUTPROP	latitude		lati	float		number				*		*		0\r"
+"OUTPROP	elevation		elev	float		number				*		*		0\r"
+"OUTPROP	property_1		gpv1	float		number				*		*		0\r"
+"OUTPROP	property_2		gpv2	float		number				*		*		0\r"
+"OUTPROP	property_3		gpv3	float		number				*		*		0\r"
+"OUTPROP	property_4		gpv4	float		number				*		*		0\r"
+"OUTPROP	row_count		rcnt	int			number				0		*		0\r"
+"OUTPROP	record			rcrd	string		text				*		*		none\r"
+"OUTPROP	records_waiting	rwat	int			number				0		*		0\r"
+"OUTPROP	changes			chng	string		text				*		*		none\r"
+"OUTPROP	change_count	ccnt	int			number				0		*		0\r"
+"OUTPROP	video_out		vout	data		video				*		*		0\r"
+"OUTPROP	event_type		evty	string		text				*		*		none\r"
+"OUTPROP	event_id		evid	string		text				*		*		none\r"
+"OUTPROP	event_data		evdt	string		text				*		*		none\r"
+"OUTPROP	message			wmsg	string		text				*		*		none\r"
+"OUTPROP	messages_dropped	mdrp	int			number				0		*		0\r";
 
 
 // ### Property Index Constants
@@ -254,8 +383,84 @@ enum
 {
 	kInputURL = 1,
 	kInputTrigger,
-
-	kOutputStatus = 1
+	kInputPriority,
+	kInputURLList,
+	kInputDeadline,
+	kInputURLTemplate,
+	kInputParam1,
+	kInputParam2,
+	kInputParam3,
+	kInputParam4,
+	kInputMethod,
+	kInputBody,
+	kInputContentType,
+	kInputBodyFile,
+	kInputTelemetry,
+	kInputFlushBytes,
+	kInputFlushMs,
+	kInputField1,
+	kInputField2,
+	kInputField3,
+	kInputField4,
+	kInputGeoJson,
+	kInputGeoProperties,
+	kInputPointIndex,
+	kInputPattern,
+	kInputMatchIndex,
+	kInputPattern2,
+	kInputPattern3,
+	kInputPattern4,
+	kInputMatchSteps,
+	kInputMatchStackKB,
+	kInputCsv,
+	kInputCsvColumns,
+	kInputRowIndex,
+	kInputXml,
+	kInputXmlPaths,
+	kInputXmlItems,
+	kInputTail,
+	kInputRecordsPerFrame,
+	kInputDiff,
+	kInputImage,
+	kInputMjpeg,
+	kInputSse,
+	kInputWebSocket,
+	kInputWsSend,
+	kInputCoalesce,
+
+	kOutputStatus = 1,
+	kOutputItemIndex,
+	kOutputItem,
+	kOutputBatch,
+	kOutputBacklog,
+	kOutputDropped,
+	kOutputValue1,
+	kOutputValue2,
+	kOutputValue3,
+	kOutputValue4,
+	kOutputNumber1,
+	kOutputNumber2,
+	kOutputNumber3,
+	kOutputNumber4,
+	kOutputPointCount,
+	kOutputLongitude,
+	kOutputLatitude,
+	kOutputElevation,
+	kOutputProperty1,
+	kOutputProperty2,
+	kOutputProperty3,
+	kOutputProperty4,
+	kOutputRowCount,
+	kOutputRecord,
+	kOutputRecordsWaiting,
+	kOutputChanges,
+	kOutputChangeCount,
+	kOutputVideo,
+	kOutputEventType,
+	kOutputEventId,
+	kOutputEventData,
+	kOutputMessage,
+	kOutputMessagesDropped
 };
 // kInputVideoIn
 
@@ -277,13 +482,250 @@ enum
 const char* sHelpStrings[] =
 {
 	"Get the text returned from a HTTP request"
-	"\nCurrently Blocking and will freeze UI and playback.",
+	"\nRequests run on a shared pool of worker threads, so UI and playback keep running."
+	" The response is sent to the status output on the next video frame.",
 
 	"URL to be loaded.",
 
 	"Trigger to load URL.",
 
-	"Current Status report."
+	"Scheduler lane for this actor's requests: 0 = background polling, 1 = normal,"
+	" 2 = cue critical. When every worker is busy, higher lanes are sent first;"
+	" requests that have waited a while are promoted so that none are starved.",
+
+	"A list of URLs to load together, one per line or as a JSON array of strings."
+	" When this is not empty the trigger loads every URL in the list in parallel"
+	" instead of the URL input. Each response is read like a single one, its values"
+	" sent just before its item. With a method other than GET the list is sent in"
+	" order, one request at a time, and there is no batch.",
+
+	"Milliseconds to wait for a URL list before sending the batch output anyway."
+	" Responses that have not arrived by then are null. 0 waits for all of them.",
+
+	"A URL with placeholders, e.g. http://host/api?sensor={id}&since={t}. When this is"
+	" not empty the trigger loads the template filled in from the param inputs instead"
+	" of the URL input. Use {1} to {4} to pick a param by number; named placeholders"
+	" take the remaining params in order of appearance. Write {{ for a literal brace.",
+
+	"Value for the first template placeholder. Values are percent-encoded.",
+
+	"Value for the second template placeholder.",
+
+	"Value for the third template placeholder.",
+
+	"Value for the fourth template placeholder.",
+
+	"HTTP method: GET, POST, PUT, PATCH, DELETE, ... GET requests run in parallel;"
+	" all other methods are sent one after another, in trigger order, over a kept-alive"
+	" connection.",
+
+	"Request body, sent with every method except GET and HEAD.",
+
+	"Content-Type header sent with the body.",
+
+	"Path of a file to send as the body instead of the body input. The file is mapped"
+	" into memory and streamed from there, never copied. Leave empty to use the body input.",
+
+	"Batch values instead of sending one request per trigger: 0 = off, 1 = NDJSON,"
+	" 2 = JSON array. Each trigger adds the body input as one record, and the records"
+	" are sent together, in one POST to the URL, when flush_bytes or flush_ms is reached.",
+
+	"In telemetry mode, send the buffered records once they reach this many bytes.",
+
+	"In telemetry mode, send the buffered records once the oldest is this many"
+	" milliseconds old. 0 sends on size only.",
+
+	"A JSON pointer into the response, e.g. /features/0/properties/mag. When any field"
+	" is set, the response is parsed on the worker thread and only the values at the"
+	" field pointers are sent to the value and number outputs; status then reports OK"
+	" or the error instead of the whole text.",
+
+	"A JSON pointer for the second field.",
+
+	"A JSON pointer for the third field.",
+
+	"A JSON pointer for the fourth field.",
+
+	"Read the response as GeoJSON, e.g. a USGS earthquake feed. Every position of every"
+	" feature becomes a point, extracted on the worker thread into packed columns that"
+	" point_index then reads from. Takes the place of the field inputs while on.",
+
+	"Comma separated names of up to four numeric feature properties, e.g. mag, depth,"
+	" sent to property_1 to property_4 with each point.",
+
+	"One-based index of the point sent to the longitude, latitude, elevation and"
+	" property outputs. Step it from a counter to walk the points.",
+
+	"A regular expression matched against the response on the worker thread, e.g."
+	" <title>{[^<]*}</title>. Groups are written {...}; the first four groups of the"
+	" first match go to the value and number outputs, or the whole match when there"
+	" are no groups. Takes the place of the field inputs while set.",
+
+	"Which match of the pattern to report, one-based. Each match is searched for"
+	" from the end of the one before, so matches never overlap.",
+
+	"A second pattern, matched in the same scan of the response as the first. With"
+	" more than one pattern set, each sends its first group to the value and number"
+	" outputs of its own number, and an empty value if it does not match.",
+
+	"A third pattern, sent to value_3 and number_3.",
+
+	"A fourth pattern, sent to value_4 and number_4.",
+
+	"How many steps a backtracking pattern may take over one response before it"
+	" gives up with an error on the status output, so that a page on which it"
+	" backtracks badly cannot hold a worker for long. 0 for no limit.",
+
+	"How large, in KB, the backtracking stack of a pattern may grow over one"
+	" response before it gives up with an error on the status output. 0 for no"
+	" limit.",
+
+	"Read the response as CSV or TSV, streamed and parsed as it downloads so that"
+	" large exports never sit in memory. 0 is off; 1 keeps the csv_columns of 4096"
+	" rows around row_index, as it is when triggered, for row_index to read from; 2 sends each column to its value output as one"
+	" JSON array, with the row count on its number output. Takes the place of the"
+	" field inputs while on.",
+
+	"Comma separated header names or one-based numbers of up to four columns, e.g."
+	" stop_name, departure. Names are matched without regard to case.",
+
+	"One-based index of the CSV row sent to the value and number outputs. Step it"
+	" from a counter to walk the rows; to read past the 4096 rows kept, trigger"
+	" again and the rows around row_index are loaded.",
+
+	"Read the response as XML, e.g. an RSS or Atom feed, streamed and parsed as it"
+	" downloads. 0 is off; 1 sends match number xml_items of each xml_paths path to"
+	" its value and number outputs; 2 sends the first xml_items matches of each path"
+	" as one JSON array, with the count on the number output. The download stops as"
+	" soon as every path has its matches. Takes the place of the field inputs while on.",
+
+	"Comma separated paths of up to four elements, e.g. channel/item/title,"
+	" channel/item/pubDate. A path ending in @name reads an attribute, e.g."
+	" entry/link/@href; a path starting with / matches from the root element.",
+
+	"How many matches of each XML path to read, counted from the top of the document.",
+
+	"Poll an append-only log or NDJSON feed for the lines added since the last"
+	" trigger. Each trigger asks for the rest of the file with an HTTP Range request"
+	" and only the new lines are sent to the record output. 0 is off; 1 starts from"
+	" the beginning of the file; 2 skips what is there at the first trigger. With"
+	" fields set, each record is read as JSON and its values go out with it.",
+
+	"How many waiting records are sent to the record output on each frame; 0 sends"
+	" all of them at once, one per line.",
+
+	"Compare each JSON response with the one before, on the worker thread, and send"
+	" only what changed to the changes output. 0 is off; 1 writes an RFC 6902 JSON"
+	" Patch; 2 writes one path=value line per change, with nothing after the = for a"
+	" removed value. Nothing is sent when a response is unchanged.",
+
+	"Decode each response as a PNG, JPEG, GIF or BMP image, on the worker thread,"
+	" and send it to the video output, e.g. a camera snapshot or a rendered chart."
+	" Frames are reused once replaced, so polling allocates nothing after the first"
+	" few. An error response leaves the last image on the output.",
+
+	"Open the URL as an MJPEG stream, as served by IP cameras, when triggered, and"
+	" send its frames to the video output. The stream stays open until this is"
+	" turned off or the actor is triggered again. Frames are decoded on the worker"
+	" threads, and only the newest is kept: when the show or the decoder falls"
+	" behind, frames are dropped rather than queued, so the picture stays live.",
+
+	"Subscribe to the URL as a Server-Sent Events stream when triggered, and send"
+	" each event to the event outputs on the frame after it arrives. The connection"
+	" stays open until this is turned off or the actor is triggered again; when it"
+	" drops it is reopened with Last-Event-ID so no events are missed. With fields"
+	" set, each event's data is read as JSON and its values go out with it.",
+
+	"Open the URL, ws://, wss://, http:// or https://, as a WebSocket when triggered,"
+	" and send each message from the server to the message output on the frame after"
+	" it arrives. The socket stays open until this is turned off or the actor is"
+	" triggered again. With fields set, each text message is read as JSON and its"
+	" values go out with it.",
+
+	"Text sent as one message on the open WebSocket each time this changes. Text"
+	" entered before the socket has opened is sent once it does; of text entered"
+	" before the trigger, only the last is kept.",
+
+	"In WebSocket mode, send only the newest message of each frame and count the"
+	" rest as dropped, for a server sending faster than the show needs.",
+
+	"Current Status report.",
+
+	"One-based position in the URL list of the response on the item output."
+	" Sent just before each item.",
+
+	"Each response of a URL list, as soon as it arrives; its status line instead"
+	" when values are read from it.",
+
+	"A JSON array of every response in a URL list, in list order. Sent once all"
+	" responses are in, or when the deadline passes.",
+
+	"In telemetry mode, the number of records waiting to be sent. Grows while the"
+	" server is slower than the triggers.",
+
+	"In telemetry mode, the number of records dropped because the buffer was full.",
+
+	"The value at field_1: strings without quotes, objects and arrays as JSON,"
+	" empty if the field is missing or null.",
+
+	"The value at field_2.",
+
+	"The value at field_3.",
+
+	"The value at field_4.",
+
+	"The value at field_1 as a number; true is 1, anything that is not a number is 0.",
+
+	"The value at field_2 as a number.",
+
+	"The value at field_3 as a number.",
+
+	"The value at field_4 as a number.",
+
+	"In GeoJSON mode, the number of points in the last response.",
+
+	"Longitude of the point at point_index, or 0 if there is no such point.",
+
+	"Latitude of the point at point_index.",
+
+	"Elevation of the point at point_index, 0 where the position has none.",
+
+	"The first geo_properties value of the point's feature; true is 1, anything that"
+	" is missing or not a number is 0.",
+
+	"The second geo_properties value.",
+
+	"The third geo_properties value.",
+
+	"The fourth geo_properties value.",
+
+	"In CSV mode 1, the number of rows read so far from the last response. Rises"
+	" while a large file is still downloading.",
+
+	"In tail mode, each new line of the file, without its line break.",
+
+	"In tail mode, the number of records not yet sent to the record output.",
+
+	"In diff mode, the changes from the previous JSON response to the last one. The"
+	" first response replaces the whole document, at the path \"\".",
+
+	"The number of changes on the changes output. Sent just before them.",
+
+	"In image mode, the last image decoded; in MJPEG mode, the newest frame of the stream.",
+
+	"In SSE mode, the type of each event, message when the server names none."
+	" Sent just before its data.",
+
+	"In SSE mode, the id of the last event that had one. Sent just before its data.",
+
+	"In SSE mode, the data of each event, its lines joined by line breaks.",
+
+	"In WebSocket mode, each message from the server, in the order received. Sent"
+	" after the values read from it.",
+
+	"In WebSocket mode, the number of messages dropped: received while the actor"
+	" was not keeping up, skipped by coalesce, or waiting to be sent when too many"
+	" were."
 };
 
 // ---------------------------------------------------------------------------------
@@ -307,10 +749,46 @@ ActorInfo*			ioActorInfo)		// pointer to this actor's ActorInfo struct - unique
 	info->mActorInfoPtr = ioActorInfo;
 
 	// ### allocation and initialization of private member variables
+	StartFetchScheduler();
+	StartHttpTransport();
+	StartImageDecoding();
+	info->mInbox = new FetchInbox;
+	info->mPriority = kFetchPriorityNormal;
+	info->mURLList = new std::vector<std::string>;
+	info->mURLTemplate = new UrlTemplate;
+	info->mRequest = new HttpRequest;
+	info->mRequest->mMethod = "GET";
+	info->mRequest->mContentType = "application/json";
+	info->mBodyText = new HttpBody;
+	info->mBodyFile = new HttpBody;
+	info->mChannel = new HttpChannel(info->mInbox);
+	info->mTelemetry = new TelemetrySink;
+	info->mResponsePlan = new ResponsePlan;
+	info->mResponsePlan->SetGeoProperties("mag");
+	info->mResponsePlan->SetCsvColumns("1");
+	info->mResponsePlan->SetXmlPaths("channel/item/title");
+	info->mChannel->SetResponsePlan(info->mResponsePlan);
+	info->mPoints = new GeoJsonPoints;
+	info->mPointIndex = 1;
+	info->mRows = new CsvTable;
+	info->mRowsFirst = 1;
+	info->mRowCount = 0;
+	info->mRowIndex = 1;
+	info->mTail = kTailOff;
+	info->mTailURL = new std::string;
+	info->mTailOffset = 0;
+	info->mTailStarted = false;
+	info->mTailRecords = new std::deque<TailRecord>;
+	info->mRecordsPerFrame = 1;
+	info->mReportedWaiting = 0;
+	info->mEvents = new std::deque<SseEvent>;
+	info->mWsPending = new std::string;
+	info->mReportedMessagesDropped = 0;
+	info->mOutputPixels = new VideoFrame;
 
 	// set number of input and output buffers in our buffer map
 	// and then initialize it
-	info->mImageBufferMap.mInputBufferCount = 1; // TODO: DX remove ImageBuffer stuff from plugin
+	info->mImageBufferMap.mInputBufferCount = 1;
 	info->mImageBufferMap.mOutputBufferCount = 1;
 	CreateImageBufferMap(ip, &info->mImageBufferMap);
 }
@@ -331,8 +809,72 @@ ActorInfo*			ioActorInfo)		// pointer to this actor's ActorInfo struct - unique
 
 	// ### destruction of private member variables
 
-	// destroy our image buffer map
+	// jobs still in flight hold their own reference to the inbox
+	if (info->mBatch != nil) {
+		info->mBatch->Abandon();
+		info->mBatch->Release();
+		info->mBatch = nil;
+	}
+	delete info->mURLList;
+	info->mURLList = nil;
+	delete info->mURLTemplate;
+	info->mURLTemplate = nil;
+	delete info->mRequest;
+	info->mRequest = nil;
+	info->mBodyText->Release();
+	info->mBodyText = nil;
+	info->mBodyFile->Release();
+	info->mBodyFile = nil;
+	delete info->mTelemetry;
+	info->mTelemetry = nil;
+	info->mResponsePlan->Release();
+	info->mResponsePlan = nil;
+	delete info->mPoints;
+	info->mPoints = nil;
+	delete info->mRows;
+	info->mRows = nil;
+	delete info->mTailURL;
+	info->mTailURL = nil;
+	delete info->mTailRecords;
+	info->mTailRecords = nil;
+	if (info->mStream != nil) {
+		info->mStream->Stop();
+		info->mStream->Release();
+		info->mStream = nil;
+	}
+	if (info->mSubscription != nil) {
+		info->mSubscription->Stop();
+		info->mSubscription->Release();
+		info->mSubscription = nil;
+	}
+	delete info->mEvents;
+	info->mEvents = nil;
+	delete info->mWsPending;
+	info->mWsPending = nil;
+	if (info->mSocket != nil) {
+		info->mSocket->Stop();
+		info->mSocket->Release();
+		info->mSocket = nil;
+	}
+	info->mChannel->Release();
+	info->mChannel = nil;
+	info->mInbox->Close();
+	info->mInbox->Release();
+	info->mInbox = nil;
+
+	// the last actor cancels the requests in flight before waiting for the
+	// workers and stream threads, so one blocked on the network cannot hold up
+	// Isadora. GDI+ stays up if a thread outlived the wait, since it may still
+	// be decoding.
+	StopHttpTransport();
+	if (StopFetchScheduler())
+		StopImageDecoding();
+
+	// destroy our image buffer map, once it no longer points at our pixels
+	DetachOutputBuffer(info);
 	DisposeImageBufferMap(ip, &info->mImageBufferMap);
+	delete info->mOutputPixels;
+	info->mOutputPixels = nil;
 
 	// destroy the PluginInfo struct allocated with IzzyMallocClear_ the CreateActor function
 	PluginAssert_(ip, ioActorInfo->mActorDataPtr != nil);
@@ -411,7 +953,8 @@ Boolean				inActivate)			// true when actor is becoming active, false otherwise.
 		}
 
 		// ### dispose any data that you don't need when 
-		// you are not active.
+		// you are not active. The pixels stay, and go out again on activation.
+		DetachOutputBuffer(info);
 		DisposeOwnedImageBuffers(ip, &info->mImageBufferMap);
 		ClearSourceBuffers(ip, &info->mImageBufferMap);
 	}
@@ -471,13 +1014,13 @@ UInt32				inMaxCharacters)		// size of the outParamaterString buffer
 
 // wstring converters
 // require headers : #include <locale> & #include <codecvt>
-wstring s2ws(const std::string& str)
+std::wstring s2ws(const std::string& str)
 {
 	using convert_typeX = std::codecvt_utf8<wchar_t>;
 	std::wstring_convert<convert_typeX, wchar_t> converterX;
 	return converterX.from_bytes(str);
 }
-string ws2s(const std::wstring& wstr)
+std::string ws2s(const std::wstring& wstr)
 {
 	using convert_typeX = std::codecvt_utf8<wchar_t>;
 	std::wstring_convert<convert_typeX, wchar_t> converterX;
@@ -505,6 +1048,274 @@ char* trimwhitespace(char* str)
 	return str;
 }
 
+// a copy of inText without leading and trailing white space. Input values
+// belong to Isadora, so they are never trimmed in place.
+std::string TrimmedCopy(const char* inText)
+{
+	const char* start = inText;
+	while (isspace((unsigned char)*start)) start++;
+
+	const char* end = start + strlen(start);
+	while (end > start && isspace((unsigned char)end[-1])) end--;
+
+	return std::string(start, end - start);
+}
+
+
+// send a c-string to one of our string outputs
+void SetOutputString(IsadoraParameters* ip, ActorInfo* inActorInfo, PropertyIndex inOutputIndex1, const char* inText)
+{
+	Value kOutTextValue = { kString, nil };
+	AllocateValueString_(ip, inText, &kOutTextValue);
+	SetOutputPropertyValue_(ip, inActorInfo, inOutputIndex1, &kOutTextValue);
+	ReleaseValueString_(ip, &kOutTextValue);
+}
+
+// send an integer to one of our int outputs
+void SetOutputInteger(IsadoraParameters* ip, ActorInfo* inActorInfo, PropertyIndex inOutputIndex1, long inValue)
+{
+	Value kOutIntValue = { kInteger, 0 };
+	kOutIntValue.u.ivalue = inValue;
+	SetOutputPropertyValue_(ip, inActorInfo, inOutputIndex1, &kOutIntValue);
+}
+
+// send a number to one of our float outputs
+void SetOutputFloat(IsadoraParameters* ip, ActorInfo* inActorInfo, PropertyIndex inOutputIndex1, double inValue)
+{
+	Value kOutFloatValue = { kFloat, 0 };
+	kOutFloatValue.u.fvalue = (float) inValue;
+	SetOutputPropertyValue_(ip, inActorInfo, inOutputIndex1, &kOutFloatValue);
+}
+
+// fill in the URL a trigger loads: the expanded url_template, or the URL input
+void SetRequestURL(PluginInfo* info)
+{
+	if (info->mURLTemplate->IsEmpty())
+		info->mRequest->mURL = info->mURL;
+	else
+		info->mURLTemplate->Expand(info->mRequest->mURL);
+}
+
+// send the telemetry buffer once it is due and the previous flush has gone out,
+// or right away when inForce is set, then report the backlog if it changed
+void ServiceTelemetry(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info, bool inForce)
+{
+	TelemetrySink* sink = info->mTelemetry;
+
+	if (inForce || (sink->IsDue(GetTickCount()) && !sink->IsSending())) {
+		SetRequestURL(info);
+		sink->Flush(*info->mRequest, info->mChannel, info->mPriority);
+	}
+
+	if (sink->GetBacklog() != info->mReportedBacklog) {
+		info->mReportedBacklog = sink->GetBacklog();
+		SetOutputInteger(ip, inActorInfo, kOutputBacklog, info->mReportedBacklog);
+	}
+	if (sink->GetDropped() != info->mReportedDropped) {
+		info->mReportedDropped = sink->GetDropped();
+		SetOutputInteger(ip, inActorInfo, kOutputDropped, info->mReportedDropped);
+	}
+}
+
+// swap in an edited copy of the extract plan; jobs in flight keep the one they were given
+void ReplaceResponsePlan(PluginInfo* info, ResponsePlan* inPlan)
+{
+	info->mResponsePlan->Release();
+	info->mResponsePlan = inPlan;
+	info->mChannel->SetResponsePlan(inPlan);
+}
+
+// send the point at point_index to the point outputs, or zeros if there is none
+void SendGeoJsonPoint(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info)
+{
+	const GeoJsonPoints& points = *info->mPoints;
+	bool valid = info->mPointIndex >= 1 && (size_t) info->mPointIndex <= points.Count();
+	size_t i = valid ? info->mPointIndex - 1 : 0;
+
+	SetOutputFloat(ip, inActorInfo, kOutputLongitude, valid ? points.mLongitude[i] : 0);
+	SetOutputFloat(ip, inActorInfo, kOutputLatitude, valid ? points.mLatitude[i] : 0);
+	SetOutputFloat(ip, inActorInfo, kOutputElevation, valid ? points.mElevation[i] : 0);
+	for (int k = 0; k < kGeoJsonMaxProperties; k++) {
+		SetOutputFloat(ip, inActorInfo, kOutputProperty1 + k, valid ? points.mProperty[k][i] : 0);
+	}
+}
+
+// place the window of rows the next CSV response keeps around row_index, with
+// a quarter of it before the row so that stepping back stays inside it
+void PlaceCsvWindow(PluginInfo* info)
+{
+	if (info->mResponsePlan->GetCsvMode() != kCsvRows)
+		return;
+
+	size_t before = kCsvWindowRows / 4;
+	size_t first = info->mRowIndex > (long) before ? info->mRowIndex - before : 1;
+	if (first != info->mResponsePlan->GetCsvFirstRow()) {
+		ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+		plan->SetCsvFirstRow(first);
+		ReplaceResponsePlan(info, plan);
+	}
+}
+
+// send the CSV row at row_index to the value and number outputs, or empty
+// values if it was not kept
+void SendCsvRow(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info)
+{
+	const CsvTable& rows = *info->mRows;
+	long offset = info->mRowIndex - info->mRowsFirst;
+	bool valid = offset >= 0 && (size_t) offset < rows.Count();
+	size_t i = valid ? offset : 0;
+
+	const std::string* columns = info->mResponsePlan->GetCsvColumns();
+	std::string text;
+	for (int k = 0; k < kCsvMaxColumns; k++) {
+		if (columns[k].empty())
+			continue;
+		if (valid)
+			rows.GetText(i, k, text);
+		else
+			text.clear();
+		SetOutputString(ip, inActorInfo, kOutputValue1 + k, text.c_str());
+		SetOutputFloat(ip, inActorInfo, kOutputNumber1 + k, valid ? rows.GetNumber(i, k) : 0);
+	}
+}
+
+
+// send the values read from one record of a stream to the value and number
+// outputs of the fields that are set, if it had any, then its text to inTextOutput
+void SendRecordValues(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info, bool inHasValues,
+	const JsonValue inValues[kJsonMaxPointers], PropertyIndex inTextOutput, const std::string& inText)
+{
+	if (inHasValues) {
+		for (int k = 0; k < kJsonMaxPointers; k++) {
+			if (!info->mResponsePlan->HasPointer(k))
+				continue;
+			SetOutputString(ip, inActorInfo, kOutputValue1 + k, inValues[k].mText.c_str());
+			SetOutputFloat(ip, inActorInfo, kOutputNumber1 + k, inValues[k].mNumber);
+		}
+	}
+	SetOutputString(ip, inActorInfo, inTextOutput, inText.c_str());
+}
+
+// send one tail record to the record output, and its values to the value and
+// number outputs of the fields that are set
+void SendTailRecord(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info, const TailRecord& inRecord)
+{
+	SendRecordValues(ip, inActorInfo, info, inRecord.mHasValues, inRecord.mValues, kOutputRecord, inRecord.mText);
+}
+
+// send this frame's share of the waiting tail records, then report how many are left
+void ServiceTail(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info)
+{
+	std::deque<TailRecord>& waiting = *info->mTailRecords;
+
+	if (!waiting.empty() && info->mRecordsPerFrame == 0) {
+		TailRecord batch;
+		for (size_t i = 0; i < waiting.size(); i++) {
+			if (i > 0)
+				batch.mText += '\n';
+			batch.mText += waiting[i].mText;
+		}
+		SendTailRecord(ip, inActorInfo, info, batch);
+		waiting.clear();
+	}
+
+	for (long i = 0; i < info->mRecordsPerFrame && !waiting.empty(); i++) {
+		SendTailRecord(ip, inActorInfo, info, waiting.front());
+		waiting.pop_front();
+	}
+
+	if ((long) waiting.size() != info->mReportedWaiting) {
+		info->mReportedWaiting = (long) waiting.size();
+		SetOutputInteger(ip, inActorInfo, kOutputRecordsWaiting, info->mReportedWaiting);
+	}
+}
+
+// the output buffer of the image buffer map, or nil while the map has none.
+// This is the only place that reaches into the map's buffers.
+ImageBuffer* GetOutputBuffer(PluginInfo* info)
+{
+	ImageBufferMap& map = info->mImageBufferMap;
+	if (map.mOutputBufferCount < 1 || map.mOutputBuffers == nil)
+		return nil;
+	return map.mOutputBuffers[0];
+}
+
+// let go of mOutputPixels before the map's buffers are disposed, so the map
+// never frees pixels it does not own
+void DetachOutputBuffer(PluginInfo* info)
+{
+	ImageBuffer* buffer = GetOutputBuffer(info);
+	if (buffer != nil && !info->mOutputPixels->mPixels.empty() && buffer->mBaseAddr == (void*) &info->mOutputPixels->mPixels[0]) {
+		buffer->mBaseAddr = nil;
+		buffer->mWidth = 0;
+		buffer->mHeight = 0;
+		buffer->mRowBytes = 0;
+	}
+	info->mNeedsDraw = true;
+}
+
+// copy inFrame into the pixels behind the video output, so that a pooled
+// frame can go back to its decoder as soon as it has been drawn from
+void BlitFrame(PluginInfo* info, const VideoFrame& inFrame)
+{
+	VideoFrame& pixels = *info->mOutputPixels;
+	pixels.Resize(inFrame.mWidth, inFrame.mHeight);
+
+	size_t rowBytes = (size_t) inFrame.mWidth * 4;
+	for (long y = 0; y < inFrame.mHeight; y++) {
+		memcpy(&pixels.mPixels[y * pixels.mRowBytes], &inFrame.mPixels[y * inFrame.mRowBytes], rowBytes);
+	}
+	info->mNeedsDraw = true;
+}
+
+// close the MJPEG stream, if one is open; the video output keeps its last frame
+void StopStream(PluginInfo* info)
+{
+	if (info->mStream == nil)
+		return;
+
+	info->mStream->Stop();
+	info->mStream->Release();
+	info->mStream = nil;
+}
+
+// close the SSE subscription, if one is open
+void StopSubscription(PluginInfo* info)
+{
+	if (info->mSubscription == nil)
+		return;
+
+	info->mSubscription->Stop();
+	info->mSubscription->Release();
+	info->mSubscription = nil;
+}
+
+// send one SSE event to the event outputs, and its values to the value and
+// number outputs of the fields that are set
+void SendSseEvent(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info, const SseEvent& inEvent)
+{
+	SetOutputString(ip, inActorInfo, kOutputEventType, inEvent.mType.c_str());
+	SetOutputString(ip, inActorInfo, kOutputEventId, inEvent.mId.c_str());
+	SendRecordValues(ip, inActorInfo, info, inEvent.mHasValues, inEvent.mValues, kOutputEventData, inEvent.mData);
+}
+
+// close the WebSocket, if one is open
+void StopWebSocket(PluginInfo* info)
+{
+	if (info->mSocket == nil)
+		return;
+
+	info->mSocket->Stop();
+	info->mSocket->Release();
+	info->mSocket = nil;
+}
+
+// send one WebSocket message to the message output, and its values to the
+// value and number outputs of the fields that are set
+void SendWebSocketMessage(IsadoraParameters* ip, ActorInfo* inActorInfo, PluginInfo* info, const WebSocketMessage& inMessage)
+{
+	SendRecordValues(ip, inActorInfo, info, inMessage.mHasValues, inMessage.mValues, kOutputMessage, inMessage.mText);
+}
 
 // ************************* DUSX - user defined functions ^ ^ ^
 // ****************************************************************
@@ -562,33 +1373,394 @@ Boolean				/* inInitializing */)		// true if the value is being set when an acto
 	case kInputTrigger:
 		if (inNewValue->type == kBoolean) {
 
-			// Set URL.
-			// WinHttpClient client(L"http://www.ltg.ed.ac.uk/~richard/unicode-sample-3-2.html");
-		
-			std::string url = info->mURL;
-			std::wstring wurl(url.length(), L' '); 
-			std::copy(url.begin(), url.end(), wurl.begin());
-
-			WinHttpClient client(wurl);
-
-			// Send http request, a GET request by default.
-			client.SendHttpRequest();
-			// The response header.
-			std::wstring httpResponseHeader = client.GetHttpResponseHeader();
-			// The response content.
-			std::wstring httpResponseContent = client.GetHttpResponse();
-			
-			// convert wstring to string...
-			std::string responseString = ws2s(httpResponseContent);
-
-			// output containers
-			Value kOutTextValueStatus = { kString, nil };
-			std::string kStatusMessage = responseString; // set to standard string value.. can't seem to set kstring to wstring
-			AllocateValueString_(ip, kStatusMessage.c_str(), &kOutTextValueStatus);
-			SetOutputPropertyValue_(ip, inActorInfo, kOutputStatus, &kOutTextValueStatus);
-			ReleaseValueString_(ip, &kOutTextValueStatus);
+			// in telemetry mode the trigger only adds the body input to the
+			// buffer, which ServiceTelemetry sends once it is due
+			if (info->mTelemetry->GetFormat() != kTelemetryOff) {
+				info->mTelemetry->Add(info->mBodyText->Data(), info->mBodyText->Length(), GetTickCount());
+				ServiceTelemetry(ip, inActorInfo, info, false);
+				break;
+			}
+
+			// The request runs on the worker pool; ReceiveMessage sends the
+			// response to the outputs once it has arrived.
+			HttpRequest& request = *info->mRequest;
+			if (!request.IsIdempotentRead()) {
+				request.SetBody(info->mUseBodyFile ? info->mBodyFile : info->mBodyText);
+			}
+
+			PlaceCsvWindow(info);
+
+			if (info->mURLList->empty()) {
+
+				SetRequestURL(info);
+
+				if (info->mWebSocket) {
+					// a new trigger reconnects, to the URL as it is now
+					StopWebSocket(info);
+					info->mSocket = new WebSocketSession;
+					SubmitStreamJob(new WebSocketJob(info->mInbox, info->mPriority, request, info->mResponsePlan, info->mSocket));
+
+					// text entered with no session goes out once this one opens
+					if (info->mWsHasPending) {
+						if (info->mSocket->Queue(*info->mWsPending))
+							SubmitFetchJob(new WebSocketSendJob(info->mInbox, info->mPriority, info->mSocket));
+						info->mWsPending->clear();
+						info->mWsHasPending = false;
+					}
+				}
+				else if (info->mSse && request.IsIdempotentRead()) {
+					// a new trigger resubscribes, from the URL as it is now
+					StopSubscription(info);
+					info->mSubscription = new SseSubscription;
+					SubmitStreamJob(new SseStreamJob(info->mInbox, info->mPriority, request, info->mResponsePlan, info->mSubscription));
+				}
+				else if (info->mMjpeg && request.IsIdempotentRead()) {
+					// a new trigger reopens the stream, from the URL as it is now
+					StopStream(info);
+					info->mStream = new MjpegStream;
+					SubmitStreamJob(new MjpegStreamJob(info->mInbox, info->mPriority, request, info->mStream));
+				}
+				else if (info->mTail != kTailOff && request.IsIdempotentRead()) {
+					// the offset belongs to one URL; another one starts over
+					if (request.mURL != *info->mTailURL) {
+						*info->mTailURL = request.mURL;
+						info->mTailOffset = 0;
+						info->mTailStarted = false;
+					}
+					bool findEnd = info->mTail == kTailNew && !info->mTailStarted;
+					SubmitFetchJob(new TailFetchJob(info->mInbox, info->mPriority, request, info->mResponsePlan, info->mTailOffset, findEnd));
+				}
+				else if (request.IsIdempotentRead())
+					SubmitFetchJob(new PageFetchJob(info->mInbox, info->mPriority, request, info->mResponsePlan));
+				else
+					info->mChannel->Send(request, info->mPriority);
+			}
+			else if (!request.IsIdempotentRead()) {
+
+				// POST, PUT etc. must not run in parallel, so the list goes
+				// through the channel in order, one response at a time
+				for (size_t i = 0; i < info->mURLList->size(); i++) {
+					request.mURL = (*info->mURLList)[i];
+					info->mChannel->Send(request, info->mPriority);
+				}
+			}
+			else {
+
+				// a new trigger replaces a batch that is still in flight
+				if (info->mBatch != nil) {
+					info->mBatch->Abandon();
+					info->mBatch->Release();
+				}
+
+				// one job per URL so that the list is spread over the whole pool
+				info->mBatch = new FetchBatch(info->mInbox, info->mURLList->size(), info->mDeadlineMs);
+				for (size_t i = 0; i < info->mURLList->size(); i++) {
+					request.mURL = (*info->mURLList)[i];
+					SubmitFetchJob(new BatchItemJob(info->mBatch, info->mInbox, info->mPriority, i, request, info->mResponsePlan));
+				}
+			}
+
+			// the jobs hold their own reference to the body; letting go of ours
+			// is what lets the body input reuse the buffer once they are done
+			request.SetBody(nil);
+		}
+		break;
+
+	case kInputMethod:
+		if (inNewValue->type == kString) {
+			info->mRequest->mMethod = TrimmedCopy(inNewValue->u.str->strData);
+		}
+		break;
+
+	case kInputContentType:
+		if (inNewValue->type == kString) {
+			info->mRequest->mContentType = inNewValue->u.str->strData;
+		}
+		break;
+
+	case kInputBody:
+		if (inNewValue->type == kString) {
+			if (info->mBodyText->IsShared()) {
+				info->mBodyText->Release();
+				info->mBodyText = new HttpBody;
+			}
+			info->mBodyText->Assign(inNewValue->u.str->strData, strlen(inNewValue->u.str->strData));
+		}
+		break;
+
+	case kInputBodyFile:
+		if (inNewValue->type == kString) {
+			if (info->mBodyFile->IsShared()) {
+				info->mBodyFile->Release();
+				info->mBodyFile = new HttpBody;
+			}
+
+			info->mUseBodyFile = inNewValue->u.str->strData[0] != '\0';
+			if (info->mUseBodyFile) {
+				if (!info->mBodyFile->MapFile(inNewValue->u.str->strData)) {
+					SetOutputString(ip, inActorInfo, kOutputStatus, "ERROR: cannot open body_file");
+				}
+			}
+			else {
+				info->mBodyFile->Clear();
+			}
+		}
+		break;
+
+	case kInputURLList:
+		if (inNewValue->type == kString) {
+			ParseURLList(inNewValue->u.str->strData, *info->mURLList);
+		}
+		break;
+
+	case kInputURLTemplate:
+		if (inNewValue->type == kString) {
+			info->mURLTemplate->Compile(inNewValue->u.str->strData);
+		}
+		break;
+
+	case kInputParam1:
+	case kInputParam2:
+	case kInputParam3:
+	case kInputParam4:
+		if (inNewValue->type == kString) {
+			info->mURLTemplate->SetParam(inPropertyIndex1 - kInputParam1, inNewValue->u.str->strData);
+		}
+		break;
+
+	case kInputDeadline:
+		if (inNewValue->type == kInteger) {
+			info->mDeadlineMs = inNewValue->u.ivalue > 0 ? (DWORD) inNewValue->u.ivalue : 0;
+		}
+		break;
+
+	case kInputPriority:
+		if (inNewValue->type == kInteger) {
+			info->mPriority = FetchPriorityFromInt(inNewValue->u.ivalue);
+		}
+		break;
+
+	case kInputField1:
+	case kInputField2:
+	case kInputField3:
+	case kInputField4:
+		if (inNewValue->type == kString) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			if (!plan->SetPointer(inPropertyIndex1 - kInputField1, TrimmedCopy(inNewValue->u.str->strData).c_str())) {
+				SetOutputString(ip, inActorInfo, kOutputStatus, "ERROR: a field must be a JSON pointer starting with /");
+			}
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputGeoJson:
+		if (inNewValue->type == kBoolean) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetGeoJson(inNewValue->u.ivalue != 0);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
 
+	case kInputGeoProperties:
+		if (inNewValue->type == kString) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetGeoProperties(inNewValue->u.str->strData);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputPattern:
+	case kInputPattern2:
+	case kInputPattern3:
+	case kInputPattern4:
+		if (inNewValue->type == kString) {
+			// compiled here, once, rather than for every response
+			int slot = inPropertyIndex1 == kInputPattern ? 0 : inPropertyIndex1 - kInputPattern2 + 1;
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			std::string error;
+			if (!plan->SetPattern(slot, inNewValue->u.str->strData, error)) {
+				SetOutputString(ip, inActorInfo, kOutputStatus, error.c_str());
+			}
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputMatchIndex:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetMatchIndex(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
 
+	case kInputMatchSteps:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetMatchSteps(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputMatchStackKB:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetMatchStackKB(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputCsv:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetCsv(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputCsvColumns:
+		if (inNewValue->type == kString) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetCsvColumns(inNewValue->u.str->strData);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputXml:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetXml(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputXmlPaths:
+		if (inNewValue->type == kString) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetXmlPaths(inNewValue->u.str->strData);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputXmlItems:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetXmlItems(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputDiff:
+		if (inNewValue->type == kInteger) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetDiff(inNewValue->u.ivalue);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputImage:
+		if (inNewValue->type == kBoolean) {
+			ResponsePlan* plan = new ResponsePlan(*info->mResponsePlan);
+			plan->SetImage(inNewValue->u.ivalue != 0);
+			ReplaceResponsePlan(info, plan);
+		}
+		break;
+
+	case kInputMjpeg:
+		if (inNewValue->type == kBoolean) {
+			info->mMjpeg = inNewValue->u.ivalue != 0;
+			if (!info->mMjpeg)
+				StopStream(info);
+		}
+		break;
+
+	case kInputSse:
+		if (inNewValue->type == kBoolean) {
+			info->mSse = inNewValue->u.ivalue != 0;
+			if (!info->mSse)
+				StopSubscription(info);
+		}
+		break;
+
+	case kInputWebSocket:
+		if (inNewValue->type == kBoolean) {
+			info->mWebSocket = inNewValue->u.ivalue != 0;
+			if (!info->mWebSocket)
+				StopWebSocket(info);
+		}
+		break;
+
+	case kInputWsSend:
+		if (inNewValue->type == kString && info->mSocket != nil) {
+			if (info->mSocket->Queue(inNewValue->u.str->strData))
+				SubmitFetchJob(new WebSocketSendJob(info->mInbox, info->mPriority, info->mSocket));
+		}
+		else if (inNewValue->type == kString) {
+			// kept until a trigger opens a socket
+			*info->mWsPending = inNewValue->u.str->strData;
+			info->mWsHasPending = true;
+		}
+		break;
+
+	case kInputCoalesce:
+		if (inNewValue->type == kBoolean) {
+			info->mCoalesce = inNewValue->u.ivalue != 0;
+		}
+		break;
+
+	case kInputTail:
+		if (inNewValue->type == kInteger) {
+			// the next trigger starts over
+			info->mTail = inNewValue->u.ivalue;
+			info->mTailURL->clear();
+			info->mTailOffset = 0;
+			info->mTailStarted = false;
+			info->mTailRecords->clear();
+		}
+		break;
+
+	case kInputRecordsPerFrame:
+		if (inNewValue->type == kInteger) {
+			info->mRecordsPerFrame = inNewValue->u.ivalue > 0 ? inNewValue->u.ivalue : 0;
+		}
+		break;
+
+	case kInputRowIndex:
+		if (inNewValue->type == kInteger) {
+			info->mRowIndex = inNewValue->u.ivalue;
+			SendCsvRow(ip, inActorInfo, info);
+
+			// a row the last response read but did not keep needs another trigger
+			bool kept = info->mRowIndex >= info->mRowsFirst && info->mRowIndex - info->mRowsFirst < (long) info->mRows->Count();
+			if (!kept && info->mRowIndex >= 1 && info->mRowIndex <= info->mRowCount)
+				SetOutputString(ip, inActorInfo, kOutputStatus, "ERROR: row_index is outside the rows kept; trigger again to load the rows around it");
+		}
+		break;
+
+	case kInputPointIndex:
+		if (inNewValue->type == kInteger) {
+			info->mPointIndex = inNewValue->u.ivalue;
+			SendGeoJsonPoint(ip, inActorInfo, info);
+		}
+		break;
+
+	case kInputTelemetry:
+		if (inNewValue->type == kInteger) {
+			// records already buffered go out in the format they were written in
+			ServiceTelemetry(ip, inActorInfo, info, true);
+			long format = inNewValue->u.ivalue;
+			info->mTelemetry->SetFormat(format <= kTelemetryOff ? kTelemetryOff : format >= kTelemetryJSONArray ? kTelemetryJSONArray : kTelemetryNDJSON);
+		}
+		break;
+
+	case kInputFlushBytes:
+		if (inNewValue->type == kInteger) {
+			info->mTelemetry->SetFlushBytes(inNewValue->u.ivalue > 0 ? (size_t) inNewValue->u.ivalue : 0);
+		}
+		break;
+
+	case kInputFlushMs:
+		if (inNewValue->type == kInteger) {
+			info->mTelemetry->SetFlushMs(inNewValue->u.ivalue > 0 ? (DWORD) inNewValue->u.ivalue : 0);
 		}
 		break;
 
@@ -730,6 +1902,144 @@ long				inRefCon)					// in our use, actually the pointer to our ActorInfo
 	// We use this Value struct in a few places below...
 	Value v = { kData, nil };
 
+	// a batch that has run out of time posts what it has into the inbox
+	if (info->mBatch != nil) {
+		info->mBatch->CheckDeadline(GetTickCount());
+		if (info->mBatch->IsFinished()) {
+			info->mBatch->Release();
+			info->mBatch = nil;
+		}
+	}
+
+	// buffered telemetry goes out on time even when no trigger arrives
+	if (info->mTelemetry->GetFormat() != kTelemetryOff) {
+		ServiceTelemetry(ip, actorInfo, info, false);
+	}
+
+	// hand any fetches completed since the last frame to the outputs
+	std::vector<FetchResult*> results;
+	if (info->mInbox->Drain(results)) {
+		for (size_t i = 0; i < results.size(); i++) {
+			FetchResult* result = results[i];
+			switch (result->mKind) {
+			case kFetchResultStatus:
+				SetOutputString(ip, actorInfo, kOutputStatus, result->mText.c_str());
+				break;
+			case kFetchResultBatchItem:
+				SetOutputInteger(ip, actorInfo, kOutputItemIndex, result->mIndex);
+				SetOutputString(ip, actorInfo, kOutputItem, result->mText.c_str());
+				break;
+			case kFetchResultBatch:
+				SetOutputString(ip, actorInfo, kOutputBatch, result->mText.c_str());
+				break;
+			case kFetchResultField:
+				SetOutputString(ip, actorInfo, kOutputValue1 + result->mIndex - 1, result->mText.c_str());
+				SetOutputFloat(ip, actorInfo, kOutputNumber1 + result->mIndex - 1, result->mNumber);
+				break;
+			case kFetchResultPoints:
+				info->mPoints->Swap(static_cast<GeoJsonResult*>(result)->mPoints);
+				SetOutputInteger(ip, actorInfo, kOutputPointCount, (long) info->mPoints->Count());
+				SendGeoJsonPoint(ip, actorInfo, info);
+				break;
+			case kFetchResultRows:
+				{
+					// the first chunk of a response replaces the table and the first
+					// rows of the window start it, later ones extend it; the row is
+					// only sent again when it may have changed
+					CsvRowsResult* chunk = static_cast<CsvRowsResult*>(result);
+					long first = chunk->mIndex;
+					long added = (long) chunk->mRows.Count();
+					if (chunk->mStart || info->mRows->Count() == 0) {
+						info->mRows->Swap(chunk->mRows);
+						info->mRowsFirst = first;
+					}
+					else
+						info->mRows->Append(chunk->mRows);
+					info->mRowCount = (long) chunk->mNumber;
+					SetOutputInteger(ip, actorInfo, kOutputRowCount, info->mRowCount);
+					if (chunk->mStart || (info->mRowIndex >= first && info->mRowIndex - first < added))
+						SendCsvRow(ip, actorInfo, info);
+				}
+				break;
+			case kFetchResultChanges:
+				SetOutputInteger(ip, actorInfo, kOutputChangeCount, (long) result->mNumber);
+				SetOutputString(ip, actorInfo, kOutputChanges, result->mText.c_str());
+				break;
+			case kFetchResultImage:
+				// deleting the result below recycles the frame once it is copied
+				BlitFrame(info, *static_cast<ImageResult*>(result)->mFrame);
+				break;
+			case kFetchResultTail:
+				{
+					// a poll that started from an older offset overlapped one already taken
+					TailResult* tail = static_cast<TailResult*>(result);
+					if (tail->mURL == *info->mTailURL && tail->mStart == info->mTailOffset) {
+						info->mTailOffset = tail->mEnd;
+						info->mTailStarted = true;
+						info->mTailRecords->insert(info->mTailRecords->end(), tail->mRecords.begin(), tail->mRecords.end());
+
+						// the oldest records go when the patch is not keeping up
+						while (info->mTailRecords->size() > kTailMaxWaiting)
+							info->mTailRecords->pop_front();
+					}
+				}
+				break;
+			}
+			delete result;
+		}
+	}
+
+	if (info->mTail != kTailOff) {
+		ServiceTail(ip, actorInfo, info);
+	}
 
-	// SetOutputPropertyValue_(ip, info->mActorInfoPtr, kOutputVideo, &v);
+	// every SSE event that arrived since the last tick, in order
+	if (info->mSubscription != nil && info->mSubscription->Drain(*info->mEvents)) {
+		for (size_t i = 0; i < info->mEvents->size(); i++) {
+			SendSseEvent(ip, actorInfo, info, (*info->mEvents)[i]);
+		}
+		info->mEvents->clear();
+	}
+
+	// the WebSocket messages waiting in the ring, oldest first, or only the
+	// newest when coalescing. At most a ring's worth is taken, so a reader
+	// refilling it as fast as it empties cannot hold up the tick.
+	if (info->mSocket != nil) {
+		WebSocketQueue& inbound = info->mSocket->GetInbound();
+		if (info->mCoalesce)
+			info->mSocket->AddDropped(inbound.SkipToNewest());
+		for (LONG i = 0; i < kWebSocketQueueSize; i++) {
+			WebSocketMessage* message = inbound.Front();
+			if (message == nil)
+				break;
+			SendWebSocketMessage(ip, actorInfo, info, *message);
+			inbound.Pop();
+		}
+
+		if (info->mSocket->GetDropped() != info->mReportedMessagesDropped) {
+			info->mReportedMessagesDropped = info->mSocket->GetDropped();
+			SetOutputInteger(ip, actorInfo, kOutputMessagesDropped, info->mReportedMessagesDropped);
+		}
+	}
+
+	// the newest frame of an MJPEG stream; any decoded since the last tick are skipped
+	if (info->mStream != nil) {
+		VideoFrame* frame = info->mStream->GetFrames().TakeNewest();
+		if (frame != nil)
+			BlitFrame(info, *frame);
+	}
+
+	// the copied pixels go out through the map's output buffer, once per new image
+	ImageBuffer* buffer = GetOutputBuffer(info);
+	if (info->mNeedsDraw && buffer != nil && info->mOutputPixels->mWidth > 0) {
+		const VideoFrame& pixels = *info->mOutputPixels;
+		buffer->mWidth = pixels.mWidth;
+		buffer->mHeight = pixels.mHeight;
+		buffer->mRowBytes = pixels.mRowBytes;
+		buffer->mDepth = 32;
+		buffer->mBaseAddr = (void*) &pixels.mPixels[0];
+		v.u.data = buffer;
+		SetOutputPropertyValue_(ip, info->mActorInfoPtr, kOutputVideo, &v);
+		info->mNeedsDraw = false;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,566 @@
+// ===========================================================================
+//	JsonCursor.cpp
+// ===========================================================================
+
+#include "JsonCursor.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define JSON_USE_SSE2	1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// ---------------------------------------------------------------------------------
+//		AppendUTF8
+// ---------------------------------------------------------------------------------
+
+void
+AppendUTF8(std::string& ioOut, unsigned long inCodePoint)
+{
+	if (inCodePoint < 0x80) {
+		ioOut += static_cast<char>(inCodePoint);
+	}
+	else if (inCodePoint < 0x800) {
+		ioOut += static_cast<char>(0xC0 | (inCodePoint >> 6));
+		ioOut += static_cast<char>(0x80 | (inCodePoint & 0x3F));
+	}
+	else if (inCodePoint < 0x10000) {
+		ioOut += static_cast<char>(0xE0 | (inCodePoint >> 12));
+		ioOut += static_cast<char>(0x80 | ((inCodePoint >> 6) & 0x3F));
+		ioOut += static_cast<char>(0x80 | (inCodePoint & 0x3F));
+	}
+	else {
+		ioOut += static_cast<char>(0xF0 | (inCodePoint >> 18));
+		ioOut += static_cast<char>(0x80 | ((inCodePoint >> 12) & 0x3F));
+		ioOut += static_cast<char>(0x80 | ((inCodePoint >> 6) & 0x3F));
+		ioOut += static_cast<char>(0x80 | (inCodePoint & 0x3F));
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		Character scanning
+// ---------------------------------------------------------------------------------
+
+static inline bool
+IsSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool
+IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+#if JSON_USE_SSE2
+static inline int
+LowestBit(unsigned int inMask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, inMask);
+	return (int) index;
+#else
+	return __builtin_ctz(inMask);
+#endif
+}
+#endif
+
+// returns the first character at or after p that is not JSON whitespace
+static const char*
+SpaceEnd(const char* p, const char* end)
+{
+	// tokens are mostly separated by nothing or a single space, so the wide
+	// compare only kicks in for runs such as pretty-printed indentation
+	while (p < end && IsSpace(*p)) {
+#if JSON_USE_SSE2
+		if (end - p >= 16) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i spaces = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+			unsigned int other = ~_mm_movemask_epi8(spaces) & 0xFFFF;
+			if (other != 0)
+				return p + LowestBit(other);
+			p += 16;
+			continue;
+		}
+#endif
+		p++;
+	}
+	return p;
+}
+
+// returns the first '"' or '\' at or after p, or end
+static const char*
+FindQuoteOrBackslash(const char* p, const char* end)
+{
+#if JSON_USE_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		unsigned int hits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+		if (hits != 0)
+			return p + LowestBit(hits);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && *p != '\\')
+		p++;
+	return p;
+}
+
+// returns the first quote or bracket at or after p, or end. Setting bit 5 turns
+// '[' and ']' into '{' and '}', so three compares cover all five characters.
+static const char*
+FindStructural(const char* p, const char* end)
+{
+#if JSON_USE_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i open = _mm_set1_epi8('{');
+	const __m128i close = _mm_set1_epi8('}');
+	const __m128i bit5 = _mm_set1_epi8(0x20);
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i folded = _mm_or_si128(chunk, bit5);
+		__m128i hitMask = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+			_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+		unsigned int hits = _mm_movemask_epi8(hitMask);
+		if (hits != 0)
+			return p + LowestBit(hits);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && (*p | 0x20) != '{' && (*p | 0x20) != '}')
+		p++;
+	return p;
+}
+
+// ---------------------------------------------------------------------------------
+//		JsonCursor
+// ---------------------------------------------------------------------------------
+
+JsonCursor::JsonCursor(const char* inText, size_t inLength)
+	: mText(inText)
+	, mPos(inText)
+	, mEnd(inText + inLength)
+	, mError("")
+{
+}
+
+void
+JsonCursor::FormatError(std::string& outError) const
+{
+	char buf[128];
+	_snprintf(buf, sizeof(buf), "ERROR: invalid JSON at offset %lu: %s", (unsigned long) (mPos - mText), mError);
+	buf[sizeof(buf) - 1] = '\0';
+	outError = buf;
+}
+
+bool
+JsonCursor::Fail(const char* inWhat)
+{
+	mError = inWhat;
+	return false;
+}
+
+bool
+JsonCursor::SkipSpace()
+{
+	mPos = SpaceEnd(mPos, mEnd);
+	if (mPos >= mEnd)
+		return Fail("unexpected end of text");
+	return true;
+}
+
+bool
+JsonCursor::EnterObject(bool& outMore)
+{
+	mPos++;
+	if (!SkipSpace())
+		return false;
+	outMore = *mPos != '}';
+	if (!outMore)
+		mPos++;
+	return true;
+}
+
+// names without escapes, which is nearly all of them, are returned in place;
+// others are decoded into mKeyScratch
+bool
+JsonCursor::ReadMemberName(const char*& outKey, size_t& outLength)
+{
+	if (!SkipSpace())
+		return false;
+	if (*mPos != '"')
+		return Fail("expected a member name");
+
+	const char* start = mPos + 1;
+	const char* run = FindQuoteOrBackslash(start, mEnd);
+
+	if (run < mEnd && *run == '"') {
+		outKey = start;
+		outLength = run - start;
+		mPos = run + 1;
+	}
+	else {
+		if (!ParseString(&mKeyScratch))
+			return false;
+		outKey = mKeyScratch.data();
+		outLength = mKeyScratch.length();
+	}
+
+	if (!SkipSpace())
+		return false;
+	if (*mPos != ':')
+		return Fail("expected ':'");
+	mPos++;
+	return true;
+}
+
+bool
+JsonCursor::NextMember(bool& outMore)
+{
+	if (!SkipSpace())
+		return false;
+	if (*mPos != ',' && *mPos != '}')
+		return Fail("expected ',' or '}'");
+	outMore = *mPos++ == ',';
+	return true;
+}
+
+bool
+JsonCursor::EnterArray(bool& outMore)
+{
+	mPos++;
+	if (!SkipSpace())
+		return false;
+	outMore = *mPos != ']';
+	if (!outMore)
+		mPos++;
+	return true;
+}
+
+bool
+JsonCursor::NextElement(bool& outMore)
+{
+	if (!SkipSpace())
+		return false;
+	if (*mPos != ',' && *mPos != ']')
+		return Fail("expected ',' or ']'");
+	outMore = *mPos++ == ',';
+	return true;
+}
+
+bool
+JsonCursor::SkipValue()
+{
+	if (!SkipSpace())
+		return false;
+
+	switch (*mPos) {
+	case '"':
+		return ParseString(NULL);
+	case '{':
+	case '[':
+		mPos++;
+		return SkipRest(1);
+	}
+
+	// a number or literal runs up to the next delimiter
+	const char* start = mPos;
+	while (mPos < mEnd && *mPos != ',' && *mPos != '}' && *mPos != ']' && !IsSpace(*mPos))
+		mPos++;
+	if (mPos == start)
+		return Fail("unexpected character");
+	return true;
+}
+
+bool
+JsonCursor::SkipRest(int inDepth)
+{
+	while (inDepth > 0) {
+
+		mPos = FindStructural(mPos, mEnd);
+		if (mPos >= mEnd)
+			return Fail("unexpected end of text");
+
+		switch (*mPos) {
+		case '"':
+			if (!ParseString(NULL))
+				return false;
+			break;
+		case '{':
+		case '[':
+			if (++inDepth > kJsonMaxDepth)
+				return Fail("nested too deeply");
+			mPos++;
+			break;
+		default:
+			inDepth--;
+			mPos++;
+			break;
+		}
+	}
+	return true;
+}
+
+bool
+JsonCursor::ReadHex4(unsigned long& outValue)
+{
+	if (mEnd - mPos < 4)
+		return false;
+
+	outValue = 0;
+	for (int i = 0; i < 4; i++) {
+		char h = *mPos++;
+		if (IsDigit(h))
+			outValue = (outValue << 4) | (unsigned long) (h - '0');
+		else if ((h | 0x20) >= 'a' && (h | 0x20) <= 'f')
+			outValue = (outValue << 4) | (unsigned long) ((h | 0x20) - 'a' + 10);
+		else
+			return false;
+	}
+	return true;
+}
+
+bool
+JsonCursor::ParseString(std::string* outText)
+{
+	mPos++;
+	if (outText != NULL)
+		outText->clear();
+
+	for (;;) {
+
+		const char* run = FindQuoteOrBackslash(mPos, mEnd);
+		if (outText != NULL)
+			outText->append(mPos, run);
+		mPos = run;
+
+		if (mPos >= mEnd)
+			return Fail("unterminated string");
+
+		if (*mPos++ == '"')
+			return true;
+
+		if (mPos >= mEnd)
+			return Fail("unterminated string");
+
+		char escaped = *mPos++;
+		char c;
+		switch (escaped) {
+		case '"':	c = '"';	break;
+		case '\\':	c = '\\';	break;
+		case '/':	c = '/';	break;
+		case 'b':	c = '\b';	break;
+		case 'f':	c = '\f';	break;
+		case 'n':	c = '\n';	break;
+		case 'r':	c = '\r';	break;
+		case 't':	c = '\t';	break;
+		case 'u':
+			{
+				unsigned long cp;
+				if (!ReadHex4(cp))
+					return Fail("bad \\u escape");
+
+				// a high surrogate combines with the low surrogate after it
+				if (cp >= 0xD800 && cp < 0xDC00 && mEnd - mPos >= 6 && mPos[0] == '\\' && mPos[1] == 'u') {
+					const char* pair = mPos;
+					unsigned long low;
+					mPos += 2;
+					if (ReadHex4(low) && low >= 0xDC00 && low < 0xE000)
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					else
+						mPos = pair;
+				}
+
+				if (outText != NULL)
+					AppendUTF8(*outText, cp);
+			}
+			continue;
+		default:
+			return Fail("bad escape");
+		}
+
+		if (outText != NULL)
+			*outText += c;
+	}
+}
+
+bool
+JsonCursor::ParseNumber()
+{
+	const char* p = mPos;
+
+	if (p < mEnd && *p == '-')
+		p++;
+	if (p >= mEnd || !IsDigit(*p))
+		return Fail("unexpected character");
+
+	if (*p == '0') {
+		p++;
+	}
+	else {
+		while (p < mEnd && IsDigit(*p))
+			p++;
+	}
+
+	if (p < mEnd && *p == '.') {
+		p++;
+		if (p >= mEnd || !IsDigit(*p))
+			return Fail("bad number");
+		while (p < mEnd && IsDigit(*p))
+			p++;
+	}
+
+	if (p < mEnd && (*p == 'e' || *p == 'E')) {
+		p++;
+		if (p < mEnd && (*p == '+' || *p == '-'))
+			p++;
+		if (p >= mEnd || !IsDigit(*p))
+			return Fail("bad number");
+		while (p < mEnd && IsDigit(*p))
+			p++;
+	}
+
+	mPos = p;
+	return true;
+}
+
+bool
+JsonCursor::ParseLiteral(const char* inWord, size_t inLength)
+{
+	if ((size_t) (mEnd - mPos) < inLength || memcmp(mPos, inWord, inLength) != 0)
+		return Fail("unexpected character");
+	mPos += inLength;
+	return true;
+}
+
+
+bool
+JsonCursor::ReadNumber(double& outValue)
+{
+	const char* start = mPos;
+	if (!ParseNumber())
+		return false;
+	outValue = JsonNumberValue(start, mPos);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		JsonKeyIs
+// ---------------------------------------------------------------------------------
+
+bool
+JsonKeyIs(const char* inKey, size_t inLength, const char* inName)
+{
+	return strlen(inName) == inLength && memcmp(inKey, inName, inLength) == 0;
+}
+
+// ---------------------------------------------------------------------------------
+//		JsonNumberValue
+// ---------------------------------------------------------------------------------
+//	Coordinates and sensor values are short decimals, so the digits are gathered
+//	into a 64-bit integer, eight at a time where possible, and scaled by an exact
+//	power of ten. That gives the correctly rounded result whenever the mantissa
+//	fits in 53 bits and the scale is at most 22; anything else goes to strtod.
+
+// true if the eight bytes of inChunk are all ASCII digits
+static inline bool
+IsEightDigits(uint64_t inChunk)
+{
+	return (((inChunk + 0x4646464646464646ULL) | (inChunk - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0;
+}
+
+// the value of eight ASCII digits loaded little-endian, so the first digit is
+// in the low byte. Pairs, then quads, are combined with two multiplies.
+static inline uint32_t
+EightDigitsValue(uint64_t inChunk)
+{
+	const uint64_t mask = 0x000000FF000000FFULL;
+	const uint64_t mul1 = 100 + (1000000ULL << 32);
+	const uint64_t mul2 = 1 + (10000ULL << 32);
+
+	inChunk -= 0x3030303030303030ULL;
+	inChunk = (inChunk * 10) + (inChunk >> 8);
+	inChunk = (((inChunk & mask) * mul1) + (((inChunk >> 16) & mask) * mul2)) >> 32;
+	return static_cast<uint32_t>(inChunk);
+}
+
+static const char*
+AccumulateDigits(const char* p, const char* end, uint64_t& ioMantissa, int& ioDigits)
+{
+	while (end - p >= 8) {
+		uint64_t chunk;
+		memcpy(&chunk, p, 8);
+		if (!IsEightDigits(chunk))
+			break;
+		ioMantissa = ioMantissa * 100000000 + EightDigitsValue(chunk);
+		ioDigits += 8;
+		p += 8;
+	}
+	while (p < end && IsDigit(*p)) {
+		ioMantissa = ioMantissa * 10 + (*p - '0');
+		ioDigits++;
+		p++;
+	}
+	return p;
+}
+
+double
+JsonNumberValue(const char* inStart, const char* inEnd)
+{
+	static const double kPowersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char* p = inStart;
+	bool negative = *p == '-';
+	if (negative)
+		p++;
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	p = AccumulateDigits(p, inEnd, mantissa, digits);
+
+	int scale = 0;
+	if (p < inEnd && *p == '.') {
+		int before = digits;
+		p = AccumulateDigits(p + 1, inEnd, mantissa, digits);
+		scale = before - digits;
+	}
+
+	if (p < inEnd && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negativeExponent = *p == '-';
+		if (*p == '-' || *p == '+')
+			p++;
+		int exponent = 0;
+		for (; p < inEnd && IsDigit(*p); p++) {
+			if (exponent < 10000)
+				exponent = exponent * 10 + (*p - '0');
+		}
+		scale += negativeExponent ? -exponent : exponent;
+	}
+
+	if (digits <= 19 && mantissa <= (1ULL << 53) && scale >= -22 && scale <= 22) {
+		double value = static_cast<double>(mantissa);
+		value = scale < 0 ? value / kPowersOf10[-scale] : value * kPowersOf10[scale];
+		return negative ? -value : value;
+	}
+
+	std::string text(inStart, inEnd);
+	return strtod(text.c_str(), NULL);
+}
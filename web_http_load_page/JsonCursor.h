@@ -0,0 +1,88 @@
+// ===========================================================================
+//	JsonCursor.h
+// ===========================================================================
+//
+//	The low level reading shared by the JSON scanners (JsonExtract, GeoJson).
+//
+//	A JsonCursor walks a buffer of JSON text without building a tree. The
+//	scanners derive from it and decide, container by container, what to decode
+//	and what to step over: SkipValue and SkipRest only look for quotes and
+//	brackets, sixteen bytes at a time with SSE2, so a subtree nobody asked for
+//	costs little more than a memchr over it.
+//
+//	Every call returns false on malformed input and leaves a description for
+//	FormatError.
+
+#ifndef JSONCURSOR_H
+#define JSONCURSOR_H
+
+#include <string>
+
+// deepest nesting accepted before the document is rejected
+static const int	kJsonMaxDepth = 256;
+
+class JsonCursor
+{
+public:
+	JsonCursor(const char* inText, size_t inLength);
+
+	// "ERROR: invalid JSON at offset N: ..." for the last failure
+	void	FormatError(std::string& outError) const;
+
+protected:
+	// moves past white space; returns false at the end of the text
+	bool	SkipSpace();
+	bool	AtEnd() const				{ return mPos >= mEnd; }
+	char	Peek() const				{ return *mPos; }
+
+	// objects: EnterObject steps over '{' and reports whether a member
+	// follows. ReadMemberName then reads the name and its ':', and after the
+	// member's value NextMember steps over ',' or the closing '}'.
+	bool	EnterObject(bool& outMore);
+	bool	ReadMemberName(const char*& outKey, size_t& outLength);
+	bool	NextMember(bool& outMore);
+
+	// arrays: the same for '[', ',' and ']'
+	bool	EnterArray(bool& outMore);
+	bool	NextElement(bool& outMore);
+
+	// decodes into outText when it is not NULL, otherwise only steps over the string
+	bool	ParseString(std::string* outText);
+
+	// steps over a number after checking it against the JSON grammar
+	bool	ParseNumber();
+
+	// parses a number and converts it
+	bool	ReadNumber(double& outValue);
+
+	bool	ParseLiteral(const char* inWord, size_t inLength);
+
+	// steps over the value at the cursor without decoding it
+	bool	SkipValue();
+
+	// steps forward until inDepth open containers have been closed
+	bool	SkipRest(int inDepth);
+
+	bool	Fail(const char* inWhat);
+
+	const char*		mText;
+	const char*		mPos;
+	const char*		mEnd;
+	const char*		mError;
+
+private:
+	bool	ReadHex4(unsigned long& outValue);
+
+	std::string		mKeyScratch;		// member names that contain escapes are decoded here
+};
+
+// true if the member name inKey, inLength equals the literal inName
+bool	JsonKeyIs(const char* inKey, size_t inLength, const char* inName);
+
+// converts number text already checked by ParseNumber
+double	JsonNumberValue(const char* inStart, const char* inEnd);
+
+// appends inCodePoint to ioOut encoded as UTF-8
+void	AppendUTF8(std::string& ioOut, unsigned long inCodePoint);
+
+#endif
@@ -0,0 +1,448 @@
+// ===========================================================================
+//	JsonDiff.cpp
+// ===========================================================================
+
+#include "JsonDiff.h"
+#include "JsonCursor.h"
+
+#include <algorithm>
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		JsonSnapshotReader
+// ---------------------------------------------------------------------------------
+//	Reads every value of a document into the snapshot's node list.
+
+class JsonSnapshotReader : public JsonCursor
+{
+public:
+	JsonSnapshotReader(const std::string& inText, std::vector<JsonSnapshotNode>& outNodes)
+		: JsonCursor(inText.data(), inText.length()), mNodes(outNodes) {}
+
+	bool	Run(std::string& outError);
+
+private:
+	JsonSnapshotReader& operator=(const JsonSnapshotReader&);
+
+	bool	ParseValue(int inDepth);
+
+	std::vector<JsonSnapshotNode>&	mNodes;
+};
+
+bool
+JsonSnapshotReader::Run(std::string& outError)
+{
+	bool ok = ParseValue(0);
+	if (ok && SkipSpace())
+		ok = Fail("unexpected text after the value");
+
+	if (!ok)
+		FormatError(outError);
+	return ok;
+}
+
+bool
+JsonSnapshotReader::ParseValue(int inDepth)
+{
+	if (inDepth > kJsonMaxDepth)
+		return Fail("nested too deeply");
+	if (!SkipSpace())
+		return false;
+
+	// the node is filled in by index, since the children move the vector
+	size_t index = mNodes.size();
+	mNodes.push_back(JsonSnapshotNode());
+	mNodes[index].mKind = 0;
+	mNodes[index].mStart = mPos - mText;
+
+	bool more;
+	bool ok = true;
+	switch (Peek()) {
+	case '{':
+		mNodes[index].mKind = '{';
+		ok = EnterObject(more);
+		while (ok && more) {
+			const char* key;
+			size_t keyLength;
+			if (!ReadMemberName(key, keyLength))
+				return false;
+
+			// the name may be in scratch space that the member's value reuses
+			std::string name(key, keyLength);
+			size_t child = mNodes.size();
+			if (!ParseValue(inDepth + 1))
+				return false;
+			mNodes[child].mKey.swap(name);
+			ok = NextMember(more);
+		}
+		break;
+
+	case '[':
+		mNodes[index].mKind = '[';
+		ok = EnterArray(more);
+		while (ok && more) {
+			if (!ParseValue(inDepth + 1))
+				return false;
+			ok = NextElement(more);
+		}
+		break;
+
+	case '"':	ok = ParseString(NULL);				break;
+	case 't':	ok = ParseLiteral("true", 4);		break;
+	case 'f':	ok = ParseLiteral("false", 5);		break;
+	case 'n':	ok = ParseLiteral("null", 4);		break;
+	default:	ok = ParseNumber();					break;
+	}
+
+	if (!ok)
+		return false;
+
+	mNodes[index].mEnd = mPos - mText;
+	mNodes[index].mNext = mNodes.size();
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		JsonSnapshot
+// ---------------------------------------------------------------------------------
+
+void
+JsonSnapshot::Clear()
+{
+	mText.clear();
+	mNodes.clear();
+}
+
+void
+JsonSnapshot::Swap(JsonSnapshot& ioOther)
+{
+	mText.swap(ioOther.mText);
+	mNodes.swap(ioOther.mNodes);
+}
+
+bool
+JsonSnapshot::Read(std::string& ioText, std::string& outError)
+{
+	Clear();
+	mText.swap(ioText);
+
+	JsonSnapshotReader reader(mText, mNodes);
+	if (!reader.Run(outError)) {
+		Clear();
+		return false;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		Writing changes
+// ---------------------------------------------------------------------------------
+
+static void
+AppendQuoted(std::string& ioOut, const std::string& inText)
+{
+	static const char* kHex = "0123456789abcdef";
+
+	ioOut += '"';
+	for (size_t i = 0; i < inText.length(); i++) {
+		unsigned char c = static_cast<unsigned char>(inText[i]);
+		if (c == '"' || c == '\\') {
+			ioOut += '\\';
+			ioOut += static_cast<char>(c);
+		}
+		else if (c < 0x20) {
+			ioOut += "\\u00";
+			ioOut += kHex[c >> 4];
+			ioOut += kHex[c & 0xF];
+		}
+		else {
+			ioOut += static_cast<char>(c);
+		}
+	}
+	ioOut += '"';
+}
+
+// appends JSON text without the white space between its tokens
+static void
+AppendCompact(std::string& ioOut, const char* inStart, const char* inEnd)
+{
+	bool inString = false;
+	for (const char* p = inStart; p < inEnd; p++) {
+		char c = *p;
+		if (inString) {
+			if (c == '\\' && p + 1 < inEnd) {
+				ioOut += c;
+				c = *++p;
+			}
+			else if (c == '"') {
+				inString = false;
+			}
+		}
+		else if (c == '"') {
+			inString = true;
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			continue;
+		}
+		ioOut += c;
+	}
+}
+
+// appends a member name to a JSON pointer, escaping ~ and /
+static void
+AppendPointerToken(std::string& ioPath, const std::string& inKey)
+{
+	ioPath += '/';
+	for (size_t i = 0; i < inKey.length(); i++) {
+		if (inKey[i] == '~')
+			ioPath += "~0";
+		else if (inKey[i] == '/')
+			ioPath += "~1";
+		else
+			ioPath += inKey[i];
+	}
+}
+
+class JsonChangeWriter
+{
+public:
+	JsonChangeWriter(JsonDiffFormat inFormat, std::string& outText)
+		: mFormat(inFormat), mText(outText), mCount(0) {}
+
+	// inValue is NULL for a removal
+	void	Add(const char* inOp, const std::string& inPath, const JsonSnapshot* inValue, size_t inNode);
+	size_t	Finish();
+
+private:
+	JsonChangeWriter& operator=(const JsonChangeWriter&);
+
+	JsonDiffFormat	mFormat;
+	std::string&	mText;
+	size_t			mCount;
+};
+
+void
+JsonChangeWriter::Add(const char* inOp, const std::string& inPath, const JsonSnapshot* inValue, size_t inNode)
+{
+	const char* value = NULL;
+	const char* valueEnd = NULL;
+	if (inValue != NULL) {
+		const JsonSnapshotNode& node = inValue->mNodes[inNode];
+		value = inValue->mText.data() + node.mStart;
+		valueEnd = inValue->mText.data() + node.mEnd;
+	}
+
+	if (mFormat == kJsonDiffLines) {
+		mText += inPath;
+		mText += '=';
+		if (value != NULL)
+			AppendCompact(mText, value, valueEnd);
+		mText += '\n';
+	}
+	else {
+		mText += mCount == 0 ? "[" : ",";
+		mText += "{\"op\":\"";
+		mText += inOp;
+		mText += "\",\"path\":";
+		AppendQuoted(mText, inPath);
+		if (value != NULL) {
+			mText += ",\"value\":";
+			AppendCompact(mText, value, valueEnd);
+		}
+		mText += '}';
+	}
+	mCount++;
+}
+
+size_t
+JsonChangeWriter::Finish()
+{
+	if (mCount > 0 && mFormat != kJsonDiffLines)
+		mText += ']';
+	return mCount;
+}
+
+// ---------------------------------------------------------------------------------
+//		DiffJson
+// ---------------------------------------------------------------------------------
+
+// orders the members of an object by name
+struct JsonKeyLess
+{
+	JsonKeyLess(const std::vector<JsonSnapshotNode>& inNodes) : mNodes(inNodes) {}
+
+	bool	operator()(size_t inA, size_t inB) const	{ return mNodes[inA].mKey < mNodes[inB].mKey; }
+
+	const std::vector<JsonSnapshotNode>&	mNodes;
+};
+
+static void
+Children(const JsonSnapshot& inDoc, size_t inNode, std::vector<size_t>& outChildren)
+{
+	outChildren.clear();
+	const JsonSnapshotNode& node = inDoc.mNodes[inNode];
+	for (size_t i = inNode + 1; i < node.mNext; i = inDoc.mNodes[i].mNext) {
+		outChildren.push_back(i);
+	}
+}
+
+static void
+DiffNodes(
+	const JsonSnapshot&	inOld,
+	size_t				inOldNode,
+	const JsonSnapshot&	inNew,
+	size_t				inNewNode,
+	std::string&		ioPath,
+	JsonChangeWriter&	ioChanges)
+{
+	const JsonSnapshotNode& a = inOld.mNodes[inOldNode];
+	const JsonSnapshotNode& b = inNew.mNodes[inNewNode];
+
+	// the same text is the same value, however large the subtree
+	size_t length = a.mEnd - a.mStart;
+	if (length == b.mEnd - b.mStart && memcmp(inOld.mText.data() + a.mStart, inNew.mText.data() + b.mStart, length) == 0)
+		return;
+
+	if (a.mKind != b.mKind || a.mKind == 0) {
+		ioChanges.Add("replace", ioPath, &inNew, inNewNode);
+		return;
+	}
+
+	size_t pathLength = ioPath.length();
+	std::vector<size_t> oldChildren;
+	std::vector<size_t> newChildren;
+	Children(inOld, inOldNode, oldChildren);
+	Children(inNew, inNewNode, newChildren);
+
+	if (a.mKind == '[') {
+		size_t common = oldChildren.size() < newChildren.size() ? oldChildren.size() : newChildren.size();
+		char index[32];
+		for (size_t i = 0; i < newChildren.size(); i++) {
+			_snprintf(index, sizeof(index), "/%lu", (unsigned long) i);
+			index[sizeof(index) - 1] = '\0';
+			ioPath += index;
+			if (i < common)
+				DiffNodes(inOld, oldChildren[i], inNew, newChildren[i], ioPath, ioChanges);
+			else
+				ioChanges.Add("add", ioPath, &inNew, newChildren[i]);
+			ioPath.resize(pathLength);
+		}
+
+		// from the end, so each index is still valid when it is removed
+		for (size_t i = oldChildren.size(); i > common; i--) {
+			_snprintf(index, sizeof(index), "/%lu", (unsigned long) (i - 1));
+			index[sizeof(index) - 1] = '\0';
+			ioPath += index;
+			ioChanges.Add("remove", ioPath, NULL, 0);
+			ioPath.resize(pathLength);
+		}
+		return;
+	}
+
+	// members usually keep their order, so they are matched by position
+	// unless the names differ
+	bool sameOrder = oldChildren.size() == newChildren.size();
+	for (size_t i = 0; sameOrder && i < newChildren.size(); i++) {
+		sameOrder = inOld.mNodes[oldChildren[i]].mKey == inNew.mNodes[newChildren[i]].mKey;
+	}
+
+	if (sameOrder) {
+		for (size_t i = 0; i < newChildren.size(); i++) {
+			AppendPointerToken(ioPath, inNew.mNodes[newChildren[i]].mKey);
+			DiffNodes(inOld, oldChildren[i], inNew, newChildren[i], ioPath, ioChanges);
+			ioPath.resize(pathLength);
+		}
+		return;
+	}
+
+	JsonKeyLess less(inOld.mNodes);
+	std::sort(oldChildren.begin(), oldChildren.end(), less);
+	std::vector<bool> matched(oldChildren.size(), false);
+
+	for (size_t i = 0; i < newChildren.size(); i++) {
+		const JsonSnapshotNode& child = inNew.mNodes[newChildren[i]];
+		AppendPointerToken(ioPath, child.mKey);
+
+		size_t lo = 0;
+		size_t hi = oldChildren.size();
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (inOld.mNodes[oldChildren[mid]].mKey < child.mKey)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo < oldChildren.size() && inOld.mNodes[oldChildren[lo]].mKey == child.mKey && !matched[lo]) {
+			matched[lo] = true;
+			DiffNodes(inOld, oldChildren[lo], inNew, newChildren[i], ioPath, ioChanges);
+		}
+		else {
+			ioChanges.Add("add", ioPath, &inNew, newChildren[i]);
+		}
+		ioPath.resize(pathLength);
+	}
+
+	for (size_t k = 0; k < oldChildren.size(); k++) {
+		if (matched[k])
+			continue;
+		AppendPointerToken(ioPath, inOld.mNodes[oldChildren[k]].mKey);
+		ioChanges.Add("remove", ioPath, NULL, 0);
+		ioPath.resize(pathLength);
+	}
+}
+
+size_t
+DiffJson(const JsonSnapshot& inOld, const JsonSnapshot& inNew, JsonDiffFormat inFormat, std::string& outChanges)
+{
+	outChanges.clear();
+	JsonChangeWriter changes(inFormat, outChanges);
+	std::string path;
+
+	if (inNew.IsEmpty())
+		return 0;
+	if (inOld.IsEmpty())
+		changes.Add("replace", path, &inNew, 0);
+	else
+		DiffNodes(inOld, 0, inNew, 0, path, changes);
+
+	return changes.Finish();
+}
+
+// ---------------------------------------------------------------------------------
+//		JsonDiffState
+// ---------------------------------------------------------------------------------
+
+JsonDiffState::JsonDiffState()
+	: mRefCount(1)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+JsonDiffState::~JsonDiffState()
+{
+	DeleteCriticalSection(&mLock);
+}
+
+void
+JsonDiffState::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+JsonDiffState::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+size_t
+JsonDiffState::Update(JsonSnapshot& ioNext, JsonDiffFormat inFormat, std::string& outChanges)
+{
+	size_t count = DiffJson(mLast, ioNext, inFormat, outChanges);
+	mLast.Swap(ioNext);
+	ioNext.Clear();
+	return count;
+}
@@ -0,0 +1,111 @@
+// ===========================================================================
+//	JsonDiff.h
+// ===========================================================================
+//
+//	Structural differences between successive JSON responses, so that patches
+//	downstream of the actor only hear about what changed.
+//
+//	A JsonSnapshot is a document read once into a flat list of nodes, one per
+//	value, each holding its member name and the span of its text. Two
+//	snapshots are compared from the root down: a subtree whose text is the
+//	same in both is passed over with one memcmp, objects are matched member by
+//	member by name, and arrays element by element by index. Values are compared
+//	as written, so 1.0 and 1 differ, as do two spellings of the same string.
+//
+//	The changes are written as an RFC 6902 JSON Patch, or as path=value lines
+//	with the path a JSON pointer, the value compact JSON, and nothing after the
+//	= for a removed value. The first document is reported as replacing the
+//	root. Array elements past the end of the shorter array are added in
+//	ascending and removed in descending order, so the patch applies as written.
+
+#ifndef JSONDIFF_H
+#define JSONDIFF_H
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+// the values of the actor's diff input
+enum JsonDiffFormat
+{
+	kJsonDiffOff = 0,
+	kJsonDiffPatch,		// an RFC 6902 JSON Patch array
+	kJsonDiffLines		// one path=value line per change
+};
+
+// ---------------------------------------------------------------------------------
+//	JsonSnapshot
+// ---------------------------------------------------------------------------------
+
+struct JsonSnapshotNode
+{
+	std::string		mKey;				// member name, decoded; empty for array elements
+	char			mKind;				// '{', '[', or 0 for any other value
+	size_t			mStart;				// span of the value in the text
+	size_t			mEnd;
+	size_t			mNext;				// index of the node after this one's subtree
+};
+
+class JsonSnapshot
+{
+public:
+	bool	IsEmpty() const				{ return mNodes.empty(); }
+	void	Clear();
+	void	Swap(JsonSnapshot& ioOther);
+
+	// reads the document in ioText, taking the text rather than copying it.
+	// Returns false with a description in outError, leaving the snapshot
+	// empty, if it is not valid JSON.
+	bool	Read(std::string& ioText, std::string& outError);
+
+	std::string						mText;
+	std::vector<JsonSnapshotNode>	mNodes;		// in document order, the root first
+};
+
+// ---------------------------------------------------------------------------------
+//	DiffJson
+// ---------------------------------------------------------------------------------
+//	Writes the changes that turn inOld into inNew to outChanges in inFormat and
+//	returns how many there are. An empty inOld gives a single change of the
+//	root; no changes give an empty outChanges.
+
+size_t	DiffJson(const JsonSnapshot& inOld, const JsonSnapshot& inNew, JsonDiffFormat inFormat, std::string& outChanges);
+
+// ---------------------------------------------------------------------------------
+//	JsonDiffState
+// ---------------------------------------------------------------------------------
+//	The last document an actor received, shared by reference between the
+//	copies of its ResponsePlan so that every job diffs against it.
+//
+//	Responses can complete on several workers at once. A job holds the lock
+//	from its Update until its changes are posted, so the changes reach the
+//	actor in the order they were computed and each applies to the one before.
+
+class JsonDiffState
+{
+public:
+	JsonDiffState();
+
+	void	AddRef();
+	void	Release();
+
+	void	Lock()						{ EnterCriticalSection(&mLock); }
+	void	Unlock()					{ LeaveCriticalSection(&mLock); }
+
+	// diffs ioNext against the last document and keeps ioNext in its place,
+	// leaving ioNext empty. Call with the lock held.
+	size_t	Update(JsonSnapshot& ioNext, JsonDiffFormat inFormat, std::string& outChanges);
+
+private:
+	~JsonDiffState();
+
+	JsonDiffState(const JsonDiffState&);
+	JsonDiffState& operator=(const JsonDiffState&);
+
+	volatile LONG		mRefCount;
+	CRITICAL_SECTION	mLock;
+	JsonSnapshot		mLast;
+};
+
+#endif
@@ -0,0 +1,378 @@
+// ===========================================================================
+//	JsonExtract.cpp
+// ===========================================================================
+
+#include "JsonExtract.h"
+#include "JsonCursor.h"
+
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		JsonScanner
+// ---------------------------------------------------------------------------------
+//	Walks a document along a compiled plan. Every value is visited together with
+//	the plan node that its path reached; members and elements that lead to no
+//	node are skipped rather than parsed, and so is the rest of a container once
+//	nothing below its node is still missing.
+
+class JsonScanner : public JsonCursor
+{
+public:
+	JsonScanner(
+		const char*		inText,
+		size_t			inLength,
+		const std::vector<JsonPlanNode>&	inNodes,
+		JsonValue*		outValues);
+
+	bool	Run(std::string& outError);
+
+private:
+	bool	ParseValue(int inNode, int inDepth);
+	bool	ParseObject(int inNode, int inDepth);
+	bool	ParseArray(int inNode, int inDepth);
+	int		FindChild(const JsonPlanNode& inNode, const char* inKey, size_t inLength) const;
+
+	const std::vector<JsonPlanNode>&	mNodes;
+	unsigned int	mPending;			// slots whose value has not been found yet
+	JsonValue*		mValues;
+};
+
+JsonScanner::JsonScanner(
+	const char*		inText,
+	size_t			inLength,
+	const std::vector<JsonPlanNode>&	inNodes,
+	JsonValue*		outValues)
+	: JsonCursor(inText, inLength)
+	, mNodes(inNodes)
+	, mPending(inNodes[0].mSubtreeSlots)
+	, mValues(outValues)
+{
+}
+
+bool
+JsonScanner::Run(std::string& outError)
+{
+	bool ok = ParseValue(0, 0);
+
+	// once every value is in, the rest of the document is never looked at
+	if (ok && mPending != 0 && SkipSpace())
+		ok = Fail("unexpected text after the value");
+
+	if (!ok)
+		FormatError(outError);
+	return ok;
+}
+
+bool
+JsonScanner::ParseValue(int inNode, int inDepth)
+{
+	if (inDepth > kJsonMaxDepth)
+		return Fail("nested too deeply");
+	if (!SkipSpace())
+		return false;
+
+	const JsonPlanNode& node = mNodes[inNode];
+
+	// a node that only leads to deeper fields needs the container it expects;
+	// anything else means those fields are missing
+	if (node.mSlots == 0) {
+		if (Peek() == '{')
+			return ParseObject(inNode, inDepth);
+		if (Peek() == '[')
+			return ParseArray(inNode, inDepth);
+		return SkipValue();
+	}
+
+	const char*		start = mPos;
+	JsonValueType	type;
+	std::string		text;
+	double			number = 0;
+	bool			ok;
+
+	switch (Peek()) {
+	case '{':	type = kJsonObject;	ok = node.mChildCount > 0 ? ParseObject(inNode, inDepth) : SkipValue();	break;
+	case '[':	type = kJsonArray;	ok = node.mChildCount > 0 ? ParseArray(inNode, inDepth) : SkipValue();	break;
+	case '"':	type = kJsonString;	ok = ParseString(&text);				break;
+	case 't':	type = kJsonBool;	ok = ParseLiteral("true", 4);	number = 1;	break;
+	case 'f':	type = kJsonBool;	ok = ParseLiteral("false", 5);			break;
+	case 'n':	type = kJsonNull;	ok = ParseLiteral("null", 4);			break;
+	default:	type = kJsonNumber;	ok = ReadNumber(number);				break;
+	}
+
+	if (!ok)
+		return false;
+
+	if (type != kJsonString && type != kJsonNull)
+		text.assign(start, mPos);
+
+	for (int k = 0; k < kJsonMaxPointers; k++) {
+		if (node.mSlots & (1u << k)) {
+			mValues[k].mType = type;
+			mValues[k].mNumber = number;
+			mValues[k].mText = text;
+		}
+	}
+	mPending &= ~node.mSlots;
+	return true;
+}
+
+bool
+JsonScanner::ParseObject(int inNode, int inDepth)
+{
+	const JsonPlanNode& node = mNodes[inNode];
+
+	bool more;
+	if (!EnterObject(more))
+		return false;
+
+	while (more) {
+
+		const char* key;
+		size_t keyLength;
+		if (!ReadMemberName(key, keyLength))
+			return false;
+
+		int child = FindChild(node, key, keyLength);
+		if (!(child >= 0 ? ParseValue(child, inDepth + 1) : SkipValue()))
+			return false;
+
+		if (mPending == 0)
+			return true;
+		if ((mPending & node.mSubtreeSlots) == 0)
+			return SkipRest(1);
+
+		if (!NextMember(more))
+			return false;
+	}
+	return true;
+}
+
+bool
+JsonScanner::ParseArray(int inNode, int inDepth)
+{
+	const JsonPlanNode& node = mNodes[inNode];
+
+	bool more;
+	if (!EnterArray(more))
+		return false;
+
+	for (long index = 0; more; index++) {
+
+		int child = -1;
+		for (int i = 0; i < node.mChildCount; i++) {
+			if (mNodes[node.mFirstChild + i].mIndex == index) {
+				child = node.mFirstChild + i;
+				break;
+			}
+		}
+
+		if (!(child >= 0 ? ParseValue(child, inDepth + 1) : SkipValue()))
+			return false;
+
+		if (mPending == 0)
+			return true;
+		if ((mPending & node.mSubtreeSlots) == 0 || index >= node.mMaxIndex)
+			return SkipRest(1);
+
+		if (!NextElement(more))
+			return false;
+	}
+	return true;
+}
+
+int
+JsonScanner::FindChild(const JsonPlanNode& inNode, const char* inKey, size_t inLength) const
+{
+	for (int i = 0; i < inNode.mChildCount; i++) {
+		const std::string& key = mNodes[inNode.mFirstChild + i].mKey;
+		if (key.length() == inLength && memcmp(key.data(), inKey, inLength) == 0)
+			return inNode.mFirstChild + i;
+	}
+	return -1;
+}
+
+// ---------------------------------------------------------------------------------
+//		JsonPointerSet
+// ---------------------------------------------------------------------------------
+
+JsonPointerSet::JsonPointerSet()
+{
+	for (int i = 0; i < kJsonMaxPointers; i++) {
+		mUsed[i] = false;
+	}
+}
+
+bool
+JsonPointerSet::IsEmpty() const
+{
+	for (int i = 0; i < kJsonMaxPointers; i++) {
+		if (mUsed[i])
+			return false;
+	}
+	return true;
+}
+
+// the token as an array index: "0", or digits without a leading zero
+static long
+ArrayIndexFromToken(const std::string& inToken)
+{
+	if (inToken.empty() || inToken.length() > 9)
+		return -1;
+	if (inToken[0] == '0' && inToken.length() > 1)
+		return -1;
+
+	long index = 0;
+	for (size_t i = 0; i < inToken.length(); i++) {
+		if (inToken[i] < '0' || inToken[i] > '9')
+			return -1;
+		index = index * 10 + (inToken[i] - '0');
+	}
+	return index;
+}
+
+bool
+JsonPointerSet::SetPointer(int inSlot, const char* inPointer)
+{
+	mUsed[inSlot] = false;
+	mTokens[inSlot].clear();
+
+	if (*inPointer == '\0') {
+		Compile();
+		return true;
+	}
+	if (*inPointer != '/') {
+		Compile();
+		return false;
+	}
+
+	std::vector<JsonPointerToken>& tokens = mTokens[inSlot];
+	const char* p = inPointer;
+	while (*p == '/') {
+
+		JsonPointerToken token;
+		for (p++; *p != '\0' && *p != '/'; p++) {
+			if (*p != '~') {
+				token.mKey += *p;
+			}
+			else if (p[1] == '0' || p[1] == '1') {
+				token.mKey += p[1] == '0' ? '~' : '/';
+				p++;
+			}
+			else {
+				tokens.clear();
+				Compile();
+				return false;
+			}
+		}
+
+		token.mIndex = ArrayIndexFromToken(token.mKey);
+		tokens.push_back(token);
+	}
+
+	mUsed[inSlot] = true;
+	Compile();
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		Compile
+// ---------------------------------------------------------------------------------
+//	Merges the pointers into a trie, then lays it out breadth first so that the
+//	children of each node are adjacent in mNodes.
+
+void
+JsonPointerSet::Compile()
+{
+	struct BuildNode
+	{
+		const JsonPointerToken*	mToken;
+		unsigned int			mSlots;
+		std::vector<int>		mChildren;
+	};
+
+	std::vector<BuildNode> tree(1);
+	tree[0].mToken = NULL;
+	tree[0].mSlots = 0;
+
+	for (int slot = 0; slot < kJsonMaxPointers; slot++) {
+
+		if (!mUsed[slot])
+			continue;
+
+		int at = 0;
+		for (size_t t = 0; t < mTokens[slot].size(); t++) {
+			const JsonPointerToken& token = mTokens[slot][t];
+
+			int next = -1;
+			for (size_t c = 0; c < tree[at].mChildren.size(); c++) {
+				if (tree[tree[at].mChildren[c]].mToken->mKey == token.mKey) {
+					next = tree[at].mChildren[c];
+					break;
+				}
+			}
+			if (next < 0) {
+				next = (int) tree.size();
+				tree.push_back(BuildNode());
+				tree[next].mToken = &token;
+				tree[next].mSlots = 0;
+				tree[at].mChildren.push_back(next);
+			}
+			at = next;
+		}
+		tree[at].mSlots |= 1u << slot;
+	}
+
+	std::vector<int> order(1, 0);
+	mNodes.resize(tree.size());
+	for (size_t i = 0; i < order.size(); i++) {
+
+		const BuildNode& from = tree[order[i]];
+		JsonPlanNode& node = mNodes[i];
+
+		node.mKey = from.mToken != NULL ? from.mToken->mKey : std::string();
+		node.mIndex = from.mToken != NULL ? from.mToken->mIndex : -1;
+		node.mFirstChild = (int) order.size();
+		node.mChildCount = (int) from.mChildren.size();
+		node.mMaxIndex = -1;
+		node.mSlots = from.mSlots;
+		node.mSubtreeSlots = from.mSlots;
+
+		for (size_t c = 0; c < from.mChildren.size(); c++) {
+			const JsonPointerToken* token = tree[from.mChildren[c]].mToken;
+			if (token->mIndex > node.mMaxIndex)
+				node.mMaxIndex = token->mIndex;
+			order.push_back(from.mChildren[c]);
+		}
+	}
+
+	// children always come after their parent, so walking backwards gathers
+	// each subtree before its root is reached
+	for (size_t i = mNodes.size(); i-- > 0; ) {
+		for (int c = 0; c < mNodes[i].mChildCount; c++) {
+			mNodes[i].mSubtreeSlots |= mNodes[mNodes[i].mFirstChild + c].mSubtreeSlots;
+		}
+	}
+}
+
+bool
+JsonPointerSet::Extract(
+	const char*		inText,
+	size_t			inLength,
+	JsonValue		outValues[kJsonMaxPointers],
+	std::string&	outError) const
+{
+	for (int i = 0; i < kJsonMaxPointers; i++) {
+		outValues[i] = JsonValue();
+	}
+	if (mNodes.empty() || mNodes[0].mSubtreeSlots == 0)
+		return true;
+
+	JsonScanner scanner(inText, inLength, mNodes, outValues);
+	if (scanner.Run(outError))
+		return true;
+
+	for (int i = 0; i < kJsonMaxPointers; i++) {
+		outValues[i] = JsonValue();
+	}
+	return false;
+}
@@ -0,0 +1,120 @@
+// ===========================================================================
+//	JsonExtract.h
+// ===========================================================================
+//
+//	Pulls a handful of fields out of a JSON response in a single pass.
+//
+//	The actor's field inputs are JSON pointers (RFC 6901), e.g.
+//	"/features/0/properties/mag". When an input changes the pointers are
+//	compiled into a JsonPointerSet: a trie of the paths they share, so that
+//	"/metadata/count" and "/metadata/title" walk through "metadata" once. A
+//	worker hands the response text to the set, which reads it once and fills
+//	in the value of every pointer, so only the extracted values cross over to
+//	Isadora's thread.
+//
+//	Only the parts of the document on a path in the trie are parsed. Any other
+//	subtree is skip-scanned by the JsonCursor, which jumps from one quote or
+//	bracket to the next, just counting depth until the subtree closes. Reading
+//	stops as soon as every pointer has its value. For a large response where a
+//	few fields are wanted, the cost follows what is read rather than the size
+//	of the document. The price is that skipped subtrees are only checked for
+//	balanced brackets and terminated strings, and nothing after the last value
+//	found is checked at all.
+//
+//	The set belongs to the actor's ResponsePlan, which decides whether a
+//	response is read as JSON at all.
+
+#ifndef JSONEXTRACT_H
+#define JSONEXTRACT_H
+
+#include <string>
+#include <vector>
+
+// number of field inputs on the actor
+static const int	kJsonMaxPointers = 4;
+
+// ---------------------------------------------------------------------------------
+//	JsonValue
+// ---------------------------------------------------------------------------------
+
+enum JsonValueType
+{
+	kJsonMissing = 0,					// the pointer did not match anything
+	kJsonNull,
+	kJsonBool,
+	kJsonNumber,
+	kJsonString,
+	kJsonArray,
+	kJsonObject
+};
+
+struct JsonValue
+{
+	JsonValue() : mType(kJsonMissing), mNumber(0) {}
+
+	JsonValueType	mType;
+	double			mNumber;			// numbers, and 1 or 0 for booleans
+	std::string		mText;				// strings unescaped, containers as raw JSON, others as written
+};
+
+// ---------------------------------------------------------------------------------
+//	JsonPointerToken
+// ---------------------------------------------------------------------------------
+//	One reference token of a pointer, with "~1" and "~0" already decoded.
+
+struct JsonPointerToken
+{
+	std::string		mKey;
+	long			mIndex;				// the token as an array index, -1 if it is not one
+};
+
+// ---------------------------------------------------------------------------------
+//	JsonPlanNode
+// ---------------------------------------------------------------------------------
+//	One node of the compiled trie. Node 0 is the document itself; the children
+//	of every node are stored next to each other.
+
+struct JsonPlanNode
+{
+	std::string		mKey;				// the token leading here from the parent
+	long			mIndex;				// mKey as an array index, -1 if it is not one
+	int				mFirstChild;
+	int				mChildCount;
+	long			mMaxIndex;			// largest mIndex among the children, -1 if none
+	unsigned int	mSlots;				// bit i set if pointer i ends at this node
+	unsigned int	mSubtreeSlots;		// mSlots of this node and everything below it
+};
+
+// ---------------------------------------------------------------------------------
+//	JsonPointerSet
+// ---------------------------------------------------------------------------------
+//	The compiled pointers of one actor.
+
+class JsonPointerSet
+{
+public:
+	JsonPointerSet();
+
+	// sets the pointer for slot inSlot (zero-based) and recompiles the trie. An
+	// empty string clears the slot. Returns false, clearing the slot, if
+	// inPointer is not a JSON pointer.
+	bool	SetPointer(int inSlot, const char* inPointer);
+
+	bool	IsEmpty() const;
+	bool	HasPointer(int inSlot) const		{ return mUsed[inSlot]; }
+
+	// reads inText and fills outValues[i] with the value at pointer i. Slots
+	// with no pointer, or whose pointer matches nothing, are kJsonMissing.
+	// Returns false with a description in outError if the parts of inText that
+	// were read are not valid JSON.
+	bool	Extract(const char* inText, size_t inLength, JsonValue outValues[kJsonMaxPointers], std::string& outError) const;
+
+private:
+	void	Compile();
+
+	bool							mUsed[kJsonMaxPointers];
+	std::vector<JsonPointerToken>	mTokens[kJsonMaxPointers];
+	std::vector<JsonPlanNode>		mNodes;
+};
+
+#endif
@@ -0,0 +1,301 @@
+// ===========================================================================
+//	MjpegStream.cpp
+// ===========================================================================
+
+#include "MjpegStream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		ParseMultipartBoundary
+// ---------------------------------------------------------------------------------
+
+bool
+ParseMultipartBoundary(const std::string& inHeaders, std::string& outBoundary)
+{
+	outBoundary.clear();
+
+	std::string type = HttpHeaderValue(inHeaders, "Content-Type");
+	if (_strnicmp(type.c_str(), "multipart/", 10) != 0)
+		return false;
+
+	// the parameter name is case-insensitive, the value is not
+	size_t at = std::string::npos;
+	for (size_t i = 0; i + 9 <= type.length(); i++) {
+		if (_strnicmp(type.c_str() + i, "boundary=", 9) == 0) {
+			at = i + 9;
+			break;
+		}
+	}
+	if (at == std::string::npos)
+		return false;
+
+	if (at < type.length() && type[at] == '"') {
+		size_t end = type.find('"', at + 1);
+		outBoundary = type.substr(at + 1, end == std::string::npos ? std::string::npos : end - at - 1);
+	}
+	else {
+		size_t end = type.find_first_of("; \t", at);
+		outBoundary = type.substr(at, end == std::string::npos ? std::string::npos : end - at);
+	}
+
+	if (outBoundary.compare(0, 2, "--") == 0)
+		outBoundary.erase(0, 2);
+	return !outBoundary.empty();
+}
+
+// ---------------------------------------------------------------------------------
+//		MultipartParser
+// ---------------------------------------------------------------------------------
+
+MultipartParser::MultipartParser(const std::string& inBoundary)
+	: mDelimiter("--" + inBoundary)
+	, mPosition(0)
+	, mSearchFrom(0)
+	, mState(kBoundary)
+	, mHasLength(false)
+	, mLength(0)
+	, mFailed(false)
+{
+}
+
+bool
+MultipartParser::Feed(const char* inData, size_t inLength, MultipartPartSink& ioSink, std::string& outError)
+{
+	if (mFailed)
+		return false;
+
+	mBuffer.append(inData, inLength);
+
+	for (;;) {
+
+		if (mState == kBoundary) {
+			// the delimiter, then the rest of its line
+			size_t at = mBuffer.find(mDelimiter, mPosition);
+			if (at == std::string::npos) {
+				// keep a delimiter split between chunks
+				if (mBuffer.length() >= mDelimiter.length())
+					mPosition = mBuffer.length() - mDelimiter.length() + 1;
+				break;
+			}
+			size_t newline = mBuffer.find('\n', at + mDelimiter.length());
+			if (newline == std::string::npos) {
+				mPosition = at;
+				break;
+			}
+			mPosition = newline + 1;
+			mState = kHeaders;
+		}
+
+		else if (mState == kHeaders) {
+			// the headers end at the first empty line
+			size_t end = mPosition;
+			size_t body = std::string::npos;
+			while (end < mBuffer.length()) {
+				size_t newline = mBuffer.find('\n', end);
+				if (newline == std::string::npos)
+					break;
+				if (newline == end || (newline == end + 1 && mBuffer[end] == '\r')) {
+					body = newline + 1;
+					break;
+				}
+				end = newline + 1;
+			}
+
+			if (body == std::string::npos) {
+				if (mBuffer.length() - mPosition > kMjpegMaxPartHeaders) {
+					outError = "ERROR: multipart part headers are too long";
+					mFailed = true;
+					return false;
+				}
+				break;
+			}
+
+			std::string length = HttpHeaderValue(mBuffer.substr(mPosition, end - mPosition), "Content-Length");
+			mHasLength = !length.empty();
+			mLength = mHasLength ? (size_t) strtoul(length.c_str(), NULL, 10) : 0;
+			if (mHasLength && mLength > kMjpegMaxPartBytes) {
+				outError = "ERROR: multipart part is too large";
+				mFailed = true;
+				return false;
+			}
+
+			mPosition = body;
+			mSearchFrom = body;
+			mState = kBody;
+		}
+
+		else {
+			size_t end;
+			if (mHasLength) {
+				if (mBuffer.length() - mPosition < mLength)
+					break;
+				end = mPosition + mLength;
+			}
+			else {
+				size_t at = mBuffer.find(mDelimiter, mSearchFrom);
+				if (at == std::string::npos) {
+					if (mBuffer.length() - mPosition > kMjpegMaxPartBytes) {
+						outError = "ERROR: multipart part is too large";
+						mFailed = true;
+						return false;
+					}
+					if (mBuffer.length() >= mDelimiter.length())
+						mSearchFrom = mBuffer.length() - mDelimiter.length() + 1;
+					break;
+				}
+
+				// the line break before the delimiter belongs to it
+				end = at;
+				if (end > mPosition && mBuffer[end - 1] == '\n')
+					end--;
+				if (end > mPosition && mBuffer[end - 1] == '\r')
+					end--;
+			}
+
+			ioSink.OnPart(mBuffer.data() + mPosition, end - mPosition);
+			mPosition = end;
+			mState = kBoundary;
+		}
+	}
+
+	// drop what has been consumed; at most a part's worth is left to move
+	if (mPosition > 0) {
+		mBuffer.erase(0, mPosition);
+		mSearchFrom = mSearchFrom > mPosition ? mSearchFrom - mPosition : 0;
+		mPosition = 0;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		FrameTripleBuffer
+// ---------------------------------------------------------------------------------
+
+FrameTripleBuffer::FrameTripleBuffer()
+	: mBack(&mFrames[0])
+	, mReady(&mFrames[1])
+	, mFront(&mFrames[2])
+	, mFresh(false)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+FrameTripleBuffer::~FrameTripleBuffer()
+{
+	DeleteCriticalSection(&mLock);
+}
+
+void
+FrameTripleBuffer::Publish()
+{
+	EnterCriticalSection(&mLock);
+	VideoFrame* ready = mReady;
+	mReady = mBack;
+	mBack = ready;
+	mFresh = true;
+	LeaveCriticalSection(&mLock);
+}
+
+VideoFrame*
+FrameTripleBuffer::TakeNewest()
+{
+	VideoFrame* frame = NULL;
+
+	EnterCriticalSection(&mLock);
+	if (mFresh) {
+		frame = mReady;
+		mReady = mFront;
+		mFront = frame;
+		mFresh = false;
+	}
+	LeaveCriticalSection(&mLock);
+
+	return frame;
+}
+
+// ---------------------------------------------------------------------------------
+//		MjpegStream
+// ---------------------------------------------------------------------------------
+
+MjpegStream::MjpegStream()
+	: mRefCount(1)
+	, mStopped(0)
+	, mHasPending(false)
+	, mDecoding(false)
+	, mFailing(false)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+MjpegStream::~MjpegStream()
+{
+	DeleteCriticalSection(&mLock);
+}
+
+void
+MjpegStream::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+MjpegStream::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+void
+MjpegStream::Stop()
+{
+	InterlockedExchange(&mStopped, 1);
+	mCancel.Cancel();
+}
+
+bool
+MjpegStream::OfferPart(const char* inData, size_t inLength)
+{
+	EnterCriticalSection(&mLock);
+	mPending.assign(inData, inLength);
+	mHasPending = true;
+	bool start = !mDecoding;
+	mDecoding = true;
+	LeaveCriticalSection(&mLock);
+
+	return start;
+}
+
+bool
+MjpegStream::DecodeNext(std::string& outError)
+{
+	outError.clear();
+
+	// the buffers swap rather than copy, so both keep their capacity
+	EnterCriticalSection(&mLock);
+	bool waiting = mHasPending && !IsStopped();
+	if (waiting) {
+		mPart.swap(mPending);
+		mHasPending = false;
+	}
+	else {
+		mDecoding = false;
+	}
+	LeaveCriticalSection(&mLock);
+
+	if (!waiting)
+		return false;
+
+	std::string error;
+	if (DecodeImage(mPart.data(), mPart.length(), *mFrames.GetBack(), error)) {
+		mFrames.Publish();
+		mFailing = false;
+	}
+	else if (!mFailing) {
+		outError = error;
+		mFailing = true;
+	}
+	return true;
+}
@@ -0,0 +1,185 @@
+// ===========================================================================
+//	MjpegStream.h
+// ===========================================================================
+//
+//	Motion JPEG streams, as served by IP cameras: one long multipart/x-mixed-
+//	replace response in which every part is the next JPEG frame.
+//
+//	The response is read on a stream thread for as long as it is open. A
+//	MultipartParser splits it into parts as it arrives and hands each one to
+//	the MjpegStream, which keeps only the newest undecoded part: a part that
+//	arrives while the one before is still waiting replaces it. Decoding runs
+//	as separate jobs on the pool, one at a time per stream, each decoding the
+//	newest part into the back frame of a FrameTripleBuffer and publishing it.
+//	The actor takes the newest published frame on each tick.
+//
+//	Nothing is ever queued behind a slow decoder or a slow show: at most one
+//	part waits to be decoded and one frame waits to be shown, and older ones
+//	are dropped, so a frame is never more than a decode and a tick old. The
+//	three frames and the part buffers are reused for the life of the stream,
+//	so once they have grown to the camera's frame size nothing is allocated.
+
+#ifndef MJPEGSTREAM_H
+#define MJPEGSTREAM_H
+
+#include "HttpTransport.h"
+#include "ImageDecode.h"
+
+#include <windows.h>
+
+#include <string>
+
+// largest part accepted from a multipart stream
+static const size_t	kMjpegMaxPartBytes = 16 * 1024 * 1024;
+
+// longest header block accepted at the start of a part
+static const size_t	kMjpegMaxPartHeaders = 16 * 1024;
+
+// ---------------------------------------------------------------------------------
+//	ParseMultipartBoundary
+// ---------------------------------------------------------------------------------
+//	Reads the boundary from the Content-Type of a multipart response's raw
+//	header block. Returns false if the response is not multipart. A leading --,
+//	which some cameras include in the parameter, is dropped.
+
+bool	ParseMultipartBoundary(const std::string& inHeaders, std::string& outBoundary);
+
+// ---------------------------------------------------------------------------------
+//	MultipartParser
+// ---------------------------------------------------------------------------------
+//	Splits a multipart body into parts as it is fed. A part with a
+//	Content-Length header is read by length, which is what cameras send;
+//	otherwise it ends at the next boundary. Text before the first boundary and
+//	between parts is skipped.
+
+class MultipartPartSink
+{
+public:
+	virtual ~MultipartPartSink() {}
+
+	// the body of one part; the bytes are only valid during the call
+	virtual void	OnPart(const char* inData, size_t inLength) = 0;
+};
+
+class MultipartParser
+{
+public:
+	explicit MultipartParser(const std::string& inBoundary);
+
+	// parses the next inLength bytes, passing each part completed by them to
+	// ioSink. Returns false with a description in outError if a part or its
+	// headers are too long; nothing more is parsed then.
+	bool	Feed(const char* inData, size_t inLength, MultipartPartSink& ioSink, std::string& outError);
+
+private:
+	MultipartParser(const MultipartParser&);
+	MultipartParser& operator=(const MultipartParser&);
+
+	enum State
+	{
+		kBoundary,			// looking for the next boundary line
+		kHeaders,			// reading a part's headers
+		kBody				// reading a part's body
+	};
+
+	std::string		mDelimiter;			// -- and the boundary
+	std::string		mBuffer;			// bytes not yet consumed
+	size_t			mPosition;			// where parsing resumes in mBuffer
+	size_t			mSearchFrom;		// where the search for the delimiter resumes in a body without a length
+	State			mState;
+	bool			mHasLength;
+	size_t			mLength;			// Content-Length of the current part
+	bool			mFailed;
+};
+
+// ---------------------------------------------------------------------------------
+//	FrameTripleBuffer
+// ---------------------------------------------------------------------------------
+//	Three frames passed between one writer and one reader without either
+//	waiting on the other: the writer fills the back frame and swaps it with the
+//	ready one, the reader swaps the ready one with the front. A ready frame the
+//	reader has not taken when the next is published is overwritten.
+
+class FrameTripleBuffer
+{
+public:
+	FrameTripleBuffer();
+	~FrameTripleBuffer();
+
+	// the frame to write the next image into. Only the writer may touch it.
+	VideoFrame*		GetBack()				{ return mBack; }
+
+	// makes the back frame the newest, and the ready frame the back one
+	void			Publish();
+
+	// the newest frame if one was published since the last call, which stays
+	// valid and unchanged until the next call; NULL if there is none
+	VideoFrame*		TakeNewest();
+
+private:
+	FrameTripleBuffer(const FrameTripleBuffer&);
+	FrameTripleBuffer& operator=(const FrameTripleBuffer&);
+
+	CRITICAL_SECTION	mLock;
+	VideoFrame			mFrames[3];
+	VideoFrame*			mBack;
+	VideoFrame*			mReady;
+	VideoFrame*			mFront;
+	bool				mFresh;			// mReady was published and not yet taken
+};
+
+// ---------------------------------------------------------------------------------
+//	MjpegStream
+// ---------------------------------------------------------------------------------
+//	The state of one open stream, shared by the actor, the job reading the
+//	response and the job decoding its frames.
+
+class MjpegStream
+{
+public:
+	MjpegStream();
+
+	void	AddRef();
+	void	Release();
+
+	// called by the actor to close the stream; cancels the request, so the
+	// reader stops even while it waits for the camera
+	void	Stop();
+	bool	IsStopped() const				{ return mStopped != 0; }
+
+	// passed to HttpSend by the reader
+	HttpCancel&	GetCancel()					{ return mCancel; }
+
+	// called by the reader with each part. Keeps a copy as the newest part,
+	// replacing one not yet decoded, and returns true if no decoder is running
+	// and the caller must submit one.
+	bool	OfferPart(const char* inData, size_t inLength);
+
+	// called by the decoder: decodes the newest part into the back frame and
+	// publishes it. A part that cannot be decoded is dropped, and sets outError
+	// when the part before it could be, so a broken camera is reported once
+	// rather than at its frame rate. Returns false, and the decoder must
+	// finish, once no part is waiting.
+	bool	DecodeNext(std::string& outError);
+
+	FrameTripleBuffer&	GetFrames()			{ return mFrames; }
+
+private:
+	~MjpegStream();
+
+	MjpegStream(const MjpegStream&);
+	MjpegStream& operator=(const MjpegStream&);
+
+	volatile LONG		mRefCount;
+	volatile LONG		mStopped;
+	HttpCancel			mCancel;
+	CRITICAL_SECTION	mLock;
+	std::string			mPending;		// the newest part not yet decoded
+	bool				mHasPending;
+	bool				mDecoding;		// a decoder is running
+	std::string			mPart;			// the part being decoded; only the decoder touches it
+	bool				mFailing;		// the last part could not be decoded; only the decoder touches it
+	FrameTripleBuffer	mFrames;
+};
+
+#endif
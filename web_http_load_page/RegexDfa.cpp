@@ -0,0 +1,1099 @@
+// ===========================================================================
+//	RegexDfa.cpp
+// ===========================================================================
+
+#include "RegexDfa.h"
+#include "JsonCursor.h"
+#include "ThirdParty/ATLRegExp/atlrx.h"
+
+#include <algorithm>
+#include <map>
+#include <string.h>
+
+typedef CAtlRECharTraitsUTF8	Utf8;
+
+// ---------------------------------------------------------------------------------
+//		NFA
+// ---------------------------------------------------------------------------------
+
+enum RegexNfaOp
+{
+	kNfaChar = 0,						// consume a character in set mX
+	kNfaSplit,							// continue at mX, or failing that at mY
+	kNfaJmp,							// continue at mX
+	kNfaSave,							// record the position in capture slot mX
+	kNfaMatch
+};
+
+struct RegexNfaInst
+{
+	RegexNfaOp	mOp;
+	int			mX;
+	int			mY;
+};
+
+// the characters are code points, as CAtlRECharTraitsUTF8::CodePoint reads
+// them; the terminator is 0
+static const unsigned long	kRegexMaxChar = 0x10FFFF;
+
+// a set of characters as sorted, disjoint ranges. Only compiling looks at the
+// ranges; matching goes through the character classes built from them.
+struct RegexCharSet
+{
+	struct Range
+	{
+		unsigned long	mFirst;
+		unsigned long	mLast;
+	};
+
+	bool	Has(unsigned long inChar) const
+	{
+		for (size_t i = 0; i < mRanges.size() && mRanges[i].mFirst <= inChar; i++) {
+			if (inChar <= mRanges[i].mLast)
+				return true;
+		}
+		return false;
+	}
+
+	void	Add(unsigned long inFirst, unsigned long inLast)
+	{
+		Range range = { inFirst, inLast };
+		mRanges.push_back(range);
+		Normalize();
+	}
+
+	// everything from 0 to kRegexMaxChar that was not in the set
+	void	Negate()
+	{
+		std::vector<Range> ranges;
+		unsigned long next = 0;
+		for (size_t i = 0; i < mRanges.size(); i++) {
+			if (mRanges[i].mFirst > next) {
+				Range gap = { next, mRanges[i].mFirst - 1 };
+				ranges.push_back(gap);
+			}
+			next = mRanges[i].mLast + 1;
+		}
+		if (next <= kRegexMaxChar) {
+			Range rest = { next, kRegexMaxChar };
+			ranges.push_back(rest);
+		}
+		mRanges.swap(ranges);
+	}
+
+	void	Remove(unsigned long inChar)
+	{
+		Negate();
+		Add(inChar, inChar);
+		Negate();
+	}
+
+	std::vector<Range>	mRanges;
+
+private:
+	static bool	Before(const Range& inLeft, const Range& inRight)	{ return inLeft.mFirst < inRight.mFirst; }
+
+	void	Normalize()
+	{
+		std::sort(mRanges.begin(), mRanges.end(), Before);
+		size_t kept = 0;
+		for (size_t i = 0; i < mRanges.size(); i++) {
+			if (kept > 0 && mRanges[i].mFirst <= mRanges[kept - 1].mLast + 1) {
+				if (mRanges[i].mLast > mRanges[kept - 1].mLast)
+					mRanges[kept - 1].mLast = mRanges[i].mLast;
+			}
+			else
+				mRanges[kept++] = mRanges[i];
+		}
+		mRanges.resize(kept);
+	}
+};
+
+// ---------------------------------------------------------------------------------
+//		PatternParser
+// ---------------------------------------------------------------------------------
+//	Reads the atlrx syntax into a tree, following the structure of
+//	CAtlRegExp's ParseRE, ParseAltE, ParseE and ParseSE so that it groups and
+//	numbers everything the same way. Whatever those functions would handle
+//	oddly, or only by backtracking, sets mUnsupported.
+
+enum PatternNodeType
+{
+	kNodeEmpty = 0,
+	kNodeSet,							// mValue is the set
+	kNodeCat,
+	kNodeAlt,							// mKids[0], or failing that mKids[1]
+	kNodeStar,
+	kNodePlus,
+	kNodeQuest,
+	kNodeGroup							// mValue is the group
+};
+
+struct PatternNode
+{
+	PatternNodeType		mType;
+	int					mValue;
+	std::vector<int>	mKids;
+};
+
+class PatternParser
+{
+public:
+	PatternParser(std::vector<PatternNode>& outNodes, std::vector<RegexCharSet>& outSets)
+		: mNodes(outNodes), mSets(outSets), mGroupCount(0), mUnsupported(false) {}
+
+	int		ParseRE(const char*& ioPos);
+	int		ParseE(const char*& ioPos);
+	int		NewNode(PatternNodeType inType, int inValue);
+	int		NewSet(const RegexCharSet& inSet);
+
+	std::vector<PatternNode>&		mNodes;
+	std::vector<RegexCharSet>&		mSets;
+	int		mGroupCount;
+	bool	mUnsupported;
+
+private:
+	int		ParseAltE(const char*& ioPos);
+	int		ParseSE(const char*& ioPos);
+	int		ParseGroup(const char*& ioPos, char inClose, int inGroup);
+	int		ParseClass(const char*& ioPos);
+	int		ParseAbbrev(char inLetter);
+
+	bool	CanBeEmpty(int inNode) const;
+};
+
+int
+PatternParser::NewNode(PatternNodeType inType, int inValue)
+{
+	PatternNode node;
+	node.mType = inType;
+	node.mValue = inValue;
+	mNodes.push_back(node);
+	return (int) mNodes.size() - 1;
+}
+
+int
+PatternParser::NewSet(const RegexCharSet& inSet)
+{
+	mSets.push_back(inSet);
+	return NewNode(kNodeSet, (int) mSets.size() - 1);
+}
+
+// RE -> AltE RE | AltE
+int
+PatternParser::ParseRE(const char*& ioPos)
+{
+	if (*ioPos == '\0')
+		return -1;
+
+	int first = ParseAltE(ioPos);
+	if (first < 0)
+		return -1;
+
+	int cat = -1;
+	while (!mUnsupported && *ioPos != '\0') {
+		int next = ParseAltE(ioPos);
+		if (next < 0)
+			break;
+		if (cat < 0) {
+			cat = NewNode(kNodeCat, 0);
+			mNodes[cat].mKids.push_back(first);
+		}
+		mNodes[cat].mKids.push_back(next);
+	}
+	return cat >= 0 ? cat : first;
+}
+
+// AltE -> E '|' AltE | E. The '|' only takes the single expressions on
+// either side of it.
+int
+PatternParser::ParseAltE(const char*& ioPos)
+{
+	int left = ParseE(ioPos);
+	if (left < 0 || *ioPos != '|')
+		return left;
+	ioPos++;
+
+	// atlrx quietly drops the whole alternative when nothing follows the '|'
+	int right = ParseAltE(ioPos);
+	if (right < 0) {
+		mUnsupported = true;
+		return -1;
+	}
+
+	int alt = NewNode(kNodeAlt, 0);
+	mNodes[alt].mKids.push_back(left);
+	mNodes[alt].mKids.push_back(right);
+	return alt;
+}
+
+// E -> SE ('*' | '+' | '?')
+int
+PatternParser::ParseE(const char*& ioPos)
+{
+	int se = ParseSE(ioPos);
+	if (se < 0)
+		return se;
+
+	PatternNodeType type;
+	switch (*ioPos) {
+	case '*':	type = kNodeStar;	break;
+	case '+':	type = kNodePlus;	break;
+	case '?':	type = kNodeQuest;	break;
+	default:	return se;
+	}
+	ioPos++;
+
+	// lazy repeats are left to the backtracker
+	if (*ioPos == '?') {
+		mUnsupported = true;
+		return -1;
+	}
+
+	// atlrx refuses a repeat that matched nothing and backtracks into the
+	// repeated expression for something longer, which an NFA does not do
+	if (CanBeEmpty(se)) {
+		mUnsupported = true;
+		return -1;
+	}
+
+	int repeat = NewNode(type, 0);
+	mNodes[repeat].mKids.push_back(se);
+	return repeat;
+}
+
+bool
+PatternParser::CanBeEmpty(int inNode) const
+{
+	const PatternNode& node = mNodes[inNode];
+	switch (node.mType) {
+	case kNodeSet:
+		return false;
+	case kNodeCat:
+		for (size_t i = 0; i < node.mKids.size(); i++) {
+			if (!CanBeEmpty(node.mKids[i]))
+				return false;
+		}
+		return true;
+	case kNodeAlt:
+		return CanBeEmpty(node.mKids[0]) || CanBeEmpty(node.mKids[1]);
+	case kNodePlus:
+	case kNodeGroup:
+		return CanBeEmpty(node.mKids[0]);
+	default:
+		return true;
+	}
+}
+
+int
+PatternParser::ParseSE(const char*& ioPos)
+{
+	RegexCharSet set;
+
+	char c = *ioPos;
+	switch (c) {
+
+	case '{':
+		ioPos++;
+		return ParseGroup(ioPos, '}', mGroupCount++);
+
+	case '(':
+		ioPos++;
+		return ParseGroup(ioPos, ')', -1);
+
+	case '[':
+		ioPos++;
+		return ParseClass(ioPos);
+
+	case '\\':
+		ioPos++;
+		c = *ioPos;
+
+		// back references need the backtracker; a trailing '\' makes atlrx
+		// read past the end of the pattern
+		if (c == '\0' || Utf8::Isdigit(c)) {
+			mUnsupported = true;
+			return -1;
+		}
+		{
+			const char* escaped = ioPos;
+			ioPos = Utf8::Next(ioPos);
+			int abbrev = ParseAbbrev(c);
+			if (abbrev >= 0 || mUnsupported)
+				return abbrev;
+			set.Add(Utf8::CodePoint(escaped), Utf8::CodePoint(escaped));
+		}
+		return NewSet(set);
+
+	case '!':
+		mUnsupported = true;
+		return -1;
+
+	case '}':
+	case ']':
+	case ')':
+	case '\0':
+		return -1;
+
+	case '.':
+		ioPos++;
+		set.Add(1, kRegexMaxChar);
+		return NewSet(set);
+
+	default: {
+		// only a '$' at the very end is special; it matches the terminator
+		unsigned long ch = c == '$' && ioPos[1] == '\0' ? 0 : Utf8::CodePoint(ioPos);
+		ioPos = Utf8::Next(ioPos);
+		set.Add(ch, ch);
+		return NewSet(set);
+	}
+	}
+}
+
+int
+PatternParser::ParseGroup(const char*& ioPos, char inClose, int inGroup)
+{
+	int body = ParseRE(ioPos);
+	if (mUnsupported)
+		return -1;
+	if (body < 0)
+		body = NewNode(kNodeEmpty, 0);
+	if (*ioPos != inClose) {
+		mUnsupported = true;
+		return -1;
+	}
+	ioPos++;
+
+	if (inGroup < 0)
+		return body;
+
+	int group = NewNode(kNodeGroup, inGroup);
+	mNodes[group].mKids.push_back(body);
+	return group;
+}
+
+int
+PatternParser::ParseClass(const char*& ioPos)
+{
+	RegexCharSet set;
+
+	bool negate = false;
+	if (*ioPos == '^') {
+		negate = true;
+		ioPos++;
+	}
+
+	while (*ioPos != '\0' && *ioPos != ']') {
+
+		// in a class "\t" is a tab and any other escape is the character itself
+		bool escaped = *ioPos == '\\';
+		if (escaped) {
+			ioPos++;
+			if (*ioPos == '\0') {
+				mUnsupported = true;
+				return -1;
+			}
+		}
+		unsigned long first = escaped && *ioPos == 't' ? '\t' : Utf8::CodePoint(ioPos);
+		ioPos = Utf8::Next(ioPos);
+
+		unsigned long last = first;
+		if (*ioPos == '-') {
+			ioPos++;
+			if (*ioPos == '\0' || *ioPos == ']') {
+				mUnsupported = true;
+				return -1;
+			}
+			last = Utf8::CodePoint(ioPos);
+			ioPos = Utf8::Next(ioPos);
+		}
+
+		if (last < first) {
+			mUnsupported = true;
+			return -1;
+		}
+		set.Add(first, last);
+	}
+	if (*ioPos != ']') {
+		mUnsupported = true;
+		return -1;
+	}
+	ioPos++;
+
+	if (negate)
+		set.Negate();
+	// a class never matches the terminator
+	set.Remove(0);
+	return NewSet(set);
+}
+
+// the abbreviations are expanded from the same table atlrx uses, and like
+// atlrx only the first expression of each is read
+int
+PatternParser::ParseAbbrev(char inLetter)
+{
+	const char** abbrevs = CAtlRECharTraitsA::GetAbbrevs();
+	for (; *abbrevs != NULL; abbrevs++) {
+		if ((*abbrevs)[0] == inLetter) {
+			const char* pos = *abbrevs + 1;
+			int node = ParseE(pos);
+			if (node < 0)
+				mUnsupported = true;
+			return node;
+		}
+	}
+	return -1;
+}
+
+// ---------------------------------------------------------------------------------
+//		Compile
+// ---------------------------------------------------------------------------------
+
+static int
+Emit(std::vector<RegexNfaInst>& ioProgram, RegexNfaOp inOp, int inX, int inY)
+{
+	RegexNfaInst inst;
+	inst.mOp = inOp;
+	inst.mX = inX;
+	inst.mY = inY;
+	ioProgram.push_back(inst);
+	return (int) ioProgram.size() - 1;
+}
+
+// appends the instructions for inNode; inReverse mirrors the order of
+// concatenations and leaves out the capture slots
+static void
+EmitNode(const std::vector<PatternNode>& inNodes, int inNode, bool inReverse, std::vector<RegexNfaInst>& ioProgram)
+{
+	const PatternNode& node = inNodes[inNode];
+
+	switch (node.mType) {
+	case kNodeEmpty:
+		break;
+
+	case kNodeSet:
+		Emit(ioProgram, kNfaChar, node.mValue, 0);
+		break;
+
+	case kNodeCat:
+		for (size_t i = 0; i < node.mKids.size(); i++) {
+			EmitNode(inNodes, node.mKids[inReverse ? node.mKids.size() - 1 - i : i], inReverse, ioProgram);
+		}
+		break;
+
+	case kNodeAlt: {
+		int split = Emit(ioProgram, kNfaSplit, 0, 0);
+		ioProgram[split].mX = (int) ioProgram.size();
+		EmitNode(inNodes, node.mKids[0], inReverse, ioProgram);
+		int jmp = Emit(ioProgram, kNfaJmp, 0, 0);
+		ioProgram[split].mY = (int) ioProgram.size();
+		EmitNode(inNodes, node.mKids[1], inReverse, ioProgram);
+		ioProgram[jmp].mX = (int) ioProgram.size();
+		break;
+	}
+
+	case kNodeStar: {
+		int split = Emit(ioProgram, kNfaSplit, 0, 0);
+		ioProgram[split].mX = (int) ioProgram.size();
+		EmitNode(inNodes, node.mKids[0], inReverse, ioProgram);
+		Emit(ioProgram, kNfaJmp, split, 0);
+		ioProgram[split].mY = (int) ioProgram.size();
+		break;
+	}
+
+	case kNodePlus: {
+		int loop = (int) ioProgram.size();
+		EmitNode(inNodes, node.mKids[0], inReverse, ioProgram);
+		int split = Emit(ioProgram, kNfaSplit, loop, 0);
+		ioProgram[split].mY = (int) ioProgram.size();
+		break;
+	}
+
+	case kNodeQuest: {
+		int split = Emit(ioProgram, kNfaSplit, 0, 0);
+		ioProgram[split].mX = (int) ioProgram.size();
+		EmitNode(inNodes, node.mKids[0], inReverse, ioProgram);
+		ioProgram[split].mY = (int) ioProgram.size();
+		break;
+	}
+
+	case kNodeGroup:
+		if (!inReverse)
+			Emit(ioProgram, kNfaSave, 2 + 2 * node.mValue, 0);
+		EmitNode(inNodes, node.mKids[0], inReverse, ioProgram);
+		if (!inReverse)
+			Emit(ioProgram, kNfaSave, 3 + 2 * node.mValue, 0);
+		break;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		RegexDfaCache
+// ---------------------------------------------------------------------------------
+//	The DFA states built so far for one direction. A state is the ordered list
+//	of NFA instructions (characters and matches) that threads are waiting at.
+
+class RegexDfaCache
+{
+public:
+	void	Clear(int inClassCount)
+	{
+		mStates.clear();
+		mMatch.clear();
+		mIndex.clear();
+		mNext.clear();
+		mClassCount = inClassCount;
+	}
+
+	std::vector< std::vector<int> >		mStates;
+	std::vector<char>					mMatch;		// the state holds a finished thread
+	std::map<std::vector<int>, int>		mIndex;
+	std::vector<int>					mNext;		// mStates.size() * mClassCount targets, -1 until built
+	int									mClassCount;
+	int									mFlushes;	// times emptied during the current search
+	std::vector<char>					mSeen;		// scratch for AddClosure
+};
+
+// the threads of one step of the NFA simulation, each with its capture slots
+struct NfaThreadList
+{
+	void	Reset(size_t inSlotCount)
+	{
+		mPcs.clear();
+		mSlots.clear();
+		mSlotCount = inSlotCount;
+		mGeneration++;
+	}
+
+	std::vector<int>					mPcs;
+	std::vector<const unsigned char*>	mSlots;
+	std::vector<unsigned int>			mOnList;
+	unsigned int						mGeneration;
+	size_t								mSlotCount;
+};
+
+// what one search works in; pooled so that searches stop allocating once
+// their buffers have grown
+struct RegexDfaScratch
+{
+	RegexDfaCache						mForward;
+	RegexDfaCache						mReverse;
+	NfaThreadList						mLists[2];
+	std::vector<const unsigned char*>	mSlots;		// the winning thread's slots
+	std::vector<const unsigned char*>	mStart;		// slots of a new thread
+};
+
+// a search that empties its cache more often than this finishes on the NFA
+static const int	kRegexDfaMaxFlushes = 8;
+
+// adds the instructions reachable from inPc without consuming a character, in
+// priority order. In first-wins mode nothing after a match is added, since
+// atlrx would never get to those threads.
+static void
+AddClosure(const std::vector<RegexNfaInst>& inProgram, int inPc, bool inFirstWins, std::vector<char>& ioSeen, std::vector<int>& ioList, bool& ioStopped)
+{
+	if (ioStopped || ioSeen[inPc])
+		return;
+	ioSeen[inPc] = 1;
+
+	const RegexNfaInst& inst = inProgram[inPc];
+	switch (inst.mOp) {
+	case kNfaJmp:
+		AddClosure(inProgram, inst.mX, inFirstWins, ioSeen, ioList, ioStopped);
+		break;
+	case kNfaSplit:
+		AddClosure(inProgram, inst.mX, inFirstWins, ioSeen, ioList, ioStopped);
+		AddClosure(inProgram, inst.mY, inFirstWins, ioSeen, ioList, ioStopped);
+		break;
+	case kNfaSave:
+		AddClosure(inProgram, inPc + 1, inFirstWins, ioSeen, ioList, ioStopped);
+		break;
+	case kNfaChar:
+		ioList.push_back(inPc);
+		break;
+	case kNfaMatch:
+		ioList.push_back(inPc);
+		if (inFirstWins)
+			ioStopped = true;
+		break;
+	}
+}
+
+// the state for inList, or -1 if the cache is full
+static int
+FindState(const std::vector<RegexNfaInst>& inProgram, RegexDfaCache& ioCache, const std::vector<int>& inList)
+{
+	std::map<std::vector<int>, int>::const_iterator found = ioCache.mIndex.find(inList);
+	if (found != ioCache.mIndex.end())
+		return found->second;
+	if ((int) ioCache.mStates.size() >= kRegexDfaMaxStates)
+		return -1;
+
+	bool match = false;
+	for (size_t i = 0; i < inList.size(); i++) {
+		if (inProgram[inList[i]].mOp == kNfaMatch)
+			match = true;
+	}
+
+	int state = (int) ioCache.mStates.size();
+	ioCache.mStates.push_back(inList);
+	ioCache.mMatch.push_back(match);
+	ioCache.mIndex[inList] = state;
+	ioCache.mNext.resize(ioCache.mNext.size() + ioCache.mClassCount, -1);
+	return state;
+}
+
+static int
+StartState(const std::vector<RegexNfaInst>& inProgram, RegexDfaCache& ioCache, int inPc, bool inFirstWins)
+{
+	std::vector<int> list;
+	bool stopped = false;
+	ioCache.mSeen.assign(inProgram.size(), 0);
+	AddClosure(inProgram, inPc, inFirstWins, ioCache.mSeen, list, stopped);
+
+	int state = FindState(inProgram, ioCache, list);
+	if (state < 0) {
+		ioCache.Clear(ioCache.mClassCount);
+		ioCache.mFlushes++;
+		state = FindState(inProgram, ioCache, list);
+	}
+	return state;
+}
+
+// the state reached from inState on a character of class inClass, built on
+// first use. inInSet[set * class count + class] tells whether a class is in a
+// set. Returns -1 once the cache has been emptied too often.
+static int
+NextState(
+	const std::vector<RegexNfaInst>&	inProgram,
+	const std::vector<char>&			inInSet,
+	RegexDfaCache&	ioCache,
+	int				inState,
+	int				inClass,
+	bool			inFirstWins)
+{
+	int next = ioCache.mNext[inState * ioCache.mClassCount + inClass];
+	if (next >= 0)
+		return next;
+
+	std::vector<int> list;
+	bool stopped = false;
+	ioCache.mSeen.assign(inProgram.size(), 0);
+
+	const std::vector<int>& threads = ioCache.mStates[inState];
+	for (size_t i = 0; i < threads.size(); i++) {
+		const RegexNfaInst& inst = inProgram[threads[i]];
+		if (inst.mOp == kNfaChar && inInSet[inst.mX * ioCache.mClassCount + inClass])
+			AddClosure(inProgram, threads[i] + 1, inFirstWins, ioCache.mSeen, list, stopped);
+	}
+
+	next = FindState(inProgram, ioCache, list);
+	if (next < 0) {
+		if (++ioCache.mFlushes > kRegexDfaMaxFlushes)
+			return -1;
+		ioCache.Clear(ioCache.mClassCount);
+		return FindState(inProgram, ioCache, list);
+	}
+	ioCache.mNext[inState * ioCache.mClassCount + inClass] = next;
+	return next;
+}
+
+// ---------------------------------------------------------------------------------
+//		RegexDfa
+// ---------------------------------------------------------------------------------
+
+RegexDfa::RegexDfa()
+	: mLoopStart(0)
+	, mAnchored(false)
+	, mGroupCount(0)
+	, mClassCount(0)
+{
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		mScratchSlots[i] = NULL;
+	}
+}
+
+RegexDfa::~RegexDfa()
+{
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		delete mScratchSlots[i];
+	}
+}
+
+bool
+RegexDfa::Compile(const char* inPattern)
+{
+	std::vector<PatternNode> nodes;
+	PatternParser parser(nodes, mSets);
+
+	const char* pos = inPattern;
+	mAnchored = *pos == '^';
+	if (mAnchored)
+		pos++;
+
+	// like atlrx, anything after an unmatched closing bracket is ignored
+	int root = parser.ParseRE(pos);
+	if (parser.mUnsupported)
+		return false;
+	if (root < 0)
+		root = parser.NewNode(kNodeEmpty, 0);
+	mGroupCount = parser.mGroupCount;
+
+	EmitNode(nodes, root, false, mForward);
+	Emit(mForward, kNfaMatch, 0, 0);
+	EmitNode(nodes, root, true, mReverse);
+	Emit(mReverse, kNfaMatch, 0, 0);
+
+	// the unanchored search tries the pattern first and only then moves on a
+	// character, which gives earlier starts priority over later ones
+	RegexCharSet any;
+	any.Add(1, kRegexMaxChar);
+	mSets.push_back(any);
+	mLoopStart = Emit(mForward, kNfaSplit, 0, 0);
+	mForward[mLoopStart].mY = mLoopStart + 1;
+	Emit(mForward, kNfaChar, (int) mSets.size() - 1, 0);
+	Emit(mForward, kNfaJmp, mLoopStart, 0);
+
+	// characters that every set treats alike can share their DFA transitions.
+	// The sets only change between the characters where their ranges start
+	// and end, so each run between two of those is tested once. Every ASCII
+	// character is a run of its own, for the table.
+	std::vector<unsigned long> bounds;
+	for (unsigned long c = 0; c <= 0x80; c++) {
+		bounds.push_back(c);
+	}
+	for (size_t s = 0; s < mSets.size(); s++) {
+		for (size_t r = 0; r < mSets[s].mRanges.size(); r++) {
+			bounds.push_back(mSets[s].mRanges[r].mFirst);
+			if (mSets[s].mRanges[r].mLast < kRegexMaxChar)
+				bounds.push_back(mSets[s].mRanges[r].mLast + 1);
+		}
+	}
+	std::sort(bounds.begin(), bounds.end());
+	bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+	std::map<std::vector<bool>, int> classes;
+	std::vector<unsigned long> classChars;
+	for (size_t i = 0; i < bounds.size(); i++) {
+		std::vector<bool> signature(mSets.size());
+		for (size_t s = 0; s < mSets.size(); s++) {
+			signature[s] = mSets[s].Has(bounds[i]);
+		}
+
+		int charClass;
+		std::map<std::vector<bool>, int>::const_iterator found = classes.find(signature);
+		if (found == classes.end()) {
+			charClass = (int) classChars.size();
+			classes[signature] = charClass;
+			classChars.push_back(bounds[i]);
+		}
+		else {
+			charClass = found->second;
+		}
+
+		if (bounds[i] < 0x80)
+			mAsciiClass[bounds[i]] = charClass;
+		else {
+			mRunStarts.push_back(bounds[i]);
+			mRunClasses.push_back(charClass);
+		}
+	}
+	mClassCount = (int) classChars.size();
+
+	mInSet.resize(mSets.size() * mClassCount);
+	for (size_t s = 0; s < mSets.size(); s++) {
+		for (int c = 0; c < mClassCount; c++) {
+			mInSet[s * mClassCount + c] = mSets[s].Has(classChars[c]);
+		}
+	}
+
+	// single characters in a row at the start are a literal every match
+	// begins with. U+FFFD also stands for any byte that is not UTF-8, which a
+	// search for its encoding would not find.
+	mPrefix.clear();
+	for (size_t pc = 0; pc < mForward.size() && mPrefix.size() < 32; pc++) {
+		const RegexNfaInst& inst = mForward[pc];
+		if (inst.mOp == kNfaSave)
+			continue;
+		if (inst.mOp != kNfaChar)
+			break;
+
+		const std::vector<RegexCharSet::Range>& ranges = mSets[inst.mX].mRanges;
+		if (ranges.size() != 1 || ranges[0].mFirst != ranges[0].mLast || ranges[0].mFirst == 0 || ranges[0].mFirst == 0xFFFD)
+			break;
+		AppendUTF8(mPrefix, ranges[0].mFirst);
+	}
+	return true;
+}
+
+// the class of the character at ioPos, which is then moved past it
+inline int
+RegexDfa::ReadClass(const unsigned char*& ioPos) const
+{
+	if (*ioPos < 0x80)
+		return mAsciiClass[*ioPos++];
+
+	const char* pos = reinterpret_cast<const char*>(ioPos);
+	ioPos = reinterpret_cast<const unsigned char*>(Utf8::Next(pos));
+	return ClassOf(Utf8::CodePoint(pos));
+}
+
+int
+RegexDfa::ClassOf(unsigned long inChar) const
+{
+	if (inChar < 0x80)
+		return mAsciiClass[inChar];
+
+	size_t run = std::upper_bound(mRunStarts.begin(), mRunStarts.end(), inChar) - mRunStarts.begin() - 1;
+	return mRunClasses[run];
+}
+
+RegexDfaScratch*
+RegexDfa::BorrowScratch()
+{
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		void* scratch = InterlockedExchangePointer((void* volatile*) &mScratchSlots[i], NULL);
+		if (scratch != NULL)
+			return static_cast<RegexDfaScratch*>(scratch);
+	}
+
+	RegexDfaScratch* scratch = new RegexDfaScratch;
+	scratch->mForward.Clear(mClassCount);
+	scratch->mReverse.Clear(mClassCount);
+
+	size_t slotCount = 2 + 2 * mGroupCount;
+	for (int i = 0; i < 2; i++) {
+		scratch->mLists[i].mOnList.assign(mForward.size(), 0);
+		scratch->mLists[i].mGeneration = 0;
+		scratch->mLists[i].mSlotCount = slotCount;
+	}
+	scratch->mSlots.resize(slotCount);
+	scratch->mStart.resize(slotCount);
+	return scratch;
+}
+
+void
+RegexDfa::ReturnScratch(RegexDfaScratch* inScratch)
+{
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		if (InterlockedCompareExchangePointer((void* volatile*) &mScratchSlots[i], inScratch, NULL) == NULL)
+			return;
+	}
+	delete inScratch;
+}
+
+// runs from inFrom to the end of the match atlrx would report
+RegexDfa::ScanResult
+RegexDfa::ScanForward(RegexDfaCache& ioCache, const unsigned char* inFrom, const unsigned char*& outEnd) const
+{
+	ioCache.mFlushes = 0;
+	int state = StartState(mForward, ioCache, mAnchored ? 0 : mLoopStart, true);
+
+	const unsigned char* end = NULL;
+	const unsigned char* p = inFrom;
+	for (;;) {
+		if (ioCache.mMatch[state])
+			end = p;
+		if (ioCache.mStates[state].empty())
+			break;
+
+		// the terminator is a character too, for a '$' at the end of the pattern
+		unsigned char c = *p;
+		state = NextState(mForward, mInSet, ioCache, state, ReadClass(p), true);
+		if (state < 0)
+			return kScanGaveUp;
+
+		if (c == '\0') {
+			if (ioCache.mMatch[state])
+				end = p;
+			break;
+		}
+	}
+
+	outEnd = end;
+	return end != NULL ? kScanMatch : kScanNoMatch;
+}
+
+// runs back from inEnd and finds the earliest start of a match that ends there
+RegexDfa::ScanResult
+RegexDfa::ScanReverse(RegexDfaCache& ioCache, const unsigned char* inFrom, const unsigned char* inEnd, const unsigned char*& outStart) const
+{
+	ioCache.mFlushes = 0;
+	int state = StartState(mReverse, ioCache, 0, false);
+
+	const unsigned char* start = NULL;
+	const unsigned char* p = inEnd;
+	for (;;) {
+		if (ioCache.mMatch[state])
+			start = p;
+		if (ioCache.mStates[state].empty() || p == inFrom)
+			break;
+
+		// characters are counted from inFrom, as the forward scan counted them
+		int charClass;
+		if (p[-1] < 0x80)
+			charClass = mAsciiClass[*--p];
+		else {
+			p = reinterpret_cast<const unsigned char*>(Utf8::Previous(reinterpret_cast<const char*>(inFrom), reinterpret_cast<const char*>(p)));
+			charClass = ClassOf(Utf8::CodePoint(reinterpret_cast<const char*>(p)));
+		}
+		state = NextState(mReverse, mInSet, ioCache, state, charClass, false);
+		if (state < 0)
+			return kScanGaveUp;
+	}
+
+	outStart = start;
+	return start != NULL ? kScanMatch : kScanNoMatch;
+}
+
+bool
+RegexDfa::Search(const char* inFrom, const char*& outStart, const char*& outEnd, const char** outGroups, int inGroupCount)
+{
+	const unsigned char* from = reinterpret_cast<const unsigned char*>(inFrom);
+	const unsigned char* start = from;
+	const unsigned char* end = NULL;
+
+	if (!mAnchored && !mPrefix.empty()) {
+		const char* candidate = Utf8::FindLiteral(inFrom, mPrefix.c_str(), mPrefix.size());
+		if (candidate == NULL)
+			return false;
+		from = reinterpret_cast<const unsigned char*>(candidate);
+	}
+
+	RegexDfaScratch* scratch = BorrowScratch();
+
+	ScanResult result = ScanForward(scratch->mForward, from, end);
+	if (result == kScanMatch && !mAnchored)
+		result = ScanReverse(scratch->mReverse, from, end, start);
+
+	// atlrx never starts a match on the terminator, except in an empty text
+	if (result == kScanMatch && *start == '\0' && start != reinterpret_cast<const unsigned char*>(inFrom))
+		result = kScanNoMatch;
+
+	// the groups, or a search the DFA gave up on, need the simulation
+	bool found = result != kScanNoMatch;
+	if (result == kScanGaveUp)
+		found = Simulate(*scratch, from, mAnchored);
+	else if (found && mGroupCount > 0)
+		found = Simulate(*scratch, start, true);
+	else if (found) {
+		scratch->mSlots[0] = start;
+		scratch->mSlots[1] = end;
+	}
+
+	if (found) {
+		outStart = reinterpret_cast<const char*>(scratch->mSlots[0]);
+		outEnd = reinterpret_cast<const char*>(scratch->mSlots[1]);
+		for (int i = 0; i < 2 * inGroupCount; i++) {
+			outGroups[i] = i < 2 * mGroupCount ? reinterpret_cast<const char*>(scratch->mSlots[2 + i]) : NULL;
+		}
+	}
+
+	ReturnScratch(scratch);
+	return found;
+}
+
+// ---------------------------------------------------------------------------------
+//		Simulate
+// ---------------------------------------------------------------------------------
+//	Runs the NFA with every thread carrying its own capture slots, in priority
+//	order, the way atlrx explores them but without ever going back. Slot 0 and
+//	1 are the match, 2 + 2n and 3 + 2n group n.
+
+static void
+AddThread(const std::vector<RegexNfaInst>& inProgram, NfaThreadList& ioList, int inPc, const unsigned char** ioSlots, const unsigned char* inPos)
+{
+	if (ioList.mOnList[inPc] == ioList.mGeneration)
+		return;
+	ioList.mOnList[inPc] = ioList.mGeneration;
+
+	const RegexNfaInst& inst = inProgram[inPc];
+	switch (inst.mOp) {
+	case kNfaJmp:
+		AddThread(inProgram, ioList, inst.mX, ioSlots, inPos);
+		break;
+	case kNfaSplit:
+		AddThread(inProgram, ioList, inst.mX, ioSlots, inPos);
+		AddThread(inProgram, ioList, inst.mY, ioSlots, inPos);
+		break;
+	case kNfaSave: {
+		const unsigned char* saved = ioSlots[inst.mX];
+		ioSlots[inst.mX] = inPos;
+		AddThread(inProgram, ioList, inPc + 1, ioSlots, inPos);
+		ioSlots[inst.mX] = saved;
+		break;
+	}
+	case kNfaChar:
+	case kNfaMatch:
+		ioList.mPcs.push_back(inPc);
+		ioList.mSlots.insert(ioList.mSlots.end(), ioSlots, ioSlots + ioList.mSlotCount);
+		break;
+	}
+}
+
+bool
+RegexDfa::Simulate(RegexDfaScratch& ioScratch, const unsigned char* inFrom, bool inAnchored) const
+{
+	size_t slotCount = ioScratch.mSlots.size();
+	std::vector<const unsigned char*>& slots = ioScratch.mStart;
+	const unsigned char** outSlots = &ioScratch.mSlots[0];
+
+	NfaThreadList* current = &ioScratch.mLists[0];
+	NfaThreadList* next = &ioScratch.mLists[1];
+
+	current->Reset(slotCount);
+	slots.assign(slotCount, (const unsigned char*) NULL);
+	slots[0] = inFrom;
+	AddThread(mForward, *current, 0, &slots[0], inFrom);
+
+	bool matched = false;
+	for (const unsigned char* p = inFrom; !current->mPcs.empty(); ) {
+
+		unsigned char c = *p;
+		const unsigned char* after = p;
+		int charClass = ReadClass(after);
+		next->Reset(slotCount);
+
+		for (size_t t = 0; t < current->mPcs.size(); t++) {
+			const RegexNfaInst& inst = mForward[current->mPcs[t]];
+			const unsigned char** threadSlots = &current->mSlots[t * slotCount];
+
+			// a finished thread outranks every thread after it
+			if (inst.mOp == kNfaMatch) {
+				matched = true;
+				threadSlots[1] = p;
+				memcpy(outSlots, threadSlots, slotCount * sizeof(*outSlots));
+				break;
+			}
+			if (mInSet[inst.mX * mClassCount + charClass])
+				AddThread(mForward, *next, current->mPcs[t] + 1, threadSlots, after);
+		}
+
+		// nothing continues past the terminator, but a thread may finish on it
+		if (c == '\0') {
+			for (size_t t = 0; t < next->mPcs.size(); t++) {
+				if (mForward[next->mPcs[t]].mOp == kNfaMatch) {
+					matched = true;
+					const unsigned char** threadSlots = &next->mSlots[t * slotCount];
+					threadSlots[1] = after;
+					memcpy(outSlots, threadSlots, slotCount * sizeof(*outSlots));
+					break;
+				}
+			}
+			break;
+		}
+
+		NfaThreadList* swap = current;
+		current = next;
+		next = swap;
+
+		// a new attempt at each later character, behind every thread in flight
+		p = after;
+		if (!inAnchored && !matched && *p != '\0') {
+			slots.assign(slotCount, (const unsigned char*) NULL);
+			slots[0] = p;
+			AddThread(mForward, *current, 0, &slots[0], p);
+		}
+	}
+	return matched;
+}
@@ -0,0 +1,115 @@
+// ===========================================================================
+//	RegexDfa.h
+// ===========================================================================
+//
+//	A linear time engine for the patterns that do not need atlrx's
+//	backtracking.
+//
+//	CAtlRegExp tries every start position and backtracks through every way a
+//	pattern can match, so a nasty pattern on a large page can take
+//	exponential time. Most extraction patterns have no back references, no
+//	'!' and no lazy repeats, and those are compiled here a second time, from
+//	the same atlrx syntax, into a Thompson NFA. A search then runs in three
+//	passes, each linear in the text it reads:
+//
+//	  1.	a lazily built DFA runs forward from the first possible start and
+//			finds where the match that atlrx would report ends. Its states are
+//			ordered sets of NFA threads, so alternatives keep atlrx's
+//			first-wins priority rather than the longest match.
+//	  2.	a DFA of the reversed NFA runs backwards from that end and finds
+//			where the match starts.
+//	  3.	only if the pattern has groups, an NFA simulation with capture slots
+//			runs over the match alone to place them.
+//
+//	DFA states are built on first use and kept in a cache of at most
+//	kRegexDfaMaxStates states. A full cache is emptied and rebuilt; if that
+//	keeps happening within one search, the search finishes on the NFA
+//	simulation instead, which is slower but still linear.
+//
+//	The text is read as UTF-8 one character at a time, split and decoded by
+//	CAtlRECharTraitsUTF8 exactly as CAtlRegExp reads it, so classes such as
+//	[^<] or a range of accented letters take whole characters. DFA
+//	transitions are indexed by character class: characters that no set in
+//	the pattern tells apart share one. ASCII characters find their class in a
+//	table; any other needs a decode and a binary search over the runs of code
+//	points between the ends of the pattern's ranges.
+//
+//	Patterns the NFA cannot express are left to CAtlRegExp (see RegexPattern).
+
+#ifndef REGEXDFA_H
+#define REGEXDFA_H
+
+#include "FetchScheduler.h"
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+// number of DFA states one cache holds before it is emptied
+static const int	kRegexDfaMaxStates = 1024;
+
+struct RegexNfaInst;
+struct RegexCharSet;
+class RegexDfaCache;
+struct RegexDfaScratch;
+
+// ---------------------------------------------------------------------------------
+//	RegexDfa
+// ---------------------------------------------------------------------------------
+
+class RegexDfa
+{
+public:
+	RegexDfa();
+	~RegexDfa();
+
+	// compiles inPattern, which CAtlRegExp::Parse has already accepted. Returns
+	// false if it uses back references, '!', lazy repeats or anything else that
+	// only the backtracker can match the same way.
+	bool	Compile(const char* inPattern);
+
+	int		GetGroupCount() const			{ return mGroupCount; }
+
+	// finds the first match starting at or after inFrom, the same match
+	// CAtlRegExp::Match(inFrom) would. outGroups receives the start and end of
+	// the first inGroupCount groups, two pointers each, both NULL for a group
+	// that took no part in the match. May be called from several threads at once.
+	bool	Search(const char* inFrom, const char*& outStart, const char*& outEnd, const char** outGroups, int inGroupCount);
+
+private:
+	RegexDfa(const RegexDfa&);
+	RegexDfa& operator=(const RegexDfa&);
+
+	enum ScanResult { kScanNoMatch, kScanMatch, kScanGaveUp };
+
+	ScanResult	ScanForward(RegexDfaCache& ioCache, const unsigned char* inFrom, const unsigned char*& outEnd) const;
+	ScanResult	ScanReverse(RegexDfaCache& ioCache, const unsigned char* inFrom, const unsigned char* inEnd, const unsigned char*& outStart) const;
+	bool		Simulate(RegexDfaScratch& ioScratch, const unsigned char* inFrom, bool inAnchored) const;
+
+	int			ReadClass(const unsigned char*& ioPos) const;
+	int			ClassOf(unsigned long inChar) const;
+
+	RegexDfaScratch*	BorrowScratch();
+	void				ReturnScratch(RegexDfaScratch* inScratch);
+
+	std::vector<RegexNfaInst>	mForward;		// the pattern, then the unanchored start loop
+	std::vector<RegexNfaInst>	mReverse;		// the pattern reversed, without groups
+	std::vector<RegexCharSet>	mSets;
+	int				mLoopStart;				// first instruction of the start loop in mForward
+	bool			mAnchored;
+	int				mGroupCount;
+
+	int				mAsciiClass[128];
+	std::vector<unsigned long>	mRunStarts;		// code points from 0x80 up where the class can change
+	std::vector<int>			mRunClasses;	// the class from each of those on
+	std::vector<char>			mInSet;			// mInSet[set * mClassCount + class]
+	int				mClassCount;
+
+	std::string		mPrefix;				// literal text every match starts with, as UTF-8
+
+	// DFA caches and simulation buffers, one set per worker searching at once
+	RegexDfaScratch* volatile	mScratchSlots[kFetchPoolSize];
+};
+
+#endif
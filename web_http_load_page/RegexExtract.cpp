@@ -0,0 +1,614 @@
+// ===========================================================================
+//	RegexExtract.cpp
+// ===========================================================================
+
+#include "RegexExtract.h"
+#include "RegexDfa.h"
+#include "RegexStatic.h"
+#include "FetchScheduler.h"
+
+#include <stdio.h>
+
+typedef CAtlREMatchContext<CAtlRECharTraitsUTF8>	RegexMatchContext;
+
+// ---------------------------------------------------------------------------------
+//		Context pool
+// ---------------------------------------------------------------------------------
+//	One slot per worker is enough for every context to be in use at once.
+//	Slots are claimed and filled with interlocked exchanges, so borrowing never
+//	waits; a context returned to a full pool is simply freed.
+
+static RegexMatchContext* volatile	sContextSlots[kFetchPoolSize];
+
+static RegexMatchContext*
+BorrowMatchContext()
+{
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		void* context = InterlockedExchangePointer((void* volatile*) &sContextSlots[i], NULL);
+		if (context != NULL)
+			return static_cast<RegexMatchContext*>(context);
+	}
+	return new RegexMatchContext;
+}
+
+static void
+ReturnMatchContext(RegexMatchContext* inContext)
+{
+	for (int i = 0; i < kFetchPoolSize; i++) {
+		if (InterlockedCompareExchangePointer((void* volatile*) &sContextSlots[i], inContext, NULL) == NULL)
+			return;
+	}
+	delete inContext;
+}
+
+// frees the pooled contexts when the plugin is unloaded
+static struct ContextPoolCleanup
+{
+	~ContextPoolCleanup()
+	{
+		for (int i = 0; i < kFetchPoolSize; i++) {
+			delete sContextSlots[i];
+			sContextSlots[i] = NULL;
+		}
+	}
+} sContextPoolCleanup;
+
+// ---------------------------------------------------------------------------------
+//		Fixed patterns
+// ---------------------------------------------------------------------------------
+//	Patterns built into the plugin as RegexStatic matchers, found by their
+//	Describe text; see RegexStatic.h for how to add one.
+
+// <title>{[^<]*}</title>
+typedef RegexStatic<
+	RxSeq<
+		RxText<'<','t','i','t','l','e','>'>,
+		RxGroup< RxStar< RxNotClass< RxChar<'<'> > > >,
+		RxText<'<','/','t','i','t','l','e','>'> > >		HtmlTitlePattern;
+
+// the same search as RegexPattern::Match, with tRegex
+template <class tRegex>
+static RegexFixedResult
+MatchFixed(const char* inText, long inOccurrence, std::string outGroups[kRegexMaxGroups], int& outGroupCount)
+{
+	typename tRegex::Context context;
+
+	const char* from = inText;
+	for (long n = 1; n <= inOccurrence; n++) {
+		if (*from == '\0')
+			return kFixedNoMatch;
+		if (!tRegex::Match(from, &context))
+			return context.m_bOverflow ? kFixedGaveUp : kFixedNoMatch;
+
+		from = context.m_Match.szEnd;
+		if (from == context.m_Match.szStart && *from != '\0')
+			from = CAtlRECharTraitsUTF8::Next(from);
+	}
+
+	if (context.m_uNumGroups == 0) {
+		outGroups[0].assign(context.m_Match.szStart, context.m_Match.szEnd);
+		outGroupCount = 1;
+		return kFixedMatch;
+	}
+
+	for (UINT i = 0; i < context.m_uNumGroups && i < kRegexMaxGroups; i++) {
+		const char* start;
+		const char* end;
+		context.GetMatch(i, &start, &end);
+		if (start != NULL && end != NULL)
+			outGroups[i].assign(start, end);
+		else
+			outGroups[i].clear();
+		outGroupCount++;
+	}
+	return kFixedMatch;
+}
+
+struct FixedPattern
+{
+	void				(*mDescribe)(std::string& outText);
+	RegexFixedMatch		mMatch;
+};
+
+static const FixedPattern	sFixedPatterns[] =
+{
+	{ HtmlTitlePattern::Describe, MatchFixed<HtmlTitlePattern> }
+};
+
+static RegexFixedMatch
+FindFixedPattern(const char* inPattern)
+{
+	std::string text;
+	for (size_t i = 0; i < sizeof(sFixedPatterns) / sizeof(sFixedPatterns[0]); i++) {
+		sFixedPatterns[i].mDescribe(text);
+		if (text == inPattern)
+			return sFixedPatterns[i].mMatch;
+	}
+	return NULL;
+}
+
+// ---------------------------------------------------------------------------------
+//		RegexPattern
+// ---------------------------------------------------------------------------------
+
+RegexPattern::RegexPattern()
+	: mRefCount(1)
+	, mAnchored(false)
+	, mDfa(NULL)
+	, mFixed(NULL)
+{
+}
+
+RegexPattern::~RegexPattern()
+{
+	delete mDfa;
+}
+
+void
+RegexPattern::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+RegexPattern::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+static const char*
+ParseErrorText(REParseError inError)
+{
+	switch (inError) {
+	case REPARSE_ERROR_OUTOFMEMORY:		return "out of memory";
+	case REPARSE_ERROR_BRACE_EXPECTED:	return "a closing } was expected";
+	case REPARSE_ERROR_PAREN_EXPECTED:	return "a closing ) was expected";
+	case REPARSE_ERROR_BRACKET_EXPECTED:	return "a closing ] was expected";
+	case REPARSE_ERROR_EMPTY_RANGE:		return "empty character class";
+	case REPARSE_ERROR_INVALID_GROUP:	return "back reference to a group that does not exist";
+	case REPARSE_ERROR_INVALID_RANGE:	return "invalid character range";
+	case REPARSE_ERROR_EMPTY_REPEATOP:	return "repeat of something that can be empty";
+	case REPARSE_ERROR_INVALID_INPUT:	return "invalid pattern";
+	default:							return "unexpected error";
+	}
+}
+
+bool
+RegexPattern::Parse(const char* inPattern, std::string& outError)
+{
+	REParseError error = mRegExp.Parse(inPattern);
+	if (error == REPARSE_ERROR_OK) {
+		mAnchored = *inPattern == '^';
+
+		// a fixed matcher still needs the DFA or the backtracker for the
+		// matches too deep for it
+		mFixed = FindFixedPattern(inPattern);
+
+		mDfa = new RegexDfa;
+		if (!mDfa->Compile(inPattern)) {
+			delete mDfa;
+			mDfa = NULL;
+		}
+		return true;
+	}
+
+	outError = "ERROR: invalid pattern: ";
+	outError += ParseErrorText(error);
+	return false;
+}
+
+static void
+MatchErrorText(REMatchError inError, const RegexLimits& inLimits, std::string& outError)
+{
+	char buf[96];
+	switch (inError) {
+	case REMATCH_ERROR_STEPS:
+		_snprintf(buf, sizeof(buf), "ERROR: pattern gave up after %lu steps", inLimits.mMaxSteps);
+		break;
+	case REMATCH_ERROR_STACK:
+		_snprintf(buf, sizeof(buf), "ERROR: pattern gave up at its %lu KB stack limit", inLimits.mMaxStackBytes / 1024);
+		break;
+	default:
+		_snprintf(buf, sizeof(buf), "ERROR: out of memory matching pattern");
+		break;
+	}
+	buf[sizeof(buf) - 1] = '\0';
+	outError = buf;
+}
+
+const char*
+RegexPattern::GetPrefix(size_t& outLength) const
+{
+	return mRegExp.GetPrefix(&outLength);
+}
+
+bool
+RegexPattern::Match(const char* inText, long inOccurrence, const RegexLimits& inLimits, std::string outGroups[kRegexMaxGroups], int& outGroupCount, std::string& outError)
+{
+	outGroupCount = 0;
+
+	if (mFixed != NULL) {
+		RegexFixedResult fixed = mFixed(inText, inOccurrence, outGroups, outGroupCount);
+		if (fixed != kFixedGaveUp)
+			return fixed == kFixedMatch;
+		outGroupCount = 0;
+	}
+	if (mDfa != NULL)
+		return MatchWithDfa(inText, inOccurrence, outGroups, outGroupCount);
+
+	RegexMatchContext* context = BorrowMatchContext();
+
+	// the step budget is shared by all the searches, so it bounds the whole call
+	size_t stepsLeft = inLimits.mMaxSteps;
+	size_t maxStack = inLimits.mMaxStackBytes / sizeof(void*);
+	if (inLimits.mMaxStackBytes != 0 && maxStack == 0)
+		maxStack = 1;
+
+	// each search starts where the previous match ended, in the same context
+	const char* from = inText;
+	bool found = false;
+	for (long n = 1; n <= inOccurrence; n++) {
+
+		// atlrx reads past the terminator when it fails on an empty text
+		if (*from == '\0' || (n > 1 && mAnchored)) {
+			found = false;
+			break;
+		}
+
+		if (inLimits.mMaxSteps != 0 && stepsLeft == 0) {
+			MatchErrorText(REMATCH_ERROR_STEPS, inLimits, outError);
+			ReturnMatchContext(context);
+			return false;
+		}
+		context->SetLimits(stepsLeft, maxStack);
+
+		found = mRegExp.Match(from, context) != FALSE;
+		if (!found) {
+			if (context->GetMatchError() != REMATCH_ERROR_OK) {
+				MatchErrorText(context->GetMatchError(), inLimits, outError);
+				ReturnMatchContext(context);
+				return false;
+			}
+			break;
+		}
+		if (inLimits.mMaxSteps != 0)
+			stepsLeft -= context->GetSteps();
+
+		// an empty match would be found again at the same place
+		from = context->m_Match.szEnd;
+		if (from == context->m_Match.szStart && *from != '\0')
+			from = CAtlRECharTraitsUTF8::Next(from);
+	}
+
+	if (!found) {
+		ReturnMatchContext(context);
+		return false;
+	}
+
+	if (context->m_uNumGroups == 0) {
+		outGroups[0].assign(context->m_Match.szStart, context->m_Match.szEnd);
+		outGroupCount = 1;
+		ReturnMatchContext(context);
+		return true;
+	}
+
+	for (UINT i = 0; i < context->m_uNumGroups && i < kRegexMaxGroups; i++) {
+		const char* start;
+		const char* end;
+		context->GetMatch(i, &start, &end);
+
+		// a group the match went around has no text
+		if (start != NULL && end != NULL)
+			outGroups[i].assign(start, end);
+		else
+			outGroups[i].clear();
+		outGroupCount++;
+	}
+	ReturnMatchContext(context);
+	return true;
+}
+
+// the same search as Match, on the linear time engine
+bool
+RegexPattern::MatchWithDfa(const char* inText, long inOccurrence, std::string outGroups[kRegexMaxGroups], int& outGroupCount)
+{
+	const char* groups[2 * kRegexMaxGroups];
+	const char* start = NULL;
+	const char* end = NULL;
+
+	const char* from = inText;
+	for (long n = 1; n <= inOccurrence; n++) {
+		if (*from == '\0' || (n > 1 && mAnchored))
+			return false;
+		if (!mDfa->Search(from, start, end, groups, kRegexMaxGroups))
+			return false;
+
+		from = end;
+		if (from == start && *from != '\0')
+			from = CAtlRECharTraitsUTF8::Next(from);
+	}
+
+	if (mDfa->GetGroupCount() == 0) {
+		outGroups[0].assign(start, end);
+		outGroupCount = 1;
+		return true;
+	}
+
+	for (int i = 0; i < mDfa->GetGroupCount() && i < kRegexMaxGroups; i++) {
+		if (groups[2 * i] != NULL && groups[2 * i + 1] != NULL)
+			outGroups[i].assign(groups[2 * i], groups[2 * i + 1]);
+		else
+			outGroups[i].clear();
+		outGroupCount++;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		RegexPatternSet
+// ---------------------------------------------------------------------------------
+
+RegexPatternSet::RegexPatternSet()
+	: mRefCount(1)
+	, mFirstByteCount(0)
+	, mScanned(0)
+{
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		mPatterns[i] = NULL;
+		mPrefixLength[i] = 0;
+	}
+}
+
+RegexPatternSet::RegexPatternSet(const RegexPatternSet& inOther)
+	: mRefCount(1)
+	, mNext(inOther.mNext)
+	, mFound(inOther.mFound)
+	, mFirstByteCount(inOther.mFirstByteCount)
+	, mScanned(inOther.mScanned)
+{
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		mPatterns[i] = inOther.mPatterns[i];
+		if (mPatterns[i] != NULL)
+			mPatterns[i]->AddRef();
+		mPrefixLength[i] = inOther.mPrefixLength[i];
+		mFirstBytes[i] = inOther.mFirstBytes[i];
+	}
+}
+
+RegexPatternSet::~RegexPatternSet()
+{
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		if (mPatterns[i] != NULL)
+			mPatterns[i]->Release();
+	}
+}
+
+void
+RegexPatternSet::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+RegexPatternSet::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+bool
+RegexPatternSet::SetPattern(int inSlot, const char* inPattern, std::string& outError)
+{
+	if (mPatterns[inSlot] != NULL) {
+		mPatterns[inSlot]->Release();
+		mPatterns[inSlot] = NULL;
+	}
+
+	bool ok = true;
+	if (*inPattern != '\0') {
+		RegexPattern* pattern = new RegexPattern;
+		ok = pattern->Parse(inPattern, outError);
+		if (ok)
+			mPatterns[inSlot] = pattern;
+		else
+			pattern->Release();
+	}
+
+	BuildPrefilter();
+	return ok;
+}
+
+bool
+RegexPatternSet::IsEmpty() const
+{
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		if (mPatterns[i] != NULL)
+			return false;
+	}
+	return true;
+}
+
+bool
+RegexPatternSet::IsSingle() const
+{
+	for (int i = 1; i < kRegexMaxPatterns; i++) {
+		if (mPatterns[i] != NULL)
+			return false;
+	}
+	return mPatterns[0] != NULL;
+}
+
+// builds the automaton over the prefixes of the patterns that have one
+void
+RegexPatternSet::BuildPrefilter()
+{
+	mNext.clear();
+	mFound.clear();
+	mFirstByteCount = 0;
+	mScanned = 0;
+
+	const char* prefixes[kRegexMaxPatterns];
+	int count = 0;
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		mPrefixLength[i] = 0;
+		if (mPatterns[i] != NULL) {
+			prefixes[i] = mPatterns[i]->GetPrefix(mPrefixLength[i]);
+			if (mPrefixLength[i] > 0)
+				count++;
+		}
+	}
+
+	// a single prefix is found faster by the pattern's own SSE2 scan
+	if (count < 2)
+		return;
+
+	// the trie of the prefixes, -1 where there is no edge
+	std::vector<int> trie(256, -1);
+	std::vector<unsigned char> found(1, 0);
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		if (mPrefixLength[i] == 0)
+			continue;
+
+		int state = 0;
+		for (size_t k = 0; k < mPrefixLength[i]; k++) {
+			int edge = 256 * state + (unsigned char) prefixes[i][k];
+			if (trie[edge] < 0) {
+				trie[edge] = (int) found.size();
+				trie.resize(trie.size() + 256, -1);
+				found.push_back(0);
+			}
+			state = trie[edge];
+		}
+		found[state] |= (unsigned char) (1 << i);
+		mScanned |= 1 << i;
+	}
+
+	// breadth first, so that each missing edge can be copied from the state of
+	// the longest proper suffix, which is shallower and already complete
+	size_t states = found.size();
+	mNext.assign(256 * states, 0);
+	std::vector<int> fail(states, 0);
+	std::vector<int> queue;
+
+	for (int c = 0; c < 256; c++) {
+		if (trie[c] > 0) {
+			mNext[c] = (unsigned char) trie[c];
+			queue.push_back(trie[c]);
+			mFirstBytes[mFirstByteCount++] = (unsigned char) c;
+		}
+	}
+	for (size_t q = 0; q < queue.size(); q++) {
+		int state = queue[q];
+		found[state] |= found[fail[state]];
+
+		for (int c = 0; c < 256; c++) {
+			int target = trie[256 * state + c];
+			if (target > 0) {
+				fail[target] = mNext[256 * fail[state] + c];
+				mNext[256 * state + c] = (unsigned char) target;
+				queue.push_back(target);
+			}
+			else {
+				mNext[256 * state + c] = mNext[256 * fail[state] + c];
+			}
+		}
+	}
+	mFound.swap(found);
+}
+
+// finds the first occurrence of every prefix in one pass, which ends as soon
+// as all of them have been seen. Returns the bits of the patterns whose prefix
+// does not occur.
+unsigned int
+RegexPatternSet::ScanPrefixes(const char* inText, const char* outFrom[kRegexMaxPatterns]) const
+{
+	const unsigned char* next = &mNext[0];
+	const unsigned char* found = &mFound[0];
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(inText);
+	unsigned int pending = mScanned;
+	unsigned int state = 0;
+
+#ifdef ATL_REGEXP_SSE2
+	__m128i firstBytes[kRegexMaxPatterns];
+	for (int i = 0; i < mFirstByteCount; i++) {
+		firstBytes[i] = _mm_set1_epi8((char) mFirstBytes[i]);
+	}
+	const __m128i zero = _mm_setzero_si128();
+#endif
+
+	while (pending != 0) {
+
+		// in the root state, skip to the next byte that can start a prefix
+		if (state == 0) {
+#ifdef ATL_REGEXP_SSE2
+			// aligned loads never cross into the next page, so reading past
+			// the terminator within the last block is safe
+			size_t misalign = reinterpret_cast<size_t>(p) & 15;
+			const unsigned char* block = p - misalign;
+			unsigned int valid = 0xFFFFu << misalign;
+			for (;;) {
+				__m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+				__m128i hits = _mm_cmpeq_epi8(bytes, zero);
+				for (int i = 0; i < mFirstByteCount; i++) {
+					hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, firstBytes[i]));
+				}
+				unsigned int mask = _mm_movemask_epi8(hits) & valid;
+				if (mask != 0) {
+					unsigned long bit;
+					_BitScanForward(&bit, mask);
+					p = block + bit;
+					break;
+				}
+				block += 16;
+				valid = 0xFFFFu;
+			}
+#else
+			while (*p != '\0' && next[*p] == 0)
+				p++;
+#endif
+		}
+
+		if (*p == '\0')
+			break;
+		state = next[256 * state + *p++];
+
+		unsigned int hits = found[state] & pending;
+		if (hits != 0) {
+			for (int i = 0; i < kRegexMaxPatterns; i++) {
+				if (hits & (1 << i))
+					outFrom[i] = reinterpret_cast<const char*>(p) - mPrefixLength[i];
+			}
+			pending &= ~hits;
+		}
+	}
+	return pending;
+}
+
+int
+RegexPatternSet::Match(const char* inText, long inOccurrence, const RegexLimits& inLimits, std::string outGroups[kRegexMaxPatterns][kRegexMaxGroups], int outGroupCounts[kRegexMaxPatterns], std::string& outError) const
+{
+	const char* from[kRegexMaxPatterns];
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		from[i] = inText;
+		outGroupCounts[i] = 0;
+	}
+	outError.clear();
+	unsigned int missing = mScanned != 0 ? ScanPrefixes(inText, from) : 0;
+
+	// each pattern then runs from its first candidate; one whose prefix never
+	// occurred cannot match
+	int matched = 0;
+	for (int i = 0; i < kRegexMaxPatterns; i++) {
+		if (mPatterns[i] == NULL || (missing & (1 << i)) != 0)
+			continue;
+		std::string error;
+		if (mPatterns[i]->Match(from[i], inOccurrence, inLimits, outGroups[i], outGroupCounts[i], error))
+			matched++;
+		else if (!error.empty() && outError.empty())
+			outError = error;
+	}
+	return matched;
+}
@@ -0,0 +1,191 @@
+// ===========================================================================
+//	RegexExtract.h
+// ===========================================================================
+//
+//	Regular expression extraction with the ATL engine vendored in
+//	ThirdParty/ATLRegExp/atlrx.h.
+//
+//	Patterns and responses are both UTF-8 and are matched in place with
+//	CAtlRECharTraitsUTF8: '.', classes and literals take whole characters,
+//	and ranges compare code points, so [^<] steps over an accented letter in
+//	one piece and a group never ends inside a character. Nothing is widened
+//	to UTF-16 first; ASCII text never goes through the decoder.
+//
+//	A RegexPattern is parsed once, when the actor's pattern input changes, and
+//	is then shared by every job that uses it. CAtlRegExp::Match only reads the
+//	compiled instructions and keeps all of its state in the match context, so
+//	several workers can match the same pattern at once. A pattern that starts
+//	with literal text, such as "mag": or <title>, is only tried where an SSE2
+//	scan finds that text, rather than at every position of the response.
+//
+//	Patterns without back references, '!' or lazy repeats are also compiled
+//	into a RegexDfa, which finds the same matches in time linear in the size
+//	of the response, whatever the response holds; the prefix scan then only
+//	tells the DFA where to start. Only the rest are matched by backtracking,
+//	bounded by RegexLimits. A pattern built into the plugin as a RegexStatic
+//	matcher (see RegexStatic.h) skips both and runs its own compiled code,
+//	unless a match goes deeper than that code allows, when the search is
+//	done again by the DFA or the backtracker.
+//
+//	Matching needs a CAtlREMatchContext for its groups, memory slots and
+//	backtracking stack. Rather than allocating one per match, workers borrow
+//	them from a small pool; a borrowed context keeps the buffers of its last
+//	match, so after the first few responses matching stops allocating, also
+//	while stepping through the matches of one body.
+//
+//	In the atlrx syntax groups are written with braces, {...}, while (...)
+//	only groups without capturing. The first kRegexMaxGroups groups of the
+//	chosen match are what the actor receives; a pattern without groups gives
+//	the whole match instead.
+//
+//	Up to kRegexMaxPatterns patterns are kept together in a RegexPatternSet.
+//	Their literal prefixes are compiled into one Aho-Corasick automaton, so a
+//	single scan of the response finds where each pattern can first match, and
+//	each pattern is then only run from there. A pattern whose prefix never
+//	occurs is not run at all, so adding patterns adds little to the scan.
+
+#ifndef REGEXEXTRACT_H
+#define REGEXEXTRACT_H
+
+#include "ThirdParty/ATLRegExp/atlrx.h"
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+class RegexDfa;
+
+// number of groups the actor can receive
+static const int	kRegexMaxGroups = 4;
+
+// default bounds on the backtracking of one search, see RegexLimits
+static const unsigned long	kRegexDefaultSteps = 50000000;
+static const unsigned long	kRegexDefaultStackBytes = 16 * 1024 * 1024;
+
+// what a matcher compiled for one pattern found; kFixedGaveUp when the match
+// went deeper than its recursion allows, see RegexStatic.h
+enum RegexFixedResult { kFixedNoMatch, kFixedMatch, kFixedGaveUp };
+
+// the search of RegexPattern::Match, as done by a matcher compiled for one pattern
+typedef RegexFixedResult	(*RegexFixedMatch)(const char* inText, long inOccurrence, std::string outGroups[kRegexMaxGroups], int& outGroupCount);
+
+// number of patterns matched together
+static const int	kRegexMaxPatterns = 4;
+
+// ---------------------------------------------------------------------------------
+//	RegexLimits
+// ---------------------------------------------------------------------------------
+//	Bounds on the backtracking of one search. A pattern that backtracks badly on
+//	some page then gives up with an error after a bounded time, instead of
+//	holding its worker and with it every actor waiting for the pool. The DFA
+//	and the fixed matchers run in linear time and ignore them.
+
+struct RegexLimits
+{
+	RegexLimits()
+		: mMaxSteps(kRegexDefaultSteps)
+		, mMaxStackBytes(kRegexDefaultStackBytes)
+	{
+	}
+
+	unsigned long	mMaxSteps;			// atlrx instructions for all the matches of one pattern; 0 for no bound
+	unsigned long	mMaxStackBytes;		// size of the backtracking stack; 0 for no bound
+};
+
+// ---------------------------------------------------------------------------------
+//	RegexPattern
+// ---------------------------------------------------------------------------------
+
+class RegexPattern
+{
+public:
+	RegexPattern();
+
+	void	AddRef();
+	void	Release();
+
+	// compiles inPattern; returns false with a description in outError if it
+	// is not a valid expression
+	bool	Parse(const char* inPattern, std::string& outError);
+
+	// finds match number inOccurrence (one-based, matches do not overlap) in
+	// the NUL terminated inText and copies out its groups. Returns false if
+	// there are fewer matches, or with a description in outError if the
+	// search reached one of inLimits first. May be called from several
+	// threads at once.
+	bool	Match(const char* inText, long inOccurrence, const RegexLimits& inLimits, std::string outGroups[kRegexMaxGroups], int& outGroupCount, std::string& outError);
+
+	// the literal text every match starts with; outLength is 0 if there is none
+	const char*	GetPrefix(size_t& outLength) const;
+
+private:
+	~RegexPattern();
+
+	RegexPattern(const RegexPattern&);
+	RegexPattern& operator=(const RegexPattern&);
+
+	bool	MatchWithDfa(const char* inText, long inOccurrence, std::string outGroups[kRegexMaxGroups], int& outGroupCount);
+
+	volatile LONG						mRefCount;
+	CAtlRegExp<CAtlRECharTraitsUTF8>	mRegExp;
+	bool								mAnchored;		// starts with ^, so only matches at the start of the text
+	RegexDfa*							mDfa;			// NULL if the pattern needs the backtracker
+	RegexFixedMatch						mFixed;			// the matcher built in for this pattern, if any, tried first
+};
+
+// ---------------------------------------------------------------------------------
+//	RegexPatternSet
+// ---------------------------------------------------------------------------------
+
+class RegexPatternSet
+{
+public:
+	RegexPatternSet();
+
+	// a copy of inOther sharing its compiled patterns; it starts with a single reference
+	RegexPatternSet(const RegexPatternSet& inOther);
+
+	void	AddRef();
+	void	Release();
+
+	// compiles inPattern into slot inSlot (zero-based); an empty inPattern
+	// clears the slot. Returns false with a description in outError, clearing
+	// the slot, if it does not compile.
+	bool	SetPattern(int inSlot, const char* inPattern, std::string& outError);
+
+	bool	IsEmpty() const;
+	bool	HasPattern(int inSlot) const		{ return mPatterns[inSlot] != NULL; }
+
+	// true if only the first slot is used, whose groups then fill all outputs
+	bool	IsSingle() const;
+
+	// finds match number inOccurrence of every pattern in the NUL terminated
+	// inText, as RegexPattern::Match does, with one scan for all of them.
+	// outGroupCounts[i] is 0 for a slot without a pattern or a match. Returns
+	// the number of patterns that matched; outError describes the first
+	// pattern that gave up at one of inLimits, and is empty if none did.
+	int		Match(const char* inText, long inOccurrence, const RegexLimits& inLimits, std::string outGroups[kRegexMaxPatterns][kRegexMaxGroups], int outGroupCounts[kRegexMaxPatterns], std::string& outError) const;
+
+private:
+	~RegexPatternSet();
+
+	RegexPatternSet& operator=(const RegexPatternSet&);
+
+	void			BuildPrefilter();
+	unsigned int	ScanPrefixes(const char* inText, const char* outFrom[kRegexMaxPatterns]) const;
+
+	volatile LONG				mRefCount;
+	RegexPattern*				mPatterns[kRegexMaxPatterns];
+
+	// the Aho-Corasick automaton over the prefixes: mNext[256 * state + byte]
+	// is the next state and mFound[state] has a bit for each prefix that ends there
+	std::vector<unsigned char>	mNext;
+	std::vector<unsigned char>	mFound;
+	size_t						mPrefixLength[kRegexMaxPatterns];
+	unsigned char				mFirstBytes[kRegexMaxPatterns];		// the bytes that leave the root state
+	int							mFirstByteCount;
+	unsigned int				mScanned;		// bit for each pattern found through the automaton
+};
+
+#endif
@@ -0,0 +1,747 @@
+// ===========================================================================
+//	RegexStatic.h
+// ===========================================================================
+//
+//	Matchers for patterns that are fixed when the plugin is built.
+//
+//	A pattern is written as a type, one template for each rule of the atlrx
+//	grammar, and the compiler turns it into a matcher of its own: every node
+//	is a static function that calls the rest of the pattern as a
+//	continuation, so there is no instruction list and no switch on the
+//	instruction type at run time, and the whole pattern can be inlined. The
+//	matchers backtrack exactly as CAtlRegExp does and read the text as UTF-8
+//	with CAtlRECharTraitsUTF8, so a fixed pattern finds the same match, with
+//	the same groups, as its atlrx text would.
+//
+//	The atlrx text "<title>{[^<]*}</title>" is written
+//
+//		RxSeq<
+//			RxText<'<','t','i','t','l','e','>'>,
+//			RxGroup< RxStar< RxNotClass< RxChar<'<'> > > >,
+//			RxText<'<','/','t','i','t','l','e','>'> >
+//
+//	and RegexStatic<Pattern>::Describe gives that text back. Groups are
+//	numbered in order, as in atlrx. A pattern that starts with RxText is only
+//	tried where an SSE2 scan finds that text.
+//
+//	Adding a matcher: there is no parser from atlrx text to these types, so a
+//	fixed pattern is found by its text instead. Write the type, then add its
+//	Describe and a MatchFixed of it to sFixedPatterns in RegexExtract.cpp.
+//	RegexPattern::Parse compares each Describe text with the pattern input,
+//	once per change of the input, and a pattern that is exactly equal uses
+//	the matcher; any other text, even an equivalent one, does not.
+//
+//	A repeat of a single character is a loop that backs off one character at
+//	a time; a repeat of anything longer recurses once per iteration. Past
+//	kRegexStaticMaxDepth iterations it stops rather than risk the stack, and
+//	sets m_bOverflow in the context: Match then returns FALSE, and a caller
+//	must not take that as "no match". RegexPattern runs the search again on
+//	its DFA or backtracker, so it still finds what atlrx would. Back
+//	references, '!', and the \n and \q abbreviations have no template.
+//	RxText must be valid UTF-8.
+//
+//	VS2013 has no constexpr, so the pattern cannot be parsed from a string
+//	literal at compile time; the types are the parsed form, spelled out.
+
+#ifndef REGEXSTATIC_H
+#define REGEXSTATIC_H
+
+#include "JsonCursor.h"
+#include "ThirdParty/ATLRegExp/atlrx.h"
+
+#include <string.h>
+#include <string>
+
+// nesting of repeats of more than one character a match may reach
+static const int	kRegexStaticMaxDepth = 1000;
+
+typedef CAtlRECharTraitsUTF8	RxTraits;
+
+// how tightly a node binds, to know where Describe needs parentheses
+enum RxLevel
+{
+	kRxAtom = 0,				// a character, class, group or parenthesised expression
+	kRxRepeat,					// an atom with *, + or ?
+	kRxAlternative,				// two of those with |
+	kRxSequence
+};
+
+// ---------------------------------------------------------------------------------
+//	RegexStaticContext
+// ---------------------------------------------------------------------------------
+//	The match and its groups, read with the same members and accessors as
+//	CAtlREMatchContext. It holds the groups itself, so matching never allocates.
+
+template <int tNumGroups>
+class RegexStaticContext
+{
+public:
+	typedef char RECHAR;
+
+	struct MatchGroup
+	{
+		const RECHAR *szStart;
+		const RECHAR *szEnd;
+	};
+
+	UINT m_uNumGroups;
+
+	MatchGroup m_Match;
+
+	RegexStaticContext()
+	{
+		m_uNumGroups = tNumGroups;
+		m_Match.szStart = NULL;
+		m_Match.szEnd = NULL;
+		Reset();
+	}
+
+	void GetMatch(UINT nIndex, const RECHAR **szStart, const RECHAR **szEnd)
+	{
+		ATLENSURE(szStart != NULL);
+		ATLENSURE(szEnd != NULL);
+		ATLENSURE(nIndex < m_uNumGroups);
+		*szStart = m_Matches[nIndex].szStart;
+		*szEnd = m_Matches[nIndex].szEnd;
+	}
+
+	void GetMatch(UINT nIndex, MatchGroup *pGroup)
+	{
+		ATLENSURE(pGroup != NULL);
+		ATLENSURE(nIndex < m_uNumGroups);
+		*pGroup = m_Matches[nIndex];
+	}
+
+	// the rest is for the matchers
+	void Reset()
+	{
+		for (int i = 0; i < tNumGroups; i++) {
+			m_Matches[i].szStart = NULL;
+			m_Matches[i].szEnd = NULL;
+		}
+		m_nDepth = 0;
+		m_bOverflow = false;
+	}
+
+	MatchGroup	m_Matches[tNumGroups > 0 ? tNumGroups : 1];
+	int			m_nDepth;
+	bool		m_bOverflow;
+};
+
+// ---------------------------------------------------------------------------------
+//		Describing
+// ---------------------------------------------------------------------------------
+
+// appends inChar as the atlrx text for it, escaped where atlrx would read it
+// as something else
+inline void
+RxDescribeChar(std::string& ioOut, unsigned long inChar, bool inClass)
+{
+	const char* special = inClass ? "\\]-^" : "\\{}()[]|!.*+?$^";
+	if (inChar == '\t' && inClass)
+		ioOut += "\\t";
+	else if (inChar < 0x80 && inChar != 0 && strchr(special, (int) inChar) != NULL) {
+		ioOut += '\\';
+		ioOut += (char) inChar;
+	}
+	else
+		AppendUTF8(ioOut, inChar);
+}
+
+// appends the text of tNode, in parentheses if it binds less tightly than inLevel
+template <class tNode>
+inline void
+RxDescribeAt(std::string& ioOut, int inLevel)
+{
+	if (tNode::kLevel > inLevel) {
+		ioOut += '(';
+		tNode::Describe(ioOut);
+		ioOut += ')';
+	}
+	else
+		tNode::Describe(ioOut);
+}
+
+// ---------------------------------------------------------------------------------
+//		Single characters
+// ---------------------------------------------------------------------------------
+//	Every node has kGroups, the number of groups in it; kCanBeEmpty, for the
+//	same check atlrx makes before repeating it; kLevel; Describe; and
+//	Match<tBase>, which matches the node at inPos, with its first group
+//	numbered tBase, and calls inNext with where it ended until inNext returns
+//	true. The single character nodes also have Step, which returns the
+//	position after the character at inPos if the node matches it, else NULL.
+
+// one character, given as its code point
+template <unsigned long tChar>
+struct RxChar
+{
+	enum { kGroups = 0, kCanBeEmpty = 0, kSingle = 1, kLevel = kRxAtom };
+
+	static bool	Has(unsigned long inChar)			{ return inChar == tChar; }
+	static void	DescribeItem(std::string& ioOut)	{ RxDescribeChar(ioOut, tChar, true); }
+	static void	Describe(std::string& ioOut)		{ RxDescribeChar(ioOut, tChar, false); }
+
+	static const char*
+	Step(const char* inPos)
+	{
+		if (tChar < 0x80)
+			return *inPos == (char) tChar && tChar != 0 ? inPos + 1 : NULL;
+		return RxTraits::CodePoint(inPos) == tChar ? RxTraits::Next(inPos) : NULL;
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		const char* next = Step(inPos);
+		return next != NULL && inNext(next);
+	}
+};
+
+// the characters from tFirst to tLast, only inside RxClass and RxNotClass
+template <unsigned long tFirst, unsigned long tLast>
+struct RxRange
+{
+	static bool	Has(unsigned long inChar)			{ return inChar >= tFirst && inChar <= tLast; }
+
+	static void
+	DescribeItem(std::string& ioOut)
+	{
+		RxDescribeChar(ioOut, tFirst, true);
+		ioOut += '-';
+		RxDescribeChar(ioOut, tLast, true);
+	}
+};
+
+template <class... tItems>
+struct RxItems;
+
+template <>
+struct RxItems<>
+{
+	static bool	Has(unsigned long)					{ return false; }
+	static void	Describe(std::string&)				{}
+};
+
+template <class tItem, class... tRest>
+struct RxItems<tItem, tRest...>
+{
+	static bool	Has(unsigned long inChar)			{ return tItem::Has(inChar) || RxItems<tRest...>::Has(inChar); }
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		tItem::DescribeItem(ioOut);
+		RxItems<tRest...>::Describe(ioOut);
+	}
+};
+
+// [...] and [^...], of RxChar and RxRange items. Neither matches the terminator.
+template <bool tNegate, class... tItems>
+struct RxClassOf
+{
+	enum { kGroups = 0, kCanBeEmpty = 0, kSingle = 1, kLevel = kRxAtom };
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		ioOut += tNegate ? "[^" : "[";
+		RxItems<tItems...>::Describe(ioOut);
+		ioOut += ']';
+	}
+
+	static const char*
+	Step(const char* inPos)
+	{
+		// ASCII text is tested without decoding
+		unsigned long c = (unsigned char) *inPos;
+		const char* next = inPos + 1;
+		if (c >= 0x80) {
+			c = RxTraits::CodePoint(inPos);
+			next = RxTraits::Next(inPos);
+		}
+		if (c == 0 || RxItems<tItems...>::Has(c) == tNegate)
+			return NULL;
+		return next;
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		const char* next = Step(inPos);
+		return next != NULL && inNext(next);
+	}
+};
+
+template <class... tItems>
+struct RxClass : RxClassOf<false, tItems...> {};
+
+template <class... tItems>
+struct RxNotClass : RxClassOf<true, tItems...> {};
+
+// '.', any character but the terminator
+struct RxAny
+{
+	enum { kGroups = 0, kCanBeEmpty = 0, kSingle = 1, kLevel = kRxAtom };
+
+	static void	Describe(std::string& ioOut)		{ ioOut += '.'; }
+
+	static const char*
+	Step(const char* inPos)
+	{
+		return *inPos != '\0' ? RxTraits::Next(inPos) : NULL;
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		const char* next = Step(inPos);
+		return next != NULL && inNext(next);
+	}
+};
+
+// the abbreviations atlrx expands, which are written back as such
+struct RxDigit : RxClass< RxRange<'0', '9'> >
+{
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\d"; }
+};
+
+struct RxAlnum : RxClass< RxRange<'a', 'z'>, RxRange<'A', 'Z'>, RxRange<'0', '9'> >
+{
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\a"; }
+};
+
+struct RxAlpha : RxClass< RxRange<'a', 'z'>, RxRange<'A', 'Z'> >
+{
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\c"; }
+};
+
+struct RxHexDigit : RxClass< RxRange<'0', '9'>, RxRange<'a', 'f'>, RxRange<'A', 'F'> >
+{
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\h"; }
+};
+
+struct RxBlank : RxClass< RxChar<' '>, RxChar<'\t'> >
+{
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\b"; }
+};
+
+// ---------------------------------------------------------------------------------
+//		Sequences
+// ---------------------------------------------------------------------------------
+
+// literal text, compared a byte at a time
+template <char... tChars>
+struct RxText
+{
+	enum { kGroups = 0, kCanBeEmpty = sizeof...(tChars) == 0, kSingle = 0, kLevel = sizeof...(tChars) > 1 ? kRxSequence : kRxAtom };
+
+	static const char	sText[sizeof...(tChars) + 1];
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		for (size_t i = 0; i < sizeof...(tChars); ) {
+			RxDescribeChar(ioOut, RxTraits::CodePoint(sText + i), false);
+			i = RxTraits::Next(sText + i) - sText;
+		}
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		// stops at the terminator, which no literal contains
+		for (size_t i = 0; i < sizeof...(tChars); i++) {
+			if (inPos[i] != sText[i])
+				return false;
+		}
+		return inNext(inPos + sizeof...(tChars));
+	}
+};
+
+template <char... tChars>
+const char RxText<tChars...>::sText[sizeof...(tChars) + 1] = { tChars..., '\0' };
+
+template <class... tNodes>
+struct RxSeq;
+
+template <class tNode>
+struct RxSeq<tNode> : tNode {};
+
+template <class tNode, class... tRest>
+struct RxSeq<tNode, tRest...>
+{
+	enum {
+		kGroups = tNode::kGroups + RxSeq<tRest...>::kGroups,
+		kCanBeEmpty = tNode::kCanBeEmpty && RxSeq<tRest...>::kCanBeEmpty,
+		kSingle = 0,
+		kLevel = kRxSequence
+	};
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		RxDescribeAt<tNode>(ioOut, kRxSequence);
+		RxDescribeAt< RxSeq<tRest...> >(ioOut, kRxSequence);
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		return tNode::template Match<tBase>(inPos, ioContext, [&](const char* inEnd) -> bool {
+			return RxSeq<tRest...>::template Match<tBase + tNode::kGroups>(inEnd, ioContext, inNext);
+		});
+	}
+};
+
+// '$' at the end of a pattern. Like atlrx it matches the terminator and
+// steps over it, so the match ends one past it.
+struct RxEnd
+{
+	enum { kGroups = 0, kCanBeEmpty = 0, kSingle = 0, kLevel = kRxAtom };
+
+	static void	Describe(std::string& ioOut)		{ ioOut += '$'; }
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		return *inPos == '\0' && inNext(inPos + 1);
+	}
+};
+
+// ---------------------------------------------------------------------------------
+//		Groups and alternatives
+// ---------------------------------------------------------------------------------
+
+// {...}. Like atlrx, a group the match backs out of gets its previous text back.
+template <class tNode>
+struct RxGroup
+{
+	enum { kGroups = 1 + tNode::kGroups, kCanBeEmpty = tNode::kCanBeEmpty, kSingle = 0, kLevel = kRxAtom };
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		ioOut += '{';
+		tNode::Describe(ioOut);
+		ioOut += '}';
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		typename tContext::MatchGroup saved = ioContext.m_Matches[tBase];
+		ioContext.m_Matches[tBase].szStart = inPos;
+
+		bool matched = tNode::template Match<tBase + 1>(inPos, ioContext, [&](const char* inEnd) -> bool {
+			ioContext.m_Matches[tBase].szEnd = inEnd;
+			return inNext(inEnd);
+		});
+		if (!matched)
+			ioContext.m_Matches[tBase] = saved;
+		return matched;
+	}
+};
+
+// tFirst, or failing that tSecond. As in atlrx, '|' only takes the single
+// expressions on either side of it, so Describe puts anything longer in
+// parentheses.
+template <class tFirst, class tSecond>
+struct RxAlt
+{
+	enum {
+		kGroups = tFirst::kGroups + tSecond::kGroups,
+		kCanBeEmpty = tFirst::kCanBeEmpty || tSecond::kCanBeEmpty,
+		kSingle = 0,
+		kLevel = kRxAlternative
+	};
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		RxDescribeAt<tFirst>(ioOut, kRxRepeat);
+		ioOut += '|';
+		RxDescribeAt<tSecond>(ioOut, kRxAlternative);
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		return tFirst::template Match<tBase>(inPos, ioContext, inNext)
+			|| tSecond::template Match<tBase + tFirst::kGroups>(inPos, ioContext, inNext);
+	}
+};
+
+// ---------------------------------------------------------------------------------
+//		Repeats
+// ---------------------------------------------------------------------------------
+
+enum RxRepeatKind
+{
+	kRxStar = 0,
+	kRxPlus,
+	kRxQuestion,
+	kRxLazyStar,
+	kRxLazyPlus,
+	kRxLazyQuestion
+};
+
+// what a repeat does with each iteration is the same for every node; how it
+// steps from one to the next depends on whether the node is a single character
+template <class tNode, int tKind, bool tSingle = tNode::kSingle != 0>
+struct RxRepeatOf;
+
+// a repeat of anything longer than a character, backtracking through every
+// iteration the way atlrx does
+template <class tNode, int tKind>
+struct RxRepeatOf<tNode, tKind, false>
+{
+	// greedy: one more iteration, which atlrx refuses if it matched nothing,
+	// and failing that the rest of the pattern
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Greedy(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		if (++ioContext.m_nDepth > kRegexStaticMaxDepth)
+			ioContext.m_bOverflow = true;
+
+		bool matched = !ioContext.m_bOverflow && tNode::template Match<tBase>(inPos, ioContext, [&](const char* inEnd) -> bool {
+			return inEnd != inPos && Greedy<tBase>(inEnd, ioContext, inNext);
+		});
+		ioContext.m_nDepth--;
+		return matched || (!ioContext.m_bOverflow && inNext(inPos));
+	}
+
+	// lazy: the rest of the pattern first, and only then another iteration
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Lazy(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		if (inNext(inPos))
+			return true;
+
+		if (++ioContext.m_nDepth > kRegexStaticMaxDepth)
+			ioContext.m_bOverflow = true;
+
+		bool matched = !ioContext.m_bOverflow && tNode::template Match<tBase>(inPos, ioContext, [&](const char* inEnd) -> bool {
+			return Lazy<tBase>(inEnd, ioContext, inNext);
+		});
+		ioContext.m_nDepth--;
+		return matched;
+	}
+
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		switch (tKind) {
+		case kRxStar:
+			return Greedy<tBase>(inPos, ioContext, inNext);
+		case kRxPlus:
+			return tNode::template Match<tBase>(inPos, ioContext, [&](const char* inEnd) -> bool {
+				return Greedy<tBase>(inEnd, ioContext, inNext);
+			});
+		case kRxQuestion:
+			return tNode::template Match<tBase>(inPos, ioContext, [&](const char* inEnd) -> bool {
+				return inEnd != inPos && inNext(inEnd);
+			}) || inNext(inPos);
+		case kRxLazyStar:
+			return Lazy<tBase>(inPos, ioContext, inNext);
+		case kRxLazyPlus:
+			return tNode::template Match<tBase>(inPos, ioContext, [&](const char* inEnd) -> bool {
+				return Lazy<tBase>(inEnd, ioContext, inNext);
+			});
+		default:
+			return inNext(inPos) || tNode::template Match<tBase>(inPos, ioContext, inNext);
+		}
+	}
+};
+
+// a repeat of a single character: the characters are counted in a loop, and
+// backing off is a step back, with no recursion
+template <class tNode, int tKind>
+struct RxRepeatOf<tNode, tKind, true>
+{
+	template <int tBase, class tContext, class tNext>
+	static bool
+	Match(const char* inPos, tContext& ioContext, const tNext& inNext)
+	{
+		const char* first = inPos;
+		if (tKind == kRxPlus || tKind == kRxLazyPlus) {
+			first = tNode::Step(inPos);
+			if (first == NULL)
+				return false;
+		}
+
+		if (tKind == kRxQuestion) {
+			const char* next = tNode::Step(inPos);
+			return (next != NULL && inNext(next)) || inNext(inPos);
+		}
+		if (tKind == kRxLazyQuestion) {
+			if (inNext(inPos))
+				return true;
+			const char* next = tNode::Step(inPos);
+			return next != NULL && inNext(next);
+		}
+
+		if (tKind == kRxLazyStar || tKind == kRxLazyPlus) {
+			for (const char* pos = first; pos != NULL; pos = tNode::Step(pos)) {
+				if (inNext(pos))
+					return true;
+			}
+			return false;
+		}
+
+		// greedy: the longest run, then shorter ones. Characters are counted
+		// from inPos, so stepping back finds the same ones.
+		const char* end = first;
+		for (const char* next = tNode::Step(end); next != NULL; next = tNode::Step(end)) {
+			end = next;
+		}
+		for (const char* pos = end; ; pos = RxTraits::Previous(inPos, pos)) {
+			if (inNext(pos))
+				return true;
+			if (pos == first)
+				return false;
+		}
+	}
+};
+
+template <class tNode, int tKind>
+struct RxRepeat : RxRepeatOf<tNode, tKind>
+{
+	// atlrx rejects * and + of something that can match nothing
+	static_assert(tKind == kRxQuestion || tKind == kRxLazyQuestion || !tNode::kCanBeEmpty, "repeat of an expression that can be empty");
+
+	enum {
+		kGroups = tNode::kGroups,
+		kCanBeEmpty = tKind == kRxPlus || tKind == kRxLazyPlus ? (int) tNode::kCanBeEmpty : 1,
+		kSingle = 0,
+		kLevel = kRxRepeat
+	};
+
+	static void
+	Describe(std::string& ioOut)
+	{
+		static const char* const kOperators[] = { "*", "+", "?", "*?", "+?", "??" };
+		RxDescribeAt<tNode>(ioOut, kRxAtom);
+		ioOut += kOperators[tKind];
+	}
+};
+
+template <class tNode> struct RxStar : RxRepeat<tNode, kRxStar> {};
+template <class tNode> struct RxPlus : RxRepeat<tNode, kRxPlus> {};
+template <class tNode> struct RxQuestion : RxRepeat<tNode, kRxQuestion> {};
+template <class tNode> struct RxLazyStar : RxRepeat<tNode, kRxLazyStar> {};
+template <class tNode> struct RxLazyPlus : RxRepeat<tNode, kRxLazyPlus> {};
+template <class tNode> struct RxLazyQuestion : RxRepeat<tNode, kRxLazyQuestion> {};
+
+// \w and \z, which atlrx expands to a repeat in parentheses
+struct RxWord : RxPlus< RxAlpha >
+{
+	enum { kLevel = kRxAtom };
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\w"; }
+};
+
+struct RxInteger : RxPlus< RxDigit >
+{
+	enum { kLevel = kRxAtom };
+	static void	Describe(std::string& ioOut)		{ ioOut += "\\z"; }
+};
+
+// ---------------------------------------------------------------------------------
+//	RegexStatic
+// ---------------------------------------------------------------------------------
+//	The matcher for tPattern; tAnchored is a leading '^'.
+
+// the literal text a pattern starts with, if it starts with RxText
+template <class tNode>
+struct RxPrefix
+{
+	static const char*	Get(size_t& outLength)		{ outLength = 0; return NULL; }
+};
+
+template <char... tChars>
+struct RxPrefix< RxText<tChars...> >
+{
+	static const char*	Get(size_t& outLength)		{ outLength = sizeof...(tChars); return RxText<tChars...>::sText; }
+};
+
+template <class tNode, class... tRest>
+struct RxPrefix< RxSeq<tNode, tRest...> > : RxPrefix<tNode> {};
+
+template <class tNode>
+struct RxPrefix< RxGroup<tNode> > : RxPrefix<tNode> {};
+
+template <class tPattern, bool tAnchored = false>
+class RegexStatic
+{
+public:
+	enum { kNumGroups = tPattern::kGroups };
+
+	typedef RegexStaticContext<kNumGroups>	Context;
+
+	// the atlrx text of the pattern
+	static void
+	Describe(std::string& outText)
+	{
+		outText = tAnchored ? "^" : "";
+		tPattern::Describe(outText);
+	}
+
+	// finds the first match in inText, as CAtlRegExp::Match does. FALSE with
+	// ioContext->m_bOverflow set means the search gave up, see above.
+	static BOOL
+	Match(const char* inText, Context* ioContext, const char** outEnd = NULL)
+	{
+		ATLENSURE(inText != NULL && ioContext != NULL);
+		ioContext->Reset();
+
+		size_t prefixLength;
+		const char* prefix = RxPrefix<tPattern>::Get(prefixLength);
+
+		const char* pos = inText;
+		if (!tAnchored && prefixLength > 0) {
+			pos = RxTraits::FindLiteral(inText, prefix, prefixLength);
+			if (pos == NULL)
+				return FALSE;
+		}
+
+		for (;;) {
+			ioContext->m_Match.szStart = pos;
+			bool matched = tPattern::template Match<0>(pos, *ioContext, [&](const char* inEnd) -> bool {
+				if (ioContext->m_bOverflow)
+					return false;
+				ioContext->m_Match.szEnd = inEnd;
+				return true;
+			});
+			if (matched) {
+				if (outEnd != NULL)
+					*outEnd = ioContext->m_Match.szEnd;
+				return TRUE;
+			}
+
+			// the next start, never the terminator
+			if (tAnchored || ioContext->m_bOverflow || *pos == '\0')
+				return FALSE;
+			pos = RxTraits::Next(pos);
+			if (*pos == '\0')
+				return FALSE;
+			if (prefixLength > 0) {
+				pos = RxTraits::FindLiteral(pos, prefix, prefixLength);
+				if (pos == NULL)
+					return FALSE;
+			}
+		}
+	}
+};
+
+#endif
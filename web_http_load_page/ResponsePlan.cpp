@@ -0,0 +1,164 @@
+// ===========================================================================
+//	ResponsePlan.cpp
+// ===========================================================================
+
+#include "ResponsePlan.h"
+#include "RegexExtract.h"
+
+// ---------------------------------------------------------------------------------
+//		ResponsePlan
+// ---------------------------------------------------------------------------------
+
+ResponsePlan::ResponsePlan()
+	: mRefCount(1)
+	, mGeoJson(false)
+	, mCsvMode(kCsvOff)
+	, mCsvFirstRow(1)
+	, mXmlMode(kXmlOff)
+	, mXmlItems(1)
+	, mDiffFormat(kJsonDiffOff)
+	, mDiffState(NULL)
+	, mFramePool(NULL)
+	, mPatterns(NULL)
+	, mMatchIndex(1)
+	, mMatchSteps(kRegexDefaultSteps)
+	, mMatchStackKB(kRegexDefaultStackBytes / 1024)
+{
+}
+
+ResponsePlan::ResponsePlan(const ResponsePlan& inOther)
+	: mRefCount(1)
+	, mPointers(inOther.mPointers)
+	, mGeoJson(inOther.mGeoJson)
+	, mCsvMode(inOther.mCsvMode)
+	, mCsvFirstRow(inOther.mCsvFirstRow)
+	, mXmlMode(inOther.mXmlMode)
+	, mXmlItems(inOther.mXmlItems)
+	, mDiffFormat(inOther.mDiffFormat)
+	, mDiffState(inOther.mDiffState)
+	, mFramePool(inOther.mFramePool)
+	, mPatterns(inOther.mPatterns)
+	, mMatchIndex(inOther.mMatchIndex)
+	, mMatchSteps(inOther.mMatchSteps)
+	, mMatchStackKB(inOther.mMatchStackKB)
+{
+	if (mPatterns != NULL)
+		mPatterns->AddRef();
+	if (mDiffState != NULL)
+		mDiffState->AddRef();
+	if (mFramePool != NULL)
+		mFramePool->AddRef();
+
+	for (int i = 0; i < kGeoJsonMaxProperties; i++) {
+		mGeoProperties[i] = inOther.mGeoProperties[i];
+	}
+	for (int i = 0; i < kCsvMaxColumns; i++) {
+		mCsvColumns[i] = inOther.mCsvColumns[i];
+	}
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		mXmlPaths[i] = inOther.mXmlPaths[i];
+	}
+}
+
+ResponsePlan::~ResponsePlan()
+{
+	if (mPatterns != NULL)
+		mPatterns->Release();
+	if (mDiffState != NULL)
+		mDiffState->Release();
+	if (mFramePool != NULL)
+		mFramePool->Release();
+}
+
+void
+ResponsePlan::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+ResponsePlan::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+ResponseMode
+ResponsePlan::GetMode() const
+{
+	if (mFramePool != NULL)
+		return kResponseImage;
+	if (mCsvMode != kCsvOff)
+		return kResponseCsv;
+	if (mXmlMode != kXmlOff)
+		return kResponseXml;
+	if (mGeoJson)
+		return kResponseGeoJson;
+	if (mPatterns != NULL)
+		return kResponseRegex;
+	if (mDiffState != NULL || !mPointers.IsEmpty())
+		return kResponseJson;
+	return kResponseText;
+}
+
+void
+ResponsePlan::SetGeoProperties(const char* inList)
+{
+	ParseGeoJsonPropertyList(inList, mGeoProperties);
+}
+
+void
+ResponsePlan::SetCsvColumns(const char* inList)
+{
+	ParseCsvColumnList(inList, mCsvColumns);
+}
+
+void
+ResponsePlan::SetXmlPaths(const char* inList)
+{
+	ParseXmlPathList(inList, mXmlPaths);
+}
+
+void
+ResponsePlan::SetDiff(int inFormat)
+{
+	mDiffFormat = inFormat;
+	if (inFormat == kJsonDiffOff && mDiffState != NULL) {
+		mDiffState->Release();
+		mDiffState = NULL;
+	}
+	else if (inFormat != kJsonDiffOff && mDiffState == NULL) {
+		mDiffState = new JsonDiffState;
+	}
+}
+
+void
+ResponsePlan::SetImage(bool inOn)
+{
+	if (!inOn && mFramePool != NULL) {
+		mFramePool->Release();
+		mFramePool = NULL;
+	}
+	else if (inOn && mFramePool == NULL) {
+		mFramePool = new FramePool;
+	}
+}
+
+bool
+ResponsePlan::SetPattern(int inSlot, const char* inPattern, std::string& outError)
+{
+	// the set may be shared with other copies of the plan, so it is replaced
+	RegexPatternSet* patterns = mPatterns != NULL ? new RegexPatternSet(*mPatterns) : new RegexPatternSet;
+	bool ok = patterns->SetPattern(inSlot, inPattern, outError);
+
+	if (mPatterns != NULL)
+		mPatterns->Release();
+	mPatterns = NULL;
+
+	if (patterns->IsEmpty())
+		patterns->Release();
+	else
+		mPatterns = patterns;
+	return ok;
+}
@@ -0,0 +1,162 @@
+// ===========================================================================
+//	ResponsePlan.h
+// ===========================================================================
+//
+//	How an actor reads its responses.
+//
+//	The actor has one ResponsePlan, which its jobs carry along. It holds the
+//	settings of every way of reading a response: the JSON pointers of the
+//	field inputs, GeoJSON points, regular expressions, CSV columns, XML paths
+//	and image frames. Several can be set at once, so GetMode decides which one
+//	a response goes through. The plan also carries the actor's JsonDiffState
+//	when responses are diffed, and its FramePool when they are decoded as
+//	images.
+
+#ifndef RESPONSEPLAN_H
+#define RESPONSEPLAN_H
+
+#include "CsvStream.h"
+#include "GeoJson.h"
+#include "ImageDecode.h"
+#include "JsonDiff.h"
+#include "JsonExtract.h"
+#include "XmlStream.h"
+
+#include <windows.h>
+
+#include <string>
+
+class RegexPatternSet;
+
+// ---------------------------------------------------------------------------------
+//	ResponseMode
+// ---------------------------------------------------------------------------------
+
+enum ResponseMode
+{
+	kResponseText,			// the response text is posted as it is
+	kResponseJson,			// the JSON pointers are read, and the document diffed
+	kResponseGeoJson,
+	kResponseRegex,
+	kResponseCsv,
+	kResponseXml,
+	kResponseImage
+};
+
+// ---------------------------------------------------------------------------------
+//	ResponsePlan
+// ---------------------------------------------------------------------------------
+//	A plan is reference counted and not changed once a job holds it: the actor
+//	edits a copy and swaps it in.
+
+class ResponsePlan
+{
+public:
+	ResponsePlan();
+
+	// copies inOther's settings; the copy starts with a single reference
+	ResponsePlan(const ResponsePlan& inOther);
+
+	void	AddRef();
+	void	Release();
+
+	// the way responses are read. Image, CSV and XML mode come first, as they
+	// stream the response; then GeoJSON, regular expressions and JSON pointers.
+	ResponseMode	GetMode() const;
+
+	// the field inputs, see JsonPointerSet::SetPointer
+	bool	SetPointer(int inSlot, const char* inPointer)	{ return mPointers.SetPointer(inSlot, inPointer); }
+	bool	HasPointer(int inSlot) const		{ return mPointers.HasPointer(inSlot); }
+	const JsonPointerSet&	GetPointers() const	{ return mPointers; }
+
+	// in GeoJSON mode responses are read into GeoJsonPoints instead, with the
+	// properties named in the comma separated list inList as extra columns
+	void	SetGeoJson(bool inOn)				{ mGeoJson = inOn; }
+	bool	IsGeoJson() const					{ return mGeoJson; }
+	void	SetGeoProperties(const char* inList);
+	const std::string*	GetGeoProperties() const	{ return mGeoProperties; }
+
+	// in CSV mode (a CsvMode other than kCsvOff) responses are streamed through
+	// a CsvParser instead, selecting the columns named or numbered in the comma
+	// separated list inList
+	void	SetCsv(int inMode)					{ mCsvMode = inMode; }
+	int		GetCsvMode() const					{ return mCsvMode; }
+	bool	IsCsv() const						{ return mCsvMode != kCsvOff; }
+	void	SetCsvColumns(const char* inList);
+	const std::string*	GetCsvColumns() const	{ return mCsvColumns; }
+
+	// the one-based first row of the kCsvWindowRows rows kept in kCsvRows mode
+	void	SetCsvFirstRow(size_t inRow)		{ mCsvFirstRow = inRow > 1 ? inRow : 1; }
+	size_t	GetCsvFirstRow() const				{ return mCsvFirstRow; }
+
+	// in XML mode (an XmlMode other than kXmlOff) responses are streamed
+	// through an XmlParser instead, reading the paths in the comma separated
+	// list inList until each has inItems matches
+	void	SetXml(int inMode)					{ mXmlMode = inMode; }
+	int		GetXmlMode() const					{ return mXmlMode; }
+	bool	IsXml() const						{ return mXmlMode != kXmlOff; }
+	void	SetXmlPaths(const char* inList);
+	const std::string*	GetXmlPaths() const		{ return mXmlPaths; }
+	void	SetXmlItems(long inItems)			{ mXmlItems = inItems > 1 ? inItems : 1; }
+	long	GetXmlItems() const					{ return mXmlItems; }
+
+	// with a JsonDiffFormat other than kJsonDiffOff, each JSON response is also
+	// diffed against the one before. The JsonDiffState holding that document
+	// is shared by copies of the plan and dropped when diffing is turned off.
+	void	SetDiff(int inFormat);
+	int		GetDiffFormat() const				{ return mDiffFormat; }
+	bool	IsDiff() const						{ return mDiffState != NULL; }
+	JsonDiffState*	GetDiffState() const		{ return mDiffState; }
+
+	// in image mode responses are decoded into frames for the video output
+	// instead. The FramePool the frames come from is shared by copies of the
+	// plan and dropped when image mode is turned off.
+	void	SetImage(bool inOn);
+	bool	IsImage() const						{ return mFramePool != NULL; }
+	FramePool*	GetFramePool() const			{ return mFramePool; }
+
+	// with a pattern set, responses are matched against the patterns instead
+	// of being read as JSON. Slot inSlot (zero-based) is compiled here, once,
+	// and the patterns are shared by copies of the plan. An empty inPattern
+	// clears the slot. Returns false with a description in outError, clearing
+	// the slot, if it does not compile.
+	bool	SetPattern(int inSlot, const char* inPattern, std::string& outError);
+	bool	IsRegex() const						{ return mPatterns != NULL; }
+	const RegexPatternSet*	GetPatterns() const	{ return mPatterns; }
+
+	// which match of the pattern is reported, one-based
+	void	SetMatchIndex(long inIndex)			{ mMatchIndex = inIndex > 1 ? inIndex : 1; }
+	long	GetMatchIndex() const				{ return mMatchIndex; }
+
+	// the RegexLimits of each search: backtracking steps and stack size in
+	// KB, 0 for no bound
+	void	SetMatchSteps(long inSteps)			{ mMatchSteps = inSteps > 0 ? inSteps : 0; }
+	unsigned long	GetMatchSteps() const		{ return mMatchSteps; }
+	void	SetMatchStackKB(long inKB)			{ mMatchStackKB = inKB > 0 ? inKB : 0; }
+	unsigned long	GetMatchStackKB() const		{ return mMatchStackKB; }
+
+private:
+	~ResponsePlan();
+
+	ResponsePlan& operator=(const ResponsePlan&);
+
+	volatile LONG		mRefCount;
+	JsonPointerSet		mPointers;
+	bool				mGeoJson;
+	std::string			mGeoProperties[kGeoJsonMaxProperties];
+	int					mCsvMode;
+	std::string			mCsvColumns[kCsvMaxColumns];
+	size_t				mCsvFirstRow;
+	int					mXmlMode;
+	std::string			mXmlPaths[kXmlMaxPaths];
+	long				mXmlItems;
+	int					mDiffFormat;
+	JsonDiffState*		mDiffState;		// NULL while diffing is off
+	FramePool*			mFramePool;		// NULL while image mode is off
+	RegexPatternSet*	mPatterns;		// NULL while no slot is set
+	long				mMatchIndex;
+	unsigned long		mMatchSteps;
+	unsigned long		mMatchStackKB;
+};
+
+#endif
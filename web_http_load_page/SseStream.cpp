@@ -0,0 +1,190 @@
+// ===========================================================================
+//	SseStream.cpp
+// ===========================================================================
+
+#include "SseStream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		SseParser
+// ---------------------------------------------------------------------------------
+
+SseParser::SseParser(const std::string& inLastId, DWORD inRetryMs)
+	: mSkipLF(false)
+	, mFirstLine(true)
+	, mLastId(inLastId)
+	, mRetryMs(inRetryMs)
+{
+}
+
+void
+SseParser::Feed(const char* inData, size_t inLength, std::vector<SseEvent>& ioEvents)
+{
+	const char* p = inData;
+	const char* end = inData + inLength;
+
+	if (mSkipLF && p < end && *p == '\n')
+		p++;
+	mSkipLF = false;
+
+	while (p < end) {
+		const char* q = p;
+		while (q < end && *q != '\n' && *q != '\r')
+			q++;
+
+		size_t room = kSseMaxLineLength - mLine.length();
+		mLine.append(p, (size_t) (q - p) < room ? (size_t) (q - p) : room);
+		if (q == end)
+			break;
+
+		// a CR at the end of the chunk may be the first half of a CRLF
+		if (*q == '\r') {
+			if (q + 1 == end)
+				mSkipLF = true;
+			else if (q[1] == '\n')
+				q++;
+		}
+
+		EndLine(ioEvents);
+		mLine.clear();
+		p = q + 1;
+	}
+}
+
+void
+SseParser::EndLine(std::vector<SseEvent>& ioEvents)
+{
+	if (mFirstLine) {
+		if (mLine.compare(0, 3, "\xEF\xBB\xBF") == 0)
+			mLine.erase(0, 3);
+		mFirstLine = false;
+	}
+
+	// an empty line dispatches the event
+	if (mLine.empty()) {
+		if (!mData.empty()) {
+			ioEvents.push_back(SseEvent());
+			SseEvent& event = ioEvents.back();
+			event.mType = mType.empty() ? "message" : mType;
+			event.mId = mLastId;
+			mData.erase(mData.length() - 1);
+			event.mData.swap(mData);
+		}
+		mData.clear();
+		mType.clear();
+		return;
+	}
+
+	if (mLine[0] == ':')
+		return;
+
+	// the field name, then the value after the colon and one space
+	size_t colon = mLine.find(':');
+	size_t fieldLength = colon == std::string::npos ? mLine.length() : colon;
+	size_t value = colon == std::string::npos ? mLine.length() : colon + 1;
+	if (value < mLine.length() && mLine[value] == ' ')
+		value++;
+
+	if (mLine.compare(0, fieldLength, "event") == 0) {
+		mType.assign(mLine, value, std::string::npos);
+	}
+	else if (mLine.compare(0, fieldLength, "data") == 0) {
+		if (mData.length() < kSseMaxDataLength)
+			mData.append(mLine, value, kSseMaxDataLength - mData.length());
+		mData += '\n';
+	}
+	else if (mLine.compare(0, fieldLength, "id") == 0) {
+		if (mLine.find('\0', value) == std::string::npos)
+			mLastId.assign(mLine, value, std::string::npos);
+	}
+	else if (mLine.compare(0, fieldLength, "retry") == 0) {
+		if (value < mLine.length() && mLine.find_first_not_of("0123456789", value) == std::string::npos)
+			mRetryMs = strtoul(mLine.c_str() + value, NULL, 10);
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		SseSubscription
+// ---------------------------------------------------------------------------------
+
+SseSubscription::SseSubscription()
+	: mRefCount(1)
+	, mStopped(0)
+	, mWake(CreateEventA(NULL, TRUE, FALSE, NULL))
+{
+	InitializeCriticalSection(&mLock);
+}
+
+SseSubscription::~SseSubscription()
+{
+	if (mWake != NULL)
+		CloseHandle(mWake);
+	DeleteCriticalSection(&mLock);
+}
+
+void
+SseSubscription::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+SseSubscription::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+void
+SseSubscription::Stop()
+{
+	InterlockedExchange(&mStopped, 1);
+	mCancel.Cancel();
+	if (mWake != NULL)
+		SetEvent(mWake);
+}
+
+bool
+SseSubscription::Wait(DWORD inMs)
+{
+	if (mWake != NULL)
+		WaitForSingleObject(mWake, inMs);
+	else
+		Sleep(inMs);
+	return !IsStopped();
+}
+
+void
+SseSubscription::Push(std::vector<SseEvent>& ioEvents)
+{
+	EnterCriticalSection(&mLock);
+	for (size_t i = 0; i < ioEvents.size(); i++) {
+		mEvents.push_back(SseEvent());
+		SseEvent& event = mEvents.back();
+		event.mType.swap(ioEvents[i].mType);
+		event.mId.swap(ioEvents[i].mId);
+		event.mData.swap(ioEvents[i].mData);
+		event.mHasValues = ioEvents[i].mHasValues;
+		for (int k = 0; k < kJsonMaxPointers; k++) {
+			event.mValues[k] = ioEvents[i].mValues[k];
+		}
+	}
+	while (mEvents.size() > kSseMaxWaiting)
+		mEvents.pop_front();
+	LeaveCriticalSection(&mLock);
+
+	ioEvents.clear();
+}
+
+bool
+SseSubscription::Drain(std::deque<SseEvent>& ioEvents)
+{
+	EnterCriticalSection(&mLock);
+	mEvents.swap(ioEvents);
+	LeaveCriticalSection(&mLock);
+
+	return !ioEvents.empty();
+}
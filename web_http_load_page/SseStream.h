@@ -0,0 +1,141 @@
+// ===========================================================================
+//	SseStream.h
+// ===========================================================================
+//
+//	Server-Sent Events subscriptions: one text/event-stream response kept open
+//	per subscription, with each event pushed to the actor as soon as it is read
+//	instead of being polled for.
+//
+//	The response is read on a stream thread for as long as the subscription
+//	is open. An SseParser reads the event: / data: / id: / retry: fields of the
+//	stream as it arrives, and each complete event is pushed onto the
+//	SseSubscription, which the actor drains on its next tick. When the
+//	connection drops, the reader waits the retry time and reconnects, sending
+//	the id of the last event read as Last-Event-ID so the server can resume
+//	from there.
+//
+//	The events waiting for the actor are bounded: when the actor is not being
+//	ticked, e.g. while its scene is inactive, the oldest are dropped.
+
+#ifndef SSESTREAM_H
+#define SSESTREAM_H
+
+#include "HttpTransport.h"
+#include "JsonExtract.h"
+
+#include <windows.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// how long to wait before reconnecting, until the server sends a retry: field
+static const DWORD	kSseDefaultRetryMs = 3000;
+
+// longest line read; the rest of a longer line is dropped
+static const size_t	kSseMaxLineLength = 1024 * 1024;
+
+// largest event data kept; the rest of a longer event is dropped
+static const size_t	kSseMaxDataLength = 4 * 1024 * 1024;
+
+// most events waiting for the actor
+static const size_t	kSseMaxWaiting = 10000;
+
+// ---------------------------------------------------------------------------------
+//	SseEvent
+// ---------------------------------------------------------------------------------
+//	One event, and the values of the plan's JSON pointers in its data when
+//	there are any.
+
+struct SseEvent
+{
+	SseEvent() : mHasValues(false) {}
+
+	std::string		mType;				// the event: field, "message" when there is none
+	std::string		mId;				// the last id: field read, which may be from an earlier event
+	std::string		mData;				// the data: fields, joined with line breaks
+	bool			mHasValues;
+	JsonValue		mValues[kJsonMaxPointers];
+};
+
+// ---------------------------------------------------------------------------------
+//	SseParser
+// ---------------------------------------------------------------------------------
+//	Reads an event stream as it is fed, following the HTML event stream format:
+//	lines end in CR, LF or CRLF, a line starting with : is a comment, and an
+//	empty line ends an event. An event without data is not dispatched.
+
+class SseParser
+{
+public:
+	// inLastId and inRetryMs carry over from the connection before
+	SseParser(const std::string& inLastId, DWORD inRetryMs);
+
+	// parses the next inLength bytes, adding each event completed by them to
+	// ioEvents
+	void	Feed(const char* inData, size_t inLength, std::vector<SseEvent>& ioEvents);
+
+	const std::string&	GetLastId() const		{ return mLastId; }
+	DWORD				GetRetryMs() const		{ return mRetryMs; }
+
+private:
+	void	EndLine(std::vector<SseEvent>& ioEvents);
+
+	std::string		mLine;
+	bool			mSkipLF;			// the last chunk ended in CR, so a leading LF ends nothing
+	bool			mFirstLine;			// a byte order mark is dropped from the first line
+	std::string		mType;
+	std::string		mData;
+	std::string		mLastId;
+	DWORD			mRetryMs;
+};
+
+// ---------------------------------------------------------------------------------
+//	SseSubscription
+// ---------------------------------------------------------------------------------
+//	The state of one subscription, shared by the actor and the job reading it.
+
+class SseSubscription
+{
+public:
+	SseSubscription();
+
+	void	AddRef();
+	void	Release();
+
+	// called by the actor to close the subscription. Cancels the request, so
+	// the reader stops at once, also while it waits for an event or to
+	// reconnect.
+	void	Stop();
+	bool	IsStopped() const				{ return mStopped != 0; }
+
+	// passed to HttpSend by the reader
+	HttpCancel&	GetCancel()					{ return mCancel; }
+
+	// waits inMs before a reconnect. Returns false if the subscription was
+	// stopped meanwhile.
+	bool	Wait(DWORD inMs);
+
+	// called by the reader: moves ioEvents onto the end of the waiting events,
+	// dropping the oldest beyond kSseMaxWaiting, and leaves ioEvents empty
+	void	Push(std::vector<SseEvent>& ioEvents);
+
+	// called by the actor: swaps the waiting events, oldest first, into
+	// ioEvents, which must be empty. Returns false if none were waiting.
+	bool	Drain(std::deque<SseEvent>& ioEvents);
+
+private:
+	~SseSubscription();
+
+	SseSubscription(const SseSubscription&);
+	SseSubscription& operator=(const SseSubscription&);
+
+	volatile LONG			mRefCount;
+	volatile LONG			mStopped;
+	HANDLE					mWake;			// set by Stop
+	HttpCancel				mCancel;
+	CRITICAL_SECTION		mLock;
+	std::deque<SseEvent>	mEvents;
+};
+
+#endif
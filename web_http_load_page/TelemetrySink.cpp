@@ -0,0 +1,143 @@
+// ===========================================================================
+//	TelemetrySink.cpp
+// ===========================================================================
+
+#include "TelemetrySink.h"
+
+// ---------------------------------------------------------------------------------
+//		TelemetrySink
+// ---------------------------------------------------------------------------------
+
+TelemetrySink::TelemetrySink()
+	: mFormat(kTelemetryOff)
+	, mFlushBytes(64 * 1024)
+	, mFlushMs(250)
+	, mFilling(new HttpBody)
+	, mSending(new HttpBody)
+	, mRecords(0)
+	, mFirstTick(0)
+	, mDropped(0)
+{
+}
+
+TelemetrySink::~TelemetrySink()
+{
+	mFilling->Release();
+	mSending->Release();
+}
+
+void
+TelemetrySink::SetFormat(TelemetryFormat inFormat)
+{
+	mFormat = inFormat;
+}
+
+void
+TelemetrySink::SetFlushBytes(size_t inBytes)
+{
+	mFlushBytes = inBytes < kTelemetryMaxBuffered ? inBytes : kTelemetryMaxBuffered;
+}
+
+void
+TelemetrySink::SetFlushMs(DWORD inMs)
+{
+	mFlushMs = inMs;
+}
+
+// ---------------------------------------------------------------------------------
+//		Add
+// ---------------------------------------------------------------------------------
+
+bool
+TelemetrySink::Add(const char* inData, size_t inLength, DWORD inNow)
+{
+	if (inLength == 0) {
+		inData = "null";
+		inLength = 4;
+	}
+
+	// the record plus its separator, and the closing bracket of an array
+	if (mFilling->Length() + inLength + 2 > kTelemetryMaxBuffered) {
+		mDropped++;
+		return false;
+	}
+
+	if (mRecords == 0) {
+		mFirstTick = inNow;
+		if (mFormat == kTelemetryJSONArray)
+			mFilling->Append("[", 1);
+	}
+	else if (mFormat == kTelemetryJSONArray) {
+		mFilling->Append(",", 1);
+	}
+
+	// copy the runs between line breaks; a break is whitespace to JSON, so a
+	// space in its place keeps the record valid
+	size_t start = 0;
+	for (size_t i = 0; i < inLength; i++) {
+		if (inData[i] == '\r' || inData[i] == '\n') {
+			mFilling->Append(inData + start, i - start);
+			mFilling->Append(" ", 1);
+			start = i + 1;
+		}
+	}
+	mFilling->Append(inData + start, inLength - start);
+
+	if (mFormat == kTelemetryNDJSON)
+		mFilling->Append("\n", 1);
+
+	mRecords++;
+	return true;
+}
+
+// ---------------------------------------------------------------------------------
+//		IsDue
+// ---------------------------------------------------------------------------------
+
+bool
+TelemetrySink::IsDue(DWORD inNow) const
+{
+	if (mRecords == 0)
+		return false;
+
+	if (mFilling->Length() >= mFlushBytes)
+		return true;
+
+	return mFlushMs > 0 && inNow - mFirstTick >= mFlushMs;
+}
+
+// ---------------------------------------------------------------------------------
+//		Flush
+// ---------------------------------------------------------------------------------
+
+void
+TelemetrySink::Flush(const HttpRequest& inRequest, HttpChannel* inChannel, FetchPriority inPriority)
+{
+	if (mRecords == 0)
+		return;
+
+	if (mFormat == kTelemetryJSONArray)
+		mFilling->Append("]", 1);
+
+	// a forced flush can overtake one still in flight; the channel keeps the
+	// old body alive, so start a fresh one instead of overwriting it
+	if (mSending->IsShared()) {
+		mSending->Release();
+		mSending = new HttpBody;
+	}
+
+	HttpBody* sent = mFilling;
+	mFilling = mSending;
+	mSending = sent;
+	mFilling->Clear();
+
+	// a body is only sent with methods that take one
+	HttpRequest request(inRequest);
+	if (request.IsIdempotentRead())
+		request.mMethod = "POST";
+	request.mContentType = mFormat == kTelemetryNDJSON ? "application/x-ndjson" : "application/json";
+	request.SetBody(mSending);
+	inChannel->Send(request, inPriority);
+
+	mRecords = 0;
+}
@@ -0,0 +1,91 @@
+// ===========================================================================
+//	TelemetrySink.h
+// ===========================================================================
+//
+//	Coalesces values pushed at frame rate into a few larger requests.
+//
+//	In telemetry mode a trigger does not send a request. It appends the body
+//	input to a buffer as one record. The buffer is sent as a single NDJSON or
+//	JSON array body once it reaches flush_bytes or its oldest record is
+//	flush_ms old. Only one flush is on the wire at a time. Records arriving in
+//	the meantime collect in a second buffer, so a slow server turns into a
+//	growing backlog instead of a pile of queued requests. Memory is bounded by
+//	kTelemetryMaxBuffered; records beyond it are dropped and counted.
+//
+//	Everything here runs on Isadora's thread. The flush itself is sent through
+//	the actor's HttpChannel.
+
+#ifndef TELEMETRYSINK_H
+#define TELEMETRYSINK_H
+
+#include "FetchJobs.h"
+
+// largest amount of record data held while waiting for a flush to complete
+static const size_t	kTelemetryMaxBuffered = 4 * 1024 * 1024;
+
+// ---------------------------------------------------------------------------------
+//	TelemetryFormat
+// ---------------------------------------------------------------------------------
+//	Values match the actor's "telemetry" input.
+
+enum TelemetryFormat
+{
+	kTelemetryOff = 0,					// every trigger sends its own request
+	kTelemetryNDJSON,					// one record per line, application/x-ndjson
+	kTelemetryJSONArray					// a JSON array of records, application/json
+};
+
+// ---------------------------------------------------------------------------------
+//	TelemetrySink
+// ---------------------------------------------------------------------------------
+
+class TelemetrySink
+{
+public:
+	TelemetrySink();
+	~TelemetrySink();
+
+	// the caller flushes any buffered records before changing the format
+	void			SetFormat(TelemetryFormat inFormat);
+	TelemetryFormat	GetFormat() const		{ return mFormat; }
+
+	void			SetFlushBytes(size_t inBytes);
+	void			SetFlushMs(DWORD inMs);
+
+	// appends one record. Line breaks inside it become spaces so that it stays
+	// one NDJSON line; an empty record is sent as null. Returns false if the
+	// record was dropped because the buffer is full.
+	bool			Add(const char* inData, size_t inLength, DWORD inNow);
+
+	// true once the buffered records have reached the size or age threshold
+	bool			IsDue(DWORD inNow) const;
+
+	// true while the previous flush is still queued or being sent
+	bool			IsSending() const		{ return mSending->IsShared(); }
+
+	// sends every buffered record as the body of a copy of inRequest, as a
+	// POST if its method is GET or HEAD. Does nothing if the buffer is empty.
+	void			Flush(const HttpRequest& inRequest, HttpChannel* inChannel, FetchPriority inPriority);
+
+	// records buffered but not yet handed to the channel
+	long			GetBacklog() const		{ return mRecords; }
+
+	// records dropped because the buffer was full, since the actor was created
+	long			GetDropped() const		{ return mDropped; }
+
+private:
+	TelemetrySink(const TelemetrySink&);
+	TelemetrySink& operator=(const TelemetrySink&);
+
+	TelemetryFormat	mFormat;
+	size_t			mFlushBytes;
+	DWORD			mFlushMs;
+
+	HttpBody*		mFilling;			// records waiting for the next flush
+	HttpBody*		mSending;			// the previous flush, held by the channel until sent
+	long			mRecords;
+	DWORD			mFirstTick;			// when the oldest record in mFilling arrived
+	long			mDropped;
+};
+
+#endif
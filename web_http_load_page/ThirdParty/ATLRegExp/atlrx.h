@@ -17,10 +17,21 @@
 #include <atlcoll.h>
 #include <mbstring.h>
 
+#if !defined(ATL_REGEXP_NO_SSE2) && (defined(_M_IX86) || defined(_M_X64))
+#include <emmintrin.h>
+#include <intrin.h>
+#define ATL_REGEXP_SSE2
+#endif
+
 #ifndef ATL_REGEXP_MIN_STACK
 #define ATL_REGEXP_MIN_STACK 256
 #endif
 
+// longest literal prefix searched for before the expression is tried
+#ifndef ATL_REGEXP_MAX_PREFIX
+#define ATL_REGEXP_MAX_PREFIX 32
+#endif
+
 /* 
 	Regular Expression Grammar
 
@@ -119,6 +130,12 @@ public:
 		return (RECHARTYPE *) (sz+1);
 	}
 
+	// the character at sz, as compared against symbols and ranges
+	static size_t CodePoint(const RECHARTYPE *sz) throw()
+	{
+		return static_cast<size_t>(static_cast<unsigned char>(*sz));
+	}
+
 	static int Strncmp(const RECHARTYPE *szLeft, const RECHARTYPE *szRight, size_t nCount) throw()
 	{
 		return strncmp(szLeft, szRight, nCount);
@@ -182,6 +199,48 @@ public:
 	{
 		return int(strlen(sz));
 	}
+
+	// returns the first occurrence of the nLen characters at szLiteral in sz,
+	// or NULL if there is none
+	static const RECHARTYPE *FindLiteral(const RECHARTYPE *sz, const RECHARTYPE *szLiteral, size_t nLen) throw()
+	{
+#ifdef ATL_REGEXP_SSE2
+		// looks for the first character and the terminator 16 bytes at a time.
+		// Aligned loads never cross into the next page, so reading past the
+		// terminator within the last block is safe.
+		const __m128i first = _mm_set1_epi8(szLiteral[0]);
+		const __m128i zero = _mm_setzero_si128();
+		size_t nMisalign = reinterpret_cast<size_t>(sz) & 15;
+		const RECHARTYPE *pBlock = sz - nMisalign;
+		unsigned int uValid = 0xFFFFu << nMisalign;
+
+		for (;;)
+		{
+			__m128i block = _mm_load_si128(reinterpret_cast<const __m128i *>(pBlock));
+			unsigned int uHits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, zero))) & uValid;
+			while (uHits)
+			{
+				unsigned long nBit;
+				_BitScanForward(&nBit, uHits);
+				const RECHARTYPE *p = pBlock + nBit;
+				if (*p == '\0')
+					return NULL;
+				if (strncmp(p, szLiteral, nLen) == 0)
+					return p;
+				uHits &= uHits - 1;
+			}
+			pBlock += 16;
+			uValid = 0xFFFFu;
+		}
+#else
+		for (; *sz; sz++)
+		{
+			if (*sz == *szLiteral && strncmp(sz, szLiteral, nLen) == 0)
+				return sz;
+		}
+		return NULL;
+#endif
+	}
 };
 
 class CAtlRECharTraitsW
@@ -201,6 +260,11 @@ public:
 		return (RECHARTYPE *) (sz+1);
 	}
 
+	static size_t CodePoint(const RECHARTYPE *sz) throw()
+	{
+		return static_cast<size_t>(*sz);
+	}
+
 	static int Strncmp(const RECHARTYPE *szLeft, const RECHARTYPE *szRight, size_t nCount) throw()
 	{
 		return wcsncmp(szLeft, szRight, nCount);
@@ -264,6 +328,16 @@ public:
 	{
 		return int(wcslen(sz)*sizeof(WCHAR));
 	}
+
+	static const RECHARTYPE *FindLiteral(const RECHARTYPE *sz, const RECHARTYPE *szLiteral, size_t nLen) throw()
+	{
+		for (; *sz; sz++)
+		{
+			if (*sz == *szLiteral && wcsncmp(sz, szLiteral, nLen) == 0)
+				return sz;
+		}
+		return NULL;
+	}
 };
 
 class CAtlRECharTraitsMB
@@ -285,6 +359,12 @@ public:
 		return _mbsinc(sz);
 	}
 
+	// only the lead byte of a double byte character is compared
+	static size_t CodePoint(const RECHARTYPE *sz) throw()
+	{
+		return static_cast<size_t>(*sz);
+	}
+
 	static int Strncmp(const RECHARTYPE *szLeft, const RECHARTYPE *szRight, size_t nCount) throw()
 	{
 		return _mbsncmp(szLeft, szRight, nCount);
@@ -334,6 +414,193 @@ public:
 	{
 		return (int)strlen((const char *) sz);
 	}
+
+	// steps whole characters, so a trail byte is never taken for the start
+	// of the literal
+	static const RECHARTYPE *FindLiteral(const RECHARTYPE *sz, const RECHARTYPE *szLiteral, size_t nLen) throw()
+	{
+		for (; *sz; sz = _mbsinc(sz))
+		{
+			if (*sz == *szLiteral && strncmp((const char *) sz, (const char *) szLiteral, nLen) == 0)
+				return sz;
+		}
+		return NULL;
+	}
+};
+
+// Matches UTF-8 text in place. A well-formed sequence is one character,
+// compared by its code point, so a range of accented letters or a [^<]
+// takes a whole character at a time. Any byte
+// that does not start a well-formed sequence is a character of its own with
+// the code point U+FFFD, so stray bytes neither stop nor derail a match.
+// ASCII bytes never go through the decoder.
+class CAtlRECharTraitsUTF8
+{
+public:
+	typedef char RECHARTYPE;
+
+	static size_t GetBitFieldForRangeArrayIndex(const RECHARTYPE *sz) throw()
+	{
+#ifndef ATL_NO_CHECK_BIT_FIELD
+		ATLASSERT(UseBitFieldForRange());
+#endif
+		return static_cast<size_t>(static_cast<unsigned char>(*sz));
+	}
+
+	// the number of bytes in the character at sz. The bytes are checked one at
+	// a time, so a sequence cut short by the terminator is never read past.
+	static size_t SequenceLength(const RECHARTYPE *sz) throw()
+	{
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(sz);
+		unsigned char chLow = 0x80;
+		unsigned char chHigh = 0xBF;
+		size_t nLen;
+
+		if (p[0] < 0x80)
+			return 1;
+		if (p[0] >= 0xC2 && p[0] <= 0xDF)
+			nLen = 2;
+		else if (p[0] >= 0xE0 && p[0] <= 0xEF)
+		{
+			// no overlong forms and no surrogates
+			nLen = 3;
+			if (p[0] == 0xE0)
+				chLow = 0xA0;
+			else if (p[0] == 0xED)
+				chHigh = 0x9F;
+		}
+		else if (p[0] >= 0xF0 && p[0] <= 0xF4)
+		{
+			// no overlong forms and nothing above U+10FFFF
+			nLen = 4;
+			if (p[0] == 0xF0)
+				chLow = 0x90;
+			else if (p[0] == 0xF4)
+				chHigh = 0x8F;
+		}
+		else
+			return 1;
+
+		if (p[1] < chLow || p[1] > chHigh)
+			return 1;
+		for (size_t i = 2; i < nLen; i++)
+		{
+			if ((p[i] & 0xC0) != 0x80)
+				return 1;
+		}
+		return nLen;
+	}
+
+	static RECHARTYPE *Next(const RECHARTYPE *sz) throw()
+	{
+		if (static_cast<unsigned char>(*sz) < 0x80)
+			return (RECHARTYPE *) (sz+1);
+		return (RECHARTYPE *) (sz+SequenceLength(sz));
+	}
+
+	// the start of the character that ends at sz, which is after szStart.
+	// Characters are counted from szStart, so it is taken to start one.
+	static RECHARTYPE *Previous(const RECHARTYPE *szStart, const RECHARTYPE *sz) throw()
+	{
+		if (static_cast<unsigned char>(sz[-1]) < 0x80)
+			return (RECHARTYPE *) (sz-1);
+
+		// a sequence is a lead byte and up to three continuation bytes; if the
+		// nearest lead byte does not end its sequence at sz, the byte before
+		// sz stands alone
+		const RECHARTYPE *p = sz-1;
+		while (p > szStart && sz-p < 4 && (static_cast<unsigned char>(*p) & 0xC0) == 0x80)
+			p--;
+		if (p+SequenceLength(p) == sz)
+			return (RECHARTYPE *) p;
+		return (RECHARTYPE *) (sz-1);
+	}
+
+	static size_t CodePoint(const RECHARTYPE *sz) throw()
+	{
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(sz);
+		if (p[0] < 0x80)
+			return p[0];
+
+		switch (SequenceLength(sz))
+		{
+		case 2:
+			return ((p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+		case 3:
+			return ((p[0] & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+		case 4:
+			return ((p[0] & 0x07) << 18) | ((p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+		default:
+			return 0xFFFD;
+		}
+	}
+
+	static int Strncmp(const RECHARTYPE *szLeft, const RECHARTYPE *szRight, size_t nCount) throw()
+	{
+		return strncmp(szLeft, szRight, nCount);
+	}
+
+	// only ASCII letters have a case; the locale is not consulted, since it
+	// could take the bytes of a sequence for letters of a code page
+	static int Strnicmp(const RECHARTYPE *szLeft, const RECHARTYPE *szRight, size_t nCount) throw()
+	{
+		for (size_t i = 0; i < nCount; i++)
+		{
+			int chLeft = ToLower(static_cast<unsigned char>(szLeft[i]));
+			int chRight = ToLower(static_cast<unsigned char>(szRight[i]));
+			if (chLeft != chRight)
+				return chLeft - chRight;
+			if (chLeft == 0)
+				break;
+		}
+		return 0;
+	}
+
+	static RECHARTYPE *Strlwr(RECHARTYPE *sz, int nSize) throw()
+	{
+		for (int i = 0; i < nSize && sz[i]; i++)
+			sz[i] = static_cast<RECHARTYPE>(ToLower(static_cast<unsigned char>(sz[i])));
+		return sz;
+	}
+
+	static long Strtol(const RECHARTYPE *sz, RECHARTYPE **szEnd, int nBase) throw()
+	{
+		return strtol(sz, szEnd, nBase);
+	}
+
+	static int Isdigit(RECHARTYPE ch) throw()
+	{
+		return ch >= '0' && ch <= '9';
+	}
+
+	static const RECHARTYPE** GetAbbrevs()
+	{
+		return CAtlRECharTraitsA::GetAbbrevs();
+	}
+
+	// ranges are kept as code points rather than in a 256 bit field
+	static BOOL UseBitFieldForRange() throw()
+	{
+		return FALSE;
+	}
+
+	static int ByteLen(const RECHARTYPE *sz) throw()
+	{
+		return int(strlen(sz));
+	}
+
+	// a lead byte never occurs inside another character, so the byte search
+	// for single byte text finds only whole characters
+	static const RECHARTYPE *FindLiteral(const RECHARTYPE *sz, const RECHARTYPE *szLiteral, size_t nLen) throw()
+	{
+		return CAtlRECharTraitsA::FindLiteral(sz, szLiteral, nLen);
+	}
+
+private:
+	static int ToLower(int ch) throw()
+	{
+		return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+	}
 };
 
 #ifndef _UNICODE
@@ -341,12 +608,20 @@ typedef CAtlRECharTraitsA CAtlRECharTraits;
 #else	// _UNICODE
 typedef CAtlRECharTraitsW CAtlRECharTraits;
 #endif // !_UNICODE
-// Note: If you want to use CAtlRECharTraitsMB you must pass it in
-// as a template argument
+// Note: If you want to use CAtlRECharTraitsMB or CAtlRECharTraitsUTF8 you
+// must pass it in as a template argument
 
 template <class CharTraits=CAtlRECharTraits>
 class CAtlRegExp;	// forward declaration
 
+// why CAtlRegExp::Match last returned FALSE other than by not matching
+enum REMatchError {
+	REMATCH_ERROR_OK = 0,				// The text was searched to the end
+	REMATCH_ERROR_OUTOFMEMORY,			// Out of memory
+	REMATCH_ERROR_STEPS,				// The step limit was reached
+	REMATCH_ERROR_STACK,				// The stack limit was reached
+};
+
 template <class CharTraits=CAtlRECharTraits>
 class CAtlREMatchContext
 {
@@ -387,34 +662,86 @@ protected:
 	CAutoVectorPtr<MatchGroup> m_Matches;
 	CAtlArray<void *> m_stack;
 	size_t m_nTos;
+	UINT m_uMemCapacity;
+	UINT m_uMatchesCapacity;
+	size_t m_nMaxSteps;
+	size_t m_nMaxStack;
+	size_t m_nSteps;
+	REMatchError m_MatchError;
 
 public:
 	CAtlREMatchContext(size_t nInitStackSize=ATL_REGEXP_MIN_STACK)
 	{
 		m_uNumGroups = 0;
 		m_nTos = 0;
+		m_uMemCapacity = 0;
+		m_uMatchesCapacity = 0;
+		m_nMaxSteps = 0;
+		m_nMaxStack = 0;
+		m_nSteps = 0;
+		m_MatchError = REMATCH_ERROR_OK;
 		m_stack.SetCount(nInitStackSize);
 		m_Match.szStart = NULL;
 		m_Match.szEnd = NULL;
 	}
 
+	// CAtlREMatchContext::SetLimits
+	// Bounds the matches made with this context: nMaxSteps is the number of
+	// instructions one Match may execute, over all the positions it tries,
+	// and nMaxStack the number of entries its backtracking stack may hold.
+	// 0 is no limit. A Match that reaches a limit gives up and returns FALSE,
+	// and GetMatchError says which limit it was.
+	void SetLimits(size_t nMaxSteps, size_t nMaxStack) throw()
+	{
+		m_nMaxSteps = nMaxSteps;
+		m_nMaxStack = nMaxStack;
+	}
+
+	REMatchError GetMatchError() const throw()
+	{
+		return m_MatchError;
+	}
+
+	// the number of instructions the last Match executed
+	size_t GetSteps() const throw()
+	{
+		return m_nSteps;
+	}
+
 protected:
+	// The buffers of the previous match are kept when they are large enough,
+	// so a context reused across matches stops allocating once it has seen
+	// the largest pattern. The stack is never shrunk either.
 	BOOL Initialize(UINT uRequiredMem, UINT uNumGroups) throw()
 	{
 		m_nTos = 0;
+		m_nSteps = 0;
+		m_MatchError = REMATCH_ERROR_OK;
 
 		m_uNumGroups = 0;
-		m_Matches.Free();
+		if (m_Matches.m_p == NULL || uNumGroups > m_uMatchesCapacity)
+		{
+			m_Matches.Free();
+			m_uMatchesCapacity = 0;
 
-		if (!m_Matches.Allocate(uNumGroups))
-			return FALSE;
+			if (!m_Matches.Allocate(uNumGroups))
+				return FALSE;
+
+			m_uMatchesCapacity = uNumGroups;
+		}
 
 		m_uNumGroups = uNumGroups;
 
-		m_Mem.Free();
+		if (m_Mem.m_p == NULL || uRequiredMem > m_uMemCapacity)
+		{
+			m_Mem.Free();
+			m_uMemCapacity = 0;
+
+			if (!m_Mem.Allocate(uRequiredMem))
+				return FALSE;
 
-		if (!m_Mem.Allocate(uRequiredMem))
-			return FALSE;
+			m_uMemCapacity = uRequiredMem;
+		}
 
 		memset(m_Mem.m_p, 0x00, uRequiredMem*sizeof(void *));
 
@@ -425,11 +752,21 @@ protected:
 	BOOL Push(void *p)
 	{
 		m_nTos++;
+		if (m_nMaxStack != 0 && m_nTos >= m_nMaxStack)
+		{
+			m_nTos--;
+			m_MatchError = REMATCH_ERROR_STACK;
+			return FALSE;
+		}
 		if (m_stack.GetCount() <= (UINT) m_nTos)
 		{
-			if (!m_stack.SetCount((m_nTos+1)*2))
+			size_t nCount = (m_nTos+1)*2;
+			if (m_nMaxStack != 0 && nCount > m_nMaxStack)
+				nCount = m_nMaxStack;
+			if (!m_stack.SetCount(nCount))
 			{
 				m_nTos--;
+				m_MatchError = REMATCH_ERROR_OUTOFMEMORY;
 				return FALSE;
 			}
 		}
@@ -483,6 +820,7 @@ public:
 		m_uRequiredMem = 0;
 		m_bCaseSensitive = TRUE;
 		m_LastError = REPARSE_ERROR_OK;
+		m_nPrefixLen = 0;
 	}
 
 	typedef typename CharTraits::RECHARTYPE RECHAR;
@@ -540,6 +878,10 @@ public:
 
 			if (AddInstruction(RE_MATCH) < 0)
 				return REPARSE_ERROR_OUTOFMEMORY;
+
+			// an anchored expression is only tried once, at the start
+			if (*szInput != '^')
+				FindPrefix(szInput);
 		}
 
 		if (szInput != szRE)
@@ -566,7 +908,10 @@ public:
 			int nSize = CharTraits::ByteLen(szIn)+sizeof(RECHAR);
 			szInput = (const RECHAR *) malloc(nSize);
 			if (!szInput)
+			{
+				pContext->m_MatchError = REMATCH_ERROR_OUTOFMEMORY;
 				return FALSE;
+			}
 
 			Checked::memcpy_s((char *) szInput, nSize, szIn, nSize);
 			CharTraits::Strlwr(const_cast<RECHAR *>(szInput), nSize/sizeof(RECHAR));
@@ -574,16 +919,32 @@ public:
 
 		if (!pContext->Initialize(m_uRequiredMem, m_uNumGroups))
 		{
+			pContext->m_MatchError = REMATCH_ERROR_OUTOFMEMORY;
 			if (szInput != szIn)
 				free((void *) szInput);
 			return FALSE;
 		}
 
 		size_t ip = 0;
+		size_t nSteps = 0;
+		const size_t nMaxSteps = pContext->m_nMaxSteps;
 
 		const RECHAR *sz = szInput;
 		const RECHAR *szCurrInput = szInput;
 
+		// with a literal prefix the expression is only tried where the prefix
+		// occurs, instead of at every position
+		if (m_nPrefixLen != 0)
+		{
+			sz = CharTraits::FindLiteral(szInput, m_szPrefix, m_nPrefixLen);
+			if (sz == NULL)
+			{
+				sz = szInput;
+				goto Error;
+			}
+			szCurrInput = sz;
+		}
+
 #pragma warning(push)
 #pragma warning(disable:4127) // conditional expression is constant
 
@@ -595,6 +956,12 @@ public:
 			if (ip == 0)
 				pContext->m_Match.szStart = sz;
 
+			if (++nSteps > nMaxSteps && nMaxSteps != 0)
+			{
+				pContext->m_MatchError = REMATCH_ERROR_STEPS;
+				goto Error;
+			}
+
 			switch (GetInstruction(ip).type)
  			{
 			case RE_NOP:
@@ -602,7 +969,7 @@ public:
 				break;
 
 			case RE_SYMBOL:
-				if (GetInstruction(ip).symbol.nSymbol == static_cast<size_t>(*sz))
+				if (GetInstruction(ip).symbol.nSymbol == CharTraits::CodePoint(sz))
 				{
 					sz = CharTraits::Next(sz);
 					ip++;
@@ -636,7 +1003,8 @@ public:
 				break;
 
 			case RE_PUSH_CHARPOS:
-				pContext->Push((void *) sz);
+				if (!pContext->Push((void *) sz))
+					goto Error;
 				ip++;
 				break;
 
@@ -646,7 +1014,8 @@ public:
 				break;
 
 			case RE_CALL:
-				pContext->Push(ip+1);
+				if (!pContext->Push(ip+1))
+					goto Error;
 				ip = GetInstruction(ip).call.nTarget;
 				break;
 
@@ -659,7 +1028,8 @@ public:
 				break;
 
 			case RE_PUSH_MEMORY:
-				pContext->Push((void *) (pContext->m_Mem[GetInstruction(ip).memory.nIndex]));
+				if (!pContext->Push((void *) (pContext->m_Mem[GetInstruction(ip).memory.nIndex])))
+					goto Error;
 				ip++;
 				break;
 
@@ -703,6 +1073,16 @@ public:
 				szCurrInput = sz;
 				if (*sz == '\0')
 					goto Error;
+				if (m_nPrefixLen != 0)
+				{
+					sz = CharTraits::FindLiteral(sz, m_szPrefix, m_nPrefixLen);
+					if (sz == NULL)
+					{
+						sz = szCurrInput;
+						goto Error;
+					}
+					szCurrInput = sz;
+				}
 				ip = 0;
 				pContext->m_nTos = 0;
 				break;
@@ -742,7 +1122,7 @@ public:
 					}
 
 					RECHAR *pBits = reinterpret_cast<RECHAR *>((&m_Instructions[ip]+1));
-					size_t u = static_cast<size_t>(* ((RECHAR *) sz));
+					size_t u = CharTraits::GetBitFieldForRangeArrayIndex(sz);
 					if (pBits[u >> 3] & 1 << (u & 0x7))
 					{
 						ip = (size_t) pContext->Pop();
@@ -766,12 +1146,13 @@ public:
 
 					BOOL bMatch = FALSE;
 					size_t inEnd = GetInstruction(ip).range.nTarget;
+					size_t ch = CharTraits::CodePoint(sz);
 					ip++;
 
 					while (ip < inEnd)
 					{						
-						if (static_cast<size_t>(*sz) >= GetInstruction(ip).memory.nIndex && 
-							static_cast<size_t>(*sz) <= GetInstruction(ip+1).memory.nIndex)
+						if (ch >= GetInstruction(ip).memory.nIndex && 
+							ch <= GetInstruction(ip+1).memory.nIndex)
 						{
 							// if we match, we jump to the end
 							sz = CharTraits::Next(sz);
@@ -800,12 +1181,13 @@ public:
 
 					BOOL bMatch = TRUE;
 					size_t inEnd = GetInstruction(ip).range.nTarget;
+					size_t ch = CharTraits::CodePoint(sz);
 					ip++;
 
 					while (ip < inEnd)
 					{
-						if (static_cast<size_t>(*sz) >= GetInstruction(ip).memory.nIndex && 
-							static_cast<size_t>(*sz) <= GetInstruction(ip+1).memory.nIndex)
+						if (ch >= GetInstruction(ip).memory.nIndex && 
+							ch <= GetInstruction(ip+1).memory.nIndex)
 						{
 							ip = (size_t) pContext->Pop();
 							bMatch = FALSE;
@@ -846,6 +1228,7 @@ public:
 				break;
 
 			case RE_MATCH:
+				pContext->m_nSteps = nSteps;
 				pContext->m_Match.szEnd = sz;
 				if (!m_bCaseSensitive)
 					FixupMatchContext(pContext, szIn, szInput);
@@ -857,8 +1240,9 @@ public:
 				break;
 
 			case RE_PUSH_GROUP:
-				pContext->Push((void *) pContext->m_Matches[GetInstruction(ip).group.nGroup].szStart);
-				pContext->Push((void *) pContext->m_Matches[GetInstruction(ip).group.nGroup].szEnd);
+				if (!pContext->Push((void *) pContext->m_Matches[GetInstruction(ip).group.nGroup].szStart) ||
+					!pContext->Push((void *) pContext->m_Matches[GetInstruction(ip).group.nGroup].szEnd))
+					goto Error;
 				ip++;
 				break;
 
@@ -878,6 +1262,7 @@ public:
 
 		ATLASSERT(FALSE);
 Error:
+		pContext->m_nSteps = nSteps;
 		pContext->m_Match.szEnd = sz;
 		if (!m_bCaseSensitive)
 			FixupMatchContext(pContext, szIn, szInput);
@@ -888,6 +1273,17 @@ Error:
 		return FALSE;
 	}
 
+	// CAtlRegExp::GetPrefix
+	// Returns the literal characters that every match starts with and sets
+	// *pnLen to their number, 0 if there are none. For an expression parsed
+	// case insensitive they are lower case.
+	const RECHAR *GetPrefix(size_t *pnLen) const throw()
+	{
+		ATLASSERT(pnLen);
+		*pnLen = m_nPrefixLen;
+		return m_szPrefix;
+	}
+
 protected:
 	REParseError m_LastError;
 
@@ -908,9 +1304,67 @@ protected:
 		m_uRequiredMem = 0;
 		m_bCaseSensitive = TRUE;
 		m_uNumGroups = 0;
+		m_nPrefixLen = 0;
 		SetLastParseError(REPARSE_ERROR_OK);
 	}
 
+	// CAtlRegExp::FindPrefix
+	// Records the literal characters that every match starts with. In this
+	// grammar '|' binds to the single expressions on either side of it, so
+	// a plain character belongs to the prefix unless a repeat or '|' follows.
+	// A character of several units is copied whole.
+	void FindPrefix(const RECHAR *sz) throw()
+	{
+		const RECHAR **szAbbrevs = CharTraits::GetAbbrevs();
+
+		m_nPrefixLen = 0;
+		while (m_nPrefixLen < ATL_REGEXP_MAX_PREFIX)
+		{
+			RECHAR ch = *sz;
+			const RECHAR *szChar = sz;
+			const RECHAR *szNext;
+
+			if (ch == '\\')
+			{
+				// an escaped character, but not a back reference or abbreviation
+				ch = sz[1];
+				if (ch == '\0' || CharTraits::Isdigit(ch))
+					break;
+				const RECHAR **szAbbrev = szAbbrevs;
+				while (*szAbbrev && **szAbbrev != ch)
+					szAbbrev++;
+				if (*szAbbrev)
+					break;
+				szChar = sz+1;
+				szNext = CharTraits::Next(szChar);
+			}
+			else
+			{
+				if (ch == '\0' || ch == '{' || ch == '}' || ch == '(' || ch == ')' ||
+					ch == '[' || ch == ']' || ch == '|' || ch == '!' || ch == '.' ||
+					ch == '*' || ch == '+' || ch == '?')
+					break;
+				if (ch == '$' && sz[1] == '\0')
+					break;
+				szNext = CharTraits::Next(sz);
+			}
+
+			if (*szNext == '*' || *szNext == '+' || *szNext == '?' || *szNext == '|')
+				break;
+			if (m_nPrefixLen + (szNext - szChar) > ATL_REGEXP_MAX_PREFIX)
+				break;
+
+			// with CAtlRECharTraitsUTF8, U+FFFD also stands for any byte that
+			// is not UTF-8, which a search for its encoding would not find
+			if (CharTraits::CodePoint(szChar) == 0xFFFD)
+				break;
+
+			while (szChar < szNext)
+				m_szPrefix[m_nPrefixLen++] = *szChar++;
+			sz = szNext;
+		}
+	}
+
 
 	enum REInstructionType { 
 		RE_NOP,
@@ -1008,6 +1462,8 @@ protected:
 	UINT m_uNumGroups;
 	UINT m_uRequiredMem;
 	BOOL m_bCaseSensitive;
+	RECHAR m_szPrefix[ATL_REGEXP_MAX_PREFIX];
+	size_t m_nPrefixLen;
 
 
 	// class used internally to restore
@@ -1164,23 +1620,23 @@ protected:
 		return nCall;
 	}
 
-	RECHAR GetEscapedChar(RECHAR ch) throw()
+	size_t GetEscapedChar(const RECHAR *sz) throw()
 	{
-		if (ch == 't')
+		if (*sz == 't')
 			return '\t';
-		return ch;
+		return CharTraits::CodePoint(sz);
 	}
 
 	// ParseCharItem: parse grammar rule CharItem
-	int ParseCharItem(const RECHAR **ppszRE, RECHAR *pchStartChar, RECHAR *pchEndChar) throw()
+	int ParseCharItem(const RECHAR **ppszRE, size_t *pchStartChar, size_t *pchEndChar) throw()
 	{
 		if (**ppszRE == '\\')
 		{
 			*ppszRE = CharTraits::Next(*ppszRE);
-			*pchStartChar = GetEscapedChar(**ppszRE);
+			*pchStartChar = GetEscapedChar(*ppszRE);
 		}
 		else
-			*pchStartChar = **ppszRE;
+			*pchStartChar = CharTraits::CodePoint(*ppszRE);
 		*ppszRE = CharTraits::Next(*ppszRE);
 
 		if (!MatchToken(ppszRE, '-'))
@@ -1196,7 +1652,7 @@ protected:
 			return -1;
 		}
 
-		*pchEndChar = **ppszRE;
+		*pchEndChar = CharTraits::CodePoint(*ppszRE);
 		*ppszRE = CharTraits::Next(*ppszRE);
 
 		if (*pchEndChar < *pchStartChar)
@@ -1252,8 +1708,8 @@ protected:
 				return -1;
 		}
 
-		RECHAR chStart;
-		RECHAR chEnd;
+		size_t chStart;
+		size_t chEnd;
 
 		while (**ppszRE && **ppszRE != ']')
 		{
@@ -1262,7 +1718,7 @@ protected:
 
 			if (CharTraits::UseBitFieldForRange())
 			{
-				for (int i=chStart; i<=chEnd; i++)
+				for (size_t i=chStart; i<=chEnd; i++)
 					pBits[i >> 3] |= 1 << (i & 0x7);
 			}
 			else
@@ -1275,8 +1731,8 @@ protected:
 				if (nEnd < 0)
 					return -1;
 
-				GetInstruction(nStart).memory.nIndex = (int) chStart;
-				GetInstruction(nEnd).memory.nIndex = (int) chEnd;
+				GetInstruction(nStart).memory.nIndex = chStart;
+				GetInstruction(nEnd).memory.nIndex = chEnd;
 			}
 		}
 
@@ -1429,7 +1885,7 @@ protected:
 				p = AddInstruction(RE_SYMBOL);
 				if (p < 0)
 					return -1;
-				GetInstruction(p).symbol.nSymbol = (int) **ppszRE;
+				GetInstruction(p).symbol.nSymbol = CharTraits::CodePoint(*ppszRE);
 				*ppszRE = CharTraits::Next(*ppszRE);
 				return p;
 			}
@@ -1483,7 +1939,7 @@ protected:
 			p = AddInstruction(RE_SYMBOL);
 			if (p < 0)
 				return -1;
-			GetInstruction(p).symbol.nSymbol = (int) **ppszRE;
+			GetInstruction(p).symbol.nSymbol = CharTraits::CodePoint(*ppszRE);
 			bEmpty = false;
 		}
 		*ppszRE = CharTraits::Next(*ppszRE);
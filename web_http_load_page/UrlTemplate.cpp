@@ -0,0 +1,165 @@
+// ===========================================================================
+//	UrlTemplate.cpp
+// ===========================================================================
+
+#include "UrlTemplate.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+// ---------------------------------------------------------------------------------
+//		UrlTemplate
+// ---------------------------------------------------------------------------------
+
+UrlTemplate::UrlTemplate()
+{
+	memset(mSlotUses, 0, sizeof(mSlotUses));
+}
+
+// ---------------------------------------------------------------------------------
+//		Compile
+// ---------------------------------------------------------------------------------
+
+void
+UrlTemplate::Compile(const char* inTemplate)
+{
+	mLiterals.clear();
+	mSegments.clear();
+	memset(mSlotUses, 0, sizeof(mSlotUses));
+
+	// numbered placeholders claim their slots first so that named ones can be
+	// given whatever is left, in order of appearance
+	bool claimed[kUrlTemplateMaxParams] = { false };
+	for (const char* p = strchr(inTemplate, '{'); p != NULL; p = strchr(p + 1, '{')) {
+		char* end = NULL;
+		long n = strtol(p + 1, &end, 10);
+		if (end != p + 1 && *end == '}' && n >= 1 && n <= kUrlTemplateMaxParams)
+			claimed[n - 1] = true;
+	}
+
+	std::vector<std::string> names;
+	std::vector<int> nameSlots;
+
+	Segment literal = { 0, 0, -1 };
+	const char* p = inTemplate;
+
+	while (*p != '\0') {
+
+		const char* close = (*p == '{' && p[1] != '{') ? strchr(p, '}') : NULL;
+
+		if (close == NULL) {
+			// "{{" is an escaped brace; an unterminated "{" is taken literally
+			if (*p == '{' && p[1] == '{')
+				p++;
+			mLiterals += *p++;
+			literal.mLength++;
+			continue;
+		}
+
+		// resolve the placeholder to a slot
+		std::string name(p + 1, close);
+		char* end = NULL;
+		long n = strtol(name.c_str(), &end, 10);
+		int slot = -1;
+
+		if (!name.empty() && *end == '\0' && n >= 1 && n <= kUrlTemplateMaxParams) {
+			slot = (int) n - 1;
+		}
+		else {
+			for (size_t i = 0; i < names.size() && slot < 0; i++) {
+				if (names[i] == name)
+					slot = nameSlots[i];
+			}
+			for (int i = 0; i < kUrlTemplateMaxParams && slot < 0; i++) {
+				if (!claimed[i]) {
+					claimed[i] = true;
+					names.push_back(name);
+					nameSlots.push_back(i);
+					slot = i;
+				}
+			}
+		}
+
+		p = close + 1;
+
+		// more names than inputs: the placeholder expands to nothing
+		if (slot < 0)
+			continue;
+
+		if (literal.mLength > 0) {
+			mSegments.push_back(literal);
+		}
+		literal.mOffset = mLiterals.length();
+		literal.mLength = 0;
+
+		Segment s = { 0, 0, slot };
+		mSegments.push_back(s);
+		mSlotUses[slot]++;
+	}
+
+	if (literal.mLength > 0) {
+		mSegments.push_back(literal);
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		SetParam
+// ---------------------------------------------------------------------------------
+
+void
+UrlTemplate::SetParam(int inIndex, const char* inValue)
+{
+	static const char* kHex = "0123456789ABCDEF";
+
+	if (inIndex < 0 || inIndex >= kUrlTemplateMaxParams)
+		return;
+
+	std::string& out = mParams[inIndex];
+	out.clear();
+
+	for (const unsigned char* p = (const unsigned char*) inValue; *p != '\0'; p++) {
+		unsigned char c = *p;
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+			|| c == '-' || c == '.' || c == '_' || c == '~') {
+			out += (char) c;
+		}
+		else {
+			out += '%';
+			out += kHex[c >> 4];
+			out += kHex[c & 0xF];
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		Expand
+// ---------------------------------------------------------------------------------
+
+void
+UrlTemplate::Expand(std::string& outURL) const
+{
+	size_t length = mLiterals.length();
+	for (int i = 0; i < kUrlTemplateMaxParams; i++) {
+		length += mSlotUses[i] * mParams[i].length();
+	}
+
+	outURL.resize(length);
+	if (length == 0)
+		return;
+
+	char* dst = &outURL[0];
+	const char* literals = mLiterals.data();
+
+	for (size_t i = 0; i < mSegments.size(); i++) {
+		const Segment& s = mSegments[i];
+		if (s.mSlot < 0) {
+			memcpy(dst, literals + s.mOffset, s.mLength);
+			dst += s.mLength;
+		}
+		else {
+			const std::string& value = mParams[s.mSlot];
+			memcpy(dst, value.data(), value.length());
+			dst += value.length();
+		}
+	}
+}
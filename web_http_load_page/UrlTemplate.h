@@ -0,0 +1,60 @@
+// ===========================================================================
+//	UrlTemplate.h
+// ===========================================================================
+//
+//	A URL with placeholders, e.g. "http://host/api?sensor={id}&since={t}",
+//	filled from the actor's numbered param inputs.
+//
+//	The template is compiled once, when the url_template input changes, into a
+//	list of literal and slot segments. Parameter values are percent-encoded once,
+//	when their input changes. Expanding on trigger is then one resize of the
+//	output string followed by a memcpy per segment: nothing is parsed and no
+//	temporary strings are built.
+//
+//	Placeholders are either numbered, "{1}" to "{4}", or named. Named
+//	placeholders take the numbers left over by the numbered ones in order of
+//	first appearance, so in "?sensor={id}&since={t}" {id} is param_1 and {t}
+//	is param_2. "{{" is a literal brace.
+
+#ifndef URLTEMPLATE_H
+#define URLTEMPLATE_H
+
+#include <string>
+#include <vector>
+
+// number of param inputs on the actor
+static const int	kUrlTemplateMaxParams = 4;
+
+class UrlTemplate
+{
+public:
+	UrlTemplate();
+
+	// compiles inTemplate; an empty string clears the template
+	void	Compile(const char* inTemplate);
+
+	// true if no template is set, in which case the plain URL input is used
+	bool	IsEmpty() const		{ return mSegments.empty(); }
+
+	// sets the zero-based parameter inIndex. The value is stored percent-encoded;
+	// only RFC 3986 unreserved characters are left as they are.
+	void	SetParam(int inIndex, const char* inValue);
+
+	// writes the expanded URL into outURL, reusing its capacity
+	void	Expand(std::string& outURL) const;
+
+private:
+	struct Segment
+	{
+		size_t		mOffset;		// into mLiterals, for a literal segment
+		size_t		mLength;		// length of a literal segment
+		int			mSlot;			// zero-based parameter, or -1 for a literal
+	};
+
+	std::string				mLiterals;					// the literal text of every segment, back to back
+	std::vector<Segment>	mSegments;
+	size_t					mSlotUses[kUrlTemplateMaxParams];	// how often each parameter appears
+	std::string				mParams[kUrlTemplateMaxParams];	// encoded parameter values
+};
+
+#endif
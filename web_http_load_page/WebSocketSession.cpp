@@ -0,0 +1,150 @@
+// ===========================================================================
+//	WebSocketSession.cpp
+// ===========================================================================
+
+#include "WebSocketSession.h"
+
+// ---------------------------------------------------------------------------------
+//		WebSocketQueue
+// ---------------------------------------------------------------------------------
+//	mHead and mTail only ever count up, wrapping as unsigned values, so the
+//	ring holds mTail - mHead messages and a full ring is told from an empty one.
+
+WebSocketQueue::WebSocketQueue()
+	: mSlots(kWebSocketQueueSize)
+	, mHead(0)
+	, mTail(0)
+{
+}
+
+WebSocketMessage*
+WebSocketQueue::BeginPush()
+{
+	ULONG tail = (ULONG) mTail;
+	if (tail - (ULONG) mHead >= (ULONG) kWebSocketQueueSize)
+		return NULL;
+	return &mSlots[tail & (kWebSocketQueueSize - 1)];
+}
+
+void
+WebSocketQueue::EndPush()
+{
+	InterlockedExchange(&mTail, (LONG) ((ULONG) mTail + 1));
+}
+
+WebSocketMessage*
+WebSocketQueue::Front()
+{
+	ULONG head = (ULONG) mHead;
+	if (head == (ULONG) mTail)
+		return NULL;
+	return &mSlots[head & (kWebSocketQueueSize - 1)];
+}
+
+void
+WebSocketQueue::Pop()
+{
+	InterlockedExchange(&mHead, (LONG) ((ULONG) mHead + 1));
+}
+
+LONG
+WebSocketQueue::SkipToNewest()
+{
+	ULONG tail = (ULONG) mTail;
+	ULONG count = tail - (ULONG) mHead;
+	if (count <= 1)
+		return 0;
+
+	InterlockedExchange(&mHead, (LONG) (tail - 1));
+	return (LONG) (count - 1);
+}
+
+// ---------------------------------------------------------------------------------
+//		WebSocketSession
+// ---------------------------------------------------------------------------------
+
+WebSocketSession::WebSocketSession()
+	: mRefCount(1)
+	, mStopped(0)
+	, mDropped(0)
+	, mOpen(false)
+	, mSending(false)
+{
+	InitializeCriticalSection(&mLock);
+}
+
+WebSocketSession::~WebSocketSession()
+{
+	DeleteCriticalSection(&mLock);
+}
+
+void
+WebSocketSession::AddRef()
+{
+	InterlockedIncrement(&mRefCount);
+}
+
+void
+WebSocketSession::Release()
+{
+	if (InterlockedDecrement(&mRefCount) == 0) {
+		delete this;
+	}
+}
+
+void
+WebSocketSession::Stop()
+{
+	InterlockedExchange(&mStopped, 1);
+	mSocket.Abort();
+}
+
+bool
+WebSocketSession::SetOpen()
+{
+	EnterCriticalSection(&mLock);
+	mOpen = true;
+	bool start = !mSending && !mOutgoing.empty();
+	if (start)
+		mSending = true;
+	LeaveCriticalSection(&mLock);
+
+	return start;
+}
+
+bool
+WebSocketSession::Queue(const std::string& inText)
+{
+	EnterCriticalSection(&mLock);
+	mOutgoing.push_back(inText);
+	LONG dropped = 0;
+	while (mOutgoing.size() > kWebSocketMaxOutgoing) {
+		mOutgoing.pop_front();
+		dropped++;
+	}
+	bool start = mOpen && !mSending;
+	if (start)
+		mSending = true;
+	LeaveCriticalSection(&mLock);
+
+	if (dropped > 0)
+		AddDropped(dropped);
+	return start;
+}
+
+bool
+WebSocketSession::TakeOutgoing(std::string& outText)
+{
+	EnterCriticalSection(&mLock);
+	bool waiting = !mOutgoing.empty() && !IsStopped();
+	if (waiting) {
+		outText.swap(mOutgoing.front());
+		mOutgoing.pop_front();
+	}
+	else {
+		mSending = false;
+	}
+	LeaveCriticalSection(&mLock);
+
+	return waiting;
+}
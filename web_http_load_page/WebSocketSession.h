@@ -0,0 +1,154 @@
+// ===========================================================================
+//	WebSocketSession.h
+// ===========================================================================
+//
+//	WebSocket client connections: one socket kept open per session, with each
+//	message the server sends pushed to the actor as it arrives, and the text
+//	of the send input sent back on the same socket.
+//
+//	The socket is read on a stream thread for as long as the session is open,
+//	and stopping the session aborts the socket under the reader. Each
+//	message is moved into the next slot of a WebSocketQueue, a fixed ring that
+//	the reader fills and the actor empties on its next tick without either
+//	taking a lock. When the ring is full, e.g. while the actor's scene is
+//	inactive, new messages are dropped and counted rather than queued without
+//	bound. The actor may also coalesce, sending only the newest message of a
+//	tick to its outputs and counting the rest as dropped.
+//
+//	Outgoing messages wait in the session until a send job takes them, one
+//	job at a time per session, so they go out in order while the reader keeps
+//	reading.
+
+#ifndef WEBSOCKETSESSION_H
+#define WEBSOCKETSESSION_H
+
+#include "HttpTransport.h"
+#include "JsonExtract.h"
+
+#include <windows.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// slots in the ring of messages waiting for the actor; a power of two
+static const LONG	kWebSocketQueueSize = 1024;
+
+// largest message kept; the rest of a longer message is dropped
+static const size_t	kWebSocketMaxMessage = 4 * 1024 * 1024;
+
+// most messages waiting to be sent; the oldest are dropped beyond it
+static const size_t	kWebSocketMaxOutgoing = 1024;
+
+// ---------------------------------------------------------------------------------
+//	WebSocketMessage
+// ---------------------------------------------------------------------------------
+//	One message, and the values of the plan's JSON pointers in it when there
+//	are any.
+
+struct WebSocketMessage
+{
+	WebSocketMessage() : mBinary(false), mHasValues(false) {}
+
+	std::string		mText;
+	bool			mBinary;
+	bool			mHasValues;
+	JsonValue		mValues[kJsonMaxPointers];
+};
+
+// ---------------------------------------------------------------------------------
+//	WebSocketQueue
+// ---------------------------------------------------------------------------------
+//	A bounded ring passing messages from one writer to one reader without
+//	locks. Each side only writes its own index, and publishes it with a full
+//	barrier once the slot it covers is filled or emptied. The slots are reused,
+//	and their strings keep their capacity, so a steady stream of messages
+//	allocates nothing once it has settled.
+
+class WebSocketQueue
+{
+public:
+	WebSocketQueue();
+
+	// writer: the free slot to fill, or NULL if the ring is full
+	WebSocketMessage*	BeginPush();
+
+	// writer: hands the slot from BeginPush to the reader
+	void				EndPush();
+
+	// reader: the oldest message, or NULL if the ring is empty
+	WebSocketMessage*	Front();
+
+	// reader: gives the slot from Front back to the writer
+	void				Pop();
+
+	// reader: drops every message but the newest, returning how many
+	LONG				SkipToNewest();
+
+private:
+	WebSocketQueue(const WebSocketQueue&);
+	WebSocketQueue& operator=(const WebSocketQueue&);
+
+	std::vector<WebSocketMessage>	mSlots;
+	volatile LONG					mHead;		// next slot to read; only the reader writes it
+	volatile LONG					mTail;		// next slot to fill; only the writer writes it
+};
+
+// ---------------------------------------------------------------------------------
+//	WebSocketSession
+// ---------------------------------------------------------------------------------
+//	The state of one connection, shared by the actor, the job reading the
+//	socket and the job sending on it.
+
+class WebSocketSession
+{
+public:
+	WebSocketSession();
+
+	void	AddRef();
+	void	Release();
+
+	// called by the actor to close the session. The socket is aborted, so a
+	// reader waiting on it stops at once; one still connecting stops once the
+	// connection is made.
+	void	Stop();
+	bool	IsStopped() const				{ return mStopped != 0; }
+
+	HttpWebSocket&		GetSocket()			{ return mSocket; }
+	WebSocketQueue&		GetInbound()		{ return mInbound; }
+
+	// called by the reader once the socket is open. Returns true if messages
+	// are waiting and the caller must submit a sender.
+	bool	SetOpen();
+
+	// called by the actor: queues inText to be sent, dropping the oldest
+	// waiting message beyond kWebSocketMaxOutgoing. Returns true if the socket
+	// is open with no sender running, and the caller must submit one.
+	bool	Queue(const std::string& inText);
+
+	// called by the sender: moves the oldest waiting message into outText.
+	// Returns false, and the sender must finish, once none is waiting.
+	bool	TakeOutgoing(std::string& outText);
+
+	// messages dropped on the way in or out
+	void	AddDropped(LONG inCount)		{ InterlockedExchangeAdd(&mDropped, inCount); }
+	LONG	GetDropped() const				{ return mDropped; }
+
+private:
+	~WebSocketSession();
+
+	WebSocketSession(const WebSocketSession&);
+	WebSocketSession& operator=(const WebSocketSession&);
+
+	volatile LONG			mRefCount;
+	volatile LONG			mStopped;
+	volatile LONG			mDropped;
+	HttpWebSocket			mSocket;
+	WebSocketQueue			mInbound;
+	CRITICAL_SECTION		mLock;
+	std::deque<std::string>	mOutgoing;
+	bool					mOpen;
+	bool					mSending;		// a sender is running
+};
+
+#endif
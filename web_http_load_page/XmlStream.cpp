@@ -0,0 +1,599 @@
+// ===========================================================================
+//	XmlStream.cpp
+// ===========================================================================
+
+#include "XmlStream.h"
+#include "JsonCursor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------------
+//		ParseXmlPathList
+// ---------------------------------------------------------------------------------
+
+void
+ParseXmlPathList(const char* inText, std::string outPaths[kXmlMaxPaths])
+{
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		outPaths[i].clear();
+	}
+
+	const char* p = inText;
+	for (int i = 0; i < kXmlMaxPaths && *p != '\0'; i++) {
+
+		while (*p == ' ' || *p == '\t')
+			p++;
+		const char* start = p;
+		while (*p != '\0' && *p != ',')
+			p++;
+		const char* end = p;
+		while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+			end--;
+
+		outPaths[i].assign(start, end);
+		if (*p == ',')
+			p++;
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		Text
+// ---------------------------------------------------------------------------------
+
+static inline bool
+IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// the code points of windows-1252 bytes 0x80 to 0x9F; the five it leaves
+// undefined are read as the ISO-8859-1 control codes
+static const unsigned short	sWindows1252[32] =
+{
+	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+// appends inLength bytes of document text to ioValue, up to kXmlMaxValueLength
+static void
+AppendValue(std::string& ioValue, const char* inData, size_t inLength, XmlEncoding inEncoding)
+{
+	if (ioValue.length() >= kXmlMaxValueLength)
+		return;
+
+	size_t room = kXmlMaxValueLength - ioValue.length();
+	if (inEncoding == kXmlUTF8) {
+		ioValue.append(inData, inLength < room ? inLength : room);
+		return;
+	}
+
+	// a converted byte takes up to three, and no character is cut in half
+	for (size_t i = 0; i < inLength && ioValue.length() + 3 <= kXmlMaxValueLength; i++) {
+		unsigned char c = static_cast<unsigned char>(inData[i]);
+		if (c < 0x80)
+			ioValue += static_cast<char>(c);
+		else if (c < 0xA0 && inEncoding == kXmlWindows1252)
+			AppendUTF8(ioValue, sWindows1252[c - 0x80]);
+		else
+			AppendUTF8(ioValue, c);
+	}
+}
+
+// appends the character of entity inName (without & and ;) to ioValue, or
+// returns false if it is not one the parser knows
+static bool
+AppendEntity(std::string& ioValue, const std::string& inName)
+{
+	if (inName == "lt")			ioValue += '<';
+	else if (inName == "gt")	ioValue += '>';
+	else if (inName == "amp")	ioValue += '&';
+	else if (inName == "quot")	ioValue += '"';
+	else if (inName == "apos")	ioValue += '\'';
+	else if (inName.length() >= 2 && inName[0] == '#') {
+		bool hex = inName[1] == 'x' || inName[1] == 'X';
+		const char* digits = inName.c_str() + (hex ? 2 : 1);
+		char* end;
+		unsigned long codePoint = strtoul(digits, &end, hex ? 16 : 10);
+		if (end == digits || *end != '\0' || codePoint == 0 || codePoint > 0x10FFFF)
+			return false;
+		AppendUTF8(ioValue, codePoint);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+// appends an attribute value to ioValue, decoding its entities
+static void
+AppendDecoded(std::string& ioValue, const char* inStart, const char* inEnd, XmlEncoding inEncoding)
+{
+	const char* p = inStart;
+	while (p < inEnd) {
+		const char* amp = static_cast<const char*>(memchr(p, '&', inEnd - p));
+		if (amp == NULL) {
+			AppendValue(ioValue, p, inEnd - p, inEncoding);
+			break;
+		}
+		AppendValue(ioValue, p, amp - p, inEncoding);
+
+		const char* semicolon = static_cast<const char*>(memchr(amp, ';', inEnd - amp));
+		if (semicolon == NULL || !AppendEntity(ioValue, std::string(amp + 1, semicolon))) {
+			ioValue += '&';
+			p = amp + 1;
+		}
+		else {
+			p = semicolon + 1;
+		}
+	}
+}
+
+static void
+Trim(std::string& ioText)
+{
+	size_t end = ioText.length();
+	while (end > 0 && IsSpace(ioText[end - 1]))
+		end--;
+	size_t start = 0;
+	while (start < end && IsSpace(ioText[start]))
+		start++;
+	ioText = ioText.substr(start, end - start);
+}
+
+// whether a path step matches the qualified element or attribute name inName
+static bool
+NameMatches(const std::string& inStep, const char* inName, size_t inLength)
+{
+	if (inStep == "*")
+		return true;
+	if (inStep.compare(0, std::string::npos, inName, inLength) == 0)
+		return true;
+
+	// a step without a prefix matches the local part of a prefixed name
+	if (inStep.find(':') != std::string::npos)
+		return false;
+	const char* colon = static_cast<const char*>(memchr(inName, ':', inLength));
+	if (colon == NULL)
+		return false;
+	return inStep.compare(0, std::string::npos, colon + 1, inName + inLength - colon - 1) == 0;
+}
+
+// ---------------------------------------------------------------------------------
+//		XmlParser
+// ---------------------------------------------------------------------------------
+
+XmlParser::XmlParser(const std::string inPaths[kXmlMaxPaths], size_t inItems)
+	: mItems(inItems > 0 ? inItems : 1)
+	, mDone(false)
+	, mFailed(false)
+	, mEncoding(kXmlUTF8)
+	, mState(kText)
+	, mQuote(0)
+	, mRun(0)
+	, mBrackets(0)
+{
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		ParsePath(inPaths[i], mPaths[i]);
+		mCaptureDepth[i] = 0;
+	}
+}
+
+void
+XmlParser::ParsePath(const std::string& inText, Path& outPath)
+{
+	const char* p = inText.c_str();
+	while (IsSpace(*p))
+		p++;
+	outPath.mAnchored = *p == '/';
+
+	while (*p != '\0') {
+		while (*p == '/')
+			p++;
+		const char* start = p;
+		while (*p != '\0' && *p != '/')
+			p++;
+		const char* end = p;
+		while (end > start && IsSpace(end[-1]))
+			end--;
+		if (end == start)
+			continue;
+
+		if (*start == '@') {
+			outPath.mAttribute.assign(start + 1, end);
+			break;
+		}
+		outPath.mSteps.push_back(std::string(start, end));
+	}
+
+	outPath.mUsed = !outPath.mSteps.empty() || !outPath.mAttribute.empty();
+}
+
+// whether the innermost open elements are the steps of inPath
+bool
+XmlParser::PathMatches(const Path& inPath) const
+{
+	size_t count = inPath.mSteps.size();
+	size_t depth = mStack.size();
+	if (count > depth || (inPath.mAnchored && count != depth))
+		return false;
+
+	for (size_t k = 0; k < count; k++) {
+		const std::string& name = mStack[depth - count + k];
+		if (!NameMatches(inPath.mSteps[k], name.data(), name.length()))
+			return false;
+	}
+	return true;
+}
+
+bool
+XmlParser::Feed(const char* inData, size_t inLength, std::string& outError)
+{
+	const char* p = inData;
+	const char* end = inData + inLength;
+
+	while (p < end && !mFailed && !mDone) {
+		char c = *p;
+
+		switch (mState) {
+		case kText:
+			{
+				const char* stop = p;
+				while (stop < end && *stop != '<' && *stop != '&')
+					stop++;
+				AddText(p, stop - p);
+				p = stop;
+				if (p == end)
+					break;
+
+				if (*p == '<') {
+					mState = kMarkup;
+					mTag.clear();
+				}
+				else {
+					mState = kEntity;
+					mEntity.clear();
+				}
+				p++;
+			}
+			break;
+
+		case kEntity:
+			if (c == ';') {
+				AddEntity();
+				mState = kText;
+				p++;
+			}
+			else if (c == '<' || c == '&' || IsSpace(c) || mEntity.length() >= 10) {
+				// not an entity after all, so it is kept as written
+				std::string text = "&" + mEntity;
+				AddText(text.data(), text.length());
+				mState = kText;
+			}
+			else {
+				mEntity += c;
+				p++;
+			}
+			break;
+
+		case kMarkup:
+			mTag += c;
+			p++;
+			if (mTag == "!--") {
+				mState = kComment;
+				mRun = 0;
+			}
+			else if (mTag == "![CDATA[") {
+				mState = kCData;
+				mRun = 0;
+			}
+			else if (mTag[0] == '?') {
+				mState = kInstruction;
+				mRun = 0;
+			}
+			else if (mTag[0] == '!') {
+				if (strncmp(mTag.c_str(), "!--", mTag.length()) != 0 && strncmp(mTag.c_str(), "![CDATA[", mTag.length()) != 0) {
+					mState = kDeclaration;
+					mQuote = 0;
+					mBrackets = 0;
+				}
+			}
+			else {
+				// the character is read again as part of the tag
+				mTag.clear();
+				mState = kTag;
+				mQuote = 0;
+				p--;
+			}
+			break;
+
+		case kTag:
+			p++;
+			if (mQuote != 0) {
+				if (c == mQuote)
+					mQuote = 0;
+			}
+			else if (c == '"' || c == '\'') {
+				mQuote = c;
+			}
+			else if (c == '>') {
+				mState = kText;
+				EndMarkup();
+				break;
+			}
+			mTag += c;
+			if (mTag.length() > kXmlMaxTagLength)
+				Fail("ERROR: an XML tag is too long");
+			break;
+
+		case kComment:
+			p++;
+			if (c == '-') {
+				mRun++;
+			}
+			else {
+				if (c == '>' && mRun >= 2)
+					mState = kText;
+				mRun = 0;
+			}
+			break;
+
+		case kCData:
+			if (c == ']') {
+				mRun++;
+				p++;
+			}
+			else if (c == '>' && mRun >= 2) {
+				for (int i = 2; i < mRun; i++)
+					AddText("]", 1);
+				mState = kText;
+				p++;
+			}
+			else {
+				for (int i = 0; i < mRun; i++)
+					AddText("]", 1);
+				mRun = 0;
+
+				const char* stop = static_cast<const char*>(memchr(p, ']', end - p));
+				if (stop == NULL)
+					stop = end;
+				AddText(p, stop - p);
+				p = stop;
+			}
+			break;
+
+		case kDeclaration:
+			p++;
+			if (mQuote != 0) {
+				if (c == mQuote)
+					mQuote = 0;
+			}
+			else if (c == '"' || c == '\'')
+				mQuote = c;
+			else if (c == '[')
+				mBrackets++;
+			else if (c == ']')
+				mBrackets--;
+			else if (c == '>' && mBrackets <= 0)
+				mState = kText;
+			break;
+
+		case kInstruction:
+			p++;
+			if (c == '>' && mRun != 0) {
+				ReadDeclaration();
+				mState = kText;
+				break;
+			}
+			mRun = c == '?';
+			if (mTag.length() < 256)
+				mTag += c;
+			break;
+		}
+	}
+
+	if (mFailed) {
+		outError = mError;
+		return false;
+	}
+	return !mDone;
+}
+
+// adds document text to the value of every path being read
+void
+XmlParser::AddText(const char* inData, size_t inLength)
+{
+	if (inLength == 0)
+		return;
+
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		if (mCaptureDepth[i] != 0)
+			AppendValue(mValues[i], inData, inLength, mEncoding);
+	}
+}
+
+void
+XmlParser::AddEntity()
+{
+	std::string text;
+	if (!AppendEntity(text, mEntity)) {
+		text = "&" + mEntity + ";";
+		AddText(text.data(), text.length());
+		return;
+	}
+
+	// the character is already UTF-8
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		if (mCaptureDepth[i] != 0)
+			AppendValue(mValues[i], text.data(), text.length(), kXmlUTF8);
+	}
+}
+
+// handles the start or end tag in mTag
+void
+XmlParser::EndMarkup()
+{
+	if (!mTag.empty() && mTag[0] == '/')
+		EndElement();
+	else
+		StartElement();
+}
+
+void
+XmlParser::StartElement()
+{
+	const char* tag = mTag.c_str();
+	const char* tagEnd = tag + mTag.length();
+	const char* nameEnd = tag;
+	while (nameEnd < tagEnd && !IsSpace(*nameEnd) && *nameEnd != '/')
+		nameEnd++;
+	if (nameEnd == tag)
+		return;
+
+	bool empty = false;
+	const char* last = tagEnd;
+	while (last > nameEnd && IsSpace(last[-1]))
+		last--;
+	if (last > tag && last[-1] == '/') {
+		empty = true;
+		tagEnd = last - 1;
+	}
+
+	if (mStack.size() >= kXmlMaxDepth) {
+		Fail("ERROR: the XML nests too deeply");
+		return;
+	}
+	mStack.push_back(std::string(tag, nameEnd));
+
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		const Path& path = mPaths[i];
+		if (!path.mUsed || mCaptureDepth[i] != 0 || mMatches[i].size() >= mItems || !PathMatches(path))
+			continue;
+
+		if (path.mAttribute.empty()) {
+			mCaptureDepth[i] = mStack.size();
+			mValues[i].clear();
+			continue;
+		}
+
+		// attributes are name="value" or name='value'
+		const char* p = nameEnd;
+		while (p < tagEnd) {
+			while (p < tagEnd && IsSpace(*p))
+				p++;
+			const char* name = p;
+			while (p < tagEnd && *p != '=' && !IsSpace(*p))
+				p++;
+			const char* nameStop = p;
+			if (nameStop == name) {
+				p++;
+				continue;
+			}
+			while (p < tagEnd && IsSpace(*p))
+				p++;
+			if (p == tagEnd || *p != '=')
+				continue;
+			p++;
+			while (p < tagEnd && IsSpace(*p))
+				p++;
+			if (p == tagEnd || (*p != '"' && *p != '\''))
+				break;
+			char quote = *p++;
+			const char* value = p;
+			while (p < tagEnd && *p != quote)
+				p++;
+			const char* valueEnd = p;
+			if (p < tagEnd)
+				p++;
+
+			if (NameMatches(path.mAttribute, name, nameStop - name)) {
+				std::string text;
+				AppendDecoded(text, value, valueEnd, mEncoding);
+				AddMatch(i, text);
+				break;
+			}
+		}
+	}
+
+	if (empty) {
+		mTag = "/" + mStack.back();
+		EndElement();
+	}
+}
+
+// closes the innermost open element named in mTag and any left open inside it
+void
+XmlParser::EndElement()
+{
+	size_t start = 1;
+	size_t end = mTag.length();
+	while (end > start && IsSpace(mTag[end - 1]))
+		end--;
+
+	size_t depth = mStack.size();
+	while (depth > 0 && mStack[depth - 1].compare(0, std::string::npos, mTag, start, end - start) != 0)
+		depth--;
+	if (depth == 0)
+		return;
+
+	while (mStack.size() >= depth) {
+		for (int i = 0; i < kXmlMaxPaths; i++) {
+			if (mCaptureDepth[i] == mStack.size()) {
+				mCaptureDepth[i] = 0;
+				AddMatch(i, mValues[i]);
+			}
+		}
+		mStack.pop_back();
+	}
+}
+
+void
+XmlParser::AddMatch(int inPath, std::string& ioValue)
+{
+	Trim(ioValue);
+	mMatches[inPath].push_back(std::string());
+	mMatches[inPath].back().swap(ioValue);
+
+	for (int i = 0; i < kXmlMaxPaths; i++) {
+		if (mPaths[i].mUsed && mMatches[i].size() < mItems)
+			return;
+	}
+	mDone = true;
+}
+
+// reads the encoding from an <?xml ... ?> declaration in mTag
+void
+XmlParser::ReadDeclaration()
+{
+	if (mTag.compare(0, 4, "?xml") != 0)
+		return;
+
+	size_t pos = mTag.find("encoding");
+	if (pos == std::string::npos)
+		return;
+	pos = mTag.find_first_of("\"'", pos);
+	if (pos == std::string::npos)
+		return;
+	size_t end = mTag.find(mTag[pos], pos + 1);
+	if (end == std::string::npos)
+		return;
+
+	std::string encoding = mTag.substr(pos + 1, end - pos - 1);
+	for (size_t i = 0; i < encoding.length(); i++) {
+		if (encoding[i] >= 'A' && encoding[i] <= 'Z')
+			encoding[i] += 'a' - 'A';
+	}
+	if (encoding == "iso-8859-1" || encoding == "latin1")
+		mEncoding = kXmlLatin1;
+	else if (encoding == "windows-1252" || encoding == "cp1252")
+		mEncoding = kXmlWindows1252;
+}
+
+void
+XmlParser::Fail(const char* inError)
+{
+	mFailed = true;
+	mError = inError;
+}
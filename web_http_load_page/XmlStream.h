@@ -0,0 +1,150 @@
+// ===========================================================================
+//	XmlStream.h
+// ===========================================================================
+//
+//	Streaming extraction of elements from XML responses, such as the RSS and
+//	Atom feeds venues publish their schedules in.
+//
+//	The parser is a pull parser fed the body in the chunks it arrives in. It
+//	builds no tree: it keeps the names of the open elements and the text of
+//	the elements being read, nothing else, and reports when every path has
+//	all the matches asked for so that the download can be stopped there and
+//	the rest of a long feed is never fetched.
+//
+//	Paths are element names separated by /, e.g. channel/item/title, and
+//	match an element whose innermost open elements have those names; a path
+//	that starts with / must match from the root element. * matches any name,
+//	a name without a prefix matches any prefix (title matches atom:title),
+//	and a last step of @name reads an attribute instead, e.g. entry/link/@href.
+//	The value of an element is all of the text inside it, entities and CDATA
+//	decoded, with white space trimmed from both ends.
+//
+//	The parser does not validate. Unknown entities are kept as written, an end
+//	tag closes everything back to the element it names, and a stray one is
+//	ignored, so a slightly broken feed still reads. Text is read as UTF-8
+//	unless the declaration names ISO-8859-1 or windows-1252, which are
+//	converted; windows-1252 puts quotes, dashes and the euro sign where
+//	ISO-8859-1 has control codes.
+
+#ifndef XMLSTREAM_H
+#define XMLSTREAM_H
+
+#include <string>
+#include <vector>
+
+// number of paths the actor can select
+static const int	kXmlMaxPaths = 4;
+
+// longest value kept for a match, and longest tag; the rest of a longer value
+// is dropped
+static const size_t	kXmlMaxValueLength = 64 * 1024;
+static const size_t	kXmlMaxTagLength = 64 * 1024;
+
+// deepest nesting of elements accepted
+static const size_t	kXmlMaxDepth = 256;
+
+// the values of the actor's xml input
+enum XmlMode
+{
+	kXmlOff = 0,
+	kXmlValues,			// match number xml_items of each path to its value output
+	kXmlArrays			// the first xml_items matches of each path as one JSON array
+};
+
+// the encodings the parser converts from, as read from the declaration
+enum XmlEncoding
+{
+	kXmlUTF8 = 0,
+	kXmlLatin1,
+	kXmlWindows1252
+};
+
+// ---------------------------------------------------------------------------------
+//	ParseXmlPathList
+// ---------------------------------------------------------------------------------
+//	Splits the comma separated list of the xml_paths input into at most
+//	kXmlMaxPaths paths. Unused entries are left empty.
+
+void	ParseXmlPathList(const char* inText, std::string outPaths[kXmlMaxPaths]);
+
+// ---------------------------------------------------------------------------------
+//	XmlParser
+// ---------------------------------------------------------------------------------
+
+class XmlParser
+{
+public:
+	// inPaths are the paths from ParseXmlPathList; each is read until it has
+	// inItems matches
+	XmlParser(const std::string inPaths[kXmlMaxPaths], size_t inItems);
+
+	// parses the next inLength bytes of the document. Returns false once every
+	// path has its matches, or with a description in outError if the document
+	// nests too deeply or has a tag that is too long; nothing more is parsed then.
+	bool	Feed(const char* inData, size_t inLength, std::string& outError);
+
+	// true once every path has its matches
+	bool	IsDone() const					{ return mDone; }
+
+	// the matches of path inPath in document order, at most inItems of them
+	const std::vector<std::string>&	GetMatches(int inPath) const	{ return mMatches[inPath]; }
+
+private:
+	XmlParser(const XmlParser&);
+	XmlParser& operator=(const XmlParser&);
+
+	enum State
+	{
+		kText,				// character data
+		kEntity,			// after & in character data
+		kMarkup,			// after <, until the kind of markup is known
+		kTag,				// a start or end tag
+		kComment,			// <!-- ... -->
+		kCData,				// <![CDATA[ ... ]]>
+		kDeclaration,		// <!DOCTYPE ...> and other <! markup
+		kInstruction		// <? ... ?>
+	};
+
+	struct Path
+	{
+		Path() : mAnchored(false), mUsed(false) {}
+
+		bool						mAnchored;		// starts with /, so it matches from the root
+		bool						mUsed;
+		std::vector<std::string>	mSteps;			// element names
+		std::string					mAttribute;		// the name after @, empty for element text
+	};
+
+	void	ParsePath(const std::string& inText, Path& outPath);
+	bool	PathMatches(const Path& inPath) const;
+
+	void	AddText(const char* inData, size_t inLength);
+	void	AddEntity();
+	void	EndMarkup();
+	void	StartElement();
+	void	EndElement();
+	void	AddMatch(int inPath, std::string& ioValue);
+	void	ReadDeclaration();
+	void	Fail(const char* inError);
+
+	Path			mPaths[kXmlMaxPaths];
+	size_t			mItems;
+	bool			mDone;
+	bool			mFailed;
+	std::string		mError;
+	XmlEncoding		mEncoding;					// the encoding the declaration names
+
+	State			mState;
+	std::string		mTag;						// text of the markup being read, without the <
+	char			mQuote;						// the quote a tag's attribute value is in, or 0
+	int				mRun;						// -, ] or ? characters just read in a comment, CDATA or instruction
+	int				mBrackets;					// depth of [ in a <! declaration
+	std::string		mEntity;					// the entity being read, without the &
+
+	std::vector<std::string>	mStack;			// names of the open elements
+	size_t			mCaptureDepth[kXmlMaxPaths];	// stack depth of the element each path is reading, 0 if none
+	std::string		mValues[kXmlMaxPaths];		// text of those elements so far
+	std::vector<std::string>	mMatches[kXmlMaxPaths];
+};
+
+#endif